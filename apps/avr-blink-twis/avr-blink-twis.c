@@ -14,6 +14,7 @@
    a - (SETIO1_1) Start "SOS" blinking
    s - (SETIO1_0) Stop "SOS" blinking
    x - (RESETMCU) Reset device
+   b - (BOOTTMNL) Reboot into Timonel
 */
 
 /* Morse Code:
@@ -35,6 +36,7 @@ uint8_t command[32] = {0};           /* I2C Command received from master  */
 uint8_t commandLength = 0;           /* I2C Command number of bytes  */
 
 bool reset_now = false;
+bool boot_now = false;
 bool slow_ops_enabled = false;
 volatile bool blink = true;
 volatile uint16_t toggle_delay = LONG_DELAY;
@@ -44,6 +46,7 @@ void DisableWatchDog(void);
 void SetCPUSpeed1MHz(void);
 void SetCPUSpeed8MHz(void);
 void ReceiveEvent(uint8_t);
+void TwiReply(uint8_t);
 void EnableSlowOps(void);
 void ResetMCU(void);
 
@@ -76,6 +79,9 @@ int main(void) {
         if (reset_now == true) {
             ResetMCU();
         }
+        if (boot_now == true) {
+            UsiTwiRebootToBootloader(); /* The reply is read by the master before the watchdog reset */
+        }
         
         if (toggle_delay-- == 0) {
             if (blink == true) {
@@ -94,9 +100,24 @@ int main(void) {
    |________________________|
 */
 void ReceiveEvent(uint8_t received_bytes) {
+#if TWI_BLOCK_API
+    uint8_t *p_frame = NULL;
+    received_bytes = UsiTwiGetRxFrame(&p_frame);
+    if (received_bytes == 0) {
+        return;                           /* No complete command received, the master reads padding */
+    }
+    if (received_bytes > sizeof(command)) {
+        received_bytes = sizeof(command);
+    }
+    for (uint8_t i = 0; i < received_bytes; i++) {
+        command[i] = p_frame[i];          /* Copy the command out of the RX frame before releasing it */
+    }
+    UsiTwiReleaseRxFrame();
+#else
     for (uint8_t i = 0; i < received_bytes; i++) {
         command[i] = UsiTwiReceiveByte(); /* Store the data sent by the TWI master in the data buffer */
     }
+#endif /* TWI_BLOCK_API */
     uint8_t opCodeAck = ~command[0]; /* Command Operation Code acknowledge => Command Bitwise "Not". */
     switch (command[0]) {
         // ******************
@@ -106,7 +127,7 @@ void ReceiveEvent(uint8_t received_bytes) {
             LED_DDR |= (1 << LED_PIN);  /* Set led control pin Data Direction Register for output */
             LED_PORT |= (1 << LED_PIN); /* Turn PB1 on (Power control pin) */
             blink = true;
-            UsiTwiTransmitByte(opCodeAck);
+            TwiReply(opCodeAck);
             break;
         }
         // ******************
@@ -116,7 +137,7 @@ void ReceiveEvent(uint8_t received_bytes) {
             LED_DDR |= (1 << LED_PIN);   /* Set led control pin Data Direction Register for output */
             LED_PORT &= ~(1 << LED_PIN); /* Turn PB1 off (Power control pin) */
             blink = false;
-            UsiTwiTransmitByte(opCodeAck);
+            TwiReply(opCodeAck);
             break;
         }
         // ******************
@@ -124,20 +145,46 @@ void ReceiveEvent(uint8_t received_bytes) {
         // ******************
         case RESETMCU: {
             LED_PORT &= ~(1 << LED_PIN); /* Turn power off */
-            UsiTwiTransmitByte(opCodeAck);
+            TwiReply(opCodeAck);
             reset_now = true;
             break;
         }
+        // ******************
+        // * BOOTTMNL Reply *
+        // ******************
+        case BOOTTMNL: {
+            LED_PORT &= ~(1 << LED_PIN); /* Turn power off */
+            TwiReply(opCodeAck);
+            boot_now = true;
+            break;
+        }
         // *************************
         // * Unknown Command Reply *
         // *************************
         default: {
-            UsiTwiTransmitByte(UNKNOWNC);
+            TwiReply(UNKNOWNC);
             break;
         }
     }
 }
 
+/*  ________________________
+   |                        |
+   |   TWI reply to master  |
+   |________________________|
+*/
+void TwiReply(uint8_t reply) {
+#if TWI_BLOCK_API
+    uint8_t *p_reply = UsiTwiClaimTxFrame();
+    if (p_reply != NULL) {                /* NULL: both TX frames are still unread, the master gets padding */
+        p_reply[0] = reply;
+        UsiTwiCommitTxFrame(1);
+    }
+#else
+    UsiTwiTransmitByte(reply);
+#endif /* TWI_BLOCK_API */
+}
+
 /*  ________________________
    |                        |
    | Enable slow operations |
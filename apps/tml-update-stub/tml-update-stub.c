@@ -0,0 +1,357 @@
+/*
+ *  Timonel Update Stub
+ *  Author: Gustavo Casanova / Nicebots
+ *  ...........................................
+ *  File: tml-update-stub.c (Application source)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+/* This application is uploaded through Timonel like any other one to replace the bootloader over
+   TWI, without the timonel-updater image. The new bootloader is received with Timonel's page
+   commands, staged in the free flash memory above the stub, and copied over the bootloader only
+   after its CRC16 is checked. The first page after the stub keeps the staging area end while the
+   image is installed, so the stub can start again and receive it after a power loss. The data
+   packets use the same check as the bootloader being replaced (8-bit sum or CRC16), as reported
+   by its status:
+   -----------------------
+   STPGADDR - Set the staging page offset (from the bootloader image start, 0 starts a new image)
+   WRITPAGE - Write data to the staging page, the page is written to flash when it's complete
+   GETCRC   - CRC16 of the staged image: set the size, then read it after the calculation
+   INSTTMNL - Install the staged image at the given address if its CRC16 matches, then reboot
+*/
+
+// Includes
+#include "tml-update-stub.h"
+
+// Global variables
+uint8_t command[TWI_RX_BUFFER_SIZE] = {0}; /* I2C Command received from master */
+uint8_t page_data[SPM_PAGESIZE];           /* Staging page contents */
+uint16_t page_offset = 0;                  /* Staging page offset from the image start */
+uint8_t page_ix = 0;                       /* Staging page bytes received */
+uint16_t bounds_page = 0;                  /* First page after the stub: the staging area end, saved while installing */
+uint16_t stage_start = 0;                  /* Staging area: the page after bounds_page */
+uint16_t stage_size = 0;                   /* Staging area: up to the trampoline page below Timonel */
+uint16_t crc = CRC16_INIT;                 /* Last CRC16 calculated */
+uint16_t crc_size = 0;                     /* Staged bytes checked by GETCRC */
+uint16_t install_start = 0;                /* INSTTMNL: new bootloader start address */
+uint16_t install_size = 0;                 /* INSTTMNL: new bootloader size */
+uint16_t install_crc = 0;                  /* INSTTMNL: expected CRC16 */
+volatile uint8_t flags = 0;
+volatile bool slow_ops_enabled = false;
+
+extern uint8_t __data_load_end;            /* Linker: flash memory end of the stub code and data */
+extern void __init(void);                  /* Linker: stub reset handler */
+
+// Prototypes
+void DisableWatchDog(void);
+void SetCPUSpeed8MHz(void);
+void ReceiveEvent(uint8_t);
+void EnableSlowOps(void);
+void WriteStagePage(void);
+uint16_t StageCrc(const uint16_t size);
+void InstallBootloader(void);
+void FlashPage(const uint16_t page_addr, const uint16_t src_addr, const uint16_t first_word);
+uint16_t StubResetVector(void);
+
+// Main function
+int main(void) {
+    /*  ___________________
+       |                   |
+       |    Setup Block    |
+       |___________________|
+    */
+    DisableWatchDog();                  /* Disable watchdog to avoid continuous loop after reset */
+    SetCPUSpeed8MHz();                  /* Set the CPU prescaler for 8 MHz */
+    bounds_page = (((uint16_t)&__data_load_end + (SPM_PAGESIZE - 1)) & ~(SPM_PAGESIZE - 1));
+    stage_start = (bounds_page + SPM_PAGESIZE);
+    uint16_t stage_end = 0;
+    if (pgm_read_word(RESET_PAGE) == StubResetVector()) {
+        // The power was lost while installing: Timonel may be partially overwritten, use the saved staging area end
+        stage_end = pgm_read_word(bounds_page);
+    } else {
+        // Timonel set the reset vector to jump to itself, its trampoline page is kept out of the staging area
+        stage_end = ((((pgm_read_word(RESET_PAGE) & 0x0FFF) + 1) << 1) - SPM_PAGESIZE);
+    }
+    if ((stage_end > stage_start) && (stage_end <= ((uint16_t)FLASHEND + 1))) {
+        stage_size = (stage_end - stage_start);
+    }
+    // Initialize I2C
+    p_receive_event = ReceiveEvent;     /* Pointer to TWI receive event function */
+    p_enable_slow_ops = EnableSlowOps;  /* Pointer to enable slow options function */
+    UsiTwiDriverInit(TWI_ADDR);         /* NOTE: TWI_ADDR is defined in Makefile! */
+    sei();                              /* Enable Interrupts */
+
+    /*  ___________________
+       |                   |
+       |     Main Loop     |
+       |___________________|
+    */
+    for (;;) {
+        if (slow_ops_enabled == true) {
+            slow_ops_enabled = false;
+            if ((flags >> FL_WRITE_PAGE) & true) {
+                flags &= ~(1 << FL_WRITE_PAGE);
+                WriteStagePage();
+            }
+            if ((flags >> FL_CALC_CRC) & true) {
+                flags &= ~(1 << FL_CALC_CRC);
+                UsiTwiDriverSuspend();  /* Busy: NACK the TWI address while calculating */
+                crc = StageCrc(crc_size);
+                UsiTwiDriverInit(TWI_ADDR);
+            }
+            if ((flags >> FL_INSTALL) & true) {
+                flags &= ~(1 << FL_INSTALL);
+                UsiTwiDriverSuspend();  /* Busy: NACK the TWI address while checking */
+                if (StageCrc(install_size) == install_crc) {
+                    InstallBootloader(); /* It doesn't return, the device restarts into the new bootloader */
+                }
+                flags |= (1 << FL_STAGE_ERROR);
+                UsiTwiDriverInit(TWI_ADDR);
+            }
+        }
+    }
+    return 0;
+}
+
+/*  ________________________
+   |                        |
+   | TWI data receive event |
+   |________________________|
+*/
+void ReceiveEvent(uint8_t received_bytes) {
+    for (uint8_t i = 0; i < received_bytes; i++) {
+        command[i] = UsiTwiReceiveByte(); /* Store the data sent by the TWI master in the data buffer */
+    }
+    switch (command[0]) {
+        // ******************
+        // * STPGADDR Reply *
+        // ******************
+        case STPGADDR: {
+            page_offset = (((command[1] << 8) + command[2]) & ~(SPM_PAGESIZE - 1));
+            page_ix = 0;
+            flags &= ~(1 << FL_PKT_ERROR);
+            if (page_offset == 0) {
+                flags &= ~(1 << FL_STAGE_ERROR); /* A new image starts */
+            }
+            if ((received_bytes != STPGADDR_CMDLN) || (page_offset >= stage_size)) {
+                flags |= (1 << FL_STAGE_ERROR);
+            }
+            UsiTwiTransmitByte(AKPGADDR);
+            UsiTwiTransmitByte((uint8_t)(command[1] + command[2]));
+            break;
+        }
+        // ******************
+        // * WRITPAGE Reply *
+        // ******************
+        case WRITPAGE: {
+            // The packet check is the one Timonel reports to the TWI master: an 8-bit sum, or a CRC16 (MSB first)
+            // when Timonel uses CRC16. Data packets are always even, so the command length parity tells them apart.
+            const bool use_crc = (received_bytes & 1);
+            const uint8_t check_len = (use_crc ? PKT_CRC16_LEN : PKT_SUM_LEN);
+            uint8_t data_end = 1;
+            if (received_bytes >= (check_len + 3)) {
+                data_end = (received_bytes - check_len); /* Data bytes go from command[1] to command[data_end - 1] */
+            }
+            uint16_t check = (use_crc ? CRC16_INIT : 0);
+            for (uint8_t i = 1; i < data_end; i++) {
+                check = (use_crc ? _crc_xmodem_update(check, command[i]) : (uint8_t)(check + command[i]));
+            }
+            const uint16_t received = (use_crc ? ((command[data_end] << 8) | command[data_end + 1]) : command[data_end]);
+            if ((data_end == 1) || (check != received) ||
+                ((page_ix + (data_end - 1)) > SPM_PAGESIZE) || ((flags >> FL_PKT_ERROR) & true)) {
+                flags |= (1 << FL_PKT_ERROR);  /* The master has to send the page again, from STPGADDR */
+                check = 0;
+            } else {
+                for (uint8_t i = 1; i < data_end; i++) {
+                    page_data[page_ix++] = command[i];
+                }
+                if (page_ix == SPM_PAGESIZE) {
+                    flags |= (1 << FL_WRITE_PAGE);
+                }
+            }
+            UsiTwiTransmitByte(ACKWTPAG);
+            if (use_crc) {
+                UsiTwiTransmitByte((uint8_t)(check >> 8));
+            }
+            UsiTwiTransmitByte((uint8_t)(check & 0xFF));
+            break;
+        }
+        // ******************
+        // *  GETCRC Reply  *
+        // ******************
+        case GETCRC: {
+            UsiTwiTransmitByte(ACKGTCRC);
+            if (received_bytes == GETCRC_CMDLN) {
+                crc_size = ((command[3] << 8) + command[4]); /* The offset is always 0: the image start */
+                flags |= (1 << FL_CALC_CRC);
+                UsiTwiTransmitByte((uint8_t)(command[1] + command[2] + command[3] + command[4]));
+            } else {
+                UsiTwiTransmitByte((uint8_t)(crc >> 8));
+                UsiTwiTransmitByte((uint8_t)(crc & 0xFF));
+            }
+            break;
+        }
+        // ******************
+        // * INSTTMNL Reply *
+        // ******************
+        case INSTTMNL: {
+            uint8_t status = INST_OK;
+            install_start = ((command[1] << 8) + command[2]);
+            install_size = ((command[3] << 8) + command[4]);
+            install_crc = ((command[5] << 8) + command[6]);
+            // The new bootloader goes above the staging area, leaving its trampoline page free
+            if ((received_bytes != INSTTMNL_CMDLN) || (install_size == 0) || (install_size > stage_size) ||
+                (install_start & (SPM_PAGESIZE - 1)) || (install_start < (stage_start + stage_size)) ||
+                (((uint32_t)install_start + install_size) > ((uint32_t)FLASHEND + 1))) {
+                status = INST_ERR_RANGE;
+            } else if ((flags >> FL_STAGE_ERROR) & true) {
+                status = INST_ERR_STAGE;
+            } else {
+                flags |= (1 << FL_INSTALL);
+            }
+            UsiTwiTransmitByte(ACKINSTT);
+            UsiTwiTransmitByte(status);
+            break;
+        }
+        // *************************
+        // * Unknown Command Reply *
+        // *************************
+        default: {
+            UsiTwiTransmitByte(UNKNOWNC);
+            break;
+        }
+    }
+}
+
+/*  ________________________
+   |                        |
+   | Enable slow operations |
+   |________________________|
+*/
+void EnableSlowOps(void) {
+    slow_ops_enabled = true;
+}
+
+/*  _________________________
+   |                         |
+   | Function WriteStagePage |
+   |_________________________|
+*/
+// Write the complete staging page to flash memory, the TWI address isn't acknowledged meanwhile
+void WriteStagePage(void) {
+    if (page_offset >= stage_size) {
+        flags |= (1 << FL_STAGE_ERROR); /* The page would go beyond the staging area */
+    }
+    if ((flags >> FL_STAGE_ERROR) & true) {
+        return;                         /* The page is outside the staging area */
+    }
+    UsiTwiDriverSuspend();              /* Busy: NACK the TWI address while writing */
+    cli();
+    const uint16_t page_addr = (stage_start + page_offset);
+    boot_page_erase(page_addr);
+    boot_spm_busy_wait();
+    for (uint8_t i = 0; i < SPM_PAGESIZE; i += 2) {
+        boot_page_fill((page_addr + i), ((page_data[i + 1] << 8) | page_data[i]));
+    }
+    boot_page_write(page_addr);
+    boot_spm_busy_wait();
+    page_offset += SPM_PAGESIZE;        /* Consecutive pages don't need STPGADDR */
+    page_ix = 0;
+    sei();
+    UsiTwiDriverInit(TWI_ADDR);         /* Ready: acknowledge the TWI address again */
+}
+
+/*  ___________________
+   |                   |
+   | Function StageCrc |
+   |___________________|
+*/
+// CRC16 of the staged image first bytes, as Timonel's GETCRC
+uint16_t StageCrc(const uint16_t size) {
+    uint16_t stage_crc = CRC16_INIT;
+    for (uint16_t i = 0; (i < size) && (i < stage_size); i++) {
+        stage_crc = _crc_xmodem_update(stage_crc, pgm_read_byte(stage_start + i));
+    }
+    return stage_crc;
+}
+
+/*  ____________________________
+   |                            |
+   | Function InstallBootloader |
+   |____________________________|
+*/
+// Copy the staged image over the bootloader. First, the staging area end is saved in bounds_page and the
+// reset vector is pointed to the stub: if the power fails in the middle, the stub starts again with the
+// image still staged and the TWI master can install it again. Then the image pages are copied, the page
+// below the new bootloader is erased (no trampoline, no application) and the whole vector table is pointed
+// to the new bootloader before restarting. NOTE: The reset page is rewritten twice, a power loss while it's
+// erased (a page erase time each) leaves the device without a working reset vector.
+void InstallBootloader(void) {
+    cli();
+    FlashPage(bounds_page, bounds_page, (stage_start + stage_size));
+    FlashPage(RESET_PAGE, RESET_PAGE, StubResetVector());
+    for (uint16_t offset = 0; offset < install_size; offset += SPM_PAGESIZE) {
+        FlashPage((install_start + offset), (stage_start + offset), 0);
+    }
+    boot_page_erase(install_start - SPM_PAGESIZE);
+    boot_spm_busy_wait();
+    boot_page_erase(RESET_PAGE);
+    boot_spm_busy_wait();
+    for (uint8_t i = 0; i < SPM_PAGESIZE; i += 2) {
+        boot_page_fill((RESET_PAGE + i), (0xC000 + (((install_start - i) / 2) - 1))); /* Every vector jumps to the new bootloader start (rjmp is relative) */
+    }
+    boot_page_write(RESET_PAGE);
+    boot_spm_busy_wait();
+    wdt_enable(WDTO_15MS);
+    for (;;) {
+    }
+}
+
+// Function FlashPage (Erase a page and write another one's contents to it. If first_word isn't 0, it replaces the first word)
+void FlashPage(const uint16_t page_addr, const uint16_t src_addr, const uint16_t first_word) {
+    uint16_t words[SPM_PAGESIZE / 2];
+    for (uint8_t i = 0; i < (SPM_PAGESIZE / 2); i++) {
+        words[i] = pgm_read_word(src_addr + (i << 1));
+    }
+    if (first_word != 0) {
+        words[0] = first_word;
+    }
+    boot_page_erase(page_addr);
+    boot_spm_busy_wait();
+    for (uint8_t i = 0; i < (SPM_PAGESIZE / 2); i++) {
+        boot_page_fill((page_addr + (i << 1)), words[i]);
+    }
+    boot_page_write(page_addr);
+    boot_spm_busy_wait();
+}
+
+// Function StubResetVector (Reset vector jumping to the stub: rjmp __init)
+uint16_t StubResetVector(void) {
+    return (0xC000 + (((uint16_t)__init - 1) & 0x0FFF));
+}
+
+/*  __________________________
+   |                          |
+   | Function SetCPUSpeed8MHz |
+   |__________________________|
+*/
+void SetCPUSpeed8MHz(void) {
+    cli();                 /* Disable interrupts */
+    CLKPR = (1 << CLKPCE); /* Mandatory for setting CPU prescaler */
+    CLKPR = (0x00);        /* Set CPU prescaler 1 (System clock / 1) */
+    sei();                 /* Enable interrupts */
+}
+
+/*  __________________________
+   |                          |
+   | Function DisableWatchDog |
+   |__________________________|
+*/
+void DisableWatchDog(void) {
+    MCUSR = 0;
+    WDTCR = ((1 << WDCE) | (1 << WDE));
+    WDTCR = ((1 << WDP2) | (1 << WDP1) | (1 << WDP0));
+}
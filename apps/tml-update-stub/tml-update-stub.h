@@ -0,0 +1,57 @@
+/*
+ *  Timonel Update Stub
+ *  Author: Gustavo Casanova / Nicebots
+ *  ...........................................
+ *  File: tml-update-stub.h (Application headers)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#ifndef _TML_UPDATE_STUB_H_
+#define _TML_UPDATE_STUB_H_
+
+#ifndef __AVR_ATtiny85__
+#define __AVR_ATtiny85__
+#endif
+
+// Includes
+#include <avr/boot.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/wdt.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <util/crc16.h>
+#include "../../nb-libs/cmd/nb-twi-cmd.h"
+#include "../../nb-libs/twis/interrupt-based/nb-usitwisl.h"
+
+// Flash memory layout
+#define RESET_PAGE      0           /* Interrupt vector table address start location */
+#define CRC16_INIT      0xFFFF      /* CRC16 initial value (CCITT polynomial, same as Timonel) */
+
+// Command lengths (same framing as Timonel's page commands, with checksums)
+#define STPGADDR_CMDLN  4           /* STPGADDR: 1 cmd byte + 2 offset bytes + 1 checksum byte */
+#define STPGADDR_RPLYLN 2           /* STPGADDR reply: 1 ack + 1 offset checksum */
+#define PKT_SUM_LEN     1           /* WRITPAGE data check length: 8-bit sum (even command length) */
+#define PKT_CRC16_LEN   2           /* WRITPAGE data check length: CRC16, MSB first (odd command length) */
+#define GETCRC_CMDLN    5           /* GETCRC setting the size: 1 cmd byte + 2 offset bytes + 2 size bytes */
+#define GETCRC_RPLYLN   3           /* GETCRC reply returning the CRC16: 1 ack + 2 CRC bytes */
+#define INSTTMNL_CMDLN  7           /* INSTTMNL: 1 cmd byte + 2 start bytes + 2 size bytes + 2 CRC16 bytes */
+#define INSTTMNL_RPLYLN 2           /* INSTTMNL reply: 1 ack + 1 status byte */
+
+// INSTTMNL reply status: the install starts after the reply is read only when it's INST_OK
+#define INST_OK         0           /* The image fits, its CRC16 is checked again before copying it */
+#define INST_ERR_RANGE  1           /* The image doesn't fit in the staging area, or its destination overlaps it */
+#define INST_ERR_STAGE  2           /* A page was sent outside the staging area, the image has to be sent again */
+
+// Operation flags
+#define FL_WRITE_PAGE   1           /* The staging page is complete, write it to flash memory */
+#define FL_CALC_CRC     2           /* Calculate the CRC16 of the staged image */
+#define FL_INSTALL      3           /* Check the staged image and copy it over the bootloader */
+#define FL_PKT_ERROR    4           /* A data packet was rejected, the page is discarded until the next STPGADDR */
+#define FL_STAGE_ERROR  5           /* A page outside the staging area, the install is rejected until a new image starts */
+
+#endif /* _TML_UPDATE_STUB_H_ */
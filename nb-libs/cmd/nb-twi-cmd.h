@@ -32,6 +32,41 @@
 #define ACKEXITT 0x79 /* Acknowledge Exit Timonel (Jump To App) command */
 #define READFLSH 0x87 /* Command Read Data From Flash Memory */
 #define ACKRDFSH 0x78 /* Acknowledge Read Data From Flash Memory command */
+#define ERASEPAG 0x88 /* Command Erase Flash Memory Page */
+#define ACKERPAG 0x77 /* Acknowledge Erase Flash Memory Page command */
+#define GETCRC   0x89 /* Command Get Flash Memory CRC16 */
+#define ACKGTCRC 0x76 /* Acknowledge Get Flash Memory CRC16 command */
+#define WRITERLE 0x8A /* Command Write Run-Length Encoded Data To Page Buffer */
+#define ACKWTRLE 0x75 /* Acknowledge Write Run-Length Encoded Data To Page Buffer command */
+#define WRITPGWN 0x8B /* Command Write Data To Page Buffer Without Reply (Windowed Ack) */
+#define ACKWTPGW 0x74 /* Acknowledge Write Data To Page Buffer Without Reply command (Reserved) */
+#define BOOTTMNL 0x8C /* Command Reboot Into Timonel (Application Firmware) */
+#define ACKBOOTT 0x73 /* Acknowledge Reboot Into Timonel command */
+#define INSTTMNL 0x8D /* Command Install Staged Timonel Update (Update Stub) */
+#define ACKINSTT 0x72 /* Acknowledge Install Staged Timonel Update command */
+#define GETSTATS 0x8E /* Command Get Timonel Statistics Counters */
+#define ACKGTSTS 0x71 /* Acknowledge Get Timonel Statistics Counters command */
+
+// Reboot handshake: an application rebooting into Timonel with BOOTTMNL leaves this marker at the
+// SRAM start before its watchdog reset, then Timonel doesn't exit to the application on timeout
+#define BOOT_HOLD_ADDR 0x0060 /* SRAM address of the reboot handshake marker (ATtiny25/45/85 RAMSTART) */
+#define BOOT_HOLD_MARK 0xB007 /* Reboot handshake marker value */
+
+// Application address handover: when Timonel exits to the application, it leaves the application
+// TWI address in r2 and its complement in r3, the C runtime startup code doesn't use them
+#define APP_ADDR_OFFSET 28    /* Application TWI address = Timonel TWI address + offset (36 to 63) */
+
+// Statistics counters: the GETSTATS operand selects the entry to read, entries 0 to 15 time the command
+// handlers (opcode low nibble, RESETMCU to 0x8F) with Timer0, the flash memory operations use Timer1
+#define STATS_PAGE_WRITE 16   /* Entry: flash memory page writes */
+#define STATS_PAGE_ERASE 17   /* Entry: flash memory page erases (ERASEPAG, FORCE_ERASE_PG, trampoline page) */
+#define STATS_PKT_ERROR  18   /* Entry: data packets rejected by their checks (count only) */
+#define STATS_RX_OVERRUN 19   /* Entry: command bytes dropped with the RX buffer full (count only) */
+#define STATS_ENTRIES    20   /* Statistics entries count */
+#define STATS_CLEAR_FLAG 0x80 /* GETSTATS operand flag: clear the entry after reading it */
+#define STATS_SAT_TICKS  0x80000000 /* GETSTATS ticks flag: an event outlasted the 8-bit timer range, its time was saturated */
+#define STATS_CMD_PRESC  64   /* Timer0 prescaler: command handler ticks (CPU clock / 64) */
+#define STATS_SLOW_PRESC 1024 /* Timer1 prescaler: flash memory operation ticks (CPU clock / 1024) */
 
 #define SETIO1_0 0x92 /* Command Set Io Port 1 = 0 */
 #define ACKIO1_0 0x6D /* Acknowledge Set Io Port 1 = 0 command */
@@ -16,15 +16,77 @@
  */
 
 #include "NbMicro.h"
+#include <bitset>
 #include "TimonelTwiM.h"
 
+// State of each TWI bus in use: its Wire object, the store of TWI addresses in use (one bit per slave
+// address, from LOW_TWI_ADDR to HIG_TWI_ADDR), the TWI clock remembered for each slave address
+// (0 = TWI_CLK_DEFAULT) and the one currently set in its Wire object ...
+typedef struct twi_bus_state_ {
+    TwoWire *p_wire = nullptr;
+    std::bitset<HIG_TWI_ADDR - LOW_TWI_ADDR + 1> active_addresses;
+    uint32_t device_clocks[HIG_TWI_ADDR - LOW_TWI_ADDR + 1] = {0};
+    uint32_t wire_clock = TWI_CLK_DEFAULT;
+} TwiBusState;
+static TwiBusState twi_buses[MAX_TWI_BUSES];
+
+// Function GetBusState (Returns the state of a Wire object's bus, a free one is taken the first time it's used)
+static TwiBusState *GetBusState(TwoWire &wire) {
+    TwiBusState *p_free = nullptr;
+    for (byte i = 0; i < MAX_TWI_BUSES; i++) {
+        if (twi_buses[i].p_wire == &wire) {
+            return &twi_buses[i];
+        }
+        if ((twi_buses[i].p_wire == nullptr) && (p_free == nullptr)) {
+            p_free = &twi_buses[i];
+        }
+    }
+    if (p_free != nullptr) {
+        p_free->p_wire = &wire;
+    }
+    return p_free;
+}
+
+// Function SetWireClock (Changes a bus clock only when it differs from the one already set)
+static void SetWireClock(TwiBusState *p_bus, const uint32_t clock_hz) {
+    if (clock_hz != p_bus->wire_clock) {
+        p_bus->p_wire->setClock(clock_hz);
+        p_bus->wire_clock = clock_hz;
+    }
+}
+
+// Function CheckBufferFrame (Checks a READBUFF reply sequence number, data count and checksum)
+static byte CheckBufferFrame(const byte twi_reply_arr[], const byte seq, const byte count) {
+    const byte frame_count = twi_reply_arr[2];
+    if ((twi_reply_arr[1] != seq) || (frame_count > count)) {
+        return ERR_BUF_XMIT;
+    }
+    byte sum = seq + frame_count;
+    for (byte i = 0; i < frame_count; i++) {
+        sum += twi_reply_arr[i + 3];
+    }
+    return (sum == twi_reply_arr[frame_count + 3]) ? OK : ERR_BUF_XMIT;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 ////////////                    NBMICRO CLASS                    ////////////
 /////////////////////////////////////////////////////////////////////////////
 
-// Class constructor
-NbMicro::NbMicro(byte twi_address, byte sda, byte scl) : addr_(twi_address), sda_(sda), scl_(scl) {
-    if ((!active_addresses.insert(addr_).second) && (addr_ != 0)) {
+// Class constructor (on the default Wire bus)
+NbMicro::NbMicro(byte twi_address, byte sda, byte scl) : NbMicro(Wire, twi_address, sda, scl) {
+}
+
+// Class constructor (on a given Wire bus: objects on different buses can use the same TWI address)
+NbMicro::NbMicro(TwoWire &wire, byte twi_address, byte sda, byte scl) : wire_(wire), addr_(twi_address), sda_(sda), scl_(scl) {
+    p_bus_ = GetBusState(wire_);
+    if (p_bus_ == nullptr) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Error: More than %d TWI buses in use! Unable to create a device object on another one ...\r\n", __func__, MAX_TWI_BUSES);
+#endif /* DEBUG_LEVEL */
+        delay(DLY_NBMICRO);
+        std::terminate();
+    }
+    if (ReserveTwiAddress(addr_) != OK) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Error: The TWI address [%02d] is in use! Unable to create another device object with it ...\r\n", __func__, addr_);
         USE_SERIAL.printf_P("[%s] Execution terminated, please review the devices' TWI addresses on your code.\r\n", __func__);
@@ -38,7 +100,8 @@ NbMicro::NbMicro(byte twi_address, byte sda, byte scl) : addr_(twi_address), sda
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Creating a new TWI connection with address %02d\n\r", __func__, addr_);
 #endif                          /* DEBUG_LEVEL */
-        Wire.begin(sda_, scl_); /* Init I2C sda_:GPIO0, scl_:GPIO2 (ESP-01) / sda_:D3, scl_:D4 (NodeMCU) */
+        wire_.begin(sda_, scl_); /* Init I2C sda_:GPIO0, scl_:GPIO2 (ESP-01) / sda_:D3, scl_:D4 (NodeMCU) */
+        p_bus_->wire_clock = TWI_CLK_DEFAULT;
         reusing_twi_connection_ = false;
     } else {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
@@ -68,6 +131,11 @@ byte NbMicro::SetTwiAddress(byte twi_address) {
     if (addr_ != 0) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Object TWI address already defined, using %d\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        return ERR_ADDR_IN_USE;
+    } else if (ReserveTwiAddress(twi_address) != OK) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] The TWI address [%02d] is in use by another device object!\r\n", __func__, twi_address);
 #endif /* DEBUG_LEVEL */
         return ERR_ADDR_IN_USE;
     } else {
@@ -85,6 +153,7 @@ byte NbMicro::SetTwiAddress(byte twi_address) {
   | - If no error                       -> return 0 |
   | - If ack error on single byte reply -> return 3 |
   | - If ack error on multi byte reply  -> return 4 |
+  | - If TWI transmission error         -> return 5 |
   |_________________________________________________|
 */
 // Send a TWI command to the microcontroller (Overload A: single byte command)
@@ -108,6 +177,7 @@ byte NbMicro::TwiCmdXmit(byte twi_cmd, byte twi_reply, byte twi_reply_arr[], byt
   | - If no error                       -> return 0 |
   | - If ack error on single byte reply -> return 1 |
   | - If ack error on multi byte reply  -> return 2 |
+  | - If TWI transmission error         -> return 3 |
   |_________________________________________________|
 */
 // Send a TWI command to the microcontroller (Overload B: multibyte command)
@@ -115,16 +185,45 @@ byte NbMicro::TwiCmdXmit(byte twi_cmd_arr[], byte cmd_size, byte twi_reply, byte
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
     USE_SERIAL.printf_P("[%s] > Multi byte cmd: 0x%02X --> making actual TWI transmission ...\n\r", __func__, twi_cmd_arr[0]);
 #endif /* DEBUG_LEVEL */
+    SelectBusClock();
     // TWI command transmit
+#if ((defined BURST_XMIT) && (BURST_XMIT == true))
+    // Burst mode: the whole command is sent in a single TWI transaction (one start, address and stop)
+    unsigned long bus_time = micros();
+    wire_.beginTransmission(addr_);
+    byte bytes_written = wire_.write(twi_cmd_arr, cmd_size);
+    byte xmit_result = wire_.endTransmission();
+    stats_.transactions++;
+    stats_.bus_time_us += (micros() - bus_time);
+    if ((xmit_result != 0) || (bytes_written != cmd_size)) {
+        stats_.nacks++;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+        USE_SERIAL.printf_P("[%s] > Error transmitting 0x%02X command (%d of %d bytes written)\n\r", __func__, twi_cmd_arr[0], bytes_written, cmd_size);
+#endif                           /* DEBUG_LEVEL */
+        return ERR_CMD_XMIT;     /* Error: the command transmission failed */
+    }
+    stats_.bytes_sent += cmd_size;
+#else
+    // Byte-per-transaction mode: each command byte is sent in its own TWI transaction
     for (int i = 0; i < cmd_size; i++) {
-        Wire.beginTransmission(addr_);
-        Wire.write(twi_cmd_arr[i]);
-        Wire.endTransmission();
+        unsigned long bus_time = micros();
+        wire_.beginTransmission(addr_);
+        wire_.write(twi_cmd_arr[i]);
+        if (wire_.endTransmission() == 0) {
+            stats_.bytes_sent++;
+        } else {
+            stats_.nacks++;
+        }
+        stats_.transactions++;
+        stats_.bus_time_us += (micros() - bus_time);
     }
+#endif /* BURST_XMIT */
     // TWI command reply (one byte expected)
     if (reply_size == 0) {
-        Wire.requestFrom(addr_, ++reply_size, STOP_ON_REQ); /* True: releases the bus with a stop after a master request. */
-        byte reply = Wire.read();                           /* False: sends a restart, not releasing the bus.             */
+        unsigned long bus_time = micros();
+        byte reply_length = wire_.requestFrom(addr_, ++reply_size, STOP_ON_REQ); /* True: releases the bus with a stop after a master request. */
+        byte reply = wire_.read();                                               /* False: sends a restart, not releasing the bus.             */
+        CountReply(reply_length, reply_size, bus_time);
         if (reply == twi_reply) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
             USE_SERIAL.printf_P("[%s] > Command 0x%02X parsed OK <<< 0x%02X (single byte reply)\n\r", __func__, twi_cmd_arr[0], reply);
@@ -139,10 +238,12 @@ byte NbMicro::TwiCmdXmit(byte twi_cmd_arr[], byte cmd_size, byte twi_reply, byte
     }
     // TWI command reply (multiple bytes expected)
     else {
-        byte reply_length = Wire.requestFrom(addr_, reply_size, STOP_ON_REQ); /* True: releases the bus with a stop after a master request. */
+        unsigned long bus_time = micros();
+        byte reply_length = wire_.requestFrom(addr_, reply_size, STOP_ON_REQ); /* True: releases the bus with a stop after a master request. */
         for (int i = 0; i < reply_size; i++) {                                /* False: sends a restart, not releasing the bus.             */
-            twi_reply_arr[i] = Wire.read();
+            twi_reply_arr[i] = wire_.read();
         }
+        CountReply(reply_length, reply_size, bus_time);
         if ((twi_reply_arr[0] == twi_reply) && (reply_length == reply_size)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 3))
             USE_SERIAL.printf_P("[%s] >>> Command 0x%02X parsed OK <<< 0x%02X (multibyte reply)\n\r", __func__, twi_cmd_arr[0], twi_reply_arr[0]);
@@ -157,6 +258,241 @@ byte NbMicro::TwiCmdXmit(byte twi_cmd_arr[], byte cmd_size, byte twi_reply, byte
     }
 }
 
+/* _________________________________________________
+  |                                                 | 
+  | TwiCmdSend                                      |
+  | - If no error                       -> return 0 |
+  | - If TWI transmission error         -> return 3 |
+  |_________________________________________________|
+*/
+// Send a TWI command in a single transaction without reading a reply (e.g. windowed data packets)
+byte NbMicro::TwiCmdSend(const byte twi_cmd_arr[], const byte cmd_size) {
+    SelectBusClock();
+    unsigned long bus_time = micros();
+    wire_.beginTransmission(addr_);
+    byte bytes_written = wire_.write(twi_cmd_arr, cmd_size);
+    byte xmit_result = wire_.endTransmission();
+    stats_.transactions++;
+    stats_.bus_time_us += (micros() - bus_time);
+    if ((xmit_result != 0) || (bytes_written != cmd_size)) {
+        stats_.nacks++;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+        USE_SERIAL.printf_P("[%s] > Error transmitting 0x%02X command (%d of %d bytes written)\n\r", __func__, twi_cmd_arr[0], bytes_written, cmd_size);
+#endif                       /* DEBUG_LEVEL */
+        return ERR_CMD_XMIT; /* Error: the command transmission failed */
+    }
+    stats_.bytes_sent += cmd_size;
+    return OK;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | WaitForReady                                    |
+  | - If the device acknowledges        -> return 0 |
+  | - If timeout expired                -> return 1 |
+  |_________________________________________________|
+*/
+// Poll the device address until it's acknowledged (slaves don't acknowledge it while busy)
+byte NbMicro::WaitForReady(const word timeout) {
+    SelectBusClock();
+    unsigned long start_time = millis();
+    for (;;) {
+        unsigned long bus_time = micros();
+        wire_.beginTransmission(addr_);
+        byte poll_result = wire_.endTransmission();
+        stats_.transactions++;
+        stats_.bus_time_us += (micros() - bus_time);
+        if (poll_result == 0) {
+            return OK;
+        }
+        stats_.busy_polls++;
+        if ((millis() - start_time) >= timeout) {
+            break; /* A zero timeout makes a single poll */
+        }
+        TimedDelay(DLY_READY_POLL);
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("[%s] Device %02d still busy after %d ms ...\r\n", __func__, addr_, timeout);
+#endif /* DEBUG_LEVEL */
+    return ERR_NOT_READY;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | SetBusClock                                     |
+  | - If no error                       -> return 0 |
+  | - If address not tracked            -> return 1 |
+  |_________________________________________________|
+*/
+// Set the TWI clock used with this device's address (0 = TWI_CLK_DEFAULT). It's kept after this object is
+// destroyed, so a new object for the same address, e.g. after the application restarts, reuses it.
+byte NbMicro::SetBusClock(const uint32_t clock_hz) {
+    if ((addr_ < LOW_TWI_ADDR) || (addr_ > HIG_TWI_ADDR)) {
+        return ERR_NOT_TRACKED;
+    }
+    p_bus_->device_clocks[addr_ - LOW_TWI_ADDR] = clock_hz;
+    return OK;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | GetBusClock                                     |
+  |_________________________________________________|
+*/
+// Return the TWI clock used with this device's address
+uint32_t NbMicro::GetBusClock(void) {
+    if ((addr_ < LOW_TWI_ADDR) || (addr_ > HIG_TWI_ADDR) || (p_bus_->device_clocks[addr_ - LOW_TWI_ADDR] == 0)) {
+        return TWI_CLK_DEFAULT;
+    }
+    return p_bus_->device_clocks[addr_ - LOW_TWI_ADDR];
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | ReadBuffer                                      |
+  | - If no error                       -> return 0 |
+  | - If a frame transfer failed        -> return 1 |
+  |_________________________________________________|
+*/
+// Read up to "len" bytes of application data from the device with back-to-back READBUFF frames. It
+// stops early when the device has no more data, the bytes read are returned in p_read. A frame with
+// a bad reply is requested again with the same sequence number, so the device resends it unchanged.
+byte NbMicro::ReadBuffer(byte dst[], const word len, word *p_read) {
+    word bytes_read = 0;
+    byte start_flag = BUF_START_FLAG;
+    byte errors = OK;
+    while (bytes_read < len) {
+        const byte count = ((len - bytes_read) < BUF_FRAME_SIZE) ? (len - bytes_read) : BUF_FRAME_SIZE;
+        byte twi_cmd_arr[4] = {READBUFF, ++buf_seq_, 0, 0};
+        byte twi_reply_arr[BUF_FRAME_SIZE + 4];
+        byte attempts = 0;
+        for (;;) {
+            twi_cmd_arr[2] = count | start_flag;
+            twi_cmd_arr[3] = twi_cmd_arr[1] + twi_cmd_arr[2]; /* The device doesn't take a corrupted frame request */
+            errors = TwiCmdXmit(twi_cmd_arr, 4, ACKRDBUF, twi_reply_arr, count + 4);
+            if ((errors == OK) && (CheckBufferFrame(twi_reply_arr, buf_seq_, count) != OK)) {
+                stats_.check_errors++;
+                errors = ERR_BUF_XMIT;
+            }
+            if (errors == OK) {
+                break;
+            }
+            start_flag = 0; /* The retries may repeat a frame already read by the device */
+            if (++attempts >= MAX_BUF_RETRY) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Error reading frame %d from device %02d after %d attempts ...\n\r", __func__, buf_seq_, addr_, attempts);
+#endif /* DEBUG_LEVEL */
+                if (p_read != nullptr) {
+                    *p_read = bytes_read;
+                }
+                return ERR_BUF_XMIT;
+            }
+            stats_.retries++;
+        }
+        start_flag = 0;
+        const byte frame_count = twi_reply_arr[2];
+        if (frame_count == 0) {
+            break; /* The device doesn't have more data */
+        }
+        memcpy(&dst[bytes_read], &twi_reply_arr[3], frame_count);
+        bytes_read += frame_count;
+    }
+    if (p_read != nullptr) {
+        *p_read = bytes_read;
+    }
+    return OK;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | WriteBuffer                                     |
+  | - If no error                       -> return 0 |
+  | - If a frame transfer failed        -> return 1 |
+  | - If the device didn't accept data  -> return 2 |
+  |_________________________________________________|
+*/
+// Write "len" bytes of application data to the device with back-to-back WRITBUFF frames. A frame
+// with a bad reply is sent again with the same sequence number, so the device doesn't take it twice.
+// When the device accepts only part of a frame, the rest goes in the next one.
+byte NbMicro::WriteBuffer(const byte src[], const word len) {
+    word bytes_written = 0;
+    byte start_flag = BUF_START_FLAG;
+    byte full_attempts = 0;
+    while (bytes_written < len) {
+        const byte count = ((len - bytes_written) < BUF_FRAME_SIZE) ? (len - bytes_written) : BUF_FRAME_SIZE;
+        byte twi_cmd_arr[BUF_FRAME_SIZE + 4] = {WRITBUFF, ++buf_seq_, 0};
+        byte twi_reply_arr[4];
+        byte sum = buf_seq_ + count;
+        for (byte i = 0; i < count; i++) {
+            twi_cmd_arr[i + 3] = src[bytes_written + i];
+            sum += twi_cmd_arr[i + 3];
+        }
+        twi_cmd_arr[count + 3] = sum;
+        byte attempts = 0;
+        for (;;) {
+            twi_cmd_arr[2] = count | start_flag;
+            byte errors = TwiCmdXmit(twi_cmd_arr, count + 4, ACKWTBUF, twi_reply_arr, 4);
+            if ((errors == OK) && ((twi_reply_arr[1] != buf_seq_) || ((byte)(twi_reply_arr[1] + twi_reply_arr[2]) != twi_reply_arr[3]))) {
+                stats_.check_errors++; /* A corrupted accepted count would skip or repeat data */
+                errors = ERR_BUF_XMIT;
+            }
+            if ((errors == OK) && (twi_reply_arr[2] == BUF_CHECK_ERR)) {
+                stats_.check_errors++;
+                errors = ERR_BUF_XMIT;
+            }
+            if (errors == OK) {
+                break;
+            }
+            start_flag = 0; /* The retries may repeat a frame already taken by the device */
+            if (++attempts >= MAX_BUF_RETRY) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Error writing frame %d to device %02d after %d attempts ...\n\r", __func__, buf_seq_, addr_, attempts);
+#endif /* DEBUG_LEVEL */
+                return ERR_BUF_XMIT;
+            }
+            stats_.retries++;
+        }
+        start_flag = 0;
+        const byte accepted = (twi_reply_arr[2] < count) ? twi_reply_arr[2] : count;
+        if (accepted == 0) {
+            // The device buffer is full: give it some time and send the data again in a new frame
+            if (++full_attempts >= MAX_BUF_RETRY) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Device %02d didn't accept more data after %d attempts ...\n\r", __func__, addr_, full_attempts);
+#endif /* DEBUG_LEVEL */
+                return ERR_BUF_FULL;
+            }
+            stats_.retries++;
+            TimedDelay(DLY_READY_POLL);
+            continue;
+        }
+        full_attempts = 0;
+        bytes_written += accepted;
+    }
+    return OK;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | GetStats                                        |
+  |_________________________________________________|
+*/
+// Return this instance's bus counters and phase timings, e.g. to tell slow wiring (NACKs, checksum
+// errors, retries) apart from slow firmware (busy polls, delays)
+NbMicro::Stats NbMicro::GetStats(void) {
+    return stats_;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | ResetStats                                      |
+  |_________________________________________________|
+*/
+// Clear this instance's bus counters and phase timings
+void NbMicro::ResetStats(void) {
+    stats_ = Stats();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 ////////////             NbMicro internal functions              ////////////
 /////////////////////////////////////////////////////////////////////////////
@@ -166,7 +502,26 @@ NbMicro::~NbMicro() {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
     USE_SERIAL.printf_P("[%s] Freeing TWI address %02d ...\r\n", __func__, addr_);
 #endif /* DEBUG_LEVEL */
-    active_addresses.erase(addr_);
+    if ((addr_ >= LOW_TWI_ADDR) && (addr_ <= HIG_TWI_ADDR)) {
+        p_bus_->active_addresses.reset(addr_ - LOW_TWI_ADDR);
+    }
+}
+
+// Function ReserveTwiAddress (Marks a slave address as in use, addresses out of the slave range aren't tracked)
+byte NbMicro::ReserveTwiAddress(const byte twi_address) {
+    if ((twi_address < LOW_TWI_ADDR) || (twi_address > HIG_TWI_ADDR)) {
+        return OK;
+    }
+    if (p_bus_->active_addresses.test(twi_address - LOW_TWI_ADDR)) {
+        return ERR_ADDR_IN_USE;
+    }
+    p_bus_->active_addresses.set(twi_address - LOW_TWI_ADDR);
+    return OK;
+}
+
+// Function SelectBusClock (Sets the Wire clock remembered for this device before a transaction)
+void NbMicro::SelectBusClock(void) {
+    SetWireClock(p_bus_, GetBusClock());
 }
 
 // Function InitMicro (Initializes the microcontroller firmware)
@@ -177,19 +532,59 @@ byte NbMicro::InitMicro(void) {
     return (TwiCmdXmit(INITSOFT, ACKINITS));
 }
 
+// Function TimedDelay (Waits between transactions, adding the time to the delay counter)
+void NbMicro::TimedDelay(const unsigned long ms) {
+    unsigned long delay_time = micros();
+    delay(ms);
+    stats_.delay_time_us += (micros() - delay_time);
+}
+
+// Function BeginPhase (Records a phase start timestamp)
+void NbMicro::BeginPhase(const byte phase) {
+    stats_.phase_start_us[phase] = micros();
+}
+
+// Function EndPhase (Records a phase duration since its last start)
+void NbMicro::EndPhase(const byte phase) {
+    stats_.phase_time_us[phase] = (micros() - stats_.phase_start_us[phase]);
+}
+
+// Function CountReply (Adds a reply read to the bus counters, short replies are counted as NACKs)
+void NbMicro::CountReply(const byte reply_length, const byte reply_size, const unsigned long bus_time) {
+    stats_.transactions++;
+    stats_.bytes_received += reply_length;
+    stats_.bus_time_us += (micros() - bus_time);
+    if (reply_length != reply_size) {
+        stats_.nacks++;
+    }
+}
+
 #if ((defined MULTI_DEVICE) && (MULTI_DEVICE == true))
 #pragma GCC warning "TwiBus device discovery functions code included in TWI master!"
 /////////////////////////////////////////////////////////////////////////////
 ////////////                    TWIBUS CLASS                     ////////////
 /////////////////////////////////////////////////////////////////////////////
 
-// Class constructor
-TwiBus::TwiBus(byte sda, byte scl) : sda_(sda), scl_(scl) {
+// Class constructor (on the default Wire bus)
+TwiBus::TwiBus(byte sda, byte scl) : TwiBus(Wire, sda, scl) {
+}
+
+// Class constructor (on a given Wire bus)
+TwiBus::TwiBus(TwoWire &wire, byte sda, byte scl) : wire_(wire), sda_(sda), scl_(scl) {
+    p_bus_ = GetBusState(wire_);
+    if (p_bus_ == nullptr) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Error: More than %d TWI buses in use! Unable to create a bus object for another one ...\r\n", __func__, MAX_TWI_BUSES);
+#endif /* DEBUG_LEVEL */
+        delay(DLY_NBMICRO);
+        std::terminate();
+    }
     if (!((sda == 0) && (scl == 0))) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Creating a new I2C connection\n\r", __func__);
 #endif                        /* DEBUG_LEVEL */
-        Wire.begin(sda, scl); /* Init I2C sda:GPIO0, scl:GPIO2 (ESP-01) / sda:D3, scl:D4 (NodeMCU) */
+        wire_.begin(sda, scl); /* Init I2C sda:GPIO0, scl:GPIO2 (ESP-01) / sda:D3, scl:D4 (NodeMCU) */
+        p_bus_->wire_clock = TWI_CLK_DEFAULT;
         reusing_twi_connection_ = false;
     } else {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
@@ -211,6 +606,7 @@ TwiBus::~TwiBus() {
 */
 // ScanBus (Overload A: Return the address and mode of the first TWI device found on the bus)
 byte TwiBus::ScanBus(bool *p_app_mode) {
+    SetWireClock(p_bus_, TWI_CLK_DEFAULT); /* Unknown devices are scanned at the default clock */
     // Address 08 to 35: Timonel bootloader (app mode = false)
     // Address 36 to 63: Application firmware (app mode = true)
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
@@ -218,8 +614,8 @@ byte TwiBus::ScanBus(bool *p_app_mode) {
 #endif /* DEBUG_LEVEL */
     byte twi_addr = LOW_TWI_ADDR;
     while (twi_addr < HIG_TWI_ADDR) {
-        Wire.beginTransmission(twi_addr);
-        if (Wire.endTransmission() == 0) {
+        wire_.beginTransmission(twi_addr);
+        if (wire_.endTransmission() == 0) {
             if (p_app_mode != nullptr) {
                 if (twi_addr < (((HIG_TWI_ADDR + 1 - LOW_TWI_ADDR) / 2) + LOW_TWI_ADDR)) {
     #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
@@ -248,6 +644,7 @@ byte TwiBus::ScanBus(bool *p_app_mode) {
 */
 // ScanBus (Overload B: Fills an array with the address, firmware and version of all devices connected to the bus)
 byte TwiBus::ScanBus(DeviceInfo dev_info_arr[], byte arr_size, byte start_twi_addr) {
+    SetWireClock(p_bus_, TWI_CLK_DEFAULT); /* Unknown devices are scanned at the default clock */
     // Address 08 to 35: Timonel bootloader
     // Address 36 to 63: Application firmware
     // Each I2C slave must have a unique bootloader address that corresponds
@@ -258,10 +655,10 @@ byte TwiBus::ScanBus(DeviceInfo dev_info_arr[], byte arr_size, byte start_twi_ad
     USE_SERIAL.printf_P("\n\r[%s] Scanning TWI bus, searching all the connected devices, please wait ...\n\r", __func__);
 #endif /* DEBUG_LEVEL */
     byte found_devices = 0;
-    byte twi_addr = LOW_TWI_ADDR;
-    while (twi_addr <= HIG_TWI_ADDR) {
-        Wire.beginTransmission(twi_addr);
-        if (Wire.endTransmission() == 0) {
+    byte twi_addr = start_twi_addr;
+    while ((twi_addr <= HIG_TWI_ADDR) && (found_devices < arr_size)) {
+        wire_.beginTransmission(twi_addr);
+        if (wire_.endTransmission() == 0) {
             if (twi_addr < (((HIG_TWI_ADDR + 1 - LOW_TWI_ADDR) / 2) + LOW_TWI_ADDR)) {
                 Timonel tml(twi_addr);
                 Timonel::Status sts = tml.GetStatus();
@@ -286,6 +683,420 @@ byte TwiBus::ScanBus(DeviceInfo dev_info_arr[], byte arr_size, byte start_twi_ad
     }
     return OK;
 }
+
+/* _________________________
+  |                         | 
+  |    DiscoverDevices A    |
+  |_________________________|
+*/
+// DiscoverDevices (Overload A: Full scan) Fill a table with the address and firmware of all devices connected to the bus, returns the number of
+// devices found. The whole bus is probed first, then each bootloader is queried once and its status is
+// cached in the table, so the Timonel objects created from it don't have to query the devices again.
+byte TwiBus::DiscoverDevices(DeviceEntry dev_table[], const byte table_size) {
+    SetWireClock(p_bus_, TWI_CLK_DEFAULT); /* Unknown devices are scanned at the default clock */
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] Discovering TWI bus devices ...\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+    byte found_devices = 0;
+    // Pass 1: address probe only, without delays between addresses
+    for (byte twi_addr = LOW_TWI_ADDR; (twi_addr <= HIG_TWI_ADDR) && (found_devices < table_size); twi_addr++) {
+        wire_.beginTransmission(twi_addr);
+        if (wire_.endTransmission() == 0) {
+            dev_table[found_devices].addr = twi_addr;
+            dev_table[found_devices].p_wire = &wire_;
+            if (twi_addr < (((HIG_TWI_ADDR + 1 - LOW_TWI_ADDR) / 2) + LOW_TWI_ADDR)) {
+                dev_table[found_devices].firmware = FW_UNKNOWN; /* Bootloader address: confirmed on pass 2 */
+            } else {
+                dev_table[found_devices].firmware = FW_APP;
+            }
+            found_devices++;
+        }
+    }
+    // Pass 2: a single status read per device found at a bootloader address
+    for (byte i = 0; i < found_devices; i++) {
+        if (dev_table[i].firmware != FW_APP) {
+            byte *reply = dev_table[i].status_reply;
+            wire_.beginTransmission(dev_table[i].addr);
+            wire_.write(GETTMNLV);
+            if ((wire_.endTransmission() == 0) && (wire_.requestFrom(dev_table[i].addr, (byte)DEV_STATUS_SIZE, (byte)STOP_ON_REQ) == DEV_STATUS_SIZE)) {
+                for (byte j = 0; j < DEV_STATUS_SIZE; j++) {
+                    reply[j] = wire_.read();
+                }
+                if ((reply[0] == ACKTMNLV) && (reply[1] == T_SIGNATURE)) {
+                    dev_table[i].firmware = FW_TIMONEL;
+                }
+            }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P("[%s] Device %02d: %s\n\r", __func__, dev_table[i].addr, ((dev_table[i].firmware == FW_TIMONEL) ? L_TIMONEL : L_UNKNOWN));
+#endif /* DEBUG_LEVEL */
+        }
+    }
+    return found_devices;
+}
+
+/* _________________________
+  |                         | 
+  |    DiscoverDevices B    |
+  |_________________________|
+*/
+// DiscoverDevices (Overload B: Warm start from the inventory saved by the last full scan) Each device in
+// the inventory is checked with a single probe at its remembered TWI clock: a status read for bootloaders
+// and an address probe for the others. When all of them answer with the same firmware, the table is filled
+// without scanning the bus, the bootloaders' fresh status is cached in it and the inventory is only saved
+// again if a version, feature or application changed. Otherwise, or without a valid inventory, the whole
+// bus is scanned (overload A) and the inventory is replaced. NOTE: Devices added to the bus since the last
+// full scan aren't found by a warm start.
+byte TwiBus::DiscoverDevices(DeviceEntry dev_table[], const byte table_size, InventoryStore &store) {
+    byte inventory[INV_HEADER_SIZE + (INV_MAX_ENTRIES * INV_ENTRY_SIZE)];
+    const int inv_size = store.Load(inventory, sizeof(inventory));
+    byte inv_count = 0;
+    if ((inv_size >= INV_HEADER_SIZE) && (inventory[0] == INV_SIGNATURE) && (inventory[1] == INV_VERSION)) {
+        byte sum = 0;
+        for (int i = INV_HEADER_SIZE; i < inv_size; i++) {
+            sum += inventory[i];
+        }
+        inv_count = inventory[2];
+        if ((inv_count > table_size) || (inv_count > INV_MAX_ENTRIES) ||
+            (inv_size != (INV_HEADER_SIZE + (inv_count * INV_ENTRY_SIZE))) || (sum != inventory[3])) {
+            inv_count = 0; /* Damaged or doesn't fit in the table */
+        }
+    }
+    bool missing = (inv_count == 0);
+    bool updated = false;
+    byte checked = 0;
+    while ((checked < inv_count) && (!missing)) {
+        missing = !CheckInventoryEntry(&inventory[INV_HEADER_SIZE + (checked * INV_ENTRY_SIZE)], &dev_table[checked], &updated);
+        checked++;
+    }
+    if (!missing) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("\n\r[%s] Warm start: %d devices found at their inventory addresses\n\r", __func__, inv_count);
+#endif /* DEBUG_LEVEL */
+        if (updated) {
+            SaveInventory(dev_table, inv_count, store);
+        }
+        return inv_count;
+    }
+    // A device didn't answer: the clocks restored from the inventory are dropped with it
+    for (byte i = 0; i < checked; i++) {
+        const byte twi_addr = inventory[INV_HEADER_SIZE + (i * INV_ENTRY_SIZE) + I_ADDR];
+        if ((twi_addr >= LOW_TWI_ADDR) && (twi_addr <= HIG_TWI_ADDR)) {
+            p_bus_->device_clocks[twi_addr - LOW_TWI_ADDR] = 0;
+        }
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] The inventory doesn't match the bus, scanning it ...\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+    const byte found_devices = DiscoverDevices(dev_table, table_size);
+    SaveInventory(dev_table, found_devices, store);
+    return found_devices;
+}
+
+/* _________________________
+  |                         | 
+  |      SaveInventory      |
+  |_________________________|
+*/
+// Save the devices of a table filled by DiscoverDevices to an inventory store, along with the TWI clock
+// remembered for each address, e.g. after Timonel::NegotiateClock. The devices on other buses are skipped.
+byte TwiBus::SaveInventory(const DeviceEntry dev_table[], const byte dev_count, InventoryStore &store) {
+    byte inventory[INV_HEADER_SIZE + (INV_MAX_ENTRIES * INV_ENTRY_SIZE)];
+    byte inv_count = 0;
+    byte sum = 0;
+    for (byte i = 0; (i < dev_count) && (inv_count < INV_MAX_ENTRIES); i++) {
+        const byte twi_addr = dev_table[i].addr;
+        if ((dev_table[i].p_wire != &wire_) || (twi_addr < LOW_TWI_ADDR) || (twi_addr > HIG_TWI_ADDR)) {
+            continue;
+        }
+        byte *inv_entry = &inventory[INV_HEADER_SIZE + (inv_count * INV_ENTRY_SIZE)];
+        const bool timonel = (dev_table[i].firmware == FW_TIMONEL);
+        const uint32_t clock_hz = p_bus_->device_clocks[twi_addr - LOW_TWI_ADDR];
+        inv_entry[I_ADDR] = twi_addr;
+        inv_entry[I_FIRMWARE] = dev_table[i].firmware;
+        inv_entry[I_MAJOR] = (timonel ? dev_table[i].status_reply[S_MAJOR] : 0);
+        inv_entry[I_MINOR] = (timonel ? dev_table[i].status_reply[S_MINOR] : 0);
+        inv_entry[I_FEATURES] = (timonel ? dev_table[i].status_reply[S_FEATURES] : 0);
+        inv_entry[I_EXT_FEATURES] = (timonel ? dev_table[i].status_reply[S_EXT_FEATURES] : 0);
+        inv_entry[I_APPL_ADDR_MSB] = (timonel ? dev_table[i].status_reply[S_APPL_ADDR_MSB] : 0);
+        inv_entry[I_APPL_ADDR_LSB] = (timonel ? dev_table[i].status_reply[S_APPL_ADDR_LSB] : 0);
+        inv_entry[I_CLOCK] = (byte)(clock_hz >> 24);
+        inv_entry[I_CLOCK + 1] = (byte)(clock_hz >> 16);
+        inv_entry[I_CLOCK + 2] = (byte)(clock_hz >> 8);
+        inv_entry[I_CLOCK + 3] = (byte)(clock_hz & 0xFF);
+        for (byte j = 0; j < INV_ENTRY_SIZE; j++) {
+            sum += inv_entry[j];
+        }
+        inv_count++;
+    }
+    inventory[0] = INV_SIGNATURE;
+    inventory[1] = INV_VERSION;
+    inventory[2] = inv_count;
+    inventory[3] = sum;
+    if (!store.Save(inventory, (INV_HEADER_SIZE + (inv_count * INV_ENTRY_SIZE)))) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Error: the inventory of %d devices couldn't be saved ...\n\r", __func__, inv_count);
+#endif /* DEBUG_LEVEL */
+        return ERR_INV_SAVE;
+    }
+    return OK;
+}
+
+// Function CheckInventoryEntry (Probes an inventory device at its remembered clock and fills its table entry,
+// returns false if it doesn't answer with the same firmware, "p_updated" is set if its Timonel status changed)
+bool TwiBus::CheckInventoryEntry(const byte inv_entry[], DeviceEntry *p_device, bool *p_updated) {
+    const byte twi_addr = inv_entry[I_ADDR];
+    if ((twi_addr < LOW_TWI_ADDR) || (twi_addr > HIG_TWI_ADDR)) {
+        return false;
+    }
+    const uint32_t clock_hz = (((uint32_t)inv_entry[I_CLOCK] << 24) | ((uint32_t)inv_entry[I_CLOCK + 1] << 16) |
+                               ((uint32_t)inv_entry[I_CLOCK + 2] << 8) | inv_entry[I_CLOCK + 3]);
+    p_bus_->device_clocks[twi_addr - LOW_TWI_ADDR] = clock_hz;
+    SetWireClock(p_bus_, ((clock_hz == 0) ? TWI_CLK_DEFAULT : clock_hz));
+    p_device->addr = twi_addr;
+    p_device->p_wire = &wire_;
+    p_device->firmware = inv_entry[I_FIRMWARE];
+    wire_.beginTransmission(twi_addr);
+    if (p_device->firmware != FW_TIMONEL) {
+        return (wire_.endTransmission() == 0); /* Address probe only */
+    }
+    byte *reply = p_device->status_reply;
+    wire_.write(GETTMNLV);
+    if ((wire_.endTransmission() != 0) || (wire_.requestFrom(twi_addr, (byte)DEV_STATUS_SIZE, (byte)STOP_ON_REQ) != DEV_STATUS_SIZE)) {
+        return false;
+    }
+    for (byte j = 0; j < DEV_STATUS_SIZE; j++) {
+        reply[j] = wire_.read();
+    }
+    if ((reply[0] != ACKTMNLV) || (reply[1] != T_SIGNATURE)) {
+        return false;
+    }
+    if ((reply[S_MAJOR] != inv_entry[I_MAJOR]) || (reply[S_MINOR] != inv_entry[I_MINOR]) ||
+        (reply[S_FEATURES] != inv_entry[I_FEATURES]) || (reply[S_EXT_FEATURES] != inv_entry[I_EXT_FEATURES]) ||
+        (reply[S_APPL_ADDR_MSB] != inv_entry[I_APPL_ADDR_MSB]) || (reply[S_APPL_ADDR_LSB] != inv_entry[I_APPL_ADDR_LSB])) {
+        *p_updated = true;
+    }
+    return true;
+}
+
+/* _________________________
+  |                         | 
+  |        UploadAll        |
+  |_________________________|
+*/
+// Upload an application to several Timonel devices by interleaving their pages, so that the bus
+// is used to send pages to some devices while the others are writing their flash memory. Returns
+// the number of devices that couldn't be updated, each device error count goes to device_errors[].
+// (Overload A: payload stored in a memory array)
+byte TwiBus::UploadAll(Timonel *devices[], const byte device_count, byte payload[], const int payload_size, byte device_errors[]) {
+    PayloadArrayReader reader(payload, payload_size);
+    return UploadAll(devices, device_count, reader, payload_size, device_errors);
+}
+
+// Overload B: payload read one page at a time. The devices are at different pages while interleaving,
+// so the reader has to be able to go back to any page position.
+byte TwiBus::UploadAll(Timonel *devices[], const byte device_count, PayloadReader &reader, const int payload_size, byte device_errors[]) {
+    if (device_count > MAX_UPLOAD_DEVS) {
+        for (byte i = 0; (i < device_count) && (device_errors != nullptr); i++) {
+            device_errors[i] = ERR_UPLOAD_DEVS;
+        }
+        return device_count;
+    }
+    Timonel::UploadJob jobs[MAX_UPLOAD_DEVS];
+    byte pending_devices = 0;
+    byte failed_devices = 0;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] Uploading %d pages to %d devices ...\n\r", __func__, ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE), device_count);
+#endif /* DEBUG_LEVEL */
+    for (byte i = 0; i < device_count; i++) {
+        // Check that the payload can be uploaded to each device before starting
+        jobs[i] = Timonel::UploadJob(devices[i], MAX_UPLOAD_RETRY);
+        pending_devices += (jobs[i].Begin(reader, payload_size) == OK);
+    }
+    while (pending_devices > 0) {
+        // Each pass sends a page to every device that is ready to receive it
+        pending_devices = 0;
+        for (byte i = 0; i < device_count; i++) {
+            if (!jobs[i].IsFinished()) {
+                jobs[i].Poll();
+                pending_devices += (!jobs[i].IsFinished());
+            }
+        }
+    }
+    for (byte i = 0; i < device_count; i++) {
+        failed_devices += (jobs[i].GetState() != JOB_DONE);
+        if (device_errors != nullptr) {
+            device_errors[i] = ((jobs[i].GetState() == JOB_DONE) ? OK : jobs[i].GetErrors());
+        }
+    }
+    return failed_devices;
+}
+
+/* _________________________
+  |                         | 
+  |      BroadcastAll       |
+  |_________________________|
+*/
+// Upload the same application to several Timonel devices with a single transfer: the pages are sent
+// to the TWI general call address, then each device is verified by reading its flash memory back.
+// The devices that don't support broadcasting or fail the verification are updated one by one with
+// UploadAll. Returns the number of devices that couldn't be updated, each device error count goes to
+// device_errors[]. NOTE: All the devices on the bus that accept general calls receive the broadcast
+// pages, so all of them should be included in devices[]. Up to MAX_UPLOAD_DEVS devices can be updated.
+// (Overload A: payload stored in a memory array)
+byte TwiBus::BroadcastAll(Timonel *devices[], const byte device_count, byte payload[], const int payload_size, byte device_errors[]) {
+    PayloadArrayReader reader(payload, payload_size);
+    return BroadcastAll(devices, device_count, reader, payload_size, device_errors);
+}
+
+// Overload B: payload read one page at a time. The payload is read again by the verification and fallback
+// passes, so the reader has to be able to go back to any page position.
+byte TwiBus::BroadcastAll(Timonel *devices[], const byte device_count, PayloadReader &reader, const int payload_size, byte device_errors[]) {
+    if (device_count > MAX_UPLOAD_DEVS) {
+        for (byte i = 0; (i < device_count) && (device_errors != nullptr); i++) {
+            device_errors[i] = ERR_UPLOAD_DEVS;
+        }
+        return device_count;
+    }
+    bool on_broadcast[MAX_UPLOAD_DEVS];
+    byte broadcast_count = 0;
+    byte packet_size = MST_PACKET_LARGE; /* The broadcast packets have to be accepted by all the devices */
+    bool use_crc = false;                /* All the devices have to use the same packet check: CRC16 or 8-bit sum */
+    for (byte i = 0; i < device_count; i++) {
+        on_broadcast[i] = false;
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+        // Broadcasting requires general calls, automatic page addressing and reading the flash back
+        Timonel::Status sts = devices[i]->GetStatus();
+        on_broadcast[i] = (((sts.ext_features_code >> F_CMD_GENCALL) & true) &&
+                           ((sts.features_code >> F_AUTO_PAGE_ADDR) & true) &&
+                           ((sts.features_code >> F_CMD_READFLASH) & true) &&
+                           (devices[i]->CheckUpload(payload_size) == OK));
+        if (on_broadcast[i]) {
+            bool device_crc = ((sts.ext_features_code >> F_USE_CRC16) & true);
+            if (broadcast_count == 0) {
+                use_crc = device_crc; /* The first device sets the packet check for the broadcast */
+            }
+            on_broadcast[i] = (device_crc == use_crc);
+        }
+        broadcast_count += on_broadcast[i];
+        if (on_broadcast[i] && (sts.mst_packet_size < packet_size)) {
+            packet_size = sts.mst_packet_size;
+        }
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+    }
+    if (broadcast_count > 0) {
+        const word page_count = ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("\n\r[%s] Broadcasting %d pages to %d devices ...\n\r", __func__, page_count, broadcast_count);
+#endif /* DEBUG_LEVEL */
+        byte twi_cmd_arr[1] = {DELFLASH};
+        bool broadcast_ok = (BroadcastCmd(twi_cmd_arr, 1) == OK);
+        for (byte i = 0; i < device_count; i++) {
+            if (on_broadcast[i] && ((!broadcast_ok) || (devices[i]->WaitForRestart() != OK))) {
+                on_broadcast[i] = false;
+            }
+        }
+        for (word page_ix = 0; (page_ix < page_count) && broadcast_ok; page_ix++) {
+            broadcast_ok = (BroadcastPage(reader, payload_size, page_ix, packet_size, use_crc) == OK);
+            for (byte i = 0; i < device_count; i++) {
+                // When a packet completes a page, Timonel doesn't acknowledge its address until the page is written
+                if (on_broadcast[i] && ((!broadcast_ok) || (devices[i]->WaitForReady(TMO_FLASH_PG) != OK))) {
+                    on_broadcast[i] = false;
+                }
+            }
+        }
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+        // Verification pass: each device flash memory has to match the payload
+        for (byte i = 0; i < device_count; i++) {
+            if (on_broadcast[i] && (devices[i]->VerifyApplication(reader, payload_size) != OK)) {
+                on_broadcast[i] = false;
+            }
+            if (on_broadcast[i]) {
+                devices[i]->RefreshStatus(); /* The broadcast pages don't go through the device object */
+            }
+        }
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+    }
+    // Devices left out of the broadcast or that failed the verification are updated individually
+    Timonel *fallback_devices[MAX_UPLOAD_DEVS];
+    byte fallback_errors[MAX_UPLOAD_DEVS];
+    byte fallback_count = 0;
+    for (byte i = 0; i < device_count; i++) {
+        if (!on_broadcast[i]) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P("[%s] Device %02d not updated by broadcast, uploading to it individually ...\n\r", __func__, devices[i]->GetTwiAddress());
+#endif /* DEBUG_LEVEL */
+            devices[i]->DeleteApplication(); /* Clear any partial broadcast upload */
+            fallback_devices[fallback_count++] = devices[i];
+        }
+    }
+    byte failed_devices = 0;
+    if ((fallback_count > 0) && (fallback_count <= MAX_UPLOAD_DEVS)) {
+        failed_devices = UploadAll(fallback_devices, fallback_count, reader, payload_size, fallback_errors);
+    }
+    if (device_errors != nullptr) {
+        for (byte i = 0, j = 0; i < device_count; i++) {
+            device_errors[i] = (on_broadcast[i] ? OK : fallback_errors[j++]);
+        }
+    }
+    return failed_devices;
+}
+
+/* _________________________
+  |                         | 
+  |      BroadcastCmd       |
+  |_________________________|
+*/
+// Send a command to the TWI general call address (no reply can be read back from the devices)
+byte TwiBus::BroadcastCmd(byte twi_cmd_arr[], byte cmd_size) {
+    SetWireClock(p_bus_, TWI_CLK_DEFAULT); /* Broadcasts have to reach every device, including the ones on slow segments */
+    wire_.beginTransmission(GEN_CALL_ADDR);
+    byte bytes_written = wire_.write(twi_cmd_arr, cmd_size);
+    if ((wire_.endTransmission() != 0) || (bytes_written != cmd_size)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Error broadcasting 0x%02X command, no device acknowledged it\n\r", __func__, twi_cmd_arr[0]);
+#endif                       /* DEBUG_LEVEL */
+        return ERR_CMD_XMIT; /* Error: the command transmission failed */
+    }
+    return OK;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+////////////              TwiBus internal functions              ////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// Function BroadcastPage (Sends a payload memory page to the general call address, padding it with 0xFF)
+byte TwiBus::BroadcastPage(PayloadReader &reader, const int payload_size, const word page_ix, const byte packet_size, const bool use_crc) {
+    const byte cmd_size = packet_size + (use_crc ? 3 : 2);
+    byte twi_cmd_arr[MST_PACKET_LARGE + 3];
+    byte page_data[SPM_PAGESIZE];
+    byte twi_errors = Timonel::ReadPage(reader, payload_size, page_ix, page_data);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    byte data_ix = 0;
+    for (byte packet = 0; packet < (SPM_PAGESIZE / packet_size); packet++) {
+        byte checksum = 0;
+        word crc = CRC16_INIT;
+        twi_cmd_arr[0] = WRITPAGE;
+        for (byte i = 1; i < packet_size + 1; i++) {
+            twi_cmd_arr[i] = page_data[data_ix++];
+            checksum += (byte)twi_cmd_arr[i]; /* Data checksum accumulator (mod 256) */
+            crc = Timonel::UpdateCrc16(crc, twi_cmd_arr[i]);
+        }
+        if (use_crc) {
+            twi_cmd_arr[cmd_size - 2] = (byte)(crc >> 8); /* CRC16 MSB first */
+            twi_cmd_arr[cmd_size - 1] = (byte)(crc & 0xFF);
+        } else {
+            twi_cmd_arr[cmd_size - 1] = checksum;
+        }
+        twi_errors = BroadcastCmd(twi_cmd_arr, cmd_size);
+        if (twi_errors != OK) {
+            return twi_errors;
+        }
+    }
+    return OK;
+}
+
 #else
 #pragma GCC warning "TwiBus device discovery functions code included in TWI master!"
 #endif /* MULTI_DEVICE */
\ No newline at end of file
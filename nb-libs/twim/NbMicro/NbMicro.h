@@ -18,7 +18,6 @@
 #ifndef _NBMICRO_H_
 #define _NBMICRO_H_
 
-#include <unordered_set>
 #include "../../cmd/nb-twi-cmd.h"
 #include "Arduino.h"
 #include "Wire.h"
@@ -27,8 +26,7 @@
 
 typedef uint8_t byte;
 
-// Store of TWI addresses in use ...
-static std::unordered_set<byte> active_addresses;
+struct twi_bus_state_; /* Per-bus addresses in use and clocks, defined in NbMicro.cpp */
 
 /* 
  * ===================================================================
@@ -39,40 +37,121 @@ static std::unordered_set<byte> active_addresses;
 class NbMicro {
    public:
     NbMicro(byte twi_address = 0, byte sda = 0, byte scl = 0);
+    NbMicro(TwoWire &wire, byte twi_address = 0, byte sda = 0, byte scl = 0);
     ~NbMicro();
+    typedef struct nb_stats_ {
+        unsigned long transactions = 0;            /* TWI transactions: command writes, reply reads and address polls */
+        unsigned long bytes_sent = 0;              /* Command bytes acknowledged by the device */
+        unsigned long bytes_received = 0;          /* Reply bytes received from the device */
+        unsigned long nacks = 0;                   /* Command writes not acknowledged and short replies */
+        unsigned long busy_polls = 0;              /* Address polls not acknowledged because the device was busy */
+        unsigned long check_errors = 0;            /* Data packets with checksum or CRC16 mismatches */
+        unsigned long retries = 0;                 /* Packets or uploads sent again after errors */
+        unsigned long bus_time_us = 0;             /* Time spent in TWI transactions (us) */
+        unsigned long delay_time_us = 0;           /* Time spent in delays between transactions (us) */
+        unsigned long phase_start_us[PH_COUNT] = {0}; /* Last start timestamp of each phase: PH_INIT ... PH_VERIFY (us) */
+        unsigned long phase_time_us[PH_COUNT] = {0};  /* Last duration of each phase (us) */
+    } Stats;
+    Stats GetStats(void);
+    void ResetStats(void);
     byte GetTwiAddress(void);
     byte SetTwiAddress(byte twi_address);
     byte TwiCmdXmit(byte twi_cmd, byte twi_reply,
                     byte twi_reply_arr[] = nullptr, byte reply_size = 0);
     byte TwiCmdXmit(byte twi_cmd_arr[], byte cmd_size, byte twi_reply,
                     byte twi_reply_arr[] = nullptr, byte reply_size = 0);
+    byte TwiCmdSend(const byte twi_cmd_arr[], const byte cmd_size);
+    byte WaitForReady(const word timeout);
+    byte SetBusClock(const uint32_t clock_hz);
+    uint32_t GetBusClock(void);
+    byte ReadBuffer(byte dst[], const word len, word *p_read = nullptr);
+    byte WriteBuffer(const byte src[], const word len);
 
    protected:
     byte InitMicro(void);
+    void TimedDelay(const unsigned long ms);
+    void BeginPhase(const byte phase);
+    void EndPhase(const byte phase);
+    TwoWire &wire_; /* TWI bus of this device */
     byte addr_ = 0, sda_ = 0, scl_ = 0;
     bool reusing_twi_connection_ = true;
+    Stats stats_; /* Bus counters and phase timings of this instance */
+    byte buf_seq_ = 0; /* Last READBUFF or WRITBUFF frame sequence number */
 
    private:
+    struct twi_bus_state_ *p_bus_ = nullptr;
+    byte ReserveTwiAddress(const byte twi_address);
+    void SelectBusClock(void);
+    void CountReply(const byte reply_length,
+                    const byte reply_size,
+                    const unsigned long bus_time);
 };
 
 #if ((defined MULTI_DEVICE) && (MULTI_DEVICE == true))
+class Timonel;
+class PayloadReader;
+
+// Class InventoryStore: Persistent storage for the TwiBus device inventory (e.g. a file in the ESP8266 flash filesystem)
+class InventoryStore {
+   public:
+    virtual ~InventoryStore() {}
+    // Copy up to "size" bytes of the stored inventory to "data", returns the bytes copied (0 if there is none)
+    virtual int Load(byte data[], const int size) = 0;
+    // Replace the stored inventory with "size" bytes from "data", returns false if it couldn't be written
+    virtual bool Save(const byte data[], const int size) = 0;
+};
+
 // Class TwiBus: Represents a Two Wire Interfase (I2C) bus
 class TwiBus {
    public:
     typedef struct device_info_ {
         byte addr = 0;
-        String firmware = "";
+        const char *firmware = ""; /* Points to a firmware literal (L_TIMONEL, L_APP, L_UNKNOWN) */
         byte version_major = 0;
         byte version_minor = 0;
     } DeviceInfo;
+    typedef struct device_entry_ {
+        byte addr = 0;
+        TwoWire *p_wire = &Wire; /* TWI bus where the device was found */
+        byte firmware = FW_UNKNOWN;
+        byte status_reply[DEV_STATUS_SIZE] = {0}; /* Cached Timonel status, reused when creating the Timonel object */
+    } DeviceEntry;
     TwiBus(byte sda = 0, byte scl = 0);
+    TwiBus(TwoWire &wire, byte sda = 0, byte scl = 0);
     ~TwiBus();
     byte ScanBus(bool *p_app_mode = nullptr);
     byte ScanBus(DeviceInfo dev_info_arr[],
                  byte arr_size = HIG_TWI_ADDR + 1,
                  byte start_twi_addr = LOW_TWI_ADDR);
+    byte DiscoverDevices(DeviceEntry dev_table[],
+                         const byte table_size);
+    byte DiscoverDevices(DeviceEntry dev_table[],
+                         const byte table_size,
+                         InventoryStore &store);
+    byte SaveInventory(const DeviceEntry dev_table[],
+                       const byte dev_count,
+                       InventoryStore &store);
+    byte UploadAll(Timonel *devices[], const byte device_count,
+                   byte payload[], const int payload_size,
+                   byte device_errors[] = nullptr);
+    byte UploadAll(Timonel *devices[], const byte device_count,
+                   PayloadReader &reader, const int payload_size,
+                   byte device_errors[] = nullptr);
+    byte BroadcastAll(Timonel *devices[], const byte device_count,
+                      byte payload[], const int payload_size,
+                      byte device_errors[] = nullptr);
+    byte BroadcastAll(Timonel *devices[], const byte device_count,
+                      PayloadReader &reader, const int payload_size,
+                      byte device_errors[] = nullptr);
+    byte BroadcastCmd(byte twi_cmd_arr[], byte cmd_size);
 
    private:
+    bool CheckInventoryEntry(const byte inv_entry[],
+                             DeviceEntry *p_device,
+                             bool *p_updated);
+    byte BroadcastPage(PayloadReader &reader, const int payload_size, const word page_ix, const byte packet_size, const bool use_crc);
+    TwoWire &wire_; /* TWI bus scanned by this object */
+    struct twi_bus_state_ *p_bus_ = nullptr;
     byte sda_ = 0, scl_ = 0;
     bool reusing_twi_connection_ = true;
 };
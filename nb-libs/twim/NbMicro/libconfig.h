@@ -27,6 +27,7 @@
 
 // NbMicro::constructor defs
 #define DLY_NBMICRO 500     /* Delay before canceling NbMiccro object creation (ms) */
+#define MAX_TWI_BUSES 4     /* Max Wire objects (TWI buses) with devices at the same time */
 // End NbMicro::constructor defs
 
 // NbMicro::SetTwiAddress defs
@@ -35,10 +36,39 @@
 
 // NbMicro::TwiCmdXmit defs
 #define STOP_ON_REQ true    /* Config: true=master releases the bus with "stop" after a request, false=sends restart */
+#define BURST_XMIT true     /* Config: true=multibyte commands are sent in a single transaction, false=one per byte */
 #define ERR_CMD_PARSE_S 1   /* Error: reply doesn't match command (single byte) */
 #define ERR_CMD_PARSE_M 2   /* Error: reply doesn't match command (multi byte) */
+#define ERR_CMD_XMIT 3      /* Error: the slave didn't acknowledge the command transmission */
 // End NbMicro::TwiCmdXmit defs
 
+// NbMicro::GetStats defs
+#define PH_INIT 0           /* Phase: bootloader initialization */
+#define PH_ERASE 1          /* Phase: application deletion (erase and restart) */
+#define PH_UPLOAD 2         /* Phase: application upload */
+#define PH_VERIFY 3         /* Phase: application verification */
+#define PH_COUNT 4          /* Phases timed by the instances' statistics */
+// End NbMicro::GetStats defs
+
+// NbMicro::SetBusClock defs
+#define TWI_CLK_DEFAULT 100000 /* TWI clock set by Wire.begin(), used with the devices without a negotiated one (Hz) */
+#define ERR_NOT_TRACKED 1   /* Error: the address is out of the slave range, its clock can't be remembered */
+// End NbMicro::SetBusClock defs
+
+// NbMicro::ReadBuffer defs
+#define BUF_FRAME_SIZE 24   /* Max data bytes per READBUFF or WRITBUFF frame (TWIS_BUFF_FRAME on the device) */
+#define BUF_START_FLAG 0x80 /* Frame count byte flag: first frame of a transfer, the device doesn't take it as a retry */
+#define BUF_CHECK_ERR 0xFF  /* WRITBUFF reply accepted count: the frame failed the device checksum */
+#define MAX_BUF_RETRY 3     /* Max attempts per READBUFF or WRITBUFF frame */
+#define ERR_BUF_XMIT 1      /* Error: a frame couldn't be transferred after MAX_BUF_RETRY attempts */
+#define ERR_BUF_FULL 2      /* Error: the device didn't accept more data after MAX_BUF_RETRY attempts */
+// End NbMicro::ReadBuffer defs
+
+// NbMicro::WaitForReady defs
+#define DLY_READY_POLL 1    /* Delay between TWI address polls while the device is busy (ms) */
+#define ERR_NOT_READY 1     /* Error: the device didn't acknowledge its address before the timeout */
+// End NbMicro::WaitForReady defs
+
 // TwiBus::ScanBus defs
 #define DLY_SCAN_BUS 1      /* TWI scanner pass delay */
 #define L_TIMONEL "Timonel" /* Literal: Timonel */
@@ -46,6 +76,41 @@
 #define L_APP "Application" /* Literal: Application */
 //  End TwiBus::ScanBus defs
 
+// TwiBus::DiscoverDevices defs
+#define FW_UNKNOWN 0        /* Discovered firmware: unknown device at a bootloader address */
+#define FW_TIMONEL 1        /* Discovered firmware: Timonel bootloader */
+#define FW_APP 2            /* Discovered firmware: application */
+#define DEV_STATUS_SIZE 16  /* Timonel status (GETTMNLV reply) bytes cached per device */
+// End TwiBus::DiscoverDevices defs
+
+// TwiBus::SaveInventory defs
+#define INV_SIGNATURE 0x4E  /* Inventory signature "N" */
+#define INV_VERSION 1       /* Inventory layout version, an inventory saved with another one is discarded */
+#define INV_HEADER_SIZE 4   /* Inventory header: signature, version, entry count and entries checksum (8-bit sum) */
+#define INV_ENTRY_SIZE 12   /* Inventory entry: address, firmware, version (2), features (2), app start (2), clock (4) */
+#define INV_MAX_ENTRIES (HIG_TWI_ADDR - LOW_TWI_ADDR + 1) /* Max devices kept in the inventory */
+#define I_ADDR 0            /* Inventory entry: TWI address byte position */
+#define I_FIRMWARE 1        /* Inventory entry: firmware (FW_UNKNOWN, FW_TIMONEL or FW_APP) byte position */
+#define I_MAJOR 2           /* Inventory entry: Timonel major number byte position */
+#define I_MINOR 3           /* Inventory entry: Timonel minor number byte position */
+#define I_FEATURES 4        /* Inventory entry: Timonel features code byte position */
+#define I_EXT_FEATURES 5    /* Inventory entry: Timonel extended features code byte position */
+#define I_APPL_ADDR_MSB 6   /* Inventory entry: application address (trampoline jump) MSB position */
+#define I_APPL_ADDR_LSB 7   /* Inventory entry: application address (trampoline jump) LSB position */
+#define I_CLOCK 8           /* Inventory entry: TWI clock remembered for the address, 4 bytes MSB first (0 = default) */
+#define ERR_INV_SAVE 1      /* Error: the inventory store couldn't save the inventory */
+// End TwiBus::SaveInventory defs
+
+// TwiBus::UploadAll defs
+#define MAX_UPLOAD_RETRY 2  /* Max upload restarts per device after an error */
+#define MAX_UPLOAD_DEVS (HIG_TML_ADDR - LOW_TML_ADDR + 1) /* Max devices per upload: one per Timonel address */
+#define ERR_UPLOAD_DEVS 1   /* Error: more devices than MAX_UPLOAD_DEVS were given, none of them was updated */
+// End TwiBus::UploadAll defs
+
+// TwiBus::BroadcastAll defs
+#define GEN_CALL_ADDR 0     /* TWI general call address: commands sent to it reach all the devices that accept it */
+// End TwiBus::BroadcastAll defs
+
 
 
 /////////////////////////////////////////////////////////////////////////////
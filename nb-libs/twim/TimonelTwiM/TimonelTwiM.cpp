@@ -15,8 +15,16 @@
 
 #include "TimonelTwiM.h"
 
-// Class constructor
-Timonel::Timonel(const byte twi_address, const byte sda, const byte scl) : NbMicro(twi_address, sda, scl) {
+#if ((defined BUFFER_LENGTH) && (BUFFER_LENGTH < (MST_PACKET_LARGE + 2)))
+#error "The Wire library buffer can't hold a full-page WRITPAGE command, please set MST_PACKET_LARGE to 32 in libconfig.h"
+#endif /* BUFFER_LENGTH */
+
+// Class constructor (on the default Wire bus)
+Timonel::Timonel(const byte twi_address, const byte sda, const byte scl) : Timonel(Wire, twi_address, sda, scl) {
+}
+
+// Class constructor (on a given Wire bus)
+Timonel::Timonel(TwoWire &wire, const byte twi_address, const byte sda, const byte scl) : NbMicro(wire, twi_address, sda, scl) {
     if ((addr_ >= LOW_TML_ADDR) && (addr_ <= HIG_TML_ADDR)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Bootloader instance created with TWI address %02d.\r\n", __func__, addr_);
@@ -29,6 +37,21 @@ Timonel::Timonel(const byte twi_address, const byte sda, const byte scl) : NbMic
     }
 }
 
+#if ((defined MULTI_DEVICE) && (MULTI_DEVICE == true))
+// Class constructor (from a TwiBus::DiscoverDevices table entry: its cached status avoids querying the device again)
+Timonel::Timonel(const TwiBus::DeviceEntry &device) : NbMicro(*device.p_wire, device.addr) {
+    static_assert(DEV_STATUS_SIZE == S_REPLY_LENGTH, "The device status cache must hold a whole GETTMNLV reply");
+    if ((device.firmware == FW_TIMONEL) && (ParseStatus(device.status_reply) == OK)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Bootloader instance created with TWI address %02d (cached status).\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        BootloaderInit(true);
+    } else {
+        BootloaderInit();
+    }
+}
+#endif /* MULTI_DEVICE */
+
 // Class destructor
 Timonel::~Timonel() {
     // Destructor
@@ -39,18 +62,32 @@ Timonel::~Timonel() {
   |        GetStatus        |
   |_________________________|
 */
-// Return a struct with the Timonel bootloader running status
+// Return a struct with the Timonel bootloader running status (cached, the device is queried
+// only if a command that changes its status was sent after the last reading)
 Timonel::Status Timonel::GetStatus(void) {
+    if (!status_valid_) {
+        RefreshStatus();
+    }
+    return status_;
+}
+
+/* _________________________
+  |                         | 
+  |      RefreshStatus      |
+  |_________________________|
+*/
+// Read the Timonel bootloader running status from the device, updating the cached one
+byte Timonel::RefreshStatus(void) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
     USE_SERIAL.printf_P("[%s] Getting Timonel device %02d status ...\r\n", __func__, addr_);
     byte twi_errors = QueryStatus();
     if (twi_errors > 0) {
         USE_SERIAL.printf_P("[%s] Error getting Timonel %02d status <<< %d \r\n", __func__, addr_, twi_errors);
     }
+    return twi_errors;
 #else
-    QueryStatus();
+    return QueryStatus();
 #endif /* DEBUG_LEVEL */
-    return status_;
 }
 
 /* _________________________
@@ -71,7 +108,61 @@ byte Timonel::SetTwiAddress(byte twi_address) {
         USE_SERIAL.printf_P("[%s] Error getting Timonel %02d status <<< %d \r\n", __func__, addr_, twi_errors);
     }
 #endif /* DEBUG_LEVEL */
-    QueryStatus();
+    return twi_errors;
+}
+
+/* _________________________
+  |                         | 
+  |     NegotiateClock      |
+  |_________________________|
+*/
+// Find the fastest TWI clock this device works with, up to "max_clock": each step is tested with status and
+// CRC16 readings compared to the ones at the default clock, the first step with errors falls back to the last
+// good one. The clock found is remembered for this device address and used in all its transactions.
+byte Timonel::NegotiateClock(const uint32_t max_clock) {
+    static const uint32_t clock_steps[] = {TWI_CLK_DEFAULT, CLK_STEP_FAST, CLK_STEP_FAST_2, CLK_STEP_MAX};
+    const bool use_crc = ((status_.ext_features_code >> F_USE_CRC16) & true);
+    byte ref_status[S_REPLY_LENGTH] = {0}; /* Reference readings at the default clock */
+    word ref_crc = 0;
+    SetBusClock(TWI_CLK_DEFAULT);
+    byte twi_errors = TwiCmdXmit(GETTMNLV, ACKTMNLV, ref_status, S_REPLY_LENGTH);
+    if (use_crc && (twi_errors == OK)) {
+        twi_errors = GetFlashCrc(status_.bootloader_start, CLK_TEST_CRC, &ref_crc);
+    }
+    if (twi_errors != OK) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Timonel device %02d doesn't work at the default clock (%d) ...\r\n", __func__, addr_, twi_errors);
+#endif /* DEBUG_LEVEL */
+        return twi_errors;
+    }
+    uint32_t best_clock = TWI_CLK_DEFAULT;
+    for (byte step = 1; (step < (sizeof(clock_steps) / sizeof(clock_steps[0]))) && (clock_steps[step] <= max_clock); step++) {
+        SetBusClock(clock_steps[step]);
+        byte step_errors = 0;
+        for (byte i = 0; i < CLK_TEST_COUNT; i++) {
+            byte twi_reply_arr[S_REPLY_LENGTH] = {0};
+            if ((TwiCmdXmit(GETTMNLV, ACKTMNLV, twi_reply_arr, S_REPLY_LENGTH) != OK) || (memcmp(twi_reply_arr, ref_status, S_REPLY_LENGTH) != 0)) {
+                step_errors++;
+            }
+            word crc = 0;
+            if (use_crc && ((GetFlashCrc(status_.bootloader_start, CLK_TEST_CRC, &crc) != OK) || (crc != ref_crc))) {
+                step_errors++;
+            }
+        }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Timonel device %02d at %lu Hz: %d errors in %d tests\r\n", __func__, addr_, clock_steps[step], step_errors, CLK_TEST_COUNT);
+#endif /* DEBUG_LEVEL */
+        if (step_errors > 0) {
+            break;
+        }
+        best_clock = clock_steps[step];
+    }
+    SetBusClock(best_clock);
+    // A failed step could leave the device busy, e.g. calculating a CRC16, wait for it at the clock chosen
+    twi_errors = WaitForReady(TMO_FLASH_PG);
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("[%s] Timonel device %02d TWI clock set to %lu Hz\r\n", __func__, addr_, best_clock);
+#endif /* DEBUG_LEVEL */
     return twi_errors;
 }
 
@@ -85,6 +176,7 @@ byte Timonel::RunApplication(void) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
     USE_SERIAL.printf_P("\n\r[%s] Exit bootloader & run application >>> 0x%02X\r\n", __func__, EXITTMNL);
 #endif /* DEBUG_LEVEL */
+    status_valid_ = false;
     return (TwiCmdXmit(EXITTMNL, ACKEXITT));
 }
 
@@ -93,47 +185,640 @@ byte Timonel::RunApplication(void) {
   |    DeleteApplication    |
   |_________________________|
 */
-// Ask Timonel to delete the user application
+// Ask Timonel to delete the user application. DELFLASH is sent again after errors, up to MAX_DEL_RETRY times:
+// when only its reply was lost, the application is already deleted and deleting it again is harmless.
 byte Timonel::DeleteApplication(void) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
     USE_SERIAL.printf_P("\n\r[%s] Delete Flash Memory >>> 0x%02X\r\n", __func__, DELFLASH);
 #endif /* DEBUG_LEVEL */
+    status_valid_ = false;
+    BeginPhase(PH_ERASE);
     byte twi_errors = TwiCmdXmit(DELFLASH, ACKDELFL);
-    delay(DLY_DEL_INIT);    /* Long delay (~750 ms) to allow complete erasing before trying to initialize */
-    twi_errors += BootloaderInit();
+    twi_errors += WaitForRestart();
+    for (byte retry = 0; (twi_errors != OK) && (retry < MAX_DEL_RETRY); retry++) {
+        stats_.retries++;
+        twi_errors = TwiCmdXmit(DELFLASH, ACKDELFL);
+        twi_errors += WaitForRestart();
+    }
+    EndPhase(PH_ERASE);
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
     if (twi_errors > 0) {
         USE_SERIAL.printf_P("\n\n\r###################################################\n\r");
         USE_SERIAL.printf_P("# [%s] # WARNING !!!\n\r# Timonel couldn't be initialized after delete!\n\r", __func__);
         USE_SERIAL.printf_P("# Maybe it's taking too long to delete the memory,\n\r");
-        USE_SERIAL.printf_P("# try increasing delay(DLY_DEL_INIT) ...\n\r");
+        USE_SERIAL.printf_P("# try increasing TMO_DEL_INIT ...\n\r");
         USE_SERIAL.printf_P("###################################################\n\n\r");
     }
 #endif /* DEBUG_LEVEL */
     return twi_errors;
 }
 
+/* _________________________
+  |                         | 
+  |     WaitForRestart      |
+  |_________________________|
+*/
+// Wait until Timonel restarts after deleting the application, then initialize it again
+byte Timonel::WaitForRestart(void) {
+    byte twi_errors = WaitForReady(TMO_DEL_INIT); /* Timonel doesn't acknowledge its address until erased and restarted */
+    twi_errors += BootloaderInit();
+    return twi_errors;
+}
+
+/* _________________________
+  |                         | 
+  |     EnterBootloader     |
+  |_________________________|
+*/
+// Ask the application running on this device to reboot into Timonel and initialize the bootloader. With BOOTTMNL,
+// Timonel waits for the master after the reboot. Applications that don't know it are restarted with RESETMCU, then
+// Timonel has to be initialized before its exit timeout. If the application doesn't answer, Timonel may be running.
+byte Timonel::EnterBootloader(const byte app_twi_address) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] Reboot application %02d into Timonel %02d >>> 0x%02X\r\n", __func__, app_twi_address, addr_, BOOTTMNL);
+#endif /* DEBUG_LEVEL */
+    status_valid_ = false;
+    if ((AppCmdXmit(app_twi_address, BOOTTMNL, ACKBOOTT) != OK) &&
+        (AppCmdXmit(app_twi_address, RESETMCU, ACKRESET) != OK)) {
+        if (BootloaderInit() == OK) {
+            return OK; /* Timonel was already running */
+        }
+        return ERR_APP_REBOOT;
+    }
+    return WaitForRestart();
+}
+
+/* _________________________
+  |                         | 
+  |    UpdateApplication    |
+  |_________________________|
+*/
+// Replace the application running on this device: reboot into Timonel, delete the old application, upload
+// the new one and run it. The whole cycle is made over TWI, without power cycling the device.
+byte Timonel::UpdateApplication(const byte app_twi_address, byte payload[], int payload_size) {
+    byte twi_errors = EnterBootloader(app_twi_address);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    twi_errors = DeleteApplication();
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    twi_errors = UploadApplication(payload, payload_size);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    return RunApplication();
+}
+
+/* _________________________
+  |                         | 
+  |    UpdateBootloader     |
+  |_________________________|
+*/
+// Replace Timonel with a new bootloader image over TWI, without the timonel-updater application: the update stub
+// (apps/tml-update-stub) is uploaded and run as a regular application, then the new bootloader is sent to it page
+// by page with the Timonel framing (STPGADDR + WRITPAGE packets, with the packet check reported by Timonel: 8-bit
+// sum or CRC16). The stub stages it above itself and copies it over the bootloader only when it's fully received
+// and its CRC16 matches. Afterward, the new bootloader is initialized if it uses this object's TWI address.
+// NOTE: The device is left without an application.
+byte Timonel::UpdateBootloader(byte stub_payload[], int stub_size, const byte stub_twi_address,
+                               const byte bootloader[], const int bootloader_size, const word bootloader_start) {
+    byte twi_errors = DeleteApplication();
+    if (twi_errors == OK) {
+        twi_errors = UploadApplication(stub_payload, stub_size);
+    }
+    if (twi_errors == OK) {
+        twi_errors = RunApplication();
+    }
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    return ResumeBootloaderUpdate(stub_twi_address, bootloader, bootloader_size, bootloader_start);
+}
+
+/* _________________________
+  |                         |
+  | ResumeBootloaderUpdate  |
+  |_________________________|
+*/
+// Send the new bootloader to an update stub that is already running and install it. UpdateBootloader calls it
+// after starting the stub, and it also recovers a device whose power was lost while the stub was installing
+// the bootloader: the stub starts again from the reset vector, with the same staging area, instead of Timonel.
+byte Timonel::ResumeBootloaderUpdate(const byte stub_twi_address, const byte bootloader[], const int bootloader_size, const word bootloader_start) {
+    if (WaitForApp(stub_twi_address, TMO_STUB_START) != OK) {
+        return ERR_UPD_STUB;
+    }
+    BeginPhase(PH_UPLOAD);
+    word crc = CRC16_INIT;
+    for (word page_offset = 0; page_offset < bootloader_size; page_offset += SPM_PAGESIZE) {
+        byte page_errors = SendStubPage(stub_twi_address, bootloader, bootloader_size, page_offset);
+        for (byte retry = 0; (page_errors != OK) && (retry < MAX_PKT_RETRY); retry++) {
+            stats_.retries++;
+            WaitForApp(stub_twi_address, TMO_FLASH_PG); /* The failed packet could have completed the page */
+            page_errors = SendStubPage(stub_twi_address, bootloader, bootloader_size, page_offset);
+        }
+        if (page_errors != OK) {
+            EndPhase(PH_UPLOAD);
+            return ERR_UPD_PAGE;
+        }
+    }
+    EndPhase(PH_UPLOAD);
+    for (int i = 0; i < bootloader_size; i++) {
+        crc = UpdateCrc16(crc, bootloader[i]);
+    }
+    // The staged image is checked before asking the stub to install it, the stub checks it again before copying it
+    byte crc_cmd[G_CMD_LENGTH] = {GETCRC, 0, 0, 0, 0};
+    byte crc_reply[G_REPLY_LENGTH] = {0};
+    crc_cmd[3] = ((bootloader_size & 0xFF00) >> 8); /* Staged image size MSB (the offset is always 0) */
+    crc_cmd[4] = (bootloader_size & 0xFF);          /* Staged image size LSB */
+    if ((AppCmdXmit(stub_twi_address, crc_cmd, G_CMD_LENGTH, ACKGTCRC, crc_reply, 2) != OK) ||
+        (crc_reply[1] != (byte)(crc_cmd[1] + crc_cmd[2] + crc_cmd[3] + crc_cmd[4])) ||
+        (WaitForApp(stub_twi_address, TMO_STUB_CRC) != OK) ||
+        (AppCmdXmit(stub_twi_address, crc_cmd, 1, ACKGTCRC, crc_reply, G_REPLY_LENGTH) != OK) ||
+        (((crc_reply[1] << 8) | crc_reply[2]) != crc)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] The staged bootloader CRC16 doesn't match: 0x%04X <<< 0x%02X%02X\r\n", __func__, crc, crc_reply[1], crc_reply[2]);
+#endif /* DEBUG_LEVEL */
+        return ERR_UPD_CRC;
+    }
+    byte install_cmd[I_CMD_LENGTH] = {INSTTMNL, 0, 0, 0, 0, 0, 0};
+    byte install_reply[I_REPLY_LENGTH] = {0};
+    install_cmd[1] = ((bootloader_start & 0xFF00) >> 8); /* New bootloader start address MSB */
+    install_cmd[2] = (bootloader_start & 0xFF);          /* New bootloader start address LSB */
+    install_cmd[3] = ((bootloader_size & 0xFF00) >> 8);  /* New bootloader size MSB */
+    install_cmd[4] = (bootloader_size & 0xFF);           /* New bootloader size LSB */
+    install_cmd[5] = ((crc & 0xFF00) >> 8);              /* New bootloader CRC16 MSB */
+    install_cmd[6] = (crc & 0xFF);                       /* New bootloader CRC16 LSB */
+    const byte install_errors = AppCmdXmit(stub_twi_address, install_cmd, I_CMD_LENGTH, ACKINSTT, install_reply, I_REPLY_LENGTH);
+    if ((install_errors == OK) && (install_reply[1] != OK)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] The update stub rejected the install <<< Status = %d\r\n", __func__, install_reply[1]);
+#endif /* DEBUG_LEVEL */
+        return ERR_UPD_INSTALL;
+    }
+    // The stub copies the new bootloader and restarts the device with the watchdog. A lost reply doesn't mean that
+    // the command was lost: the install has failed only if the new bootloader doesn't start.
+    status_valid_ = false;
+    const byte twi_errors = WaitForRestart();
+    if ((twi_errors != OK) && (install_errors != OK)) {
+        return ERR_UPD_INSTALL;
+    }
+    return twi_errors;
+}
+
+// Function SendStubPage (Sends a bootloader page to the update stub, padded with 0xFF after the image end)
+byte Timonel::SendStubPage(const byte stub_twi_address, const byte bootloader[], const int bootloader_size, const word page_offset) {
+    static_assert(((UPD_PACKET_SIZE % 2) == 0) && (UPD_PACKET_SIZE <= MST_PACKET_LARGE), "UPD_PACKET_SIZE must be even and not bigger than MST_PACKET_LARGE");
+    byte addr_cmd[P_CMD_LENGTH] = {STPGADDR, 0, 0, 0};
+    byte addr_reply[P_REPLY_LENGTH] = {0};
+    addr_cmd[1] = ((page_offset & 0xFF00) >> 8);        /* Staging page offset MSB */
+    addr_cmd[2] = (page_offset & 0xFF);                 /* Staging page offset LSB */
+    addr_cmd[3] = (byte)(addr_cmd[1] + addr_cmd[2]);    /* Checksum */
+    if ((AppCmdXmit(stub_twi_address, addr_cmd, P_CMD_LENGTH, AKPGADDR, addr_reply, P_REPLY_LENGTH) != OK) ||
+        (addr_reply[1] != addr_cmd[3])) {
+        return ERR_CMD_PARSE_M;
+    }
+    // The data packets are checked as Timonel checks them, 8-bit sum or CRC16, the stub accepts both
+    for (byte packet_ix = 0; packet_ix < SPM_PAGESIZE; packet_ix += UPD_PACKET_SIZE) {
+        byte packet[UPD_PACKET_SIZE];
+        for (byte i = 0; i < UPD_PACKET_SIZE; i++) {
+            const int data_ix = (page_offset + packet_ix + i);
+            packet[i] = ((data_ix < bootloader_size) ? bootloader[data_ix] : 0xFF);
+        }
+        byte twi_errors = SendPacket(WRITPAGE, ACKWTPAG, packet, UPD_PACKET_SIZE, stub_twi_address);
+        if (twi_errors != OK) {
+            return twi_errors;
+        }
+    }
+    return WaitForApp(stub_twi_address, TMO_FLASH_PG); /* The stub writes the page to its staging area */
+}
+
+// Function AppCmdXmit (Sends a single byte command to the application TWI address and checks its reply)
+byte Timonel::AppCmdXmit(const byte app_twi_address, const byte twi_cmd, const byte twi_reply) {
+    byte twi_reply_arr[1] = {0};
+    return AppCmdXmit(app_twi_address, &twi_cmd, 1, twi_reply, twi_reply_arr, 1);
+}
+
+// Function AppCmdXmit (Sends a command to an application TWI address, then reads its reply and checks the acknowledge)
+byte Timonel::AppCmdXmit(const byte app_twi_address, const byte twi_cmd_arr[], const byte cmd_size,
+                         const byte twi_reply, byte twi_reply_arr[], const byte reply_size) {
+    wire_.beginTransmission(app_twi_address);
+    wire_.write(twi_cmd_arr, cmd_size);
+    stats_.transactions += 2;
+    if (wire_.endTransmission() != 0) {
+        stats_.nacks++;
+        return ERR_CMD_XMIT;
+    }
+    if (wire_.requestFrom(app_twi_address, reply_size, (byte)STOP_ON_REQ) != reply_size) {
+        stats_.nacks++;
+        return ERR_CMD_PARSE_S;
+    }
+    for (byte i = 0; i < reply_size; i++) {
+        twi_reply_arr[i] = wire_.read();
+    }
+    return ((twi_reply_arr[0] == twi_reply) ? OK : ERR_CMD_PARSE_S);
+}
+
+// Function WaitForApp (Polls an application TWI address until it's acknowledged or the timeout expires)
+byte Timonel::WaitForApp(const byte app_twi_address, const word timeout) {
+    unsigned long start_time = millis();
+    for (;;) {
+        wire_.beginTransmission(app_twi_address);
+        stats_.transactions++;
+        if (wire_.endTransmission() == 0) {
+            return OK;
+        }
+        stats_.busy_polls++;
+        if ((millis() - start_time) >= timeout) {
+            return ERR_NOT_READY;
+        }
+        TimedDelay(DLY_READY_POLL);
+    }
+}
+
 /* _________________________
   |                         | 
   |    UploadApplication    |
   |_________________________|
 */
-// Upload an user application to a microcontroller running Timonel
+// Upload an user application to a microcontroller running Timonel (Overload A: payload stored in a memory array)
 byte Timonel::UploadApplication(byte payload[], int payload_size, const int start_address) {
+    PayloadArrayReader reader(payload, payload_size);
+    return UploadApplication(reader, payload_size, start_address);
+}
+
+// Upload an user application to a microcontroller running Timonel (Overload B: payload read one page at a time,
+// so only a memory page has to be buffered, whatever the application size)
+byte Timonel::UploadApplication(PayloadReader &reader, const int payload_size, const int start_address) {
+    byte twi_errors = CheckUpload(payload_size, start_address); /* Upload error counter */
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    return UploadPages(reader, payload_size, start_address, 0, 0);
+}
+
+/* _________________________
+  |                         | 
+  |    ResumeApplication    |
+  |_________________________|
+*/
+// Resume an interrupted application upload from the page position reported by Timonel (Overload A: payload
+// stored in a memory array)
+byte Timonel::ResumeApplication(byte payload[], int payload_size) {
+    PayloadArrayReader reader(payload, payload_size);
+    return ResumeApplication(reader, payload_size);
+}
+
+// Resume an interrupted application upload from the page position reported by Timonel (Overload B: the
+// reader is moved past the payload data already written). It needs PKT_RESYNC and AUTO_PAGE_ADDR, since the
+// page position is kept by Timonel only while it isn't restarted.
+byte Timonel::ResumeApplication(PayloadReader &reader, const int payload_size) {
+    byte twi_errors = RefreshStatus();
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    if ((!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) || (status_.write_page == 0xFF)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] This Timonel device doesn't report its page position, can't resume the upload ...\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+        return ERR_NOT_SUPP;
+    }
+    twi_errors = CheckUpload(payload_size);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    const word first_page = status_.write_page;
+    const word page_count = ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+    if ((first_page > page_count) || ((first_page == page_count) && (status_.write_offset > 0))) {
+        return ERR_PAGE_SYNC; /* Timonel is past the end of this payload, it's not the one being uploaded */
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("[%s] Resuming upload at page %d, offset %d ...\n\r", __func__, first_page + 1, status_.write_offset);
+#endif /* DEBUG_LEVEL */
+    return UploadPages(reader, payload_size, 0, first_page, status_.write_offset);
+}
+
+// Function UploadPages (Application upload loop: sends the reader's pages from "first_page" to the payload end,
+// starting at "page_offset" in the first one). When the WritePage retries run out and Timonel reports its page
+// position (PKT_RESYNC and AUTO_PAGE_ADDR), the application isn't deleted, so the upload can be continued with
+// ResumeApplication. Otherwise, after payload reading errors or a Timonel restart, it's deleted for safety.
+byte Timonel::UploadPages(PayloadReader &reader, const int payload_size, const int start_address, const word first_page, const byte page_offset) {
+    byte twi_errors = 0; /* Upload error counter */
+    BeginPhase(PH_UPLOAD);
+    const word page_count = GetUploadPages(payload_size, start_address); /* Pages to write, including the special ones */
+    byte page_data[SPM_PAGESIZE];                                        /* Payload memory page to be sent to Timonel */
+    word page_number = 0;                                                /* Flash memory page where it goes */
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r");
+#endif /* DEBUG_LEVEL */
     // .....................................
-    // ...... Function initialization ......
+    // ...... Application upload loop ......
     // .....................................
-    byte packet_ix = 0;                         /* TWI (I2C) data packet internal byte index */
-    byte padding = 0;                           /* Padding byte quantity to add to match the page size */
-    byte page_end = 0;                          /* Byte counter to detect the end of flash mem page */
-    byte page_count = 1;                        /* Current page counter */
-    byte twi_errors = 0;                        /* Upload error counter */
-    byte data_packet[MST_PACKET_SIZE] = {0xFF}; /* Payload data packet to be sent to Timonel */
+    for (word page_ix = first_page; page_ix < page_count; page_ix++) {
+        twi_errors += LoadPage(reader, payload_size, start_address, page_ix, page_data, &page_number);
+        const bool page_loaded = (twi_errors == OK);
+        if (page_loaded) {
+            twi_errors += WritePage(page_data, page_number, ((page_ix == first_page) ? page_offset : 0));
+            // When a packet completes a page, Timonel doesn't acknowledge its address until the page is written,
+            // unless it holds the next transaction by clock stretching
+            if (!status_.clock_stretch) {
+                twi_errors += WaitForReady(TMO_FLASH_PG); /* ###### WAIT FOR TIMONEL TO BE READY FOR THE NEXT PAGE ###### */
+            }
+        }
+        if (twi_errors > 0) {
+            EndPhase(PH_UPLOAD);
+            // The page position has to be the failed page or the next one (when only its reply was lost): after a
+            // restart Timonel reports the first page, but the pages already written aren't blank
+            if (page_loaded && ((status_.features_code >> F_AUTO_PAGE_ADDR) & true) && (status_.write_page != 0xFF) &&
+                (RefreshStatus() == OK) && ((status_.write_page == page_ix) || (status_.write_page == (page_ix + 1)))) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-    USE_SERIAL.printf_P("\n\r");
+                USE_SERIAL.printf_P("\n\r[%s] Upload error at page %d, offset %d: it can be resumed with ResumeApplication ...\n\n\r", __func__, status_.write_page + 1, status_.write_offset);
+#endif /* DEBUG_LEVEL */
+                return twi_errors;
+            }
+            // Safety payload deletion due to TWI transmission or payload reading errors, after WritePage retries
+            twi_errors += DeleteApplication();
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P("\n\r[%s] Upload error: safety payload deletion triggered, please RESET TWI master!\n\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+            return twi_errors;
+        }
+    }
+    // .....................................
+    // .......... Upload loop end ..........
+    // .....................................
+    EndPhase(PH_UPLOAD);
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] Application was successfully uploaded to AVR flash memory ...\n\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+    return twi_errors;
+}
+
+/* _________________________
+  |                         | 
+  |        UploadJob        |
+  |_________________________|
+*/
+// Upload job constructor: the job doesn't start until Begin() is called
+Timonel::UploadJob::UploadJob(Timonel *p_device, const byte max_retries) : p_device_(p_device), max_retries_(max_retries) {
+}
+
+// Start a non-blocking application upload, then call Poll() from the main loop until IsFinished() (Overload A:
+// payload stored in a memory array)
+byte Timonel::UploadJob::Begin(const byte payload[], const int payload_size, const int start_address) {
+    array_reader_ = PayloadArrayReader(payload, payload_size);
+    return Begin(array_reader_, payload_size, start_address);
+}
+
+// Start a non-blocking application upload, then call Poll() from the main loop until IsFinished() (Overload B:
+// payload read one page at a time, the reader has to be able to go back to restart the upload after errors)
+byte Timonel::UploadJob::Begin(PayloadReader &reader, const int payload_size, const int start_address) {
+    p_reader_ = &reader;
+    payload_size_ = payload_size;
+    start_address_ = start_address;
+    page_count_ = 0;
+    page_ix_ = 0;
+    retries_ = 0;
+    errors_ = ((p_device_ != nullptr) ? p_device_->CheckUpload(payload_size, start_address) : ERR_NOT_SUPP);
+    state_ = ((errors_ == OK) ? JOB_SEND_PAGE : JOB_FAILED);
+    if (state_ == JOB_SEND_PAGE) {
+        page_count_ = p_device_->GetUploadPages(payload_size, start_address); /* Pages to write, including the special ones */
+        p_device_->BeginPhase(PH_UPLOAD);
+    }
+    return errors_;
+}
+
+// Advance the upload by one step without waiting: send a page or check whether the device is ready.
+// Returns the upload progress (0 to 100 %).
+byte Timonel::UploadJob::Poll(void) {
+    switch (state_) {
+        case JOB_WRITING: {
+            // When a page is complete, Timonel doesn't acknowledge its address until it's written
+            if (p_device_->WaitForReady(0) != OK) { /* Single poll: don't hold the caller waiting for the device */
+                if ((millis() - step_time_) > TMO_FLASH_PG) {
+                    errors_ += ERR_NOT_READY;
+                    Abort();
+                }
+                break;
+            }
+            if (page_ix_ == page_count_) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Device %02d upload complete\n\r", __func__, p_device_->addr_);
+#endif /* DEBUG_LEVEL */
+                p_device_->EndPhase(PH_UPLOAD);
+                state_ = JOB_DONE;
+                break;
+            }
+            state_ = JOB_SEND_PAGE;
+        }
+        // fall through
+        case JOB_SEND_PAGE: {
+            byte twi_errors = p_device_->UploadPage(*p_reader_, payload_size_, page_ix_, start_address_);
+            step_time_ = millis();
+            if (twi_errors == OK) {
+                page_ix_++;
+                state_ = JOB_WRITING;
+            } else {
+                errors_ += twi_errors;
+                Abort();
+            }
+            break;
+        }
+        case JOB_DELETING: {
+            // Timonel doesn't acknowledge its address until the memory is erased and it restarts
+            if (p_device_->WaitForReady(0) != OK) {
+                if ((millis() - step_time_) > TMO_DEL_INIT) {
+                    errors_ += ERR_NOT_READY;
+                    state_ = JOB_FAILED;
+                }
+                break;
+            }
+            p_device_->EndPhase(PH_ERASE);
+            byte twi_errors = p_device_->BootloaderInit();
+            if ((twi_errors == OK) && (retries_ < max_retries_)) {
+                retries_++;
+                p_device_->stats_.retries++;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Device %02d upload error, restarting it (retry %d) ...\n\r", __func__, p_device_->addr_, retries_);
+#endif /* DEBUG_LEVEL */
+                page_ix_ = 0;
+                p_device_->BeginPhase(PH_UPLOAD);
+                state_ = JOB_SEND_PAGE;
+            } else {
+                errors_ += twi_errors;
+                state_ = JOB_FAILED;
+            }
+            break;
+        }
+        default: {
+            // Idle or finished jobs have nothing to do ...
+            break;
+        }
+    }
+    if (state_ == JOB_DONE) {
+        return 100;
+    }
+    return ((page_count_ > 0) ? (byte)(((unsigned long)page_ix_ * 100) / (page_count_ + 1)) : 0);
+}
+
+// Return the upload job state (JOB_IDLE, JOB_SEND_PAGE, JOB_WRITING, JOB_DELETING, JOB_DONE or JOB_FAILED)
+byte Timonel::UploadJob::GetState(void) {
+    return state_;
+}
+
+// Return the errors accumulated by the upload job
+byte Timonel::UploadJob::GetErrors(void) {
+    return errors_;
+}
+
+// Return true when the upload job is done or failed
+bool Timonel::UploadJob::IsFinished(void) {
+    return ((state_ == JOB_DONE) || (state_ == JOB_FAILED));
+}
+
+// Safety payload deletion after an upload error, the job waits for Timonel to restart without blocking
+void Timonel::UploadJob::Abort(void) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("[%s] Device %02d upload error: safety payload deletion triggered ...\n\r", __func__, p_device_->addr_);
+#endif /* DEBUG_LEVEL */
+    p_device_->status_valid_ = false;
+    p_device_->EndPhase(PH_UPLOAD);
+    p_device_->BeginPhase(PH_ERASE);
+    errors_ += p_device_->TwiCmdXmit(DELFLASH, ACKDELFL);
+    step_time_ = millis();
+    state_ = JOB_DELETING;
+}
+
+/* _________________________
+  |                         | 
+  |       UploadDelta       |
+  |_________________________|
+*/
+// Upload an user application rewriting only the flash memory pages that differ from the payload (Overload A:
+// payload stored in a memory array)
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+#pragma GCC warning "Timonel::UploadDelta function code included in TWI master!"
+byte Timonel::UploadDelta(byte payload[], int payload_size) {
+    PayloadArrayReader reader(payload, payload_size);
+    return UploadDelta(reader, payload_size);
+}
+
+// Upload an user application rewriting only the flash memory pages that differ from the payload (Overload B:
+// payload read one page at a time, the reader has to be able to go back to the first page)
+byte Timonel::UploadDelta(PayloadReader &reader, const int payload_size) {
+    // Delta uploads require reading the flash memory back and erasing single pages, either with ERASEPAG
+    // or by setting the page address with FORCE_ERASE_PG enabled. Otherwise, the whole application is
+    // deleted and uploaded again.
+    const bool erase_cmd = ((status_.ext_features_code >> F_CMD_ERASEPAG) & true);
+    if (!(((status_.features_code >> F_CMD_READFLASH) & true) &&
+          ((status_.features_code >> F_AUTO_PAGE_ADDR) & true) &&
+          (erase_cmd || (((status_.features_code >> F_CMD_SETPGADDR) & true) &&
+                         ((status_.ext_features_code >> F_FORCE_ERASE_PG) & true)))) ||
+        (payload_size > (status_.bootloader_start - SPM_PAGESIZE))) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Delta upload not supported by Timonel %02d features, uploading the whole application ...\n\r", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        byte twi_errors = DeleteApplication();
+        if (twi_errors != OK) {
+            return twi_errors;
+        }
+        return UploadApplication(reader, payload_size);
+    }
+    byte twi_errors = CheckUpload(payload_size); /* Upload error counter */
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    // Timonel replaces the application reset vector with a jump to the bootloader
+    // and stores the application start address in the trampoline instead.
+    const word boot_jump = (0xC000 + ((status_.bootloader_start / 2) - 1));
+    byte page_data[SPM_PAGESIZE]; /* Payload memory page to be sent to Timonel */
+    byte flash_data[SPM_PAGESIZE];
+    twi_errors += ReadPage(reader, payload_size, 0, page_data);
+    const word tpl = CalculateTrampoline(status_.bootloader_start, ((page_data[1] << 8) | page_data[0]));
+    word pages_written = 0;
+    // If the trampoline doesn't match, the application reset vector changed: page 0 has to be rewritten
+    twi_errors += ReadFlash(status_.bootloader_start - TRAMPOLINE_LEN, flash_data, TRAMPOLINE_LEN);
+    bool tpl_changed = ((flash_data[0] != (tpl & 0xFF)) || (flash_data[1] != ((tpl >> 8) & 0xFF)));
+    // All the application pages are compared, since the previous application could be bigger than the new one
+    const bool use_crc = ((status_.ext_features_code >> F_USE_CRC16) & true);
+    for (word page_addr = 0; (page_addr < (status_.bootloader_start - SPM_PAGESIZE)) && (twi_errors == 0); page_addr += SPM_PAGESIZE) {
+        bool page_changed = ((page_addr == 0) && tpl_changed);
+        bool page_blank = (page_addr >= payload_size); /* Past the payload, pages must be blank */
+        byte page_image[SPM_PAGESIZE];                 /* Expected page contents */
+        word page_crc = CRC16_INIT;
+        if (page_blank) {
+            memset(page_data, 0xFF, SPM_PAGESIZE);
+        } else {
+            twi_errors += ReadPage(reader, payload_size, (page_addr / SPM_PAGESIZE), page_data);
+        }
+        for (byte i = 0; i < SPM_PAGESIZE; i++) {
+            page_image[i] = page_data[i];
+            if ((page_addr + i) == 0) {
+                page_image[i] = (boot_jump & 0xFF);
+            } else if ((page_addr + i) == 1) {
+                page_image[i] = ((boot_jump >> 8) & 0xFF);
+            }
+            page_crc = UpdateCrc16(page_crc, page_image[i]);
+        }
+        if (use_crc) {
+            // Timonel calculates the page CRC16, so only 2 bytes are read back instead of the whole page
+            word flash_crc = 0;
+            twi_errors += GetFlashCrc(page_addr, SPM_PAGESIZE, &flash_crc);
+            page_changed = (page_changed || (flash_crc != page_crc));
+        } else {
+            twi_errors += ReadFlash(page_addr, flash_data, SPM_PAGESIZE);
+            for (byte i = 0; (i < SPM_PAGESIZE) && (!page_changed) && (twi_errors == 0); i++) {
+                page_changed = (flash_data[i] != page_image[i]);
+            }
+        }
+        if (page_changed && (twi_errors == 0)) {
+            if (erase_cmd) {
+                // ERASEPAG also sets the page address, blank pages don't need any data transfer
+                twi_errors += ErasePage(page_addr);
+                if (!page_blank) {
+                    twi_errors += WritePage(page_data, (page_addr / SPM_PAGESIZE));
+                    twi_errors += WaitForReady(TMO_FLASH_PG); /* ###### WAIT FOR TIMONEL TO BE READY FOR THE NEXT PAGE ###### */
+                }
+            } else {
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+                // Timonel erases the page before writing it (FORCE_ERASE_PG)
+                twi_errors += SetPageAddress(page_addr);
+                twi_errors += WritePage(page_data, (page_addr / SPM_PAGESIZE));
+                twi_errors += WaitForReady(TMO_FLASH_PG); /* ###### WAIT FOR TIMONEL TO BE READY FOR THE NEXT PAGE ###### */
+#else
+                twi_errors += ERR_SETADDRESS; /* The page address handling code is not included in TWI master */
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+            }
+            pages_written++;
+        }
+    }
+    if (twi_errors > 0) {
+        // Safety payload deletion due to TWI transmission errors
+        twi_errors += DeleteApplication();
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("\n\r[%s] Delta upload error: safety payload deletion triggered, please RESET TWI master!\n\n\r", __func__);
+#endif /* DEBUG_LEVEL */
+        return twi_errors;
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("\n\r[%s] Application was successfully updated, %d pages rewritten ...\n\n\r", __func__, pages_written);
 #endif /* DEBUG_LEVEL */
-#if (!((defined FEATURES_CODE) && ((FEATURES_CODE >> F_AUTO_PAGE_ADDR) & true)))
-#pragma GCC warning "Address handling code included in Timonel::UploadApplication!"    
+    return OK;
+}
+#else
+#pragma GCC warning "Timonel::UploadDelta function code NOT INCLUDED in TWI master!"
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+
+/* _________________________
+  |                         | 
+  |       CheckUpload       |
+  |_________________________|
+*/
+// Check whether an user application can be uploaded with the current Timonel features
+byte Timonel::CheckUpload(const int payload_size, const int start_address) {
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+#pragma GCC warning "Address handling code included in Timonel::CheckUpload!"
     if (!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) {
         // .............................................................................
         // If AUTO_PAGE_ADDR is disabled, the TWI master calculates the pages addresses
@@ -145,21 +830,6 @@ byte Timonel::UploadApplication(byte payload[], int payload_size, const int star
 #endif /* DEBUG_LEVEL */
             return ERR_SETADDRESS;
         }
-        if (start_address >= SPM_PAGESIZE) {
-            // If the application is to be flashed at an address other than 0 ...
-            // NOTES:
-            // 1) Any address different than a 64-bit page start address will be converted
-            //    by Timonel to the start address of the page it belongs to by using this mask:
-            //    [  page_addr &= ~(SPM_PAGESIZE - 1);  ].
-            // 2) Uploading applications on pages that start at addresses other than 0 is only
-            //    possible when the TWI master calculates the addresses (AUTO_PAGE_ADDR disabled).
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P("[%s] Application doesn't start at 0, fixing reset vector to jump to Timonel ...\n\r", __func__);
-#endif /* DEBUG_LEVEL */
-            twi_errors += FillSpecialPage(RST_PAGE);
-            twi_errors += SetPageAddress(start_address); /* Calculate and fill reset page */
-            delay(DLY_FLASH_PG);
-        }
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
         USE_SERIAL.printf_P("[%s] Writing payload to flash, starting at 0x%04X (addresses set by TWI master) ...\n\r", __func__, start_address);
 #endif /* DEBUG_LEVEL */
@@ -168,8 +838,6 @@ byte Timonel::UploadApplication(byte payload[], int payload_size, const int star
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
             USE_SERIAL.printf_P("[%s] Payload (%d bytes) fits in AVR memory (trampoline page available), uploading ...\n\r", __func__, payload_size);
 #endif /* DEBUG_LEVEL */
-            twi_errors += FillSpecialPage(TPL_PAGE, payload[1], payload[0]); /* Calculate and fill trampoline page */
-            twi_errors += SetPageAddress(start_address);
         } else {
             // If the application overlaps the trampoline bytes, exit with error!
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
@@ -182,149 +850,398 @@ byte Timonel::UploadApplication(byte payload[], int payload_size, const int star
 #endif /* DEBUG_LEVEL */
             return ERR_APP_OVF_AU;
         }
-        delay(DLY_FLASH_PG);
         // .............................................................................
-    } else {
+        return OK;
+    }
 #else
-        if (!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) {
+    if (!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P("[%s] WARNING! AUTO_PAGE_ADDR is disabled in Timonel, please setup TWI master to support it!\n\n\r", __func__);
+        USE_SERIAL.printf_P("[%s] WARNING! AUTO_PAGE_ADDR is disabled in Timonel, please setup TWI master to support it!\n\n\r", __func__);
 #endif /* DEBUG_LEVEL */
-            return ERR_AUTO_CALC;
-        }      
-#endif /* FEATURES_CODE >> !(F_AUTO_PAGE_ADDR) */
-        // .............................................................................
-        // If AUTO_PAGE_ADDR is enabled, the bootloader calculates the pages addresses
-        // .............................................................................
+        return ERR_AUTO_CALC;
+    }
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+    // .............................................................................
+    // If AUTO_PAGE_ADDR is enabled, the bootloader calculates the pages addresses
+    // .............................................................................
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-        USE_SERIAL.printf_P("[%s] Writing payload to flash, starting at 0x%04X (auto-calculated addresses) ...\n\r", __func__, start_address);
+    USE_SERIAL.printf_P("[%s] Writing payload to flash, starting at 0x%04X (auto-calculated addresses) ...\n\r", __func__, start_address);
 #endif /* DEBUG_LEVEL */
 #if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_APP_USE_TPL_PG) & true))
-        if ((status_.features_code >> F_APP_USE_TPL_PG) & true) {
-            // If APP_USE_TPL_PG is enabled, allow application sizes up to TIMONEL_START - TRAMPOLINE_LEN
-            if (payload_size <= status_.bootloader_start - TRAMPOLINE_LEN) {
-                // If the user application fits in memory (can use also the trampoline page)
+    if ((status_.features_code >> F_APP_USE_TPL_PG) & true) {
+        // If APP_USE_TPL_PG is enabled, allow application sizes up to TIMONEL_START - TRAMPOLINE_LEN
+        if (payload_size <= status_.bootloader_start - TRAMPOLINE_LEN) {
+            // If the user application fits in memory (can use also the trampoline page)
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P("[%s] Payload (%d bytes) fits in AVR memory (trampoline page available), uploading ...\n\r", __func__, payload_size);
+            USE_SERIAL.printf_P("[%s] Payload (%d bytes) fits in AVR memory (trampoline page available), uploading ...\n\r", __func__, payload_size);
 #endif /* DEBUG_LEVEL */
-            } else {
+        } else {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P("[%s] Warning! Payload (%d bytes) doesn't fit in AVR flash memory with current Timonel setup ...\n\r", __func__, payload_size);
-                USE_SERIAL.printf_P("[%s] Trampoline page is available for the application.\n\r", __func__);                
-                USE_SERIAL.printf_P("[%s] Trampoline: %d (Timonel start: %d)\n\r", __func__, status_.bootloader_start - TRAMPOLINE_LEN, status_.bootloader_start);
-                USE_SERIAL.printf_P("[%s]   App size: %d\n\r", __func__, payload_size);
-                USE_SERIAL.printf_P("[%s] --------------------------------------\n\r", __func__);
-                USE_SERIAL.printf_P("[%s]   Overflow: %d bytes\n\n\r", __func__, payload_size - (status_.bootloader_start - TRAMPOLINE_LEN));
+            USE_SERIAL.printf_P("[%s] Warning! Payload (%d bytes) doesn't fit in AVR flash memory with current Timonel setup ...\n\r", __func__, payload_size);
+            USE_SERIAL.printf_P("[%s] Trampoline page is available for the application.\n\r", __func__);
+            USE_SERIAL.printf_P("[%s] Trampoline: %d (Timonel start: %d)\n\r", __func__, status_.bootloader_start - TRAMPOLINE_LEN, status_.bootloader_start);
+            USE_SERIAL.printf_P("[%s]   App size: %d\n\r", __func__, payload_size);
+            USE_SERIAL.printf_P("[%s] --------------------------------------\n\r", __func__);
+            USE_SERIAL.printf_P("[%s]   Overflow: %d bytes\n\n\r", __func__, payload_size - (status_.bootloader_start - TRAMPOLINE_LEN));
 #endif /* DEBUG_LEVEL */
-                return ERR_APP_OVF_MC;
-            }
-        } else {
+            return ERR_APP_OVF_MC;
+        }
+        return OK;
+    }
 #endif /* FEATURES_CODE >> F_APP_USE_TPL_PG */
-            // If APP_USE_TPL_PG is NOT enabled, allow application sizes up to TIMONEL_START - SPM_PAGESIZE
-            if (payload_size <= status_.bootloader_start - SPM_PAGESIZE) {
-                // If the user application fits in memory (using also the trampoline page)
+    // If APP_USE_TPL_PG is NOT enabled, allow application sizes up to TIMONEL_START - SPM_PAGESIZE
+    if (payload_size <= status_.bootloader_start - SPM_PAGESIZE) {
+        // If the user application fits in memory (using also the trampoline page)
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P("[%s] Payload (%d bytes) fits in AVR memory (trampoline page NOT available), uploading ...\n\r", __func__, payload_size);
+        USE_SERIAL.printf_P("[%s] Payload (%d bytes) fits in AVR memory (trampoline page NOT available), uploading ...\n\r", __func__, payload_size);
 #endif /* DEBUG_LEVEL */
-            } else {
+    } else {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P("[%s] Warning! Payload (%d bytes) doesn't fit in AVR flash memory with current Timonel setup ...\n\r", __func__, payload_size);
-                USE_SERIAL.printf_P("[%s] Trampoline page is NOT available for the application.\n\r", __func__);                
-                USE_SERIAL.printf_P("[%s] Trampoline: %d (Timonel start: %d)\n\r", __func__, status_.bootloader_start - TRAMPOLINE_LEN, status_.bootloader_start);
-                USE_SERIAL.printf_P("[%s]   App size: %d\n\r", __func__, payload_size);
-                USE_SERIAL.printf_P("[%s] --------------------------------------\n\r", __func__);
-                USE_SERIAL.printf_P("[%s]   Overflow: %d bytes\n\n\r", __func__, (payload_size - (status_.bootloader_start - SPM_PAGESIZE)));
+        USE_SERIAL.printf_P("[%s] Warning! Payload (%d bytes) doesn't fit in AVR flash memory with current Timonel setup ...\n\r", __func__, payload_size);
+        USE_SERIAL.printf_P("[%s] Trampoline page is NOT available for the application.\n\r", __func__);
+        USE_SERIAL.printf_P("[%s] Trampoline: %d (Timonel start: %d)\n\r", __func__, status_.bootloader_start - TRAMPOLINE_LEN, status_.bootloader_start);
+        USE_SERIAL.printf_P("[%s]   App size: %d\n\r", __func__, payload_size);
+        USE_SERIAL.printf_P("[%s] --------------------------------------\n\r", __func__);
+        USE_SERIAL.printf_P("[%s]   Overflow: %d bytes\n\n\r", __func__, (payload_size - (status_.bootloader_start - SPM_PAGESIZE)));
 #endif /* DEBUG_LEVEL */
-                return ERR_APP_OVF_MC;
-            }            
-#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_APP_USE_TPL_PG) & true))
+        return ERR_APP_OVF_MC;
+    }
+    return OK;
+}
+
+/* _________________________
+  |                         | 
+  |       UploadPage        |
+  |_________________________|
+*/
+// Send a payload memory page to Timonel, the caller has to wait until Timonel is ready again (Overload A:
+// payload stored in a memory array)
+byte Timonel::UploadPage(const byte payload[], const int payload_size, const word page_ix, const int start_address) {
+    PayloadArrayReader reader(payload, payload_size);
+    return UploadPage(reader, payload_size, page_ix, start_address);
+}
+
+// Send a payload memory page to Timonel, the caller has to wait until Timonel is ready again (Overload B:
+// the page is read from the reader position where it starts). Without AUTO_PAGE_ADDR, "page_ix" counts the
+// reset and trampoline pages too, from 0 to Timonel::GetUploadPages() - 1.
+byte Timonel::UploadPage(PayloadReader &reader, const int payload_size, const word page_ix, const int start_address) {
+    byte page_data[SPM_PAGESIZE]; /* Payload memory page to be sent to Timonel */
+    word page_number = 0;         /* Flash memory page where it goes */
+    byte twi_errors = LoadPage(reader, payload_size, start_address, page_ix, page_data, &page_number);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    return WritePage(page_data, page_number);
+}
+
+/* _________________________
+  |                         | 
+  |        ReadPage         |
+  |_________________________|
+*/
+// Read a payload memory page from a reader, the last page is padded with 0xFF. Streams may return less
+// data than requested, so the page is filled with as many reads as needed.
+byte Timonel::ReadPage(PayloadReader &reader, const int payload_size, const word page_ix, byte page_data[]) {
+    const int page_start = (page_ix * SPM_PAGESIZE);
+    int page_size = (payload_size - page_start);
+    page_size = ((page_size < SPM_PAGESIZE) ? page_size : SPM_PAGESIZE);
+    int data_size = 0;
+    if ((page_size > 0) && reader.Seek(page_start)) {
+        while (data_size < page_size) {
+            int bytes_read = reader.Read(page_data + data_size, page_size - data_size);
+            if (bytes_read <= 0) {
+                break;
+            }
+            data_size += bytes_read;
         }
-#endif /* FEATURES_CODE >> F_APP_USE_TPL_PG */        
-        // .............................................................................        
-#if (!((defined FEATURES_CODE) && ((FEATURES_CODE >> F_AUTO_PAGE_ADDR) & true)))
     }
-#endif /* FEATURES_CODE >> !(F_AUTO_PAGE_ADDR) */
-
-    if ((payload_size % SPM_PAGESIZE) != 0) {
-        // If the payload doesn't use an exact number of pages, resize it to fit padding data
-        padding = ((((int)(payload_size / SPM_PAGESIZE) + 1) * SPM_PAGESIZE) - payload_size);
-        payload_size += padding;
+    if ((page_size <= 0) || (data_size < page_size)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("\n\r[%s] Payload reader error: %d of %d bytes read on page %d\n\r", __func__, data_size, page_size, page_ix + 1);
+#endif /* DEBUG_LEVEL */
+        return ERR_PAYLOAD_END;
+    }
+    for (byte i = data_size; i < SPM_PAGESIZE; i++) {
+        page_data[i] = 0xFF;
+    }
+    return OK;
+}
+
+/* _________________________
+  |                         | 
+  |        ErasePage        |
+  |_________________________|
+*/
+// Erase a single flash memory page and set it as the next page to be written
+byte Timonel::ErasePage(const word page_addr) {
+    if (!((status_.ext_features_code >> F_CMD_ERASEPAG) & true)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Function not supported by current Timonel (TWI %d) features ...\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        return ERR_NOT_SUPP;
+    }
+    const byte cmd_size = 4;
+    const byte reply_size = 2;
+    byte twi_cmd_arr[cmd_size] = {ERASEPAG, 0, 0, 0};
+    byte twi_reply_arr[reply_size];
+    twi_cmd_arr[1] = ((page_addr & 0xFF00) >> 8);             /* Flash page address MSB */
+    twi_cmd_arr[2] = (page_addr & 0xFF);                      /* Flash page address LSB */
+    twi_cmd_arr[3] = (byte)(twi_cmd_arr[1] + twi_cmd_arr[2]); /* Checksum */
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL == 1))
+    USE_SERIAL.printf_P(" (e:%02X%02X) ", twi_cmd_arr[1], twi_cmd_arr[2]);
+#elif ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+    USE_SERIAL.printf_P("\n\n\r[%s] >> Erasing flash page on Timonel >>> %d (ERASEPAG)\n\r", __func__, twi_cmd_arr[0]);
+#endif /* DEBUG_LEVEL */
+    byte twi_errors = TwiCmdXmit(twi_cmd_arr, cmd_size, ACKERPAG, twi_reply_arr, reply_size);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    if (twi_reply_arr[1] != twi_cmd_arr[3]) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+        USE_SERIAL.printf_P("[%s] Address %04X parsed with ERROR <<< Timonel Check = %d\r\n", __func__, page_addr, twi_reply_arr[1]);
+#endif /* DEBUG_LEVEL */
+        return ERR_ADDR_PARSE;
+    }
+    // Timonel doesn't acknowledge its address until the page is erased
+    return WaitForReady(TMO_FLASH_PG);
+}
+
+/* _________________________
+  |                         | 
+  |       GetFlashCrc       |
+  |_________________________|
+*/
+// Get the CRC16 of a flash memory range, calculated by Timonel on the device. Both steps are sent again
+// after TWI errors or a range check mismatch, up to MAX_READ_RETRY times.
+byte Timonel::GetFlashCrc(const word address, const word size, word *p_crc) {
+    if (!((status_.ext_features_code >> F_USE_CRC16) & true)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Function not supported by current Timonel (TWI %d) features ...\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        return ERR_NOT_SUPP;
+    }
+    byte twi_errors = RequestFlashCrc(address, size, p_crc);
+    for (byte retry = 0; (twi_errors != OK) && (retry < MAX_READ_RETRY); retry++) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Error getting Timonel %02d flash CRC16 at 0x%04X (%d), retrying ...\r\n", __func__, addr_, address, twi_errors);
+#endif /* DEBUG_LEVEL */
+        stats_.retries++;
+        twi_errors = RequestFlashCrc(address, size, p_crc);
+    }
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+    USE_SERIAL.printf_P("[%s] Timonel %02d flash CRC16 (%04X, %d bytes) = 0x%04X\r\n", __func__, addr_, address, size, *p_crc);
+#endif /* DEBUG_LEVEL */
+    return OK;
+}
+
+// Function RequestFlashCrc (Sets the CRC16 range in Timonel, waits for the calculation and reads the CRC16 back)
+byte Timonel::RequestFlashCrc(const word address, const word size, word *p_crc) {
+    byte twi_cmd_arr[G_CMD_LENGTH] = {GETCRC, 0, 0, 0, 0};
+    byte twi_reply_arr[G_REPLY_LENGTH] = {0};
+    twi_cmd_arr[1] = ((address & 0xFF00) >> 8); /* Flash address MSB */
+    twi_cmd_arr[2] = (address & 0xFF);          /* Flash address LSB */
+    twi_cmd_arr[3] = ((size & 0xFF00) >> 8);    /* Range size MSB */
+    twi_cmd_arr[4] = (size & 0xFF);             /* Range size LSB */
+    // Step 1: set the range, Timonel doesn't acknowledge its address until the CRC16 is calculated
+    byte twi_errors = TwiCmdXmit(twi_cmd_arr, G_CMD_LENGTH, ACKGTCRC, twi_reply_arr, 2);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    if (twi_reply_arr[1] != (byte)(twi_cmd_arr[1] + twi_cmd_arr[2] + twi_cmd_arr[3] + twi_cmd_arr[4])) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Range %04X (%d bytes) parsed with ERROR <<< Timonel Check = %d\r\n", __func__, address, size, twi_reply_arr[1]);
+#endif /* DEBUG_LEVEL */
+        WaitForReady(TMO_GET_CRC); /* The wrong range could still be calculated */
+        return ERR_ADDR_PARSE;
+    }
+    twi_errors = WaitForReady(TMO_GET_CRC);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    // Step 2: read the CRC16 back
+    twi_errors = TwiCmdXmit(GETCRC, ACKGTCRC, twi_reply_arr, G_REPLY_LENGTH);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    *p_crc = ((twi_reply_arr[1] << 8) | twi_reply_arr[2]);
+    return OK;
+}
+
+/* _________________________
+  |                         | 
+  |     GetDeviceStats      |
+  |_________________________|
+*/
+// Get a statistics counters entry from a device running Timonel built with CMD_GETSTATS: the
+// command handler entries (0 to 15, by opcode low nibble) and the flash memory operation ones
+// are timed by the device timers, the rejected packets and RX buffer overruns are only counted.
+// The events that outlast the device timer range are saturated, then "saturated" is set.
+// There's no feature bit for it, the devices built without it don't reply to GETSTATS.
+byte Timonel::GetDeviceStats(const byte entry, DeviceStats *p_stats, const bool clear) {
+    if (entry >= STATS_ENTRIES) {
+        return ERR_STATS_ENTRY;
+    }
+    byte twi_cmd_arr[T_CMD_LENGTH] = {GETSTATS, (byte)(entry | (clear ? STATS_CLEAR_FLAG : 0))};
+    byte twi_reply_arr[T_REPLY_LENGTH] = {0};
+    byte twi_errors = TwiCmdXmit(twi_cmd_arr, T_CMD_LENGTH, ACKGTSTS, twi_reply_arr, T_REPLY_LENGTH);
+    if (twi_errors != OK) {
+        return twi_errors;
     }
-    // .....................................
-    // ...... Application upload loop ......
-    // .....................................    
-    for (int i = 0; i < payload_size; i++) {
-        if (i < (payload_size - padding)) {
-            // If there are payload unsent data, place them in a data packet
-            data_packet[packet_ix] = payload[i];
-        } else {
-            // If there is no more payload data and the last a data packet
-            // is incomplete, add padding data at the end of it (0xFF)            
-            data_packet[packet_ix] = 0xFF;
-        }
-        if (packet_ix++ == (MST_PACKET_SIZE - 1)) {
-            // If a data packet is complete, dispatch it one byte at a time
-            for (int j = 0; j < MST_PACKET_SIZE; j++) {
+    const byte clock_mhz = twi_reply_arr[7];
+    if ((clock_mhz == 0) || (clock_mhz == 0xFF)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P(".");
+        USE_SERIAL.printf_P("[%s] Timonel %02d didn't return the statistics entry %d ...\r\n", __func__, addr_, entry);
 #endif /* DEBUG_LEVEL */
-            }
-            twi_errors += SendDataPacket(data_packet); /* Send a data packet to Timonel through TWI */
-            packet_ix = 0;
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))  // REMEMBER REMOVING THIS BLOCK OR RISING ITS DEBUG LEVEL !!!
-            USE_SERIAL.printf_P("\n\r[%s] Last data packet transmission result: -> %d\n\r", __func__, twi_errors);
+        return ERR_STATS_ENTRY; /* A short reply: the bus lines stay high after its end */
+    }
+    p_stats->count = ((twi_reply_arr[1] << 8) | twi_reply_arr[2]);
+    p_stats->ticks = (((uint32_t)twi_reply_arr[3] << 24) | ((uint32_t)twi_reply_arr[4] << 16) | ((uint32_t)twi_reply_arr[5] << 8) | twi_reply_arr[6]);
+    p_stats->saturated = ((p_stats->ticks & STATS_SAT_TICKS) != 0);
+    p_stats->ticks &= ~STATS_SAT_TICKS;
+    const uint32_t prescaler = ((entry < STATS_PAGE_WRITE) ? STATS_CMD_PRESC : STATS_SLOW_PRESC);
+    p_stats->time_us = (uint32_t)(((uint64_t)p_stats->ticks * prescaler) / clock_mhz);
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+    USE_SERIAL.printf_P("[%s] Timonel %02d statistics entry %d: count = %d, ticks = %lu (%lu us%s)\r\n", __func__, addr_, entry, p_stats->count, (unsigned long)p_stats->ticks, (unsigned long)p_stats->time_us, (p_stats->saturated ? ", saturated" : ""));
 #endif /* DEBUG_LEVEL */
-            // ......................................................................
-            // With data packets sizes of 8 to 32 bytes 10 ms is OK (See SLV_PACKET_SIZE)
-            delay(DLY_PKT_SEND); /* ###### DELAY BETWEEN PACKETS SENT TO COMPLETE A PAGE ###### */
-        }
-        if (twi_errors > 0) {
-            // Safety payload deletion due to TWI transmission errors
-            twi_errors += DeleteApplication();
+    return OK;
+}
+
+/* _________________________
+  |                         | 
+  |       NeedsUpdate       |
+  |_________________________|
+*/
+// Check whether the device is already running an application, returns false when the payload is
+// the one in its flash memory. The whole application area (up to the trampoline) is checked with
+// a single GETCRC, so leftovers from a longer application are also detected. The device identity
+// is taken from the trampoline and the CRC16 of the area, where the reset vector jumps to Timonel
+// and the bytes after the payload are blank. It needs a Timonel built with USE_CRC16: without it,
+// or if any check can't be done, it returns true (Overload A: payload stored in a memory array).
+bool Timonel::NeedsUpdate(const byte payload[], const int payload_size) {
+    PayloadArrayReader reader(payload, payload_size);
+    return NeedsUpdate(reader, payload_size);
+}
+
+// Check whether the device is already running an application, returns false when the payload is
+// the one in its flash memory (Overload B: payload read one page at a time)
+bool Timonel::NeedsUpdate(PayloadReader &reader, const int payload_size) {
+    if (RefreshStatus() != OK) {
+        return true;
+    }
+    if (!((status_.ext_features_code >> F_USE_CRC16) & true)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P("\n\r[%s] Upload error: safety payload deletion triggered, please RESET TWI master!\n\n\r", __func__);
+        USE_SERIAL.printf_P("[%s] Timonel %02d can't be checked without USE_CRC16 ...\r\n", __func__, addr_);
 #endif /* DEBUG_LEVEL */
-            return twi_errors;
-        }
-        if (page_end++ == (SPM_PAGESIZE - 1)) {
-            // When a page end is detected ...
+        return true;
+    }
+    const word app_area = (status_.bootloader_start - TRAMPOLINE_LEN);
+    if ((payload_size < TRAMPOLINE_LEN) || (payload_size > app_area)) {
+        return true;
+    }
+    byte page_data[SPM_PAGESIZE];
+    if (ReadPage(reader, payload_size, 0, page_data) != OK) {
+        return true;
+    }
+    // The trampoline is in the status reply, it must jump to the payload start
+    const word tpl = CalculateTrampoline(status_.bootloader_start, ((page_data[1] << 8) | page_data[0]));
+    const word device_tpl = (((status_.application_start & 0xFF) << 8) | (status_.application_start >> 8));
+    if (device_tpl != tpl) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P(" P%d ", page_count);
-#endif /* DEBUG_LEVEL */
-#if (!((defined FEATURES_CODE) && ((FEATURES_CODE >> F_AUTO_PAGE_ADDR) & true)))
-            if (!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) {
-                // If AUTO_PAGE_ADDR is not enabled, add a 100 ms delay to allow memory flashing, then set the next page address */
-                delay(DLY_FLASH_PG);
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-                USE_SERIAL.printf_P("\n\r");
+        USE_SERIAL.printf_P("[%s] Timonel %02d trampoline 0x%04X doesn't match the payload (0x%04X)\r\n", __func__, addr_, device_tpl, tpl);
 #endif /* DEBUG_LEVEL */
-                twi_errors += SetPageAddress(start_address + (page_count * SPM_PAGESIZE));
-            }
-#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
-            // ......................................................................
-            // With Timonel running at 8 and 16 MHz, 100 ms is OK for flashing the page to memory
-            delay(DLY_FLASH_PG); /* ###### DELAY AFTER SENDING A FULL PAGE TO ALLOW SAFE WRITING ###### */
-            page_count++;
-            if (i < (payload_size - 1)) {
-                // If the payload end is reached, reset the page end counter
-                page_end = 0;
+        return true;
+    }
+    const word boot_jump = (0xC000 + ((status_.bootloader_start / 2) - 1));
+    word expected_crc = UpdateCrc16(UpdateCrc16(CRC16_INIT, (boot_jump & 0xFF)), ((boot_jump >> 8) & 0xFF));
+    for (word i = TRAMPOLINE_LEN; i < app_area; i++) {
+        // ReadPage pads the last payload page with 0xFF, the pages after it are blank
+        if ((i % SPM_PAGESIZE) == 0) {
+            if (i >= payload_size) {
+                memset(page_data, 0xFF, SPM_PAGESIZE);
+            } else if (ReadPage(reader, payload_size, (i / SPM_PAGESIZE), page_data) != OK) {
+                return true;
             }
         }
+        expected_crc = UpdateCrc16(expected_crc, page_data[i % SPM_PAGESIZE]);
     }
-    // .....................................
-    // .......... Upload loop end ..........
-    // .....................................     
-    if (twi_errors == 0) {
+    word flash_crc = 0;
+    if ((GetFlashCrc(0, app_area, &flash_crc) != OK) || (flash_crc != expected_crc)) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-        USE_SERIAL.printf_P("\n\r[%s] Application was successfully uploaded to AVR flash memory ...\n\n\r", __func__);
+        USE_SERIAL.printf_P("[%s] Timonel %02d application CRC16 0x%04X doesn't match the payload (0x%04X)\r\n", __func__, addr_, flash_crc, expected_crc);
 #endif /* DEBUG_LEVEL */
-    } else {
+        return true;
+    }
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-        USE_SERIAL.printf_P("\n\r[%s] %d errors detected during upload, safety payload deletion triggered, please RESET TWI master!\n\n\r", __func__, twi_errors);
+    USE_SERIAL.printf_P("[%s] Timonel %02d is already running this application (%d bytes)\r\n", __func__, addr_, payload_size);
 #endif /* DEBUG_LEVEL */
-        twi_errors += DeleteApplication();
+    return false;
+}
+
+/* _________________________
+  |                         | 
+  |       UpdateCrc16       |
+  |_________________________|
+*/
+// Add a byte to a CRC16 (CCITT polynomial 0x1021, MSB first), it matches the one calculated by Timonel
+word Timonel::UpdateCrc16(word crc, const byte data) {
+    crc ^= (data << 8);
+    for (byte i = 0; i < 8; i++) {
+        crc = ((crc & 0x8000) ? ((crc << 1) ^ CRC16_POLY) : (crc << 1));
     }
-    return twi_errors;
+    return (crc & 0xFFFF);
+}
+
+/* _________________________
+  |                         | 
+  |        EncodeRle        |
+  |_________________________|
+*/
+// Encode a memory page as WRITERLE data: runs of a repeated word and blocks of literal words, each one preceded
+// by a token byte. Returns the encoded data size, or 0 if it is bigger than max_size (the page should be sent
+// with WRITPAGE commands).
+byte Timonel::EncodeRle(const byte page_data[], byte rle_data[], const byte max_size) {
+    const byte word_count = (SPM_PAGESIZE / 2);
+    byte rle_size = 0;
+    byte word_ix = 0;
+    while (word_ix < word_count) {
+        // Count the words equal to the current one, up to the longest run a token holds
+        byte run_length = 1;
+        while (((word_ix + run_length) < word_count) && (run_length <= RLE_COUNT_MASK) &&
+               (page_data[(word_ix + run_length) * 2] == page_data[word_ix * 2]) &&
+               (page_data[((word_ix + run_length) * 2) + 1] == page_data[(word_ix * 2) + 1])) {
+            run_length++;
+        }
+        if (run_length >= RLE_MIN_RUN) {
+            if ((rle_size + 3) > max_size) {
+                return 0;
+            }
+            rle_data[rle_size++] = (RLE_RUN_FLAG | (run_length - 1));
+            rle_data[rle_size++] = page_data[word_ix * 2];
+            rle_data[rle_size++] = page_data[(word_ix * 2) + 1];
+            word_ix += run_length;
+        } else {
+            // Literal block: it goes on until a run of repeated words starts, or the token count is full
+            byte block_length = 1;
+            while (((word_ix + block_length) < word_count) && (block_length <= RLE_COUNT_MASK) &&
+                   (!(((word_ix + block_length + 1) < word_count) &&
+                      (page_data[(word_ix + block_length) * 2] == page_data[(word_ix + block_length + 1) * 2]) &&
+                      (page_data[((word_ix + block_length) * 2) + 1] == page_data[((word_ix + block_length + 1) * 2) + 1])))) {
+                block_length++;
+            }
+            if ((rle_size + 1 + (block_length * 2)) > max_size) {
+                return 0;
+            }
+            rle_data[rle_size++] = (block_length - 1);
+            for (byte i = 0; i < (block_length * 2); i++) {
+                rle_data[rle_size++] = page_data[(word_ix * 2) + i];
+            }
+            word_ix += block_length;
+        }
+    }
+    return rle_size;
 }
 
 /* _________________________
@@ -334,28 +1251,26 @@ byte Timonel::UploadApplication(byte payload[], int payload_size, const int star
 */
 // Display the microcontroller's entire flash memory contents over a serial connection
 #if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
-#pragma GCC warning "Timonel::DumpMemory function code included in TWI master!"
+#pragma GCC warning "Timonel::DumpMemory, ReadFlash and VerifyApplication functions code included in TWI master!"
 byte Timonel::DumpMemory(const word flash_size, const byte rx_packet_size, const byte values_per_line) {
     if (!((status_.features_code >> F_CMD_READFLASH) & true)) {
         USE_SERIAL.printf_P("\n\r[%s] Function not supported by current Timonel (TWI %d) features ...\r\n", __func__, addr_);
         return ERR_NOT_SUPP;
     }
-    const byte cmd_size = D_CMD_LENGTH;
-    byte twi_cmd_arr[cmd_size] = {READFLSH, 0, 0, 0};
-    byte twi_reply_arr[rx_packet_size + D_REPLY_OVRHD];
+    if ((rx_packet_size == 0) || (rx_packet_size > SLV_PACKET_SIZE)) {
+        return ERR_READ_RANGE;
+    }
+    byte data[SLV_PACKET_SIZE];
     byte checksum_errors = 0;
     byte line_ix = 1;
-    twi_cmd_arr[3] = rx_packet_size; /* Requested packet size */
     USE_SERIAL.printf_P("\n\r[%s] Dumping Timonel (TWI %d) flash memory ...\n\n\r", __func__, addr_);
     USE_SERIAL.printf_P("Addr %04X: ", 0);
     for (word address = 0; address < flash_size; address += rx_packet_size) {
-        twi_cmd_arr[1] = ((address & 0xFF00) >> 8); /* Flash page address high byte */
-        twi_cmd_arr[2] = (address & 0xFF);          /* Flash page address low byte */
-        byte twi_errors = TwiCmdXmit(twi_cmd_arr, cmd_size, ACKRDFSH, twi_reply_arr, rx_packet_size + D_REPLY_OVRHD);
-        if (twi_errors == 0) {
-            byte expected_checksum = 0;
-            for (byte i = 1; i < (rx_packet_size + 1); i++) {
-                USE_SERIAL.printf_P("%02X", twi_reply_arr[i]); /* Memory values */
+        // The reply is checked with a CRC16 or an 8-bit sum, as set in Timonel features
+        byte twi_errors = ReadFlashBlock(address, data, rx_packet_size);
+        if ((twi_errors == OK) || (twi_errors == ERR_CHECKSUM_D)) {
+            for (byte i = 0; i < rx_packet_size; i++) {
+                USE_SERIAL.printf_P("%02X", data[i]); /* Memory values */
                 if (line_ix == values_per_line) {
                     USE_SERIAL.printf_P("\n\r");
                     if ((address + rx_packet_size) < flash_size) {
@@ -366,28 +1281,20 @@ byte Timonel::DumpMemory(const word flash_size, const byte rx_packet_size, const
                     USE_SERIAL.printf_P(" "); /* Space between values */
                 }
                 line_ix++;
-                expected_checksum += (byte)twi_reply_arr[i];
             }
-            expected_checksum += (byte)twi_cmd_arr[1];
-            expected_checksum += (byte)twi_cmd_arr[2];
-            byte received_checksum = twi_reply_arr[rx_packet_size + 1];
-            if (expected_checksum != received_checksum) {
-                USE_SERIAL.printf_P("\n\r   ### Checksum ERROR! ###   Expected:%d - Received:%d\n\r", expected_checksum, received_checksum);
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-                USE_SERIAL.printf_P("%d\n\r", expected_checksum + 1);
-                USE_SERIAL.printf_P(" <-- calculated, received --> %d\n\r", twi_reply_arr[rx_packet_size + 1]);
-#endif /* DEBUG_LEVEL */
+            if (twi_errors == ERR_CHECKSUM_D) {
+                USE_SERIAL.printf_P("\n\r   ### Checksum ERROR! ###   Address: %04X\n\r", address);
                 if (checksum_errors++ == MAXCKSUMERRORS) {
                     USE_SERIAL.printf_P("[%s] Too many Checksum ERRORS [ %d ], stopping! \n\r", __func__, checksum_errors);
-                    delay(DLY_1_SECOND);
+                    TimedDelay(DLY_1_SECOND);
                     return ERR_CHECKSUM_D;
                 }
             }
         } else {
-            USE_SERIAL.printf_P("[%s] Error parsing 0x%02X command <<< 0x%02X\n\r", __func__, twi_cmd_arr[0], twi_reply_arr[0]);
+            USE_SERIAL.printf_P("[%s] Error parsing 0x%02X command <<< %d\n\r", __func__, READFLSH, twi_errors);
             return ERR_CMD_PARSE_D;
         }
-        delay(DLY_PKT_REQUEST);
+        TimedDelay(DLY_PKT_REQUEST);
     }
     USE_SERIAL.printf_P("\n\r[%s] Timonel (TWI %d) flash memory dump successful!", __func__, addr_);
     if (checksum_errors > 0) {
@@ -396,8 +1303,151 @@ byte Timonel::DumpMemory(const word flash_size, const byte rx_packet_size, const
     USE_SERIAL.printf_P("\n\n\r");
     return OK;
 }
+
+/* _________________________
+  |                         | 
+  |        ReadFlash        |
+  |_________________________|
+*/
+// Read a flash memory range into a buffer, using the biggest packets allowed by Timonel
+byte Timonel::ReadFlash(const word address, byte data[], const word size) {
+    if (!((status_.features_code >> F_CMD_READFLASH) & true)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Function not supported by current Timonel (TWI %d) features ...\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        return ERR_NOT_SUPP;
+    }
+    if (((unsigned long)address + size) > MCU_TOTAL_MEM) {
+        return ERR_READ_RANGE;
+    }
+    // The packets are requested back-to-back, only the failed ones are requested again
+    for (word offset = 0; offset < size;) {
+        const byte packet_size = (((size - offset) < status_.slv_packet_size) ? (size - offset) : status_.slv_packet_size);
+        byte twi_errors = ReadFlashBlock(address + offset, data + offset, packet_size);
+        for (byte retry = 0; (twi_errors != OK) && (retry < MAX_READ_RETRY); retry++) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P("[%s] Error reading Timonel %02d flash at 0x%04X (%d), retrying ...\r\n", __func__, addr_, address + offset, twi_errors);
+#endif /* DEBUG_LEVEL */
+            stats_.retries++;
+            twi_errors = ReadFlashBlock(address + offset, data + offset, packet_size);
+        }
+        if (twi_errors != OK) {
+            return twi_errors;
+        }
+        offset += packet_size;
+    }
+    return OK;
+}
+
+/* _________________________
+  |                         | 
+  |    VerifyApplication    |
+  |_________________________|
+*/
+// Read the user application back from the flash memory and compare it with the uploaded payload (Overload A:
+// payload stored in a memory array)
+byte Timonel::VerifyApplication(const byte payload[], const int payload_size) {
+    PayloadArrayReader reader(payload, payload_size);
+    return VerifyApplication(reader, payload_size);
+}
+
+// Read the user application back from the flash memory and compare it with the uploaded payload (Overload B:
+// payload read one page at a time)
+byte Timonel::VerifyApplication(PayloadReader &reader, const int payload_size) {
+    if (!((status_.features_code >> F_CMD_READFLASH) & true)) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Function not supported by current Timonel (TWI %d) features ...\r\n", __func__, addr_);
+#endif /* DEBUG_LEVEL */
+        return ERR_NOT_SUPP;
+    }
+    BeginPhase(PH_VERIFY);
+    byte page_data[SPM_PAGESIZE];  /* Expected page contents */
+    byte flash_data[SPM_PAGESIZE]; /* Page contents read back */
+    word app_reset = 0;            /* Application reset vector, kept for the trampoline check */
+    // Timonel replaces the application reset vector with a jump to the bootloader
+    // and stores the application start address in the trampoline instead.
+    const word boot_jump = (0xC000 + ((status_.bootloader_start / 2) - 1));
+    const bool use_crc = ((status_.ext_features_code >> F_USE_CRC16) & true);
+    word expected_crc = CRC16_INIT;
+    const word page_count = ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+    for (word page_ix = 0; page_ix < page_count; page_ix++) {
+        if (ReadPage(reader, payload_size, page_ix, page_data) != OK) {
+            EndPhase(PH_VERIFY);
+            return ERR_PAYLOAD_END;
+        }
+        const int page_addr = (page_ix * SPM_PAGESIZE);
+        const byte page_size = (((payload_size - page_addr) < SPM_PAGESIZE) ? (payload_size - page_addr) : SPM_PAGESIZE);
+        if (page_ix == 0) {
+            app_reset = ((page_data[1] << 8) | page_data[0]);
+            page_data[0] = (boot_jump & 0xFF);
+            page_data[1] = ((boot_jump >> 8) & 0xFF);
+        }
+        if (use_crc) {
+            // With CRC16 enabled, Timonel calculates the application CRC and only 2 bytes are read back
+            for (byte i = 0; i < page_size; i++) {
+                expected_crc = UpdateCrc16(expected_crc, page_data[i]);
+            }
+            continue;
+        }
+        // Otherwise, the whole application is read back and compared
+        for (byte offset = 0; offset < page_size; offset += SLV_PACKET_SIZE) {
+            if (ReadFlash(page_addr + offset, flash_data + offset, (((page_size - offset) < SLV_PACKET_SIZE) ? (page_size - offset) : SLV_PACKET_SIZE)) != OK) {
+                EndPhase(PH_VERIFY);
+                return ERR_VERIFY_READ;
+            }
+        }
+        for (byte i = 0; i < page_size; i++) {
+            if (flash_data[i] != page_data[i]) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("[%s] Timonel %02d flash mismatch at 0x%04X: 0x%02X (expected 0x%02X)\r\n", __func__, addr_, page_addr + i, flash_data[i], page_data[i]);
+#endif /* DEBUG_LEVEL */
+                EndPhase(PH_VERIFY);
+                return ERR_VERIFY_DATA;
+            }
+        }
+    }
+    if (use_crc) {
+        word flash_crc = 0;
+        if (GetFlashCrc(0, payload_size, &flash_crc) != OK) {
+            EndPhase(PH_VERIFY);
+            return ERR_VERIFY_READ;
+        }
+        // The CRC16 reply has no check of its own: a mismatch is read again before failing the verification
+        for (byte retry = 0; (flash_crc != expected_crc) && (retry < MAX_READ_RETRY); retry++) {
+            stats_.retries++;
+            if (GetFlashCrc(0, payload_size, &flash_crc) != OK) {
+                EndPhase(PH_VERIFY);
+                return ERR_VERIFY_READ;
+            }
+        }
+        if (flash_crc != expected_crc) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P("[%s] Timonel %02d flash CRC16 mismatch: 0x%04X (expected 0x%04X)\r\n", __func__, addr_, flash_crc, expected_crc);
+#endif /* DEBUG_LEVEL */
+            EndPhase(PH_VERIFY);
+            return ERR_VERIFY_DATA;
+        }
+    }
+    if (ReadFlash(status_.bootloader_start - TRAMPOLINE_LEN, flash_data, TRAMPOLINE_LEN) != OK) {
+        EndPhase(PH_VERIFY);
+        return ERR_VERIFY_READ;
+    }
+    word tpl = CalculateTrampoline(status_.bootloader_start, app_reset);
+    if ((flash_data[0] != (tpl & 0xFF)) || (flash_data[1] != ((tpl >> 8) & 0xFF))) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Timonel %02d trampoline mismatch: 0x%02X%02X (expected 0x%04X)\r\n", __func__, addr_, flash_data[1], flash_data[0], tpl);
+#endif /* DEBUG_LEVEL */
+        EndPhase(PH_VERIFY);
+        return ERR_VERIFY_DATA;
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P("[%s] Timonel %02d application verified OK (%d bytes)\r\n", __func__, addr_, payload_size);
+#endif /* DEBUG_LEVEL */
+    EndPhase(PH_VERIFY);
+    return OK;
+}
 #else
-#pragma GCC warning "Timonel::DumpMemory function code NOT INCLUDED in TWI master!"
+#pragma GCC warning "Timonel::DumpMemory, ReadFlash and VerifyApplication functions code NOT INCLUDED in TWI master!"
 #endif /* FEATURES_CODE >> F_CMD_READFLASH */
 
 /////////////////////////////////////////////////////////////////////////////
@@ -405,13 +1455,16 @@ byte Timonel::DumpMemory(const word flash_size, const byte rx_packet_size, const
 /////////////////////////////////////////////////////////////////////////////
 
 // Function BootloaderInit (Initializes Timonel in 1 or 2 steps, as required by its features)
-byte Timonel::BootloaderInit(void) {
+byte Timonel::BootloaderInit(const bool cached_status) {
     byte twi_errors = 0;
+    BeginPhase(PH_INIT);
+    // Timonel initialization: STEP 1 (Skipped when the status was already read, e.g. by TwiBus::DiscoverDevices)
+    if (!cached_status) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-    USE_SERIAL.printf_P("[%s] Timonel device %02d * Initialization Step 1 required by features *\r\n", __func__, addr_);
+        USE_SERIAL.printf_P("[%s] Timonel device %02d * Initialization Step 1 required by features *\r\n", __func__, addr_);
 #endif /* DEBUG_LEVEL */
-    // Timonel initialization: STEP 1
-    twi_errors += QueryStatus();
+        twi_errors += QueryStatus();
+    }
 #if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_TWO_STEP_INIT) & true))
 #pragma GCC warning "Two-step initialization code included in Timonel::BootloaderInit!"
     // If TWO_STEP_INIT feature is enabled in Timonel device
@@ -424,7 +1477,16 @@ byte Timonel::BootloaderInit(void) {
     }
 #else
 #pragma GCC warning "Two-step initialization code NOT INCLUDED in Timonel::BootloaderInit!"
+    if ((status_.features_code >> F_TWO_STEP_INIT) & true) {
+        twi_errors += ERR_NOT_SUPP; /* The device would stay uninitialized */
+    }
 #endif /* FEATURES_CODE >> F_TWO_STEP_INIT */
+#if ESP8266
+    if (status_.clock_stretch) {
+        wire_.setClockStretchLimit(TWI_STRETCH_LIMIT); /* The ESP8266 default limit is shorter than a page write */
+    }
+#endif /* ESP8266 */
+    EndPhase(PH_INIT);
     return twi_errors;
 }
 
@@ -441,42 +1503,224 @@ byte Timonel::QueryStatus(void) {
 #endif /* DEBUG_LEVEL */
         return twi_errors;
     } else {
-        if ((twi_reply_arr[CMD_ACK_POS] == ACKTMNLV) && (twi_reply_arr[S_SIGNATURE] == T_SIGNATURE)) {
-            status_.signature = twi_reply_arr[S_SIGNATURE];
-            status_.version_major = twi_reply_arr[S_MAJOR];
-            status_.version_minor = twi_reply_arr[S_MINOR];
-            status_.features_code = twi_reply_arr[S_FEATURES];
-            status_.ext_features_code = twi_reply_arr[S_EXT_FEATURES];
-            status_.bootloader_start = (twi_reply_arr[S_BOOT_ADDR_MSB] << 8) + twi_reply_arr[S_BOOT_ADDR_LSB];
-            status_.application_start = (twi_reply_arr[S_APPL_ADDR_LSB] << 8) + twi_reply_arr[S_APPL_ADDR_MSB];
-            status_.trampoline_addr = (~(((twi_reply_arr[S_APPL_ADDR_MSB] << 8) | twi_reply_arr[S_APPL_ADDR_LSB]) & 0xFFF));
-            status_.trampoline_addr++;
-            status_.trampoline_addr = ((((status_.bootloader_start >> 1) - status_.trampoline_addr) & 0xFFF) << 1);
-            status_.low_fuse_setting = twi_reply_arr[S_LOW_FUSE];
-            status_.oscillator_cal = twi_reply_arr[S_OSCCAL];
+        ParseStatus(twi_reply_arr);
+        return OK;
+    }
+}
+
+// Function ParseStatus (Fills the status struct with a GETTMNLV reply, returns OK if it comes from Timonel)
+byte Timonel::ParseStatus(const byte twi_reply_arr[]) {
+    if ((twi_reply_arr[CMD_ACK_POS] == ACKTMNLV) && (twi_reply_arr[S_SIGNATURE] == T_SIGNATURE)) {
+        status_.signature = twi_reply_arr[S_SIGNATURE];
+        status_.version_major = twi_reply_arr[S_MAJOR];
+        status_.version_minor = twi_reply_arr[S_MINOR];
+        status_.features_code = twi_reply_arr[S_FEATURES];
+        status_.ext_features_code = twi_reply_arr[S_EXT_FEATURES];
+        status_.bootloader_start = (twi_reply_arr[S_BOOT_ADDR_MSB] << 8) + twi_reply_arr[S_BOOT_ADDR_LSB];
+        status_.application_start = (twi_reply_arr[S_APPL_ADDR_LSB] << 8) + twi_reply_arr[S_APPL_ADDR_MSB];
+        status_.trampoline_addr = (~(((twi_reply_arr[S_APPL_ADDR_MSB] << 8) | twi_reply_arr[S_APPL_ADDR_LSB]) & 0xFFF));
+        status_.trampoline_addr++;
+        status_.trampoline_addr = ((((status_.bootloader_start >> 1) - status_.trampoline_addr) & 0xFFF) << 1);
+        status_.low_fuse_setting = twi_reply_arr[S_LOW_FUSE];
+        status_.oscillator_cal = twi_reply_arr[S_OSCCAL];
+        // Older Timonel versions don't report their packet sizes, the default ones are used with them
+        status_.mst_packet_size = (((twi_reply_arr[S_MST_PACKET] & ~S_WINDOW_ACK) == MST_PACKET_LARGE) ? MST_PACKET_LARGE : MST_PACKET_SIZE);
+        // Windowed packets are written without a reply, so they need the whole command in a single transaction
+        status_.windowed_ack = ((BURST_XMIT == true) && (twi_reply_arr[S_MST_PACKET] != 0xFF) && (twi_reply_arr[S_MST_PACKET] & S_WINDOW_ACK));
+        status_.write_page = twi_reply_arr[S_WRITE_PAGE];
+        status_.write_offset = twi_reply_arr[S_WRITE_OFFSET];
+        status_.clock_stretch = ((twi_reply_arr[S_SLV_PACKET] != 0xFF) && (twi_reply_arr[S_SLV_PACKET] & S_STRETCH_WR));
+        const byte slv_packet_size = (status_.clock_stretch ? (twi_reply_arr[S_SLV_PACKET] & ~S_STRETCH_WR) : twi_reply_arr[S_SLV_PACKET]);
+        status_.slv_packet_size = (((slv_packet_size >= 2) && (slv_packet_size <= SLV_PACKET_SIZE)) ? slv_packet_size : SLV_PACKET_SIZE);
+        // The page addressing is picked once here, so the upload loops don't check it on each page
+        p_page_writer_ = &auto_page_writer_;
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+        if (!((status_.features_code >> F_AUTO_PAGE_ADDR) & true)) {
+            p_page_writer_ = &manual_page_writer_;
+        }
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+        status_valid_ = true;
+        return OK;
+    }
+    return ERR_NOT_TIMONEL;
+}
+
+// Page writers, ParseStatus picks the one that matches each device page addressing
+const Timonel::PageWriter Timonel::auto_page_writer_ = {&Timonel::GetAutoPages, &Timonel::LoadAutoPage, &Timonel::SendPage};
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+const Timonel::PageWriter Timonel::manual_page_writer_ = {&Timonel::GetManualPages, &Timonel::LoadManualPage, &Timonel::WriteManualPage};
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+
+// Function GetUploadPages (Pages to write for a payload, as counted by the device page writer)
+word Timonel::GetUploadPages(const int payload_size, const int start_address) {
+    return (this->*(p_page_writer_->p_get_pages))(payload_size, start_address);
+}
+
+// Function LoadPage (Builds the "page_ix" page of an upload with the device page writer, and returns the flash
+// memory page it goes to)
+byte Timonel::LoadPage(PayloadReader &reader, const int payload_size, const int start_address, const word page_ix, byte page_data[], word *p_page_number) {
+    return (this->*(p_page_writer_->p_load_page))(reader, payload_size, start_address, page_ix, page_data, p_page_number);
+}
+
+// Function WritePage (Sends a whole memory page to Timonel with the device page writer). The packets rejected by
+// Timonel are sent again from the page position it reports, from "page_offset" on a resumed upload.
+byte Timonel::WritePage(const byte page_data[], const word page_number, const byte page_offset) {
+    return (this->*(p_page_writer_->p_write_page))(page_data, page_number, page_offset);
+}
+
+// Function GetAutoPages (AUTO_PAGE_ADDR page writer: only the payload pages are written, the last one is padded)
+word Timonel::GetAutoPages(const int payload_size, const int start_address) {
+    (void)start_address;
+    return ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+}
+
+// Function LoadAutoPage (AUTO_PAGE_ADDR page writer: Timonel patches the reset vector and the trampoline itself)
+byte Timonel::LoadAutoPage(PayloadReader &reader, const int payload_size, const int start_address, const word page_ix, byte page_data[], word *p_page_number) {
+    *p_page_number = ((start_address / SPM_PAGESIZE) + page_ix);
+    return ReadPage(reader, payload_size, page_ix, page_data);
+}
+
+// Function SendPage (Sends the data packets of a memory page, from "page_offset" on, at the page address already
+// set in Timonel. The packets rejected are sent again from the page position it reports)
+byte Timonel::SendPage(const byte page_data[], const word page_number, const byte page_offset) {
+    const byte packet_size = status_.mst_packet_size;
+    byte offset = page_offset;      /* Page bytes already received by Timonel */
+    byte sync_offset = page_offset; /* Page position reported by the last resync */
+    byte retries = 0;               /* Failed packets in a row without the page moving on */
+    while (offset < SPM_PAGESIZE) {
+        byte packet_errors = 0;
+        byte rle_size = 0;
+        if (((status_.ext_features_code >> F_CMD_WRITERLE) & true) && (offset == 0)) {
+            // The whole page goes in a single WRITERLE command when its encoded data fits in a packet
+            byte rle_data[MST_PACKET_LARGE];
+            rle_size = EncodeRle(page_data, rle_data, packet_size);
+            if (rle_size > 0) {
+                packet_errors = SendPacket(WRITERLE, ACKWTRLE, rle_data, rle_size);
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P(" P%d (RLE %d) ", page_number + 1, rle_size);
+#endif /* DEBUG_LEVEL */
+            }
+        }
+        if (rle_size == 0) {
+            // Send a data packet to Timonel through TWI, full-page packets halve the round-trips per page
+            const byte data_size = (((SPM_PAGESIZE - offset) < packet_size) ? (SPM_PAGESIZE - offset) : packet_size);
+            if (data_size == MST_PACKET_LARGE) {
+                packet_errors = SendDataPacket<MST_PACKET_LARGE>(page_data);
+            } else if (status_.windowed_ack && ((offset + data_size) < SPM_PAGESIZE)) {
+                // Windowed ack: the last packet's WRITPAGE reply also reports the status of the previous ones
+                packet_errors = SendPacket(WRITPGWN, ACKWTPGW, page_data + offset, data_size);
+            } else if (data_size == MST_PACKET_SIZE) {
+                packet_errors = SendDataPacket<MST_PACKET_SIZE>(page_data + offset);
+            } else {
+                packet_errors = SendPacket(WRITPAGE, ACKWTPAG, page_data + offset, data_size); /* Resumed page tail */
+            }
+            offset += data_size;
+        } else {
+            offset = SPM_PAGESIZE;
+        }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
+        USE_SERIAL.printf_P("\n\r[%s] Last data packet transmission result: -> %d\n\r", __func__, packet_errors);
+#endif /* DEBUG_LEVEL */
+        if (packet_errors > 0) {
+            // Timonel rejects the wrong packets without writing them, ask it where the page has to go on
+            if (retries++ >= MAX_PKT_RETRY) {
+                return packet_errors;
+            }
+            stats_.retries++;
+            byte sync_errors = ResyncPage(page_number, &offset);
+            if (sync_errors != OK) {
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+                USE_SERIAL.printf_P("\n\r[%s] Page %d can't be resent (%d)\n\r", __func__, page_number + 1, sync_errors);
+#endif /* DEBUG_LEVEL */
+                return (packet_errors + sync_errors);
+            }
+            if (offset > sync_offset) {
+                retries = 0; /* The page moved on since the last error, this isn't the same packet failing again */
+            }
+            sync_offset = offset;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+            USE_SERIAL.printf_P(" P%d retry %d at %d ", page_number + 1, retries, offset);
+#endif /* DEBUG_LEVEL */
+        }
+    }
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+    USE_SERIAL.printf_P(" P%d ", page_number + 1);
+#endif /* DEBUG_LEVEL */
+    return OK;
+}
+
+// Function ResyncPage (Gets the page position from Timonel after a failed packet, "p_offset" returns the page
+// bytes already received, SPM_PAGESIZE if the page was completed and written)
+byte Timonel::ResyncPage(const word page_number, byte *p_offset) {
+    // A packet whose reply was lost stays in the Timonel RX buffer, so the first status read after it can
+    // be rejected as well. The status is read again before giving up the page.
+    byte twi_errors = OK;
+    for (byte attempt = 0; attempt <= MAX_PKT_RETRY; attempt++) {
+        twi_errors = WaitForReady(TMO_FLASH_PG); /* The last packet could have completed the page */
+        twi_errors += RefreshStatus();           /* Reading the status also makes Timonel accept data packets again */
+        if (twi_errors == OK) {
+            break;
         }
+        stats_.retries++;
+    }
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    if (status_.write_page == 0xFF) {
+        return ERR_NOT_SUPP; /* Older Timonel versions and the ones built without PKT_RESYNC don't report the page position */
+    }
+    if (status_.write_page == page_number) {
+        // NOTE: Without AUTO_PAGE_ADDR the page address doesn't advance after writing a page, so a written
+        // page reports offset 0 and it's sent again, writing the same data on it.
+        *p_offset = status_.write_offset;
         return OK;
     }
+    if ((status_.write_page == (page_number + 1)) && (status_.write_offset == 0)) {
+        *p_offset = SPM_PAGESIZE; /* The failed packet was received, only its reply was lost */
+        return OK;
+    }
+    return ERR_PAGE_SYNC;
 }
 
-// Function SendDataPacket (Sends a data packet, a memory page fraction, to Timonel)
+// Function SendDataPacket (Sends a data packet, a memory page fraction or a whole page, to Timonel)
+template <byte packet_size>
 byte Timonel::SendDataPacket(const byte data_packet[]) {
-    const byte cmd_size = MST_PACKET_SIZE + 2;
-    const byte reply_size = 2;
-    byte twi_cmd[cmd_size] = {0};
-    byte twi_reply_arr[reply_size] = {0};
-    byte checksum = 0;
-    twi_cmd[0] = WRITPAGE;
-    for (int i = 1; i < cmd_size - 1; i++) {
-        twi_cmd[i] = data_packet[i - 1];
-        checksum += (byte)data_packet[i - 1]; /* Data checksum accumulator (mod 256) */
+    static_assert(((packet_size % 2) == 0) && (packet_size <= SPM_PAGESIZE), "Data packets must be even and not bigger than SPM_PAGESIZE");
+    return SendPacket(WRITPAGE, ACKWTPAG, data_packet, packet_size);
+}
+
+// Function SendPacket (Sends a page data command, WRITPAGE, WRITPGWN or WRITERLE, checking the data received by Timonel.
+// With an application TWI address, the packet goes to the update stub instead, with the same framing)
+byte Timonel::SendPacket(const byte twi_cmd_code, const byte twi_reply, const byte data[], const byte data_size,
+                         const byte app_twi_address) {
+    const bool use_crc = ((status_.ext_features_code >> F_USE_CRC16) & true);
+    const byte check_size = (use_crc ? 2 : 1);
+    const byte cmd_size = data_size + 1 + check_size;
+    const byte reply_size = 1 + check_size;
+    byte twi_cmd[MST_PACKET_LARGE + 3] = {0};
+    byte twi_reply_arr[3] = {0};
+    word check = (use_crc ? CRC16_INIT : 0);
+    status_valid_ = false;
+    twi_cmd[0] = twi_cmd_code;
+    for (byte i = 1; i < data_size + 1; i++) {
+        twi_cmd[i] = data[i - 1];
+        check = PacketCheck(check, data[i - 1]); /* Data checksum (mod 256) or CRC16 accumulator */
+    }
+    if (use_crc) {
+        twi_cmd[cmd_size - 2] = (byte)(check >> 8); /* CRC16 MSB first */
     }
-    twi_cmd[cmd_size - 1] = checksum;
-    byte twi_errors = TwiCmdXmit(twi_cmd, cmd_size, ACKWTPAG, twi_reply_arr, reply_size);
-    if (twi_reply_arr[0] == ACKWTPAG) {
-        if (twi_reply_arr[1] != checksum) {
+    twi_cmd[cmd_size - 1] = (byte)(check & 0xFF);
+    if (twi_cmd_code == WRITPGWN) {
+        return TwiCmdSend(twi_cmd, cmd_size); /* Windowed packets have no reply to check */
+    }
+    byte twi_errors = ((app_twi_address == 0) ? TwiCmdXmit(twi_cmd, cmd_size, twi_reply, twi_reply_arr, reply_size)
+                                              : AppCmdXmit(app_twi_address, twi_cmd, cmd_size, twi_reply, twi_reply_arr, reply_size));
+    if (twi_reply_arr[0] == twi_reply) {
+        word received = (use_crc ? ((twi_reply_arr[1] << 8) | twi_reply_arr[2]) : twi_reply_arr[1]);
+        if (received != check) {
+            stats_.check_errors++;
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P("[%s] Checksum ERROR! Expected value: 0x%02X <<< Received = 0x%02X\r\n", __func__, checksum, twi_reply_arr[1]);
+            USE_SERIAL.printf_P("[%s] Checksum ERROR! Expected value: 0x%04X <<< Received = 0x%04X\r\n", __func__, check, received);
 #endif /* DEBUG_LEVEL */
             return (twi_errors + ERR_TX_PKT_CHKSUM);
         }
@@ -494,12 +1738,61 @@ byte Timonel::SendDataPacket(const byte data_packet[]) {
     return twi_errors;
 }
 
-// Function SetPageAddres (Sets the start address of a flash memory page)
-#if (!((defined FEATURES_CODE) && ((FEATURES_CODE >> F_AUTO_PAGE_ADDR) & true)))
-#pragma GCC warning "Timonel::SetPageAddress, FillSpecialPage and CalculateTrampoline functions code included in TWI master!"
+// Function PacketCheck (Adds a byte to a data packet check: CRC16 or 8-bit sum, as set in Timonel features)
+word Timonel::PacketCheck(const word check, const byte data) {
+    if ((status_.ext_features_code >> F_USE_CRC16) & true) {
+        return UpdateCrc16(check, data);
+    }
+    return (byte)(check + data);
+}
+
+// Function CalculateTrampoline (Calculates the application trampoline address)
+word Timonel::CalculateTrampoline(word bootloader_start, word application_start) {
+    return (((~((bootloader_start >> 1) - ((application_start + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
+}
+
+// Function ReadFlashBlock (Reads a flash memory block from Timonel, checking the reply checksum)
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+byte Timonel::ReadFlashBlock(const word address, byte data[], const byte data_size) {
+    const bool use_crc = ((status_.ext_features_code >> F_USE_CRC16) & true);
+    const byte reply_size = data_size + (use_crc ? D_REPLY_OVRHD_CRC : D_REPLY_OVRHD);
+    byte twi_cmd_arr[D_CMD_LENGTH] = {READFLSH, 0, 0, 0};
+    byte twi_reply_arr[SLV_PACKET_SIZE + D_REPLY_OVRHD_CRC];
+    if (data_size > SLV_PACKET_SIZE) {
+        return ERR_READ_RANGE;
+    }
+    twi_cmd_arr[1] = ((address & 0xFF00) >> 8); /* Flash address high byte */
+    twi_cmd_arr[2] = (address & 0xFF);          /* Flash address low byte */
+    twi_cmd_arr[3] = data_size;                 /* Requested data size */
+    byte twi_errors = TwiCmdXmit(twi_cmd_arr, D_CMD_LENGTH, ACKRDFSH, twi_reply_arr, reply_size);
+    if (twi_errors != OK) {
+        return twi_errors;
+    }
+    // The address is checked along with the data: Timonel adds it first to the CRC16, or to the sum
+    word check = PacketCheck(PacketCheck((use_crc ? CRC16_INIT : 0), twi_cmd_arr[1]), twi_cmd_arr[2]);
+    for (byte i = 0; i < data_size; i++) {
+        data[i] = twi_reply_arr[i + 1];
+        check = PacketCheck(check, data[i]);
+    }
+    word received = (use_crc ? ((twi_reply_arr[data_size + 1] << 8) | twi_reply_arr[data_size + 2]) : twi_reply_arr[data_size + 1]);
+    if (check != received) {
+        stats_.check_errors++;
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Checksum ERROR! Expected value: 0x%04X <<< Received = 0x%04X\r\n", __func__, check, received);
+#endif /* DEBUG_LEVEL */
+        return ERR_CHECKSUM_D;
+    }
+    return OK;
+}
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+
+// Function SetPageAddres (Sets the start address of a flash memory page). Timonel takes the address as received,
+// so the command is sent again when its reply check doesn't match, up to MAX_PKT_RETRY times.
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+#pragma GCC warning "Timonel::SetPageAddress function code included in TWI master!"
 byte Timonel::SetPageAddress(const word page_addr) {
-    const byte cmd_size = 4;
-    const byte reply_size = 2;
+    const byte cmd_size = P_CMD_LENGTH;
+    const byte reply_size = P_REPLY_LENGTH;
     byte twi_cmd_arr[cmd_size] = {STPGADDR, 0, 0, 0};
     byte twi_reply_arr[reply_size];
     twi_cmd_arr[1] = ((page_addr & 0xFF00) >> 8);             /* Flash page address MSB */
@@ -510,64 +1803,120 @@ byte Timonel::SetPageAddress(const word page_addr) {
 #elif ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
     USE_SERIAL.printf_P("\n\n\r[%s] >> Setting flash page address on Timonel >>> %d (STPGADDR)\n\r", __func__, twi_cmd_arr[0]);
 #endif /* DEBUG_LEVEL */
-    byte twi_errors = TwiCmdXmit(twi_cmd_arr, cmd_size, AKPGADDR, twi_reply_arr, reply_size);
-    if (twi_errors == 0) {
+    byte twi_errors = OK;
+    for (byte retry = 0; retry <= MAX_PKT_RETRY; retry++) {
+        if (retry > 0) {
+            stats_.retries++;
+        }
+        twi_errors = TwiCmdXmit(twi_cmd_arr, cmd_size, AKPGADDR, twi_reply_arr, reply_size);
+        if (twi_errors != OK) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-        USE_SERIAL.printf_P("[%s] >> Command %d parsed OK <<< %d\n\r", __func__, twi_cmd_arr[0], twi_reply_arr[0]);
+            USE_SERIAL.printf_P("[%s] Error parsing 0x%02X command! <<< %02X\n\r", __func__, twi_cmd_arr[0], twi_reply_arr[0]);
 #endif /* DEBUG_LEVEL */
+            continue;
+        }
         if (twi_reply_arr[1] == twi_cmd_arr[3]) {
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-            USE_SERIAL.printf_P("[%s] >> Operands %d and %d parsed OK by Timonel <<< Flash Page Address Check = %d\n\r", __func__, twi_cmd_arr[1], twi_cmd_arr[2], twi_reply_arr[1]);
-#endif /* DEBUG_LEVEL */
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
             USE_SERIAL.printf_P("[%s] Address %04X (%02X) (%02X) parsed OK by Timonel <<< Check = %d\n\r", __func__, page_addr, twi_cmd_arr[1], twi_cmd_arr[2], twi_reply_arr[1]);
 #endif /* DEBUG_LEVEL */
-        } else {
+            return OK;
+        }
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-            USE_SERIAL.printf_P("[%s] Operand %d parsed with ERROR <<< Timonel Check = %d\r\n", __func__, twi_cmd_arr[1], twi_reply_arr[1]);
+        USE_SERIAL.printf_P("[%s] Operand %d parsed with ERROR <<< Timonel Check = %d\r\n", __func__, twi_cmd_arr[1], twi_reply_arr[1]);
+#endif /* DEBUG_LEVEL */
+        stats_.check_errors++;
+        twi_errors = ERR_ADDR_PARSE;
+    }
+    return twi_errors;
+}
+#else
+#pragma GCC warning "Timonel::SetPageAddress function code NOT INCLUDED in TWI master!"
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+
+// Manual page writer (AUTO_PAGE_ADDR disabled): the TWI master sets the page addresses and builds the reset and
+// trampoline pages from the Timonel status, so that the upload is a single stream of ready-made pages in address
+// order: reset page, application pages and trampoline page.
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+#pragma GCC warning "Timonel manual page writer and FillSpecialPage function code included in TWI master!"
+// Function GetManualPages (The reset page is added when the application doesn't start at 0, and the trampoline page
+// unless the last application page holds it)
+word Timonel::GetManualPages(const int payload_size, const int start_address) {
+    word page_count = ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE); /* The last payload page is padded */
+    const word tpl_number = ((status_.bootloader_start / SPM_PAGESIZE) - 1);
+    page_count += ((((start_address / SPM_PAGESIZE) + page_count - 1) != tpl_number) ? 1 : 0);
+    page_count += ((start_address >= SPM_PAGESIZE) ? 1 : 0);
+    return page_count;
+}
+
+// Function LoadManualPage (Builds the reset page, an application page or the trampoline page)
+byte Timonel::LoadManualPage(PayloadReader &reader, const int payload_size, const int start_address, const word page_ix, byte page_data[], word *p_page_number) {
+    const word rst_pages = ((start_address >= SPM_PAGESIZE) ? 1 : 0);
+    const word app_pages = ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+    const word tpl_number = ((status_.bootloader_start / SPM_PAGESIZE) - 1);
+    if (page_ix < rst_pages) {
+        // If the application is to be flashed at an address other than 0 ...
+        // NOTES:
+        // 1) Any address different than a 64-bit page start address will be converted
+        //    by Timonel to the start address of the page it belongs to by using this mask:
+        //    [  page_addr &= ~(SPM_PAGESIZE - 1);  ].
+        // 2) Uploading applications on pages that start at addresses other than 0 is only
+        //    possible when the TWI master calculates the addresses (AUTO_PAGE_ADDR disabled).
+#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
+        USE_SERIAL.printf_P("[%s] Application doesn't start at 0, fixing reset vector to jump to Timonel ...\n\r", __func__);
 #endif /* DEBUG_LEVEL */
+        memset(page_data, 0xFF, SPM_PAGESIZE);
+        FillSpecialPage(RST_PAGE, page_data);
+        *p_page_number = 0;
+        return OK;
+    }
+    if (page_ix < (rst_pages + app_pages)) {
+        byte twi_errors = ReadPage(reader, payload_size, (page_ix - rst_pages), page_data);
+        if (twi_errors != OK) {
+            return twi_errors;
         }
+        if (page_ix == rst_pages) {
+            app_reset_ = ((page_data[1] << 8) | page_data[0]); /* The first page holds the app reset vector */
+        }
+        *p_page_number = ((start_address / SPM_PAGESIZE) + (page_ix - rst_pages));
     } else {
+        memset(page_data, 0xFF, SPM_PAGESIZE);
+        *p_page_number = tpl_number;
+    }
+    if (*p_page_number == tpl_number) {
+        FillSpecialPage(TPL_PAGE, page_data, app_reset_);
+    }
+    return OK;
+}
+
+// Function WriteManualPage (Sets the page address before sending the page)
+byte Timonel::WriteManualPage(const byte page_data[], const word page_number, const byte page_offset) {
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 2))
-        USE_SERIAL.printf_P("[%s] Error parsing 0x%02X command! <<< %02X\n\r", __func__, twi_cmd_arr[0], twi_reply_arr[0]);
+    USE_SERIAL.printf_P("\n\r");
 #endif /* DEBUG_LEVEL */
-    }
-    return twi_errors;
+    byte twi_errors = SetPageAddress(page_number * SPM_PAGESIZE);
+    return (twi_errors + SendPage(page_data, page_number, page_offset));
 }
 
-// Function FillSpecialPage (Fills a reset or trampoline page, as required by Timonel features)
-byte Timonel::FillSpecialPage(const byte page_type, const byte app_reset_msb, const byte app_reset_lsb) {
-    word address = 0x0000;
-    byte packet_ix = 0; /* TWI (I2C) data packet internal byte index */
-    byte twi_errors = 0;
-    byte data_packet[MST_PACKET_SIZE] = {0xFF};
-    byte special_page[64] = {
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-        0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+// Function FillSpecialPage (Patches a reset or trampoline page, as required by Timonel features). The page is built
+// by the TWI master from the Timonel status and sent as a regular one in the upload page sequence.
+void Timonel::FillSpecialPage(const byte page_type, byte page_data[], const word app_reset) {
     // Special page selector
     switch (page_type) {
         case RST_PAGE: { /* Special page type 1: Reset Vector Page (addr: 0) */
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
             USE_SERIAL.printf_P("[%s] Type %d: Modifying the first 2 bytes (restart vector) to point to this bootloader ...\n\r", __func__, page_type);
 #endif /* DEBUG_LEVEL */
-            special_page[0] = (0xC0 + ((((status_.bootloader_start / 2) - 1) >> 8) & 0xFF));
-            special_page[1] = (((status_.bootloader_start / 2) - 1) & 0xFF);
+            page_data[0] = (0xC0 + ((((status_.bootloader_start / 2) - 1) >> 8) & 0xFF));
+            page_data[1] = (((status_.bootloader_start / 2) - 1) & 0xFF);
             break;
         }
         case TPL_PAGE: { /* Special page type 2: Trampoline Page (addr: TIMONEL_START - 64) */
 #if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-            USE_SERIAL.printf_P("[%s] Type %d: Calculate the trampoline and fill the page with 0xFF + 2-byte jump address ...\n\r", __func__, page_type);
+            USE_SERIAL.printf_P("[%s] Type %d: Calculate the trampoline and set the page 2-byte jump address ...\n\r", __func__, page_type);
 #endif /* DEBUG_LEVEL */
-            address = status_.bootloader_start - (SPM_PAGESIZE);
-            word tpl = CalculateTrampoline(status_.bootloader_start, ((app_reset_msb << 8) | app_reset_lsb));
-            special_page[SPM_PAGESIZE - 1] = (byte)((tpl >> 8) & 0xFF);
-            special_page[SPM_PAGESIZE - 2] = (byte)(tpl & 0xFF);
+            word tpl = CalculateTrampoline(status_.bootloader_start, app_reset);
+            page_data[SPM_PAGESIZE - 1] = (byte)((tpl >> 8) & 0xFF);
+            page_data[SPM_PAGESIZE - 2] = (byte)(tpl & 0xFF);
             break;
         }
         default: {
@@ -575,32 +1924,33 @@ byte Timonel::FillSpecialPage(const byte page_type, const byte app_reset_msb, co
             break;
         }
     }
-    twi_errors += SetPageAddress(address);
-    delay(DLY_SET_ADDR);
-    for (byte i = 0; i < SPM_PAGESIZE; i++) {
-        data_packet[packet_ix] = special_page[i];
-        if (packet_ix++ == (MST_PACKET_SIZE - 1)) {
-            for (int j = 0; j < MST_PACKET_SIZE; j++) {
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-                USE_SERIAL.printf_P("|");
-#endif /* DEBUG_LEVEL */
-            }
-            twi_errors += SendDataPacket(data_packet); /* Send data to Timonel through I2C */
-            packet_ix = 0;
-            delay(DLY_PKT_SEND);
-        }
+}
+#else
+#pragma GCC warning "Timonel manual page writer and FillSpecialPage function code NOT INCLUDED in TWI master!"
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+
+/////////////////////////////////////////////////////////////////////////////
+////////////                 PAYLOADREADER CLASS                 ////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// Class constructor
+PayloadArrayReader::PayloadArrayReader(const byte payload[], const int payload_size) : payload_(payload), payload_size_(payload_size) {
+}
+
+// Copy the next payload array bytes, returns the bytes copied (0 at the end of the array)
+int PayloadArrayReader::Read(byte data[], const int size) {
+    int data_size = (((payload_size_ - payload_ix_) < size) ? (payload_size_ - payload_ix_) : size);
+    for (int i = 0; i < data_size; i++) {
+        data[i] = payload_[payload_ix_++];
     }
-#if ((defined DEBUG_LEVEL) && (DEBUG_LEVEL >= 1))
-    USE_SERIAL.printf_P("\r\n");
-#endif /* DEBUG_LEVEL */
-    delay(DLY_RETURN);
-    return twi_errors;
+    return data_size;
 }
 
-// Function CalculateTrampoline (Calculates the application trampoline address)
-word Timonel::CalculateTrampoline(word bootloader_start, word application_start) {
-    return (((~((bootloader_start >> 1) - ((application_start + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
+// Move the next Read to any position of the array (up to its end)
+bool PayloadArrayReader::Seek(const int position) {
+    if ((position < 0) || (position > payload_size_)) {
+        return false;
+    }
+    payload_ix_ = position;
+    return true;
 }
-#else
-#pragma GCC warning "Timonel::SetPageAddress, FillSpecialPage and CalculateTrampoline functions code NOT INCLUDED in TWI master!"
-#endif /* FEATURES_CODE >> F_AUTO_PAGE_ADDR */
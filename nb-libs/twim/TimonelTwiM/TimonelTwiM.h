@@ -16,16 +16,46 @@
 #ifndef _TIMONELTWIM_H_
 #define _TIMONELTWIM_H_
 
+#include <new>
 #include "../../cmd/nb-twi-cmd.h"
 #include "NbMicro.h"
 #include "Wire.h"
 #include "libconfig.h"
 #include "stdbool.h"
 
+// Class PayloadReader: Source of application payload data (e.g. a memory array, a file or a network stream)
+class PayloadReader {
+   public:
+    virtual ~PayloadReader() {}
+    // Copy up to "size" payload bytes to "data", returns the bytes copied (0 at the end of the payload)
+    virtual int Read(byte data[], const int size) = 0;
+    // Move the next Read to a payload position, returns false if the source can't get there. Sequential
+    // streams have to accept at least their current position and, by skipping data, the ones after it.
+    // Going back is needed to restart failed uploads and to interleave pages (TwiBus::UploadAll).
+    virtual bool Seek(const int position) = 0;
+};
+
+// Class PayloadArrayReader: Payload source for applications stored in a memory array (e.g. "payload.h")
+class PayloadArrayReader : public PayloadReader {
+   public:
+    PayloadArrayReader(const byte payload[] = nullptr, const int payload_size = 0);
+    int Read(byte data[], const int size);
+    bool Seek(const int position);
+
+   private:
+    const byte *payload_ = nullptr;
+    int payload_size_ = 0;
+    int payload_ix_ = 0;
+};
+
 // Class Timonel: Represents an ATTiny85/45/25 microcontroller running the Timonel bootloader
 class Timonel : public NbMicro {
    public:
     Timonel(const byte twi_address = 0, const byte sda = 0, const byte scl = 0);
+    Timonel(TwoWire &wire, const byte twi_address = 0, const byte sda = 0, const byte scl = 0);
+#if ((defined MULTI_DEVICE) && (MULTI_DEVICE == true))
+    Timonel(const TwiBus::DeviceEntry &device);
+#endif /* MULTI_DEVICE */
     ~Timonel();
     typedef struct tml_status_ {
         byte signature = 0;
@@ -39,33 +69,273 @@ class Timonel : public NbMicro {
         byte low_fuse_setting = 0;
         byte oscillator_cal = 0;
         byte check_empty_fl = 0;
+        byte mst_packet_size = MST_PACKET_SIZE;
+        byte slv_packet_size = SLV_PACKET_SIZE;
+        bool windowed_ack = false;
+        bool clock_stretch = false; /* Page writes hold the bus by clock stretching instead of NACKing the address */
+        byte write_page = 0xFF;   /* Page where the next data packet is written (0xFF if not reported) */
+        byte write_offset = 0xFF; /* Data bytes already in that page buffer (0xFF if not reported) */
     } Status;
+    typedef struct tml_dev_stats_ {
+        word count = 0;         /* Events counted by the device since it started */
+        uint32_t ticks = 0;     /* Timer ticks accumulated by the events (0 for the count-only entries) */
+        uint32_t time_us = 0;   /* Ticks converted to time with the nominal clock reported by the device */
+        bool saturated = false; /* Some event outlasted the device timer range, the time is a lower bound */
+    } DeviceStats;
+    // Class UploadJob: Non-blocking application upload, each Poll() call advances it by one page at most
+    class UploadJob {
+       public:
+        UploadJob(Timonel *p_device = nullptr, const byte max_retries = 0);
+        byte Begin(const byte payload[],
+                   const int payload_size,
+                   const int start_address = 0);
+        byte Begin(PayloadReader &reader,
+                   const int payload_size,
+                   const int start_address = 0);
+        byte Poll(void);
+        byte GetState(void);
+        byte GetErrors(void);
+        bool IsFinished(void);
+
+       private:
+        void Abort(void);
+        Timonel *p_device_ = nullptr;       /* Timonel device to upload to */
+        PayloadArrayReader array_reader_;   /* Reader used when Begin() gets a payload array */
+        PayloadReader *p_reader_ = nullptr; /* Application payload (it must stay available until the job finishes) */
+        int payload_size_ = 0;
+        int start_address_ = 0;
+        word page_count_ = 0;
+        word page_ix_ = 0;              /* Next page to send to the device */
+        unsigned long step_time_ = 0;   /* Time when the last page or delete command was sent (ms) */
+        byte errors_ = 0;               /* Errors accumulated by the job */
+        byte retries_ = 0;              /* Upload restarts made after errors */
+        byte max_retries_ = 0;          /* Max upload restarts allowed */
+        byte state_ = JOB_IDLE;
+    };
     Status GetStatus(void);
+    byte RefreshStatus(void);
     byte SetTwiAddress(byte twi_address);
+    byte NegotiateClock(const uint32_t max_clock = CLK_STEP_MAX);
     byte RunApplication(void);
     byte DeleteApplication(void);
+    byte WaitForRestart(void);
+    byte EnterBootloader(const byte app_twi_address);
+    byte UpdateApplication(const byte app_twi_address,
+                           byte payload[],
+                           int payload_size);
+    byte UpdateBootloader(byte stub_payload[],
+                          int stub_size,
+                          const byte stub_twi_address,
+                          const byte bootloader[],
+                          const int bootloader_size,
+                          const word bootloader_start);
+    byte ResumeBootloaderUpdate(const byte stub_twi_address,
+                                const byte bootloader[],
+                                const int bootloader_size,
+                                const word bootloader_start);
     byte UploadApplication(byte payload[],
                            int payload_size,
                            const int start_address = 0);
+    byte UploadApplication(PayloadReader &reader,
+                           const int payload_size,
+                           const int start_address = 0);
+    byte ResumeApplication(byte payload[],
+                           int payload_size);
+    byte ResumeApplication(PayloadReader &reader,
+                           const int payload_size);
+    byte CheckUpload(const int payload_size,
+                     const int start_address = 0);
+    byte UploadPage(const byte payload[],
+                    const int payload_size,
+                    const word page_ix,
+                    const int start_address = 0);
+    byte UploadPage(PayloadReader &reader,
+                    const int payload_size,
+                    const word page_ix,
+                    const int start_address = 0);
+    byte ErasePage(const word page_addr);
+    byte GetFlashCrc(const word address,
+                     const word size,
+                     word *p_crc);
+    byte GetDeviceStats(const byte entry,
+                        DeviceStats *p_stats,
+                        const bool clear = false);
+    bool NeedsUpdate(const byte payload[],
+                     const int payload_size);
+    bool NeedsUpdate(PayloadReader &reader,
+                     const int payload_size);
+    static word UpdateCrc16(word crc, const byte data);
+    static byte EncodeRle(const byte page_data[],
+                          byte rle_data[],
+                          const byte max_size);
+    static byte ReadPage(PayloadReader &reader,
+                         const int payload_size,
+                         const word page_ix,
+                         byte page_data[]);
 #if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
     byte DumpMemory(const word flash_size = MCU_TOTAL_MEM,
                     const byte rx_packet_size = SLV_PACKET_SIZE,
                     const byte values_per_line = VALUES_PER_LINE);
+    byte ReadFlash(const word address,
+                   byte data[],
+                   const word size);
+    byte VerifyApplication(const byte payload[],
+                           const int payload_size);
+    byte VerifyApplication(PayloadReader &reader,
+                           const int payload_size);
+    byte UploadDelta(byte payload[],
+                     int payload_size);
+    byte UploadDelta(PayloadReader &reader,
+                     const int payload_size);
 #endif /* FEATURES_CODE >> F_CMD_READFLASH */
 
    private:
-    Status status_; /* Global struct that holds a Timonel instance's running status */
-    byte BootloaderInit(void);
+    // Page writer: upload page sequence and page addressing functions, picked for each device from its features
+    struct PageWriter {
+        word (Timonel::*p_get_pages)(const int payload_size,
+                                     const int start_address);
+        byte (Timonel::*p_load_page)(PayloadReader &reader,
+                                     const int payload_size,
+                                     const int start_address,
+                                     const word page_ix,
+                                     byte page_data[],
+                                     word *p_page_number);
+        byte (Timonel::*p_write_page)(const byte page_data[],
+                                      const word page_number,
+                                      const byte page_offset);
+    };
+    static const PageWriter auto_page_writer_; /* AUTO_PAGE_ADDR: Timonel sets the page addresses */
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+    static const PageWriter manual_page_writer_; /* The TWI master sets the page addresses and writes the special pages */
+#endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
+    const PageWriter *p_page_writer_ = &auto_page_writer_;
+    Status status_;             /* Global struct that holds a Timonel instance's running status */
+    bool status_valid_ = false; /* False when the device status may have changed since the last reading */
+    word app_reset_ = 0;        /* Application reset vector, taken from the first page for the trampoline page */
+    byte BootloaderInit(const bool cached_status = false);
     byte QueryStatus(void);
+    byte AppCmdXmit(const byte app_twi_address,
+                    const byte twi_cmd,
+                    const byte twi_reply);
+    byte AppCmdXmit(const byte app_twi_address,
+                    const byte twi_cmd_arr[],
+                    const byte cmd_size,
+                    const byte twi_reply,
+                    byte twi_reply_arr[],
+                    const byte reply_size);
+    byte WaitForApp(const byte app_twi_address,
+                    const word timeout);
+    byte SendStubPage(const byte stub_twi_address,
+                      const byte bootloader[],
+                      const int bootloader_size,
+                      const word page_offset);
+    byte ParseStatus(const byte twi_reply_arr[]);
+    byte RequestFlashCrc(const word address,
+                         const word size,
+                         word *p_crc);
+    template <byte packet_size>
     byte SendDataPacket(const byte data_packet[]);
-#if (!((defined FEATURES_CODE) && ((FEATURES_CODE >> F_AUTO_PAGE_ADDR) & true)))
-    byte SetPageAddress(const word page_addr);
-    byte FillSpecialPage(const byte page_type,
-                         const byte app_reset_msb = 0,
-                         const byte app_reset_lsb = 0);
+    byte SendPacket(const byte twi_cmd_code,
+                    const byte twi_reply,
+                    const byte data[],
+                    const byte data_size,
+                    const byte app_twi_address = 0);
+    word PacketCheck(const word check, const byte data);
+    byte WritePage(const byte page_data[],
+                   const word page_number,
+                   const byte page_offset = 0);
+    byte SendPage(const byte page_data[],
+                  const word page_number,
+                  const byte page_offset);
+    byte ResyncPage(const word page_number,
+                    byte *p_offset);
+    word GetUploadPages(const int payload_size,
+                        const int start_address);
+    byte LoadPage(PayloadReader &reader,
+                  const int payload_size,
+                  const int start_address,
+                  const word page_ix,
+                  byte page_data[],
+                  word *p_page_number);
+    word GetAutoPages(const int payload_size,
+                      const int start_address);
+    byte LoadAutoPage(PayloadReader &reader,
+                      const int payload_size,
+                      const int start_address,
+                      const word page_ix,
+                      byte page_data[],
+                      word *p_page_number);
+    byte UploadPages(PayloadReader &reader,
+                     const int payload_size,
+                     const int start_address,
+                     const word first_page,
+                     const byte page_offset);
     word CalculateTrampoline(const word bootloader_start,
                              const word application_start);
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+    byte ReadFlashBlock(const word address,
+                        byte data[],
+                        const byte data_size);
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_SETPGADDR) & true))
+    byte SetPageAddress(const word page_addr);
+    word GetManualPages(const int payload_size,
+                        const int start_address);
+    byte LoadManualPage(PayloadReader &reader,
+                        const int payload_size,
+                        const int start_address,
+                        const word page_ix,
+                        byte page_data[],
+                        word *p_page_number);
+    byte WriteManualPage(const byte page_data[],
+                         const word page_number,
+                         const byte page_offset);
+    void FillSpecialPage(const byte page_type,
+                         byte page_data[],
+                         const word app_reset = 0);
 #endif /* FEATURES_CODE >> F_CMD_SETPGADDR */
 };
 
+#if ((defined MULTI_DEVICE) && (MULTI_DEVICE == true))
+// Class TimonelPool: Statically allocated Timonel objects, reused across bus discoveries without using the heap
+template <byte pool_size>
+class TimonelPool {
+   public:
+    ~TimonelPool() {
+        Clear();
+    }
+    // Create a Timonel object for each bootloader found by TwiBus::DiscoverDevices, returns the device count
+    byte Load(const TwiBus::DeviceEntry dev_table[], const byte dev_count) {
+        Clear();
+        for (byte i = 0; (i < dev_count) && (count_ < pool_size); i++) {
+            if (dev_table[i].firmware == FW_TIMONEL) {
+                p_devices_[count_] = new (storage_[count_]) Timonel(dev_table[i]);
+                count_++;
+            }
+        }
+        return count_;
+    }
+    // Destroy the pool objects, releasing their TWI addresses
+    void Clear(void) {
+        while (count_ > 0) {
+            p_devices_[--count_]->~Timonel();
+        }
+    }
+    byte GetCount(void) {
+        return count_;
+    }
+    Timonel **GetDevices(void) {
+        return p_devices_;
+    }
+    Timonel *operator[](const byte device_ix) {
+        return p_devices_[device_ix];
+    }
+
+   private:
+    alignas(Timonel) byte storage_[pool_size][sizeof(Timonel)]; /* Static storage for the Timonel objects */
+    Timonel *p_devices_[pool_size] = {nullptr};
+    byte count_ = 0;
+};
+#endif /* MULTI_DEVICE */
+
 #endif /* _TIMONELTWIM_H_ */
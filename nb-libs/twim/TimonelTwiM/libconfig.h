@@ -18,12 +18,13 @@
 // General defs
 #define DEBUG_LEVEL 0       /* Debug level: 0 = No debug info over serial terminal, 1+ = Progressively increasing verbosity */
 #define USE_SERIAL Serial   /* Console output */
-#define FEATURES_CODE 253   /* Enabled features (NOTE: This must match the bootloader, If you aren't sure, use 253 (default) */
+#define FEATURES_CODE 253   /* Enabled features (NOTE: This must include the features of every bootloader driven, If you aren't sure, use 253 (default) */
 #define EXT_FEATURES 15     /* Enabled extended features (NOTE: This must match the bootloader, If you aren't sure, use 15 */
 #define LOW_TML_ADDR 8      /* Lowest allowed TWI address for Timonel devices */
 #define HIG_TML_ADDR 35     /* Highest allowed TWI address for Timonel devices */
 #define T_SIGNATURE 84      /* Timonel signature "T" (Uppercase means clock tweaking made at compile time*/
 #define MST_PACKET_SIZE 32  /* Master-to-Slave Xmit data block size: always even values, min = 2, max = 32 */
+#define MST_PACKET_LARGE 64 /* Master-to-Slave full-page data block size, used when Timonel reports it (set 32 to disable) */
 #define SLV_PACKET_SIZE 32  /* Slave-to-Master Xmit data block size: always even values, min = 2, max = 32 */
 #define SPM_PAGESIZE 64     /* Tiny85 flash page buffer size */
 #define OK 0                /* No error in function execution */
@@ -32,7 +33,7 @@
 // Timonel::QueryStatus defs
 #define CMD_ACK_POS 0       /* Command acknowledge reply position */
 // *** Status reply (10 bytes)
-#define S_REPLY_LENGTH 12   /* Timonel status reply lenght (1 bit ACK + 8 status bytes + 1 checksum byte) */
+#define S_REPLY_LENGTH 16   /* Timonel status reply lenght (1 bit ACK + 15 status bytes) */
 #define S_SIGNATURE 1       /* Status: signature byte position */
 #define S_MAJOR 2           /* Status: major number byte position */
 #define S_MINOR 3           /* Status: minor number byte position */
@@ -44,6 +45,12 @@
 #define S_APPL_ADDR_LSB 9   /* Status: Application address LSB position */
 #define S_LOW_FUSE 10       /* Status: Low fuse setting */
 #define S_OSCCAL 11         /* Status: AVR low fuse value byte position */
+#define S_MST_PACKET 12     /* Status: biggest WRITPAGE data packet accepted (0xFF in older versions) */
+#define S_SLV_PACKET 13     /* Status: biggest READFLSH data packet sent (0xFF in older versions) */
+#define S_WINDOW_ACK 0x80   /* Status: packet size byte flag, WRITPGWN windowed data packets accepted */
+#define S_STRETCH_WR 0x80   /* Status: READFLSH packet size byte flag, page writes held by clock stretching */
+#define S_WRITE_PAGE 14     /* Status: page where the next data packet is written (0xFF in older versions) */
+#define S_WRITE_OFFSET 15   /* Status: data bytes already in the page buffer (0xFF in older versions) */
 // *** Features byte (8 bits)
 #define F_ENABLE_LED_UI 0   /* Features 1 (1)  : LED UI enabled */
 #define F_AUTO_PAGE_ADDR 1  /* Features 2 (2)  : Automatic trampoline and addr handling */
@@ -58,14 +65,20 @@
 #define F_FORCE_ERASE_PG 1  /* Ext features 2 (2)  : Erase each page before writing new data */
 #define F_CLEAR_BIT_7_R31 2 /* Ext features 3 (4)  : Prevent code first instruction from being skipped */
 #define F_CHECK_PAGE_IX 3   /* Ext features 4 (8)  : Check that the page index is < SPM_PAGESIZE */
-// Extended features 5 to 8 not used
+#define F_CMD_GENCALL 4     /* Ext features 5 (16) : General call (broadcast) commands enabled */
+#define F_CMD_ERASEPAG 5    /* Ext features 6 (32) : Erase page command enabled */
+#define F_USE_CRC16 6       /* Ext features 7 (64) : CRC16 data packet checks and GETCRC command enabled */
+#define F_CMD_WRITERLE 7    /* Ext features 8 (128): Run-length encoded page write command enabled */
+#define ERR_NOT_TIMONEL 1   /* Error: the status reply doesn't come from a Timonel bootloader */
 // End Timonel::QueryStatus defs
 
+// Timonel::BootloaderInit defs
+#define TWI_STRETCH_LIMIT 25000 /* Config: clock stretching accepted when Timonel holds the bus while writing a page (us) */
+// End Timonel::BootloaderInit defs
+
 // Timonel::FillSpecialPage defs
 #define RST_PAGE 1          /* Config: 1=Reset page (addr: 0) */
 #define TPL_PAGE 2          /* Config: 2=Trampoline page (addr: TIMONEL_START - 64) */
-#define DLY_SET_ADDR 100    /* Delay after setting a memory address */
-#define DLY_RETURN 100      /* Delay before return control to caller */
 // End Timonel::FillSpecialPage defs
 
 // Timonel::DumpMemory defs
@@ -73,6 +86,7 @@
 #define VALUES_PER_LINE 32  /* Config: Memory positions values to display per line */
 #define D_CMD_LENGTH 4      /* Config: READFLSH command lenght (1 cmd byte + 2 addr bytes + 1 rx size byte + 1 checksum byte) */
 #define D_REPLY_OVRHD 2     /* Config: READFLSH reply overhead: extra bytes added to the reply: 1 ack + 1 checksum */
+#define D_REPLY_OVRHD_CRC 3 /* Config: READFLSH reply overhead with CRC16 enabled: 1 ack + 2 CRC bytes */
 #define MAXCKSUMERRORS 3    /* Config: DumpMemory max count of errors accepted */
 #define ERR_NOT_SUPP 1      /* Error: function not supported in current setup */
 #define ERR_CMD_PARSE_D 2   /* Error: reply doesn't match DumpMemory command */
@@ -86,20 +100,94 @@
 #define ERR_TX_PKT_CHKSUM 1 /* Error: Received checksum doesn't match transmitted packet */
 // End Timonel::SendDataPacket defs
 
+// Timonel::EncodeRle defs
+#define RLE_RUN_FLAG 0x80   /* WRITERLE token bit 8: the next word is repeated, otherwise n + 1 words follow */
+#define RLE_COUNT_MASK 0x7F /* WRITERLE token bits 1-7: word count - 1 */
+#define RLE_MIN_RUN 2       /* Shortest run of repeated words encoded as a run token */
+// End Timonel::EncodeRle defs
+
+// Timonel::GetFlashCrc defs
+#define CRC16_INIT 0xFFFF   /* CRC16 initial value (CCITT polynomial, same as Timonel) */
+#define CRC16_POLY 0x1021   /* CRC16 CCITT polynomial */
+#define G_CMD_LENGTH 5      /* GETCRC command length when setting the range (1 cmd byte + 2 addr bytes + 2 size bytes) */
+#define G_REPLY_LENGTH 3    /* GETCRC reply length when returning the CRC16 (1 ack + 2 CRC bytes) */
+#define TMO_GET_CRC 1000    /* Max time to wait for Timonel to calculate a flash memory CRC16 (~0.5 s for 8 kB at 1 MHz) */
+// End Timonel::GetFlashCrc defs
+
+// Timonel::GetDeviceStats defs
+#define T_CMD_LENGTH 2      /* GETSTATS command length (1 cmd byte + 1 entry byte) */
+#define T_REPLY_LENGTH 8    /* GETSTATS reply length (1 ack + 2 count bytes + 4 ticks bytes + 1 clock byte) */
+#define ERR_STATS_ENTRY 2   /* Error: the entry doesn't exist or the device didn't return it */
+// End Timonel::GetDeviceStats defs
+
 // Timonel::UploadApplication defs
-#define DLY_PKT_SEND 10     /* Delay after sending a data packet */
-#define DLY_FLASH_PG 100    /* Delay to allow memory page flashing */
+#define TMO_FLASH_PG 100    /* Max time to wait for Timonel to be ready after sending a packet (~4.5 ms per page write) */
 #define TRAMPOLINE_LEN 2    /* Trampoline length: two-byte address to jump to the app */
 #define ERR_SETADDRESS 1    /* Error: AUTO_PAGE_ADDR and CMD_SETPGADDR are disabled, can't set page addresses */
 #define ERR_APP_OVF_AU 2    /* Error: the payload doesn't fit in AVR memory (auto page addr calculation) */
 #define ERR_APP_OVF_MC 3    /* Error: the payload doesn't fit in AVR memory (page addr calculated by TWI master) */
 #define ERR_AUTO_CALC  4    /* Error: AUTO_PAGE_ADDR is disabled and the addr handling cade is not included in TWI master */
+#define ERR_PAYLOAD_END 5   /* Error: the payload reader ran out of data before reaching the payload size */
 // End Timonel::UploadApplication defs
 
+// Timonel::WritePage defs
+#define MAX_PKT_RETRY 3     /* Config: WritePage max retries of a packet, and status reads per resync, after TWI or packet check errors */
+#define ERR_PAGE_SYNC 2     /* Error: the page position reported by Timonel doesn't match the page being sent */
+// End Timonel::WritePage defs
+
+// Timonel::SetPageAddress defs
+#define P_CMD_LENGTH 4      /* STPGADDR command length (1 cmd byte + 2 addr bytes + 1 checksum byte) */
+#define P_REPLY_LENGTH 2    /* STPGADDR reply length (1 ack + 1 addr checksum) */
+// End Timonel::SetPageAddress defs
+
+// Timonel::ReadFlash defs
+#define MAX_READ_RETRY 3    /* Config: ReadFlash max retries per data packet, and GetFlashCrc ones, after TWI or checksum errors */
+#define ERR_READ_RANGE 2    /* Error: the requested range is outside the flash memory */
+// End Timonel::ReadFlash defs
+
+// Timonel::UploadJob defs
+#define JOB_IDLE 0          /* Upload job state: not started */
+#define JOB_SEND_PAGE 1     /* Upload job state: the device is ready to receive the next page */
+#define JOB_WRITING 2       /* Upload job state: the device is writing the last page received */
+#define JOB_DELETING 3      /* Upload job state: the device is deleting the application after an error */
+#define JOB_DONE 4          /* Upload job state: the application upload is complete */
+#define JOB_FAILED 5        /* Upload job state: the application upload failed after all the retries */
+// End Timonel::UploadJob defs
+
+// Timonel::VerifyApplication defs
+#define ERR_VERIFY_READ 2   /* Error: the flash memory couldn't be read back from Timonel */
+#define ERR_VERIFY_DATA 3   /* Error: the flash memory contents don't match the payload */
+// End Timonel::VerifyApplication defs
+
+// Timonel::NegotiateClock defs
+#define CLK_STEP_FAST 400000   /* TWI clock step: fast mode (Hz) */
+#define CLK_STEP_FAST_2 800000 /* TWI clock step: twice the fast mode (Hz) */
+#define CLK_STEP_MAX 1000000   /* TWI clock step: fast mode plus, the highest one tried (Hz) */
+#define CLK_TEST_COUNT 8    /* Config: test transactions per clock step, any error ends the negotiation */
+#define CLK_TEST_CRC 64     /* Config: flash memory bytes checked with GETCRC on each test, if CRC16 is enabled */
+// End Timonel::NegotiateClock defs
+
 // Timonel::DeleteApplication defs
-#define DLY_DEL_INIT 750    /* Delay to allow deleting the app before initializing Timonel */
+#define TMO_DEL_INIT 1500   /* Max time to wait for Timonel to delete the app and restart before initializing it */
+#define MAX_DEL_RETRY 2     /* Config: DeleteApplication max retries after TWI errors */
 // End Timonel::DeleteApplication defs
 
+// Timonel::EnterBootloader defs
+#define ERR_APP_REBOOT 1    /* Error: neither the application nor Timonel answered at their TWI addresses */
+// End Timonel::EnterBootloader defs
+
+// Timonel::UpdateBootloader defs
+#define UPD_PACKET_SIZE 32  /* Config: WRITPAGE data packet size sent to the update stub (its RX buffer holds 64 bytes) */
+#define TMO_STUB_START 500  /* Max time to wait for the update stub to start after running it */
+#define TMO_STUB_CRC 100    /* Max time to wait for the update stub to calculate the staged image CRC16 */
+#define I_CMD_LENGTH 7      /* INSTTMNL command length (1 cmd byte + 2 start bytes + 2 size bytes + 2 CRC16 bytes) */
+#define I_REPLY_LENGTH 2    /* INSTTMNL reply length (1 ack + 1 status byte) */
+#define ERR_UPD_STUB 1      /* Error: the update stub didn't start at its TWI address */
+#define ERR_UPD_PAGE 2      /* Error: a bootloader page couldn't be staged after MAX_PKT_RETRY attempts */
+#define ERR_UPD_CRC 3       /* Error: the staged image CRC16 doesn't match the bootloader image */
+#define ERR_UPD_INSTALL 4   /* Error: the update stub rejected the install (image size or address out of range) */
+// End Timonel::UpdateBootloader defs
+
 /////////////////////////////////////////////////////////////////////////////
 ////////////                    End settings                     ////////////
 /////////////////////////////////////////////////////////////////////////////
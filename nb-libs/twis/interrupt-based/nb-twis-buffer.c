@@ -0,0 +1,129 @@
+/*
+ *  NB TWI Slave Buffer Streaming
+ *  Author: Gustavo Casanova
+ *  .............................................
+ *  File: nb-twis-buffer.c (Buffer streaming library)
+ *  .............................................
+ *  Version: 1.0 / 2019-08-09
+ *  gustavo.casanova@nicebots.com
+ *  .............................................
+ *  READBUFF and WRITBUFF command handling for
+ *  the applications that stream data to or from
+ *  a TWI master (NbMicro ReadBuffer/WriteBuffer)
+ *  .............................................
+ */
+
+// Includes
+#include "nb-twis-buffer.h"
+
+// Buffer streaming globals
+static uint8_t read_frame[BUFF_READ_LEN(TWIS_BUFF_FRAME)]; /* Last READBUFF reply, resent when the master repeats it */
+static uint8_t read_length = 0;                             /* Last READBUFF reply length (0 = none) */
+static uint8_t write_seq = 0;                               /* Last WRITBUFF frame sequence number */
+static uint8_t write_accepted = BUFF_CHECK_ERR;             /* Last WRITBUFF frame accepted bytes (BUFF_CHECK_ERR = none) */
+
+/*  ___________________________
+   |                           |
+   | Buffer streaming reset    |
+   |___________________________|
+*/
+// Forget the last frames, e.g. when the application restarts its data buffers.
+void TwisBufferReset(void) {
+    read_length = 0;
+    write_accepted = BUFF_CHECK_ERR;
+}
+
+/*  ___________________________
+   |                           |
+   | Buffer streaming commands |
+   |___________________________|
+*/
+// Handles a READBUFF or WRITBUFF command and writes its reply in place. Returns the reply length,
+// or 0 if the command isn't one of them. A frame with the same sequence number as the previous one
+// is a master retry after a lost reply: the previous reply is repeated without reading or writing
+// the application data again. A frame failing its checksum is answered without changing the last
+// frame recorded. Frames are always processed without waiting for the application.
+uint8_t TwisBufferCommand(const uint8_t *command, uint8_t length, uint8_t *reply) {
+    if (length < BUFF_READ_CMD_LEN) {
+        return 0;
+    }
+    uint8_t count = command[2] & BUFF_COUNT_MASK;
+    switch (command[0]) {
+        // ******************
+        // * READBUFF Reply *
+        // ******************
+        case READBUFF: {
+            if ((uint8_t)(command[1] + command[2]) != command[3]) {
+                // Corrupted command: reply a frame that fails the master check, the application data isn't read
+                reply[0] = ACKRDBUF;
+                reply[1] = command[1];
+                reply[2] = 0;
+                reply[3] = ~command[1];
+                return BUFF_READ_LEN(0);
+            }
+            if ((command[2] & BUFF_START_FLAG) ||
+                (read_length == 0) ||
+                (read_frame[1] != command[1])) {
+                // New frame: read the next data bytes from the application
+                if (count > TWIS_BUFF_FRAME) {
+                    count = TWIS_BUFF_FRAME;
+                }
+                if (p_buffer_source) {
+                    count = p_buffer_source(&read_frame[3], count);
+                } else {
+                    count = 0;
+                }
+                read_frame[0] = ACKRDBUF;
+                read_frame[1] = command[1];
+                read_frame[2] = count;
+                uint8_t sum = command[1] + count;
+                for (uint8_t i = 0; i < count; i++) {
+                    sum += read_frame[i + 3];
+                }
+                read_frame[count + 3] = sum;
+                read_length = BUFF_READ_LEN(count);
+            }
+            for (uint8_t i = 0; i < read_length; i++) {
+                reply[i] = read_frame[i];
+            }
+            return read_length;
+        }
+        // ******************
+        // * WRITBUFF Reply *
+        // ******************
+        case WRITBUFF: {
+            if ((command[2] & BUFF_START_FLAG) ||
+                (write_accepted == BUFF_CHECK_ERR) ||
+                (write_seq != command[1])) {
+                // New frame: check it and pass its data bytes to the application
+                uint8_t sum = command[1] + count;
+                if ((count <= TWIS_BUFF_FRAME) && (length >= BUFF_WRITE_LEN(count))) {
+                    for (uint8_t i = 0; i < count; i++) {
+                        sum += command[i + 3];
+                    }
+                    sum -= command[count + 3];
+                } else {
+                    sum = 1; /* Wrong frame size */
+                }
+                if (sum != 0) {
+                    // Not recorded: the last frame taken is still answered with its reply when the master repeats it
+                    reply[0] = ACKWTBUF;
+                    reply[1] = command[1];
+                    reply[2] = BUFF_CHECK_ERR;
+                    reply[3] = command[1] + BUFF_CHECK_ERR;
+                    return BUFF_WRITE_RPLY_LEN;
+                }
+                write_seq = command[1];
+                write_accepted = p_buffer_sink ? p_buffer_sink(&command[3], count) : 0;
+            }
+            reply[0] = ACKWTBUF;
+            reply[1] = command[1];
+            reply[2] = write_accepted;
+            reply[3] = command[1] + write_accepted;
+            return BUFF_WRITE_RPLY_LEN;
+        }
+        default: {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ *  NB TWI Slave Buffer Streaming
+ *  Author: Gustavo Casanova
+ *  .............................................
+ *  File: nb-twis-buffer.h (Buffer streaming headers)
+ *  .............................................
+ *  Version: 1.0 / 2019-08-09
+ *  gustavo.casanova@nicebots.com
+ *  .............................................
+ *  READBUFF and WRITBUFF command handling for
+ *  the applications that stream data to or from
+ *  a TWI master (NbMicro ReadBuffer/WriteBuffer)
+ *  .............................................
+ */
+
+#ifndef _NB_TWIS_BUFFER_H_
+#define _NB_TWIS_BUFFER_H_
+
+// Includes
+#include <stdbool.h>
+#include <stdint.h>
+#include "../../cmd/nb-twi-cmd.h"
+
+// Frame definitions: READBUFF  = {cmd, seq, count | start, sum}         -> {ack, seq, count, data ..., sum}
+//                    WRITBUFF  = {cmd, seq, count | start, data ..., sum} -> {ack, seq, accepted, sum}
+// The READBUFF command and WRITBUFF reply sums add up their sequence number and count bytes, so a
+// corrupted one is never taken as a new frame or a wrong accepted count.
+#ifndef TWIS_BUFF_FRAME
+#define TWIS_BUFF_FRAME 24      /* Max data bytes per frame, the TWI RX and TX buffers must fit it + 4 */
+#endif /* TWIS_BUFF_FRAME */
+
+#define BUFF_START_FLAG 0x80    /* Count byte flag: first frame of a transfer, it's never a repetition */
+#define BUFF_COUNT_MASK 0x7F    /* Count byte mask: data bytes requested or sent */
+#define BUFF_CHECK_ERR 0xFF     /* WRITBUFF reply accepted byte count when the frame checksum fails */
+#define BUFF_READ_LEN(n) ((n) + 4)  /* READBUFF reply length */
+#define BUFF_WRITE_LEN(n) ((n) + 4) /* WRITBUFF command length */
+#define BUFF_READ_CMD_LEN 4     /* READBUFF command length */
+#define BUFF_WRITE_RPLY_LEN 4   /* WRITBUFF reply length */
+
+// Function pointers: application data source and sink, they return the bytes read or accepted
+uint8_t (*p_buffer_source)(uint8_t *, uint8_t);
+uint8_t (*p_buffer_sink)(const uint8_t *, uint8_t);
+
+// Buffer streaming prototypes
+void TwisBufferReset(void);
+uint8_t TwisBufferCommand(const uint8_t *, uint8_t, uint8_t *);
+
+#endif /* _NB_TWIS_BUFFER_H_ */
@@ -14,16 +14,40 @@
 // Includes
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/wdt.h>
+#include <stddef.h>
+#include "../../cmd/nb-twi-cmd.h"
 #include "nb-usitwisl.h"
 
 // USI TWI driver globals
 uint8_t twi_addr = 0;
+#if TWI_BLOCK_API
+uint8_t rx_frames[2][TWI_FRAME_SIZE];
+uint8_t tx_frames[2][TWI_FRAME_SIZE];
+volatile uint8_t rx_length[2] = {0, 0}; /* Bytes received in each RX frame */
+volatile uint8_t tx_length[2] = {0, 0}; /* Bytes committed in each TX frame (0 = free) */
+volatile uint8_t rx_fill = 0;           /* RX frame filled by the ISR, the other one belongs to the application */
+volatile bool rx_ready = false;         /* The application's RX frame holds a complete transaction */
+volatile uint8_t tx_send = 0;           /* TX frame sent on the next master read */
+uint8_t tx_pos = 0;                     /* Next byte to send from the current TX frame */
+uint8_t tx_claim = 0;                   /* TX frame claimed by the application */
+#else
 uint8_t rx_buffer[TWI_RX_BUFFER_SIZE];
 uint8_t tx_buffer[TWI_TX_BUFFER_SIZE];
 uint8_t rx_byte_count = 0; /* Bytes received in RX buffer */
 uint8_t rx_head = 0, rx_tail = 0;
 uint8_t tx_head = 0, tx_tail = 0;
+#endif /* TWI_BLOCK_API */
 OverflowState twi_driver_state;
+#if TWI_ADDR_FROM_BOOT
+uint8_t boot_app_addr[2] __attribute__((section(".noinit"))); /* r2 and r3 as left by Timonel at exit */
+#endif /* TWI_ADDR_FROM_BOOT */
+
+#if TWI_BLOCK_API
+// USI TWI driver frame handling prototypes
+static void RxFrameEnd(void);
+static void TxFrameDone(void);
+#endif /* TWI_BLOCK_API */
 
 // USI TWI driver basic operations prototypes
 void SET_USI_TO_WAIT_FOR_TWI_ADDRESS(void);
@@ -45,6 +69,32 @@ inline static void SET_USI_SCL_AS_INPUT(void) __attribute__((always_inline));
 inline static void SET_USI_SDA_AND_SCL_AS_OUTPUT(void) __attribute__((always_inline));
 inline static void SET_USI_SDA_AND_SCL_AS_INPUT(void) __attribute__((always_inline));
 
+#if TWI_ADDR_FROM_BOOT
+/*  _______________________________
+   |                               |
+   | Timonel TWI address handover  |
+   |_______________________________|
+*/
+// Saves r2 and r3 at the very start of the application, before the C runtime startup code runs.
+// This naked function is placed in the .init0 section, so it has no prologue and no return.
+void SaveBootAddress(void) __attribute__((naked, used, section(".init0")));
+void SaveBootAddress(void) {
+    asm volatile(
+        "sts boot_app_addr, r2 \n\t"
+        "sts boot_app_addr + 1, r3 \n\t");
+}
+
+// Returns the application TWI address handed over by Timonel, or the default one when r2 and r3
+// didn't hold a valid address and its complement at startup.
+uint8_t UsiTwiBootAddress(uint8_t default_address) {
+    if ((boot_app_addr[1] == (uint8_t)~boot_app_addr[0]) &&
+        (boot_app_addr[0] >= (8 + APP_ADDR_OFFSET)) && (boot_app_addr[0] <= (35 + APP_ADDR_OFFSET))) {
+        return boot_app_addr[0];
+    }
+    return default_address;
+}
+#endif /* TWI_ADDR_FROM_BOOT */
+
 /*  _______________________________
    |                               |
    | USI TWI driver initialization |
@@ -52,9 +102,20 @@ inline static void SET_USI_SDA_AND_SCL_AS_INPUT(void) __attribute__((always_inli
 */
 void UsiTwiDriverInit(uint8_t address) {
     // Initialize USI for TWI Slave mode.
+#if TWI_ADDR_FROM_BOOT
+    twi_addr = UsiTwiBootAddress(address); /* Per-node TWI address from Timonel, if any */
+#else
     twi_addr = address;                    /* Device TWI address */
+#endif /* TWI_ADDR_FROM_BOOT */
+#if TWI_BLOCK_API
+    rx_length[0] = rx_length[1] = 0;       /* Flush TWI RX frames */
+    tx_length[0] = tx_length[1] = 0;       /* Flush TWI TX frames */
+    rx_fill = tx_send = tx_pos = 0;
+    rx_ready = false;
+#else
     tx_tail = tx_head = 0;                 /* Flush TWI TX buffers */
     rx_tail = rx_head = rx_byte_count = 0; /* Flush TWI RX buffers */
+#endif /* TWI_BLOCK_API */
     SET_USI_SDA_AND_SCL_AS_OUTPUT();       /* Set SCL and SDA as output */
     PORT_USI |= (1 << PORT_USI_SDA);       /* Set SDA high */
     PORT_USI |= (1 << PORT_USI_SCL);       /* Set SCL high */
@@ -62,6 +123,106 @@ void UsiTwiDriverInit(uint8_t address) {
     SET_USI_TO_WAIT_FOR_TWI_ADDRESS();     /* Wait for TWI start condition and address from master */
 }
 
+#if TWI_BLOCK_API
+/*  ___________________________
+   |                           |
+   | USI TWI RX frame access   |
+   |___________________________|
+*/
+// Returns the length of the received frame and points p_frame to it, or 0 when there is none. The
+// frame stays valid until UsiTwiReleaseRxFrame is called, meanwhile the ISR fills the other one.
+uint8_t UsiTwiGetRxFrame(uint8_t **p_frame) {
+    uint8_t length = 0;
+    uint8_t sreg = SREG;
+    cli();
+    // The USI has no stop condition interrupt, so a transaction ended by a stop is closed here
+    if (USISR & (1 << TWI_STOP_COND_FLAG)) {
+        RxFrameEnd();
+    }
+    if (rx_ready) {
+        *p_frame = rx_frames[rx_fill ^ 1];
+        length = rx_length[rx_fill ^ 1];
+    }
+    SREG = sreg;
+    return length;
+}
+
+/*  ___________________________
+   |                           |
+   | USI TWI RX frame release  |
+   |___________________________|
+*/
+// Hands the application's RX frame back to the ISR.
+void UsiTwiReleaseRxFrame(void) {
+    rx_ready = false;
+}
+
+/*  ___________________________
+   |                           |
+   | USI TWI TX frame claim    |
+   |___________________________|
+*/
+// Returns a free TX frame for the application to write its reply in place, or NULL when both
+// frames are still waiting to be read by the master. Frames are sent in commit order.
+uint8_t *UsiTwiClaimTxFrame(void) {
+    uint8_t *frame = NULL;
+    uint8_t sreg = SREG;
+    cli();
+    if (tx_length[tx_send] == 0) {
+        tx_claim = tx_send;
+        frame = tx_frames[tx_claim];
+    } else if (tx_length[tx_send ^ 1] == 0) {
+        tx_claim = tx_send ^ 1;
+        frame = tx_frames[tx_claim];
+    }
+    SREG = sreg;
+    return frame;
+}
+
+/*  ___________________________
+   |                           |
+   | USI TWI TX frame commit   |
+   |___________________________|
+*/
+// Queues the claimed TX frame to be sent on a master read.
+void UsiTwiCommitTxFrame(uint8_t length) {
+    if (length > TWI_FRAME_SIZE) {
+        length = TWI_FRAME_SIZE;
+    }
+    tx_length[tx_claim] = length;
+}
+
+/*  ___________________________
+   |                           |
+   | USI TWI RX frame end      |
+   |___________________________|
+*/
+// Swaps the RX frames when a transaction ends (start or stop condition). If the application still
+// holds its frame, the received one is kept until it's released and the next write transactions are
+// NACKed at their address, so two transactions are never merged in the same frame.
+static void RxFrameEnd(void) {
+    if ((rx_length[rx_fill] != 0) && (!rx_ready)) {
+        rx_fill ^= 1;
+        rx_length[rx_fill] = 0;
+        rx_ready = true;
+    }
+}
+
+/*  ___________________________
+   |                           |
+   | USI TWI TX frame done     |
+   |___________________________|
+*/
+// Frees the TX frame sent to the master and moves to the next committed one. A frame committed after
+// the master started reading TWI_FRAME_PAD bytes (tx_pos still 0) is left for the next read.
+static void TxFrameDone(void) {
+    if ((tx_length[tx_send] != 0) && (tx_pos != 0)) {
+        tx_length[tx_send] = 0;
+        tx_send ^= 1;
+    }
+    tx_pos = 0;
+}
+#else
 /*  ___________________________
    |                           |
    | USI TWI byte transmission |
@@ -85,6 +246,38 @@ uint8_t UsiTwiReceiveByte(void) {
     rx_tail = ((rx_tail + 1) & TWI_RX_BUFFER_MASK); /* Update the RX buffer index */
     return rx_buffer[rx_tail];                      /* Return data from the buffer */
 }
+#endif /* TWI_BLOCK_API */
+
+/*  ___________________________
+   |                           |
+   | USI TWI driver suspension |
+   |___________________________|
+*/
+// Releases the TWI lines while the application runs a slow operation (e.g. writing the flash memory),
+// the device doesn't acknowledge its address until UsiTwiDriverInit is called again. This way the TWI
+// master can poll the address to know when the operation is complete, as with Timonel.
+void UsiTwiDriverSuspend(void) {
+    USICR = 0;                             /* Disable the USI two-wire mode */
+    SET_USI_SDA_AND_SCL_AS_INPUT();        /* Float SCL and SDA */
+}
+
+/*  ___________________________
+   |                           |
+   | Reboot into the bootloader|
+   |___________________________|
+*/
+// Leaves the reboot handshake marker at the SRAM start and resets the device with the watchdog, then
+// Timonel waits for the TWI master instead of running the application again on timeout. Called from
+// the main loop after replying BOOTTMNL, the master has until the watchdog reset to read the reply.
+// The interrupts stay enabled for it, so the marker is written again after each TWI interrupt in case
+// an application variable placed there was changed.
+void UsiTwiRebootToBootloader(void) {
+    volatile uint16_t *p_boot_hold = (void *)BOOT_HOLD_ADDR;
+    wdt_enable(WDTO_15MS);
+    for (;;) {
+        *p_boot_hold = BOOT_HOLD_MARK;
+    }
+}
 
 /*  _______________________________________________________
    |                                                       |
@@ -99,6 +292,9 @@ ISR(USI_START_VECTOR) {
     // should check whether it has to reply. Prepare the next overflow handler state for it.
     // Next state -> STATE_CHECK_RECEIVED_ADDRESS
     twi_driver_state = STATE_CHECK_RECEIVED_ADDRESS;
+#if TWI_BLOCK_API
+    RxFrameEnd(); /* A start condition ends the previous transaction */
+#endif /* TWI_BLOCK_API */
     while ((PIN_USI & (1 << PORT_USI_SCL)) && (!(PIN_USI & (1 << PORT_USI_SDA)))) {
         // Wait for SCL to go low to ensure the start condition has completed.
         // The start detector will hold SCL low.
@@ -133,12 +329,23 @@ ISR(USI_OVERFLOW_VECTOR) {
                 if (USIDR & 0x01) { /* If data register low-order bit = 1, start the send data mode */
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
                     if (p_receive_event) {               //                           >>
+#if TWI_BLOCK_API
+                        p_receive_event(rx_ready ? rx_length[rx_fill ^ 1] : 0);
+#else
                         p_receive_event(rx_byte_count);  // Process data in main ...    >>
+#endif /* TWI_BLOCK_API */
                     }                                    //                           >>
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
                     // Next state -> STATE_SEND_DATA_BYTE
                     twi_driver_state = STATE_SEND_DATA_BYTE;
                 } else { /* If data register low-order bit = 0, start the receive data mode */
+#if TWI_BLOCK_API
+                    if (rx_ready && (rx_length[rx_fill] != 0)) {
+                        // Both RX frames hold a transaction: NACK the address until the application releases its frame
+                        SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                        return;
+                    }
+#endif /* TWI_BLOCK_API */
                     // Next state -> STATE_RECEIVE_DATA_BYTE
                     twi_driver_state = STATE_RECEIVE_DATA_BYTE;
                 }
@@ -161,6 +368,10 @@ ISR(USI_OVERFLOW_VECTOR) {
                     p_enable_slow_ops();  // Enable slow operations in main!        >>
                 }                         //                                      >>
                 // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
+#if TWI_BLOCK_API
+                TxFrameDone(); /* Don't drop into the next frame */
+                return;
+#endif /* TWI_BLOCK_API */
             }
             // Just drop straight into STATE_SEND_DATA_BYTE (no break) ...
         }
@@ -168,6 +379,14 @@ ISR(USI_OVERFLOW_VECTOR) {
         // counter overflows, it means that a byte has been transmitted, so this device is ready
         // to transmit again or wait for a new start condition and address on the bus.
         case STATE_SEND_DATA_BYTE: {
+#if TWI_BLOCK_API
+            if (tx_pos < tx_length[tx_send]) {
+                USIDR = tx_frames[tx_send][tx_pos++];
+            } else {
+                // If the master reads beyond the frame (or there is none), send padding until it NACKs
+                USIDR = TWI_FRAME_PAD;
+            }
+#else
             if (tx_head != tx_tail) {
                 // If the TX buffer has data, copy the next byte to USI data register for sending
                 tx_tail = ((tx_tail + 1) & TWI_TX_BUFFER_MASK);
@@ -178,6 +397,7 @@ ISR(USI_OVERFLOW_VECTOR) {
                 SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
                 return;
             }
+#endif /* TWI_BLOCK_API */
             // Next state -> STATE_RECEIVE_ACK_AFTER_SENDING_DATA
             twi_driver_state = STATE_RECEIVE_ACK_AFTER_SENDING_DATA;
             SET_USI_TO_SEND_BYTE();
@@ -206,9 +426,18 @@ ISR(USI_OVERFLOW_VECTOR) {
         // This mode's cycle should end when a stop condition is detected on the bus.
         case STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK: {
             // Put data into buffer
+#if TWI_BLOCK_API
+            if (rx_length[rx_fill] >= TWI_FRAME_SIZE) {
+                // Frame full: NACK the byte instead of waiting for the application to release its frame
+                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                return;
+            }
+            rx_frames[rx_fill][rx_length[rx_fill]++] = USIDR;
+#else
             rx_byte_count++;
             rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
             rx_buffer[rx_head] = USIDR;
+#endif /* TWI_BLOCK_API */
             // Next state -> STATE_RECEIVE_DATA_BYTE
             twi_driver_state = STATE_RECEIVE_DATA_BYTE;
             SET_USI_TO_SEND_ACK();
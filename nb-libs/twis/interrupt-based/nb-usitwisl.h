@@ -42,6 +42,31 @@
 #error TWI TX buffer size is not a power of 2
 #endif /* TWI_TX_BUFFER_SIZE & TWI_TX_BUFFER_MASK */
 
+// Block API: when enabled, the RX and TX rings are replaced by two frames per direction. The ISR
+// fills one RX frame while the application processes the other one in place, and sends the oldest
+// committed TX frame on each master read, so neither the ISR nor the application waits for space.
+#ifndef TWI_BLOCK_API
+#define TWI_BLOCK_API false
+#endif /* TWI_BLOCK_API */
+
+#ifndef TWI_FRAME_SIZE
+#define TWI_FRAME_SIZE  32                              /* Bytes per RX or TX frame (2 of each) */
+#endif /* TWI_FRAME_SIZE */
+
+#if (TWI_FRAME_SIZE > 255)
+#error TWI frame size must fit in a byte
+#endif /* TWI_FRAME_SIZE > 255 */
+
+#define TWI_FRAME_PAD   0xFF                            /* Byte sent when the master reads beyond a TX frame */
+
+// Per-node address: when enabled, UsiTwiDriverInit uses the application TWI address handed over by
+// Timonel at exit (PASS_APP_ADDR) instead of the one given, so the same application image answers at
+// a different address on each node. The given address is used when the application wasn't started
+// by Timonel, or by a Timonel version that doesn't hand it over.
+#ifndef TWI_ADDR_FROM_BOOT
+#define TWI_ADDR_FROM_BOOT false
+#endif /* TWI_ADDR_FROM_BOOT */
+
 // Device modes
 typedef enum {                                          /* TWI driver operational modes */
     STATE_CHECK_RECEIVED_ADDRESS = 0,
@@ -58,8 +83,20 @@ void (*p_enable_slow_ops)(void);
 
 // USI TWI driver prototypes
 void UsiTwiDriverInit(uint8_t);
+#if TWI_ADDR_FROM_BOOT
+uint8_t UsiTwiBootAddress(uint8_t);
+#endif /* TWI_ADDR_FROM_BOOT */
+#if TWI_BLOCK_API
+uint8_t UsiTwiGetRxFrame(uint8_t **);
+void UsiTwiReleaseRxFrame(void);
+uint8_t *UsiTwiClaimTxFrame(void);
+void UsiTwiCommitTxFrame(uint8_t);
+#else
 void UsiTwiTransmitByte(uint8_t);
 uint8_t UsiTwiReceiveByte(void);
+#endif /* TWI_BLOCK_API */
+void UsiTwiDriverSuspend(void);
+void UsiTwiRebootToBootloader(void);
 //void TwiStartHandler(void);
 //void UsiOverflowHandler(void);
 
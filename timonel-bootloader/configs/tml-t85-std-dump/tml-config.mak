@@ -37,10 +37,23 @@ TWO_STEP_INIT  = false
 USE_WDT_RESET  = true
 TIMEOUT_EXIT   = true
 CMD_READFLASH  = true
+CMD_GENCALL    = false
+CMD_ERASEPAG   = false
+USE_CRC16      = false
+CMD_WRITERLE   = false
+WINDOWED_ACK   = false
+STRETCH_ON_WRITE = false
+FAST_BOOT      = false
+CMD_GETSTATS   = false
+PKT_RESYNC     = false
+REBOOT_HOLD    = false
+PASS_APP_ADDR  = false
 # Warning: Please modify the below options with caution ...
 AUTO_CLK_TWEAK = false
+FORCE_ERASE_PG = false
 LOW_FUSE       = 0x62
 LED_UI_PIN     = PB1
+MST_PACKET_SIZE = 64
 
 # Project name:
 # -------------
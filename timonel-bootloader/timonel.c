@@ -49,10 +49,30 @@
 #error "If the AUTO_PAGE_ADDR option is disabled, then CMD_SETPGADDR must be enabled in tml-config.h!"
 #endif
                                 
+#if ((MST_PACKET_SIZE > SPM_PAGESIZE) || (MST_PACKET_SIZE & 1))
+#error "MST_PACKET_SIZE must be an even value not bigger than the chip's pagesize"
+#endif
+
+#if ((MST_PACKET_SIZE + 1 + PKT_CHECK_LEN) > TWI_RX_BUFFER_SIZE)
+#error "The TWI RX buffer must be able to hold a whole WRITPAGE command (MST_PACKET_SIZE + 1 + PKT_CHECK_LEN bytes)"
+#endif
+
 #if ((MST_PACKET_SIZE > (TWI_RX_BUFFER_SIZE / 2)) || ((SLV_PACKET_SIZE > (TWI_TX_BUFFER_SIZE / 2))))
 #pragma GCC warning "Don't set transmission data size too high to avoid affecting the TWI reliability!"
 #endif
 
+#if (WINDOWED_ACK && (MST_PACKET_SIZE == SPM_PAGESIZE))
+#pragma GCC warning "WINDOWED_ACK has no effect when MST_PACKET_SIZE is a full page, each page is already acknowledged once!"
+#endif
+
+#if (FORCE_ERASE_PG && APP_USE_TPL_PG)
+#pragma GCC warning "FORCE_ERASE_PG erases the trampoline when an application page is written on its page, don't enable it along with APP_USE_TPL_PG!"
+#endif
+
+#if (FAST_BOOT && !(TIMEOUT_EXIT))
+#error "FAST_BOOT shortens the exit timeout, it needs TIMEOUT_EXIT enabled in tml-config.mak!"
+#endif
+
 #if ((CYCLESTOEXIT > 0) && (CYCLESTOEXIT < 10))
 #pragma GCC warning "Do not set CYCLESTOEXIT too low, it could make difficult for TWI master to initialize on time!"
 #endif
@@ -70,12 +90,23 @@ typedef enum {                                          /* TWI driver operationa
 typedef struct m_pack {
     uint16_t page_addr;                                 /* Flash memory page address */
     uint8_t page_ix;                                    /* Flash memory page index */
-    uint8_t flags;                                      /* Bit: 8, 7, 6, 5: not used; 4: exit; 3: delete app; 2, 1: initialized */
+    uint8_t flags;                                      /* Bit: 8: packet error; 7: CRC; 6: erase page; 5: general call; 4: exit; 3: delete app; 2, 1: initialized */
 #if AUTO_PAGE_ADDR
     uint8_t app_reset_lsb;                              /* Application first byte: reset vector LSB */
     uint8_t app_reset_msb;                              /* Application second byte: reset vector MSB */
 #endif /* AUTO_PAGE_ADDR */
+#if USE_CRC16
+    uint16_t crc_addr;                                  /* GETCRC flash memory range start */
+    uint16_t crc_size;                                  /* GETCRC flash memory range size */
+    uint16_t crc;                                       /* GETCRC last calculated CRC16 */
+#endif /* USE_CRC16 */
 } MemPack;                                              /* "Memory pack" structure */
+#if CMD_GETSTATS
+typedef struct m_stats {
+    uint16_t count;                                     /* Events counted */
+    uint32_t ticks;                                     /* Timer ticks accumulated by the events */
+} StatsEntry;                                           /* GETSTATS counters entry */
+#endif /* CMD_GETSTATS */
 
 // USI TWI driver globals
 uint8_t rx_buffer[TWI_RX_BUFFER_SIZE];
@@ -85,10 +116,19 @@ uint8_t rx_head = 0, rx_tail = 0;
 uint8_t tx_head = 0, tx_tail = 0;
 OverflowState device_state;
 
+#if CMD_GETSTATS
+// Statistics counters
+StatsEntry stats[STATS_ENTRIES];
+#endif /* CMD_GETSTATS */
+
 // Bootloader prototypes
-inline static void ReceiveEvent(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+inline static void ProcessCommand(MemPack*) __attribute__((always_inline));
+inline static uint8_t ReceiveEvent(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 inline static void ResetPrescaler(void) __attribute__((always_inline));
 inline static void RestorePrescaler(void) __attribute__((always_inline));
+#if PASS_APP_ADDR
+inline static void PassAppAddress(void) __attribute__((always_inline, noreturn));
+#endif /* PASS_APP_ADDR */
 inline static void Reply_GETTMNLV(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 inline static void Reply_EXITTMNL(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 inline static void Reply_DELFLASH(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
@@ -96,15 +136,29 @@ inline static void Reply_DELFLASH(uint8_t[], uint8_t, MemPack*) __attribute__((a
 inline static void Reply_STPGADDR(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 #endif /* CMD_SETPGADDR || !AUTO_PAGE_ADDR */
 inline static void Reply_WRITPAGE(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+#if CMD_WRITERLE
+inline static void Reply_WRITERLE(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+#endif /* CMD_WRITERLE */
 #if CMD_READFLASH
 inline static void Reply_READFLSH(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 #endif /* CMD_READFLASH */
+#if CMD_ERASEPAG
+inline static void Reply_ERASEPAG(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+#endif /* CMD_ERASEPAG */
+#if USE_CRC16
+inline static void Reply_GETCRC(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+#endif /* USE_CRC16 */
+#if CMD_GETSTATS
+inline static void Reply_GETSTATS(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
+void StatsAdd(uint8_t, uint8_t, uint8_t);
+#endif /* CMD_GETSTATS */
 inline static void Reply_INITSOFT(uint8_t[], uint8_t, MemPack*) __attribute__((always_inline));
 
 // USI TWI driver prototypes
-void UsiTwiTransmitByte(uint8_t);
+inline static void SendReply(uint8_t) __attribute__((always_inline));
 uint8_t UsiTwiReceiveByte(void);
 inline static void UsiTwiDriverInit(void) __attribute__((always_inline));
+inline static void UsiTwiDriverSuspend(void) __attribute__((always_inline));
 inline static void TwiStartHandler(void) __attribute__((always_inline));
 inline static bool UsiOverflowHandler(MemPack*) __attribute__((always_inline));
 
@@ -135,9 +189,26 @@ int main(void) {
        |    Setup Block    |
        |___________________|
     */
+#if (REBOOT_HOLD && TIMEOUT_EXIT)
+    // An application rebooting into the bootloader with BOOTTMNL leaves the handshake marker in SRAM,
+    // it's checked before the reset flags are cleared and the stack or any variable uses that memory
+    volatile uint16_t *p_boot_hold = (void *)BOOT_HOLD_ADDR;
+    const bool boot_hold = ((MCUSR & (1 << WDRF)) && (*p_boot_hold == BOOT_HOLD_MARK));
+    *p_boot_hold = 0;                                   /* Clear the marker: the next reset exits on timeout */
+#endif /* REBOOT_HOLD && TIMEOUT_EXIT */
+#if FAST_BOOT
+    // After a power-on or brown-out reset with an application loaded, the watchdog runs in interrupt
+    // mode (interrupts stay disabled, its flag is polled) to time the fast boot delay
+    const __flash uint16_t *p_trampoline = (void *)(TIMONEL_START - 2);
+    const uint8_t wdt_setup = (((MCUSR & ((1 << PORF) | (1 << BORF))) && (*p_trampoline != 0xFFFF)) ? ((1 << WDIE) | FAST_BOOT_WDP) : ((1 << WDP2) | (1 << WDP1) | (1 << WDP0)));
+    MCUSR = 0;                                          /* Disable watchdog reset */
+    WDTCR = ((1 << WDCE) | (1 << WDE));
+    WDTCR = wdt_setup;
+#else
     MCUSR = 0;                                          /* Disable watchdog */
     WDTCR = ((1 << WDCE) | (1 << WDE));
     WDTCR = ((1 << WDP2) | (1 << WDP1) | (1 << WDP0));
+#endif /* FAST_BOOT */
     cli();                                              /* Disable interrupts */
 #if ENABLE_LED_UI
     LED_UI_DDR |= (1 << LED_UI_PIN);                    /* Set led pin data direction register for output */
@@ -197,13 +268,52 @@ int main(void) {
     mem_pack.app_reset_lsb = 0x00;                      
     mem_pack.app_reset_msb = 0x00;                      
 #endif /* AUTO_PAGE_ADDR */    
+#if USE_CRC16
+    mem_pack.crc = CRC16_INIT;
+#endif /* USE_CRC16 */
     MemPack *p_mem_pack = &mem_pack;                    /* Pointer to "memory pack" structure */
+#if CMD_GETSTATS
+    for (uint8_t i = 0; i < STATS_ENTRIES; i++) {
+        stats[i].count = 0;                             /* The RAM isn't cleared at startup (-nostartfiles) */
+        stats[i].ticks = 0;
+    }
+    TCCR0B = ((1 << CS01) | (1 << CS00));               /* Timer0: command handler ticks (CK/64) */
+    TCCR1 = ((1 << CS13) | (1 << CS11) | (1 << CS10));  /* Timer1: flash memory operation ticks (CK/1024) */
+#endif /* CMD_GETSTATS */
     /*  ___________________
        |                   | 
        |     Main Loop     |
        |___________________|
     */
     for (;;) {
+#if CMD_GENCALL
+        /* ......................................................
+           . General call commands are read from the RX buffer    .
+           . when the master ends the transmission (stop or new  .
+           . start), since they have no read request to reply.    .
+           ......................................................
+        */
+        if (((mem_pack.flags >> FL_GEN_CALL) & true) && (((USISR >> TWI_STOP_COND_FLAG) & true) || ((USISR >> TWI_START_COND_FLAG) & true))) {
+            mem_pack.flags &= ~(1 << FL_GEN_CALL);
+            if (rx_byte_count > 0) {
+                ProcessCommand(p_mem_pack);
+                tx_tail = tx_head;                      /* Discard the reply, general call commands can't be read back */
+                slow_ops_enabled = true;
+            }
+        }
+#endif /* CMD_GENCALL */
+#if WINDOWED_ACK
+        /* ......................................................
+           . Windowed data packets (WRITPGWN) are read from the   .
+           . RX buffer when the master ends the transmission,    .
+           . their status is reported by the page's last WRITPAGE .
+           ......................................................
+        */
+        if ((rx_byte_count > 0) && (rx_buffer[((rx_tail + 1) & TWI_RX_BUFFER_MASK)] == WRITPGWN) && (((USISR >> TWI_STOP_COND_FLAG) & true) || ((USISR >> TWI_START_COND_FLAG) & true))) {
+            ProcessCommand(p_mem_pack);
+            tx_tail = tx_head;                          /* Discard the reply, windowed packets aren't read back */
+        }
+#endif /* WINDOWED_ACK */
         /* ......................................................
            . TWI Interrupt Emulation >>>>>>>>>>>>>>>>>>>>>>>>>>  .
            . Check the USI status register to verify whether      .
@@ -238,6 +348,9 @@ int main(void) {
                 // = Exit the bootloader & run the application (Slow Op) =
                 // =======================================================
                 if ((mem_pack.flags >> FL_EXIT_TML) & true) {
+#if FAST_BOOT
+                    WDTCR = (1 << WDIF);                /* Stop the fast boot timer before the application enables interrupts */
+#endif /* FAST_BOOT */
 #if CLEAR_BIT_7_R31
                     asm volatile("cbr r31, 0x80");      /* Clear bit 7 of r31 */
 #endif /* CLEAR_BIT_7_R31 */
@@ -256,7 +369,17 @@ int main(void) {
                     RestorePrescaler();                 /* Restore prescaler factor to divide by 8 */
 #endif /* PRESCALER BIT */
 #endif /* AUTO_CLK_TWEAK */
+#if CMD_GETSTATS
+                    TCCR0B = 0;                         /* Stop the statistics timers, the application */
+                    TCCR1 = 0;                          /* finds them in their reset state             */
+                    TCNT0 = 0;
+                    TCNT1 = 0;
+#endif /* CMD_GETSTATS */
+#if PASS_APP_ADDR
+                    PassAppAddress();                   /* Hand the application TWI address over and exit to the application */
+#else
                     RunApplication();                   /* Exit to the application */
+#endif /* PASS_APP_ADDR */
                 }
                 // ================================================
                 // = Delete the application from memory (Slow Op) =
@@ -265,6 +388,7 @@ int main(void) {
 #if ENABLE_LED_UI                   
                     LED_UI_PORT |= (1 << LED_UI_PIN);   /* Turn led on to indicate erasing ... */
 #endif /* ENABLE_LED_UI */
+                    UsiTwiDriverSuspend();              /* Busy: NACK the TWI address until the restart */
                     uint16_t page_to_del = TIMONEL_START;
                     while (page_to_del != RESET_PAGE) {
                         page_to_del -= SPM_PAGESIZE;
@@ -286,6 +410,44 @@ int main(void) {
                     for (;;) {};
 #endif /* !USE_WDT_RESET */
                 }
+#if CMD_ERASEPAG
+                // ===============================================
+                // = Erase a single flash memory page (Slow Op)  =
+                // ===============================================
+                if ((mem_pack.flags >> FL_ERASE_PAGE) & true) {
+                    mem_pack.flags &= ~(1 << FL_ERASE_PAGE);
+#if !(AUTO_PAGE_ADDR)
+                    if (mem_pack.page_addr < TIMONEL_START) {
+#else
+                    if (mem_pack.page_addr < TIMONEL_START - SPM_PAGESIZE) { /* The trampoline page is handled by the bootloader */
+#endif /* !AUTO_PAGE_ADDR */
+                        UsiTwiDriverSuspend();          /* Busy: NACK the TWI address while erasing */
+#if CMD_GETSTATS
+                        STATS_SLOW_START();
+                        boot_page_erase(mem_pack.page_addr);
+                        StatsAdd(STATS_PAGE_ERASE, TCNT1, STATS_SLOW_OVF());
+#else
+                        boot_page_erase(mem_pack.page_addr);
+#endif /* CMD_GETSTATS */
+                        UsiTwiDriverInit();             /* Ready: acknowledge the TWI address again */
+                    }
+                }
+#endif /* CMD_ERASEPAG */
+#if USE_CRC16
+                // =========================================================
+                // = Calculate the CRC16 of a flash memory range (Slow Op) =
+                // =========================================================
+                if ((mem_pack.flags >> FL_CALC_CRC) & true) {
+                    mem_pack.flags &= ~(1 << FL_CALC_CRC);
+                    UsiTwiDriverSuspend();              /* Busy: NACK the TWI address while calculating */
+                    const __flash uint8_t *mem_position = (void *)mem_pack.crc_addr;
+                    mem_pack.crc = CRC16_INIT;
+                    for (uint16_t i = 0; i < mem_pack.crc_size; i++) {
+                        mem_pack.crc = _crc_xmodem_update(mem_pack.crc, *(mem_position++));
+                    }
+                    UsiTwiDriverInit();                 /* Ready: acknowledge the TWI address again */
+                }
+#endif /* USE_CRC16 */
                 // =========================================================================
                 // = Write the received page to memory and prepare for a new one (Slow Op) =
                 // =========================================================================
@@ -297,10 +459,26 @@ int main(void) {
 #if ENABLE_LED_UI
                     LED_UI_PORT ^= (1 << LED_UI_PIN);       /* Turn led on and off to indicate writing ... */
 #endif /* ENABLE_LED_UI */
+#if STRETCH_ON_WRITE
+                    // Busy: the USI stays in two-wire mode, the start condition of a transaction arriving while the
+                    // page is written holds SCL low until the main loop handles it (clock stretching)
+#else
+                    UsiTwiDriverSuspend();                  /* Busy: NACK the TWI address while writing */
+#endif /* STRETCH_ON_WRITE */
+#if CMD_GETSTATS
+                    STATS_SLOW_START();
+#endif /* CMD_GETSTATS */
 #if FORCE_ERASE_PG
                     boot_page_erase(mem_pack.page_addr);
+#if CMD_GETSTATS
+                    StatsAdd(STATS_PAGE_ERASE, TCNT1, STATS_SLOW_OVF());
+                    STATS_SLOW_START();
+#endif /* CMD_GETSTATS */
 #endif /* FORCE_ERASE_PG */                    
                     boot_page_write(mem_pack.page_addr);
+#if CMD_GETSTATS
+                    StatsAdd(STATS_PAGE_WRITE, TCNT1, STATS_SLOW_OVF());
+#endif /* CMD_GETSTATS */
 #if AUTO_PAGE_ADDR
                     if (mem_pack.page_addr == RESET_PAGE) { /* Calculate and write trampoline */
                         uint16_t tpl = (((~((TIMONEL_START >> 1) - ((((mem_pack.app_reset_msb << 8) | mem_pack.app_reset_lsb) + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
@@ -308,7 +486,20 @@ int main(void) {
                             boot_page_fill((TIMONEL_START - SPM_PAGESIZE) + i, 0xFFFF);
                         }
                         boot_page_fill((TIMONEL_START - 2), tpl);
+#if CMD_GETSTATS
+                        STATS_SLOW_START();
+#endif /* CMD_GETSTATS */
+#if (FORCE_ERASE_PG || CMD_ERASEPAG)
+                        boot_page_erase(TIMONEL_START - SPM_PAGESIZE); /* Page 0 could be rewritten without deleting the app */
+#if CMD_GETSTATS
+                        StatsAdd(STATS_PAGE_ERASE, TCNT1, STATS_SLOW_OVF());
+                        STATS_SLOW_START();
+#endif /* CMD_GETSTATS */
+#endif /* FORCE_ERASE_PG || CMD_ERASEPAG */
                         boot_page_write(TIMONEL_START - SPM_PAGESIZE);                        
+#if CMD_GETSTATS
+                        StatsAdd(STATS_PAGE_WRITE, TCNT1, STATS_SLOW_OVF());
+#endif /* CMD_GETSTATS */
                     }
 #if APP_USE_TPL_PG
                     if (mem_pack.page_addr == (TIMONEL_START - SPM_PAGESIZE)) {
@@ -334,21 +525,37 @@ int main(void) {
                     mem_pack.page_addr += SPM_PAGESIZE;
 #endif /* AUTO_PAGE_ADDR */
                     mem_pack.page_ix = 0;
+#if !(STRETCH_ON_WRITE)
+                    UsiTwiDriverInit();                     /* Ready: acknowledge the TWI address again */
+#endif /* !STRETCH_ON_WRITE */
                 }
             }
         } else {
             // ======================================
             // = *\* Bootloader not initialized */* =
             // ======================================
+#if FAST_BOOT
+            if ((WDTCR >> WDIF) & true) {
+                led_delay = 0;                          /* Fast boot time over: the master didn't initialize */
+                exit_delay = 0;                         /* the bootloader, run the application right now     */
+            }
+#endif /* FAST_BOOT */
             if (led_delay-- == 0) {
 #if ENABLE_LED_UI               
                 LED_UI_PORT ^= (1 << LED_UI_PIN);       /* If Timonel isn't initialized, led blinks at LED_DLY intervals */
 #endif /* ENABLE_LED_UI */
 #if TIMEOUT_EXIT                
+#if REBOOT_HOLD
+                if ((!boot_hold) && (exit_delay-- == 0)) {
+#else
                 if (exit_delay-- == 0) {
+#endif /* REBOOT_HOLD */
                     // ========================================
                     // = >>> Timeout: Run the application <<< =
                     // ========================================
+#if FAST_BOOT
+                    WDTCR = (1 << WDIF);                /* Stop the fast boot timer before the application enables interrupts */
+#endif /* FAST_BOOT */
 #if AUTO_CLK_TWEAK
                     if ((boot_lock_fuse_bits_get(L_FUSE_ADDR) & 0x0F) == RCOSC_CLK_SRC) {
                         OSCCAL = factory_osccal;        /* Back the oscillator calibration to its original setting */
@@ -364,7 +571,17 @@ int main(void) {
                     RestorePrescaler();                 /* Restore prescaler factor to divide by 8 */
 #endif /* PRESCALER BIT */ 
 #endif /* AUTO_CLK_TWEAK */
+#if CMD_GETSTATS
+                    TCCR0B = 0;                         /* Stop the statistics timers, the application */
+                    TCCR1 = 0;                          /* finds them in their reset state             */
+                    TCNT0 = 0;
+                    TCNT1 = 0;
+#endif /* CMD_GETSTATS */
+#if PASS_APP_ADDR
+                    PassAppAddress();                   /* Count from CYCLESTOEXIT to 0, then hand the address over and exit */
+#else
                     RunApplication();                   /* Count from CYCLESTOEXIT to 0, then exit to the application */
+#endif /* PASS_APP_ADDR */
                 }
 #endif /* TIMEOUT_EXIT */
             }
@@ -373,48 +590,110 @@ int main(void) {
     return 0;
 }
 
+/*  ________________________
+   |                        |
+   | TWI command processing |
+   |________________________|
+*/
+inline void ProcessCommand(MemPack *p_mem_pack) {
+    // The command is processed in place (zero-copy): the RX buffer is emptied after each command, so the
+    // next one is always received from rx_buffer[0] on. No bytes arrive while processing, the bus is held.
+    uint8_t command_size = rx_byte_count;
+    rx_tail = rx_head = TWI_RX_BUFFER_MASK;
+    rx_byte_count = 0;
+    if (command_size > CMD_MAX_LEN) {
+        command_size = CMD_MAX_LEN;                     /* Oversized commands are truncated and fail their checksums */
+    }
+#if WINDOWED_ACK
+    if (command_size == 0) {
+        return;                                         /* Nothing new to process, e.g. a windowed packet reply request */
+    }
+#endif /* WINDOWED_ACK */
+    tx_tail = tx_head = TWI_TX_BUFFER_MASK;             /* Drop any unread reply bytes, the reply is written from tx_buffer[0] on */
+#if CMD_GETSTATS
+    const uint8_t opcode = rx_buffer[0];
+    STATS_CMD_START();
+    if (ReceiveEvent(rx_buffer, command_size, p_mem_pack)) {
+        StatsAdd((opcode & 0x0F), TCNT0, STATS_CMD_OVF()); /* Timonel commands are counted by opcode low nibble */
+    }
+#else
+    ReceiveEvent(rx_buffer, command_size, p_mem_pack);
+#endif /* CMD_GETSTATS */
+}
+
 /*  ________________________
    |                        |
    | TWI data receive event |
    |________________________|
 */
-inline void ReceiveEvent(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
+inline uint8_t ReceiveEvent(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
     switch (command[0]) {
         case GETTMNLV: {
             Reply_GETTMNLV(command, command_size, p_mem_pack);
-            return;
+            return true;
         }
         case EXITTMNL: {
             Reply_EXITTMNL(command, command_size, p_mem_pack);
-            return;
+            return true;
         }
         case DELFLASH: {
             Reply_DELFLASH(command, command_size, p_mem_pack);
-            return;
+            return true;
         }
 #if (CMD_SETPGADDR || !(AUTO_PAGE_ADDR))
         case STPGADDR: {
             Reply_STPGADDR(command, command_size, p_mem_pack);
-            return;
+            return true;
         }
 #endif /* CMD_SETPGADDR || !AUTO_PAGE_ADDR */
         case WRITPAGE: {
             Reply_WRITPAGE(command, command_size, p_mem_pack);
-            return;            
+            return true;
+        }
+#if WINDOWED_ACK
+        case WRITPGWN: {
+            Reply_WRITPAGE(command, command_size, p_mem_pack);
+            return true;
+        }
+#endif /* WINDOWED_ACK */
+#if CMD_WRITERLE
+        case WRITERLE: {
+            Reply_WRITERLE(command, command_size, p_mem_pack);
+            return true;
         }
+#endif /* CMD_WRITERLE */
 #if CMD_READFLASH
         case READFLSH: {
             Reply_READFLSH(command, command_size, p_mem_pack);
-            return;              
+            return true;
         }        
 #endif /* CMD_READFLASH */
+#if CMD_ERASEPAG
+        case ERASEPAG: {
+            Reply_ERASEPAG(command, command_size, p_mem_pack);
+            return true;
+        }
+#endif /* CMD_ERASEPAG */
+#if USE_CRC16
+        case GETCRC: {
+            Reply_GETCRC(command, command_size, p_mem_pack);
+            return true;
+        }
+#endif /* USE_CRC16 */
+#if CMD_GETSTATS
+        case GETSTATS: {
+            Reply_GETSTATS(command, command_size, p_mem_pack);
+            return true;
+        }
+#endif /* CMD_GETSTATS */
 #if TWO_STEP_INIT
         case INITSOFT: {
             Reply_INITSOFT(command, command_size, p_mem_pack);
-            return;
+            return true;
         }
 #endif /* TWO_STEP_INIT */
     }
+    return false;                                       /* Unknown or disabled command */
 }
 
 // ******************
@@ -423,7 +702,7 @@ inline void ReceiveEvent(uint8_t command[], uint8_t command_size, MemPack *p_mem
 inline void Reply_GETTMNLV(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
     const __flash uint8_t *mem_position;
     mem_position = (void *)(TIMONEL_START - 1); 
-    uint8_t reply[GETTMNLV_RPLYLN];
+    uint8_t *reply = tx_buffer;
     reply[0] = ACKTMNLV;
     reply[1] = ID_CHAR_3;                       /* "T" Signature */
     reply[2] = TIMONEL_VER_MJR;                 /* Major version number */
@@ -436,14 +715,27 @@ inline void Reply_GETTMNLV(uint8_t command[], uint8_t command_size, MemPack *p_m
     reply[9] = *(--mem_position);               /* Trampoline first byte (LSB) */
     reply[10] = boot_lock_fuse_bits_get(0);     /* Low fuse setting */
     reply[11] = OSCCAL;                         /* Internal RC oscillator calibration */
+#if WINDOWED_ACK
+    reply[12] = (MST_PACKET_SIZE | WND_ACK_FLAG); /* Biggest WRITPAGE data packet accepted + windowed ack */
+#else
+    reply[12] = MST_PACKET_SIZE;                /* Biggest WRITPAGE data packet accepted */
+#endif /* WINDOWED_ACK */
+#if STRETCH_ON_WRITE
+    reply[13] = (SLV_PACKET_SIZE | STR_WRITE_FLAG); /* Biggest READFLSH data packet sent + clock stretching */
+#else
+    reply[13] = SLV_PACKET_SIZE;                /* Biggest READFLSH data packet sent */
+#endif /* STRETCH_ON_WRITE */
+#if PKT_RESYNC
+    reply[14] = (uint8_t)(p_mem_pack->page_addr / SPM_PAGESIZE); /* Page where the next data packet is written */
+    reply[15] = p_mem_pack->page_ix;            /* Data bytes already in the page buffer */
+    p_mem_pack->flags &= ~(1 << FL_PKT_ERROR);  /* The master knows the page position, accept data packets again */
+#endif /* PKT_RESYNC */
 
     p_mem_pack->flags |= (1 << FL_INIT_1);      /* First-step of single or two-step initialization */
 #if ENABLE_LED_UI
     LED_UI_PORT &= ~(1 << LED_UI_PIN);          /* Turn led off to indicate initialization */
 #endif /* ENABLE_LED_UI */
-    for (uint8_t i = 0; i < GETTMNLV_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    SendReply(GETTMNLV_RPLYLN);
     return;
 }
 
@@ -451,7 +743,8 @@ inline void Reply_GETTMNLV(uint8_t command[], uint8_t command_size, MemPack *p_m
 // * EXITTMNL Reply *
 // ******************
 inline void Reply_EXITTMNL(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
-    UsiTwiTransmitByte(ACKEXITT);
+    tx_buffer[0] = ACKEXITT;
+    SendReply(1);
     p_mem_pack->flags |= (1 << FL_EXIT_TML);
     return;
 }
@@ -460,7 +753,8 @@ inline void Reply_EXITTMNL(uint8_t command[], uint8_t command_size, MemPack *p_m
 // * DELFLASH Reply *
 // ******************
 inline void Reply_DELFLASH(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
-    UsiTwiTransmitByte(ACKDELFL);
+    tx_buffer[0] = ACKDELFL;
+    SendReply(1);
     p_mem_pack->flags |= (1 << FL_DEL_FLASH);
     return;
 }
@@ -470,14 +764,12 @@ inline void Reply_DELFLASH(uint8_t command[], uint8_t command_size, MemPack *p_m
 // ******************
 #if (CMD_SETPGADDR || !(AUTO_PAGE_ADDR))
 inline void Reply_STPGADDR(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
-    uint8_t reply[STPGADDR_RPLYLN] = { 0 };
+    uint8_t *reply = tx_buffer;
     p_mem_pack->page_addr = ((command[1] << 8) + command[2]);   /* Sets the flash memory page base address */
     p_mem_pack->page_addr &= ~(SPM_PAGESIZE - 1);               /* Keep only pages' base addresses */
     reply[0] = AKPGADDR;
     reply[1] = (uint8_t)(command[1] + command[2]);              /* Returns the sum of MSB and LSB of the page address */
-    for (uint8_t i = 0; i < STPGADDR_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
-    }
+    SendReply(STPGADDR_RPLYLN);
     return;
 }
 #endif /* CMD_SETPGADDR || !AUTO_PAGE_ADDR */
@@ -486,8 +778,60 @@ inline void Reply_STPGADDR(uint8_t command[], uint8_t command_size, MemPack *p_m
 // * WRITPAGE Reply *
 // ******************
 inline void Reply_WRITPAGE(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
-    uint8_t reply[WRITPAGE_RPLYLN] = { 0 };
+    uint8_t *reply = tx_buffer;
+    const uint8_t data_end = (command_size - PKT_CHECK_LEN); /* Data bytes go from command[1] to command[data_end - 1] */
     reply[0] = ACKWTPAG;
+    reply[1] = 0;
+#if PKT_RESYNC
+    // The packet is checked before filling the page buffer, so a rejected packet leaves
+    // it untouched and the TWI master can send it again (page buffer words can't be rewritten)
+#if USE_CRC16
+    uint16_t crc = CRC16_INIT;
+    for (uint8_t i = 1; i < data_end; i++) {
+        crc = _crc_xmodem_update(crc, command[i]);          /* Reply CRC16 over the received data */
+    }
+    reply[1] = (uint8_t)(crc >> 8);
+    reply[2] = (uint8_t)(crc & 0xFF);
+    bool check_ok = ((reply[1] == command[data_end]) && (reply[2] == command[data_end + 1]));
+#else
+    for (uint8_t i = 1; i < data_end; i++) {
+        reply[1] += (uint8_t)(command[i]);                  /* Reply checksum accumulator */
+    }
+    bool check_ok = (reply[1] == command[data_end]);
+#endif /* USE_CRC16 */
+    if ((p_mem_pack->flags >> FL_PKT_ERROR) & true) {
+        check_ok = false;                                   /* A previous packet was rejected, wait for the master to resync */
+    }
+#if CHECK_PAGE_IX
+    if (((data_end - 1) & 1) || ((p_mem_pack->page_ix + (data_end - 1)) > SPM_PAGESIZE)) {
+#else
+    if ((data_end - 1) & 1) {
+#endif /* CHECK_PAGE_IX */
+        p_mem_pack->flags |= (1 << FL_DEL_FLASH);           /* Wrong packet sizes: safety payload deletion ... */
+        check_ok = false;
+    }
+    if (check_ok) {
+        uint8_t i = 1;
+        if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == RESET_PAGE) {
+#if AUTO_PAGE_ADDR
+            p_mem_pack->app_reset_lsb = command[1];
+            p_mem_pack->app_reset_msb = command[2];
+#endif /* AUTO_PAGE_ADDR */
+            // This section modifies the reset vector to point to this bootloader.
+            // WARNING: This only works when CMD_SETPGADDR is disabled. If CMD_SETPGADDR is enabled,
+            // the reset vector modification MUST BE done by the TWI master's upload program.
+            // Otherwise, Timonel won't have the execution control after power-on reset.
+            boot_page_fill((RESET_PAGE), (0xC000 + ((TIMONEL_START / 2) - 1)));
+            p_mem_pack->page_ix += 2;
+            i = 3;
+        }
+        for (; i < data_end; i += 2) {
+            boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), ((command[i + 1] << 8) | command[i]));
+            p_mem_pack->page_ix += 2;
+        }
+    } else {
+        p_mem_pack->flags |= (1 << FL_PKT_ERROR);           /* Reject the data packets until the master reads the status */
+#else
     if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == RESET_PAGE) {
 #if AUTO_PAGE_ADDR
         p_mem_pack->app_reset_lsb = command[1];
@@ -498,56 +842,184 @@ inline void Reply_WRITPAGE(uint8_t command[], uint8_t command_size, MemPack *p_m
         // the reset vector modification MUST BE done by the TWI master's upload program.
         // Otherwise, Timonel won't have the execution control after power-on reset.
         boot_page_fill((RESET_PAGE), (0xC000 + ((TIMONEL_START / 2) - 1)));
+#if !(USE_CRC16)
         reply[1] += (uint8_t)((command[2]) + command[1]);   /* Reply checksum accumulator */
+#endif /* !USE_CRC16 */
         p_mem_pack->page_ix += 2;
-        for (uint8_t i = 3; i < (MST_PACKET_SIZE + 1); i += 2) {
+        for (uint8_t i = 3; i < data_end; i += 2) {
             boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), ((command[i + 1] << 8) | command[i]));
+#if !(USE_CRC16)
             reply[1] += (uint8_t)((command[i + 1]) + command[i]);
+#endif /* !USE_CRC16 */
             p_mem_pack->page_ix += 2;
-        }                
+        }
     } else {
-        for (uint8_t i = 1; i < (MST_PACKET_SIZE + 1); i += 2) {
+        for (uint8_t i = 1; i < data_end; i += 2) {
             boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), ((command[i + 1] << 8) | command[i]));
+#if !(USE_CRC16)
             reply[1] += (uint8_t)((command[i + 1]) + command[i]);
+#endif /* !USE_CRC16 */
             p_mem_pack->page_ix += 2;
         }
     }
+#if USE_CRC16
+    uint16_t crc = CRC16_INIT;
+    for (uint8_t i = 1; i < data_end; i++) {
+        crc = _crc_xmodem_update(crc, command[i]);          /* Reply CRC16 over the received data */
+    }
+    reply[1] = (uint8_t)(crc >> 8);
+    reply[2] = (uint8_t)(crc & 0xFF);
+    bool check_ok = ((reply[1] == command[data_end]) && (reply[2] == command[data_end + 1]));
+#else
+    bool check_ok = (reply[1] == command[data_end]);
+#endif /* USE_CRC16 */
+#if WINDOWED_ACK
+    if ((p_mem_pack->flags >> FL_DEL_FLASH) & true) {
+        check_ok = false;                                   /* A previous windowed packet failed, report it in this reply */
+    }
+#endif /* WINDOWED_ACK */
 #if CHECK_PAGE_IX
-    if ((reply[1] != command[MST_PACKET_SIZE + 1]) || (p_mem_pack->page_ix > SPM_PAGESIZE)) {
+    if ((!check_ok) || ((data_end - 1) & 1) || (p_mem_pack->page_ix > SPM_PAGESIZE)) {
 #else
-    if (reply[1] != command[MST_PACKET_SIZE + 1]) {
+    if ((!check_ok) || ((data_end - 1) & 1)) {
 #endif /* CHECK_PAGE_IX */
         p_mem_pack->flags |= (1 << FL_DEL_FLASH);           /* If checksums don't match, safety payload deletion ... */
+#endif /* PKT_RESYNC */
+#if CMD_GETSTATS
+        StatsAdd(STATS_PKT_ERROR, 0, false);
+#endif /* CMD_GETSTATS */
         reply[1] = 0;
+#if USE_CRC16
+        reply[2] = 0;
+#endif /* USE_CRC16 */
+    }
+    SendReply(WRITPAGE_RPLYLN);
+    return;
+}
+
+// ******************
+// * WRITERLE Reply *
+// ******************
+#if CMD_WRITERLE
+inline void Reply_WRITERLE(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
+    uint8_t *reply = tx_buffer;
+    const uint8_t data_end = (command_size - PKT_CHECK_LEN); /* Encoded data goes from command[1] to command[data_end - 1] */
+    bool data_ok = true;
+    uint8_t i = 1;
+    reply[0] = ACKWTRLE;
+    reply[1] = 0;
+    // The packet check covers the encoded data, as it was sent by the TWI master. It's
+    // verified before expanding it, so a rejected packet never leaves a partially expanded page.
+#if USE_CRC16
+    uint16_t crc = CRC16_INIT;
+    for (i = 1; i < data_end; i++) {
+        crc = _crc_xmodem_update(crc, command[i]);
+    }
+    reply[1] = (uint8_t)(crc >> 8);
+    reply[2] = (uint8_t)(crc & 0xFF);
+    bool check_ok = ((reply[1] == command[data_end]) && (reply[2] == command[data_end + 1]));
+#else
+    for (i = 1; i < data_end; i++) {
+        reply[1] += (uint8_t)(command[i]);
+    }
+    bool check_ok = (reply[1] == command[data_end]);
+#endif /* USE_CRC16 */
+#if PKT_RESYNC
+    if ((p_mem_pack->flags >> FL_PKT_ERROR) & true) {
+        check_ok = false;                                   /* A previous packet was rejected, wait for the master to resync */
+    }
+#endif /* PKT_RESYNC */
+    // Expand the run-length encoded words into the page buffer
+    i = 1;
+    while ((i < data_end) && data_ok && check_ok) {
+        const uint8_t token = command[i++];
+        const bool run = ((token & RLE_RUN_FLAG) == RLE_RUN_FLAG);
+        uint8_t word_count = ((token & RLE_COUNT_MASK) + 1);
+        const uint16_t block_end = (i + (run ? 2 : (word_count << 1)));
+        if (block_end > data_end) {
+            data_ok = false;                                /* Truncated block */
+            break;
+        }
+        while (word_count--) {
+            if (p_mem_pack->page_ix >= SPM_PAGESIZE) {
+                data_ok = false;                            /* The expanded data doesn't fit in the page */
+                break;
+            }
+            uint16_t page_word = ((command[i + 1] << 8) | command[i]);
+            if ((p_mem_pack->page_addr + p_mem_pack->page_ix) == RESET_PAGE) {
+#if AUTO_PAGE_ADDR
+                p_mem_pack->app_reset_lsb = command[i];
+                p_mem_pack->app_reset_msb = command[i + 1];
+#endif /* AUTO_PAGE_ADDR */
+                page_word = (0xC000 + ((TIMONEL_START / 2) - 1)); /* Reset vector pointing to this bootloader */
+            }
+            boot_page_fill((p_mem_pack->page_addr + p_mem_pack->page_ix), page_word);
+            p_mem_pack->page_ix += 2;
+            if (!run) {
+                i += 2;
+            }
+        }
+        i = block_end;
     }
-    for (uint8_t i = 0; i < WRITPAGE_RPLYLN; i++) {
-        UsiTwiTransmitByte(reply[i]);
+#if PKT_RESYNC
+    if (!data_ok) {
+        p_mem_pack->flags |= (1 << FL_DEL_FLASH);           /* Wrong encoded data, partially expanded: safety payload deletion ... */
     }
+    if ((!check_ok) || (!data_ok)) {
+        p_mem_pack->flags |= (1 << FL_PKT_ERROR);           /* Reject the data packets until the master reads the status */
+#else
+    if ((!check_ok) || (!data_ok)) {
+        p_mem_pack->flags |= (1 << FL_DEL_FLASH);           /* If the data is wrong, safety payload deletion ... */
+#endif /* PKT_RESYNC */
+#if CMD_GETSTATS
+        StatsAdd(STATS_PKT_ERROR, 0, false);
+#endif /* CMD_GETSTATS */
+        reply[1] = 0;
+#if USE_CRC16
+        reply[2] = 0;
+#endif /* USE_CRC16 */
+    }
+    SendReply(WRITPAGE_RPLYLN);
     return;
 }
+#endif /* CMD_WRITERLE */
 
 // ******************
 // * READFLSH Reply *
 // ******************
 #if CMD_READFLASH
 inline void Reply_READFLSH(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
-    const uint8_t reply_len = (command[3] + 2);             /* Reply length: ack + memory positions requested + checksum */
-    uint8_t reply[reply_len];
+    if (command[3] > SLV_PACKET_SIZE) {
+        command[3] = SLV_PACKET_SIZE;                       /* The reply has to fit in the TX buffer */
+    }
+    const uint8_t reply_len = (command[3] + 1 + PKT_CHECK_LEN); /* Reply length: ack + memory positions requested + check */
+    uint8_t *reply = tx_buffer;
     reply[0] = ACKRDFSH;
+#if USE_CRC16
+    uint16_t crc = _crc_xmodem_update(_crc_xmodem_update(CRC16_INIT, command[1]), command[2]); /* Address MSB and LSB first */
+#else
     reply[reply_len - 1] = 0;                               /* Checksum initialization */
+#endif /* USE_CRC16 */
     // Point the initial memory position to the received address, then
     // advance to fill the reply with the requested data amount.
     const __flash uint8_t *mem_position;
     mem_position = (void *)((command[1] << 8) + command[2]);
     for (uint8_t i = 1; i < command[3] + 1; i++) {
         reply[i] = (*(mem_position++) & 0xFF);              /* Actual memory position data */
+#if USE_CRC16
+        crc = _crc_xmodem_update(crc, reply[i]);            /* CRC16 accumulator */
+#else
         reply[reply_len - 1] += (uint8_t)(reply[i]);        /* Checksum accumulator */
+#endif /* USE_CRC16 */
     }
+#if USE_CRC16
+    reply[reply_len - 2] = (uint8_t)(crc >> 8);
+    reply[reply_len - 1] = (uint8_t)(crc & 0xFF);
+#else
     reply[reply_len - 1] += (uint8_t)(command[1]);          /* Add Received address MSB to checksum */
     reply[reply_len - 1] += (uint8_t)(command[2]);          /* Add Received address MSB to checksum */
-    for (uint8_t i = 0; i < reply_len; i++) {
-        UsiTwiTransmitByte(reply[i]);                   
-    }
+#endif /* USE_CRC16 */
+    SendReply(reply_len);
 #if ENABLE_LED_UI               
     LED_UI_PORT ^= (1 << LED_UI_PIN);                       /* Blinks whenever a memory data block is sent */
 #endif /* ENABLE_LED_UI */          
@@ -555,12 +1027,96 @@ inline void Reply_READFLSH(uint8_t command[], uint8_t command_size, MemPack *p_m
 }
 #endif /* CMD_READFLASH */
 
+// ******************
+// * ERASEPAG Reply *
+// ******************
+#if CMD_ERASEPAG
+inline void Reply_ERASEPAG(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
+    uint8_t *reply = tx_buffer;
+    p_mem_pack->page_addr = ((command[1] << 8) + command[2]);   /* Sets the flash memory page base address */
+    p_mem_pack->page_addr &= ~(SPM_PAGESIZE - 1);               /* Keep only pages' base addresses */
+    p_mem_pack->page_ix = 0;                                    /* Next data packets are written to this page */
+    p_mem_pack->flags |= (1 << FL_ERASE_PAGE);                  /* Erase the page after the reply (slow op) */
+    reply[0] = ACKERPAG;
+    reply[1] = (uint8_t)(command[1] + command[2]);              /* Returns the sum of MSB and LSB of the page address */
+    SendReply(ERASEPAG_RPLYLN);
+    return;
+}
+#endif /* CMD_ERASEPAG */
+
+// ******************
+// *  GETCRC Reply  *
+// ******************
+#if USE_CRC16
+inline void Reply_GETCRC(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
+    tx_buffer[0] = ACKGTCRC;
+    if (command_size == GETCRC_CMDLN) {
+        // Set the flash memory range to check, the CRC16 is calculated after the reply (slow op)
+        p_mem_pack->crc_addr = ((command[1] << 8) + command[2]);
+        p_mem_pack->crc_size = ((command[3] << 8) + command[4]);
+        p_mem_pack->flags |= (1 << FL_CALC_CRC);
+        tx_buffer[1] = (uint8_t)(command[1] + command[2] + command[3] + command[4]); /* Operands checksum */
+        SendReply(2);
+    } else {
+        // Return the last CRC16 calculated
+        tx_buffer[1] = (uint8_t)(p_mem_pack->crc >> 8);
+        tx_buffer[2] = (uint8_t)(p_mem_pack->crc & 0xFF);
+        SendReply(GETCRC_RPLYLN);
+    }
+    return;
+}
+#endif /* USE_CRC16 */
+
+// ******************
+// * GETSTATS Reply *
+// ******************
+#if CMD_GETSTATS
+inline void Reply_GETSTATS(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
+    uint8_t *reply = tx_buffer;
+    const uint8_t entry = (command[1] & ~STATS_CLEAR_FLAG);
+    reply[0] = ACKGTSTS;
+    if ((command_size != GETSTATS_CMDLN) || (entry >= STATS_ENTRIES)) {
+        SendReply(1);                                       /* Unknown entry: the short reply tells the master */
+        return;
+    }
+    const uint16_t count = stats[entry].count;
+    const uint32_t ticks = stats[entry].ticks;
+    reply[1] = (uint8_t)(count >> 8);                       /* Counters are sent MSB first */
+    reply[2] = (uint8_t)(count & 0xFF);
+    reply[3] = (uint8_t)(ticks >> 24);
+    reply[4] = (uint8_t)(ticks >> 16);
+    reply[5] = (uint8_t)(ticks >> 8);
+    reply[6] = (uint8_t)(ticks & 0xFF);
+    reply[7] = STATS_CLK_MHZ;                               /* Nominal clock to convert the ticks to time */
+    if (command[1] & STATS_CLEAR_FLAG) {
+        stats[entry].count = 0;
+        stats[entry].ticks = 0;
+    }
+    SendReply(GETSTATS_RPLYLN);
+    return;
+}
+
+// Function StatsAdd
+void StatsAdd(uint8_t entry, uint8_t ticks, uint8_t overflow) {
+    // Count an event and accumulate its duration, measured with an 8-bit timer restarted at its beginning.
+    // If the timer overflowed, the event took longer than the timer range: its time is saturated and the
+    // entry flagged, so the master knows that the accumulated time is only a lower bound.
+    stats[entry].count++;
+    if (overflow) {
+        ticks = 0xFF;
+        stats[entry].ticks |= STATS_SAT_TICKS;
+    }
+    stats[entry].ticks += ticks;
+}
+#endif /* CMD_GETSTATS */
+
 // ******************
 // * INITSOFT Reply *
 // ******************
 inline void Reply_INITSOFT(uint8_t command[], uint8_t command_size, MemPack *p_mem_pack) {
     p_mem_pack->flags |= (1 << FL_INIT_2);                  /* Two-step init step 1: receive INITSOFT command */
-    UsiTwiTransmitByte(ACKINITS);
+    tx_buffer[0] = ACKINITS;
+    SendReply(1);
     return;    
 }
 
@@ -578,19 +1134,37 @@ inline void RestorePrescaler(void) {
     CLKPR = ((1 << CLKPS1) | (1 << CLKPS0));                        /* Clock division factor 8 (0011) */
 }
 
+#if PASS_APP_ADDR
+// Function PassAppAddress
+inline void PassAppAddress(void) {
+    // Leave the application TWI address in r2 and its complement in r3 and jump to the trampoline,
+    // all in the same asm block so the compiler can't reuse r2 and r3 before the application starts.
+    // Its C runtime startup code doesn't use them (see nb-usitwisl TWI_ADDR_FROM_BOOT).
+    asm volatile(
+        "mov r2, %0 \n\t"
+        "mov r3, %1 \n\t"
+        "ijmp \n\t"
+        :
+        : "r"((uint8_t)(TWI_ADDR + APP_ADDR_OFFSET)), "r"((uint8_t)~(TWI_ADDR + APP_ADDR_OFFSET)),
+          "z"((uint16_t)((TIMONEL_START - 2) / 2))
+        : "r2", "r3");
+    __builtin_unreachable();
+}
+#endif /* PASS_APP_ADDR */
+
 /////////////////////////////////////////////////////////////////////////////
 ////////////       ALL USI TWI DRIVER CODE BELOW THIS LINE       ////////////
 /////////////////////////////////////////////////////////////////////////////
 
-/*  ___________________________
-   |                           |
-   | USI TWI byte transmission |
-   |___________________________|
+/*  ____________________________
+   |                            |
+   | USI TWI reply transmission |
+   |____________________________|
 */
-void UsiTwiTransmitByte(uint8_t data_byte) {
-    tx_head = ((tx_head + 1) & TWI_TX_BUFFER_MASK); /* Update the TX buffer index */
-    while (tx_head == tx_tail) {};          /* Wait until there is free space in the TX buffer */
-    tx_buffer[tx_head] = data_byte;         /* Write the data byte into the TX buffer */
+inline void SendReply(uint8_t reply_size) {
+    // The reply handlers write the reply straight into the TX buffer, from tx_buffer[0] on, after
+    // ProcessCommand empties it (tx_tail = TWI_TX_BUFFER_MASK). This only sets where the reply ends.
+    tx_head = ((reply_size - 1) & TWI_TX_BUFFER_MASK);
 }
 
 /*  _______________________________
@@ -600,8 +1174,9 @@ void UsiTwiTransmitByte(uint8_t data_byte) {
 */
 void UsiTwiDriverInit(void) {
     // Initialize USI for TWI Slave mode.
-    tx_tail = tx_head = 0;                  /* Flush TWI TX buffers */
-    rx_tail = rx_head = rx_byte_count = 0;  /* Flush TWI RX buffers */
+    tx_tail = tx_head = TWI_TX_BUFFER_MASK; /* Flush TWI TX buffers, the next reply goes from tx_buffer[0] on */
+    rx_tail = rx_head = TWI_RX_BUFFER_MASK; /* Flush TWI RX buffers, the next command goes from rx_buffer[0] on */
+    rx_byte_count = 0;
     SET_USI_SDA_AND_SCL_AS_OUTPUT();        /* Set SCL and SDA as output */
     PORT_USI |= (1 << PORT_USI_SDA);        /* Set SDA high */
     PORT_USI |= (1 << PORT_USI_SCL);        /* Set SCL high */
@@ -609,6 +1184,19 @@ void UsiTwiDriverInit(void) {
     SET_USI_TO_WAIT_FOR_TWI_ADDRESS();      /* Wait for TWI start condition and address from master */
 }
 
+/*  ____________________________
+   |                            |
+   | USI TWI driver suspension  |
+   |____________________________|
+*/
+inline void UsiTwiDriverSuspend(void) {
+    // Release the TWI lines while running a slow operation (flash writing or erasing).
+    // The device doesn't acknowledge its address until the driver is initialized again,
+    // so the TWI master can poll it to know when the operation is complete.
+    USICR = 0;                              /* Disable the USI two-wire mode */
+    SET_USI_SDA_AND_SCL_AS_INPUT();         /* Float SCL and SDA */
+}
+
 /*  _______________________________________________________
    |                                                       |
    | TWI start condition handler (Interrupt-like function) |
@@ -647,26 +1235,29 @@ inline void TwiStartHandler(void) {
 inline bool UsiOverflowHandler(MemPack *p_mem_pack) {    
     switch (device_state) {
         // If the address received after the start condition matches this device or is
-        // a general call, reply ACK and check whether it should send or receive data.
-        // Otherwise, set USI to wait for the next start condition and address.
+        // a general call (when enabled), reply ACK and check whether it should send or
+        // receive data. Otherwise, set USI to wait for the next start condition and address.
         case STATE_CHECK_RECEIVED_ADDRESS: {
+#if CMD_GENCALL
             if ((USIDR == 0) || ((USIDR >> 1) == TWI_ADDR)) {
+#else
+            if ((USIDR >> 1) == TWI_ADDR) {
+#endif /* CMD_GENCALL */
                 if (USIDR & 0x01) {     /* If data register low-order bit = 1, start the send data mode */
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
                     //                                                                   >>
-                    uint8_t command_size = rx_byte_count;               //                 >>
-                    static uint8_t command[MST_PACKET_SIZE * 2];        //                   >>
-                    for (uint8_t i = 0; i < command_size; i++) {        //  Call a function    >>
-                        while (rx_byte_count-- == 0) {};                //  in main to process   >>
-                        rx_tail = ((rx_tail + 1) & TWI_RX_BUFFER_MASK); //  the received data    >>
-                        command[i] = rx_buffer[rx_tail];                //  (command) ...      >>
-                    }                                                   //                   >>
-                    ReceiveEvent(command, command_size, p_mem_pack);    //                 >>
+                    ProcessCommand(p_mem_pack); // Call a function in main to process    >>
+                    //                             the received data (command) ...      >>
                     //                                                                   >>
                     // >>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>>
                     // Next state -> STATE_SEND_DATA_BYTE
                     device_state = STATE_SEND_DATA_BYTE;
                 } else {                /* If data register low-order bit = 0, start the receive data mode */
+#if CMD_GENCALL
+                    if (USIDR == 0) {
+                        p_mem_pack->flags |= (1 << FL_GEN_CALL);    /* General call: process the command after the stop */
+                    }
+#endif /* CMD_GENCALL */
                     // Next state -> STATE_RECEIVE_DATA_BYTE
                     device_state = STATE_RECEIVE_DATA_BYTE;
                 }
@@ -732,7 +1323,17 @@ inline bool UsiOverflowHandler(MemPack *p_mem_pack) {
         // 2) Copy the received byte from USIDR to RX buffer and send ACK. After the
         // counter overflows, return to the previous state (STATE_RECEIVE_DATA_BYTE).
         // This mode's cycle should end when a stop condition is detected on the bus.
+        // When the master sends a whole command in a single transaction (burst mode), all its
+        // bytes are buffered here until the read request arrives. If the RX buffer is full, the
+        // byte is dropped and not acknowledged (NACK), so the master can detect the overrun.
         case STATE_PUT_BYTE_IN_RX_BUFFER_AND_SEND_ACK: {
+            if (rx_byte_count >= TWI_RX_BUFFER_SIZE) {
+#if CMD_GETSTATS
+                StatsAdd(STATS_RX_OVERRUN, 0, false);
+#endif /* CMD_GETSTATS */
+                SET_USI_TO_WAIT_FOR_TWI_ADDRESS();
+                return false;
+            }
             // Put data into buffer
             rx_byte_count++;
             rx_head = ((rx_head + 1) & TWI_RX_BUFFER_MASK);
@@ -28,6 +28,7 @@
 #include <avr/wdt.h>
 #include <stdbool.h>
 #include <avr/interrupt.h>
+#include <util/crc16.h>
 #include "../nb-libs/cmd/nb-twi-cmd.h"
 
 /* ====== [   The configuration of the next optional features can be checked   ] ====== */        
@@ -90,8 +91,10 @@
                                     /* NOTE: This value can be set externally as a makefile option         */
 
 // Bit 2
-#define FORCE_ERASE_PG  false       /* If this option is enabled, each flash memory page is erased before  */
-                                    /* writing new data. Normally, it shouldn't be necessary to enable it. */
+#ifndef FORCE_ERASE_PG              /* If this option is enabled, each flash memory page is erased before  */
+#define FORCE_ERASE_PG  false       /* writing new data. It allows the TWI master to rewrite only the      */
+#endif /* FORCE_ERASE_PG */         /* pages that changed (delta upload) without deleting the whole app.   */
+                                    /* NOTE: This value can be set externally as a makefile option         */
 
 // Bit 3
 #define CLEAR_BIT_7_R31 false       /* This is to avoid that the first bootloader instruction is skipped   */
@@ -103,6 +106,26 @@
                                     /* that isn't bigger than SPM_PAGESIZE (usually 64 bytes). This keeps  */
                                     /* the app data integrity in case the master sends wrong page sizes.   */
 
+// Bit 5
+#ifndef CMD_GENCALL                 /* If this option is enabled, the commands sent to the TWI general     */
+#define CMD_GENCALL     false       /* call address (0) are processed like the addressed ones, but without */
+#endif /* CMD_GENCALL */            /* a reply. This allows flashing the same app on many devices at once. */
+
+// Bit 6
+#ifndef CMD_ERASEPAG                /* This option enables the ERASEPAG command, which erases a single     */
+#define CMD_ERASEPAG    false       /* flash memory page and sets it as the page to write next. It allows  */
+#endif /* CMD_ERASEPAG */           /* partial app updates without deleting the whole flash memory.        */
+
+// Bit 7
+#ifndef USE_CRC16                   /* If this option is enabled, the WRITPAGE and READFLSH data packets   */
+#define USE_CRC16       false       /* are checked with a CRC16 instead of an 8-bit sum, and the GETCRC    */
+#endif /* USE_CRC16 */              /* command returns the CRC16 of a flash memory range for verification. */
+
+// Bit 8
+#ifndef CMD_WRITERLE                /* If this option is enabled, the WRITERLE command receives a memory   */
+#define CMD_WRITERLE    false       /* page compressed with word run-length encoding and expands it in the */
+#endif /* CMD_WRITERLE */           /* page buffer, so pages with repeated data take fewer bytes to send.  */
+
 /* ^^^^^^ [       End of feature settings shown in the GETTMNLV command.       ] ^^^^^^ */
 /* ====== [       ......................................................       ] ====== */
 
@@ -113,9 +136,74 @@
 /* ------------------------------------------------------------------------------------ */
                                     
 // TWI commands Xmit packet size
-#define MST_PACKET_SIZE 32          /* Master-to-slave Xmit packet size: always even values, min=2, max=32 */
+#ifndef MST_PACKET_SIZE             /* Master-to-slave Xmit packet size: always even values, min=2, max=64 */
+#define MST_PACKET_SIZE 32          /* (a full page). This is the biggest WRITPAGE packet accepted, smaller */
+#endif /* MST_PACKET_SIZE */        /* ones are also accepted. NOTE: This value can be set externally as a */
+                                    /* makefile option and it is shown in the GETTMNLV command.            */
 #define SLV_PACKET_SIZE 32          /* Slave-to-master Xmit packet size: always even values, min=2, max=32 */
 
+// Windowed page acknowledge
+#ifndef WINDOWED_ACK                /* If this is enabled, the WRITPGWN data packets are processed when    */
+#define WINDOWED_ACK    false       /* the TWI master ends the transmission, without a reply. The page's   */
+#endif /* WINDOWED_ACK */           /* last packet, sent with WRITPAGE, reports the status of them all.    */
+                                    /* NOTE: This value can be set externally as a makefile option and it  */
+                                    /* is shown in the GETTMNLV command (packet size byte, bit 8).         */
+#define WND_ACK_FLAG    0x80        /* GETTMNLV packet size byte flag: windowed ack enabled                */
+
+// Data packet resend
+#ifndef PKT_RESYNC                  /* If this is enabled, the WRITPAGE and WRITERLE packets are checked   */
+#define PKT_RESYNC      false       /* before filling the page buffer. A rejected packet is dropped, the   */
+#endif /* PKT_RESYNC */             /* next ones too until GETTMNLV is read, and GETTMNLV reports the page */
+                                    /* and offset where the data goes on, so the TWI master can resend     */
+                                    /* it. When disabled, a rejected packet deletes the application.       */
+                                    /* NOTE: This value can be set externally as a makefile option and it  */
+                                    /* is shown in the GETTMNLV reply length (14 or 16 bytes).             */
+
+// Clock stretching while writing pages
+#ifndef STRETCH_ON_WRITE            /* If this is enabled, the TWI address isn't released while a page is  */
+#define STRETCH_ON_WRITE false      /* written: a TWI master transaction started meanwhile is held low by  */
+#endif /* STRETCH_ON_WRITE */       /* the USI start detector (clock stretching) until the write ends, so  */
+                                    /* the master doesn't have to poll the device address between pages.   */
+                                    /* NOTE: This value can be set externally as a makefile option and it  */
+                                    /* is shown in the GETTMNLV command (READFLSH size byte, bit 8).       */
+#define STR_WRITE_FLAG  0x80        /* GETTMNLV READFLSH size byte flag: clock stretching enabled          */
+
+// Fast boot after power-on
+#ifndef FAST_BOOT                   /* If this is enabled along with TIMEOUT_EXIT, Timonel runs the loaded */
+#define FAST_BOOT       false       /* application after FAST_BOOT_WDP when it starts from a power-on or a */
+#endif /* FAST_BOOT */              /* brown-out reset and it isn't initialized, timed by the watchdog     */
+                                    /* oscillator instead of the exit delay loop. After the other resets   */
+                                    /* (watchdog, e.g. RESETMCU, or the reset pin) the regular exit timeout */
+                                    /* waits for the TWI master. NOTE: This value can be set externally as */
+                                    /* a makefile option.                                                  */
+#define FAST_BOOT_WDP   (1 << WDP0) /* Fast boot time: watchdog prescaler bits (32 ms)                     */
+
+// Reboot handshake
+#ifndef REBOOT_HOLD                 /* If this is enabled along with TIMEOUT_EXIT, Timonel doesn't run the */
+#define REBOOT_HOLD     false       /* application on timeout when it starts from a watchdog reset with    */
+#endif /* REBOOT_HOLD */            /* the BOOTTMNL marker (BOOT_HOLD_MARK at BOOT_HOLD_ADDR) left in SRAM */
+                                    /* by the application: it waits for the TWI master to initialize it.   */
+                                    /* The marker is cleared on every start. NOTE: This value can be set   */
+                                    /* externally as a makefile option.                                    */
+
+// Application address handover
+#ifndef PASS_APP_ADDR               /* If this is enabled, Timonel hands its application TWI address       */
+#define PASS_APP_ADDR   false       /* over to the application when it exits: TWI_ADDR + APP_ADDR_OFFSET   */
+#endif /* PASS_APP_ADDR */          /* in r2 and its complement in r3, so a single application image gets  */
+                                    /* a per-node address. NOTE: nb-usitwisl takes it when the application */
+                                    /* is built with TWI_ADDR_FROM_BOOT enabled. This value can be set     */
+                                    /* externally as a makefile option.                                    */
+
+// Statistics counters
+#ifndef CMD_GETSTATS                /* If this is enabled, Timonel counts and times its command handlers   */
+#define CMD_GETSTATS    false       /* and the flash memory page writes and erases (Timer0 and Timer1      */
+#endif /* CMD_GETSTATS */           /* ticks), along with the rejected data packets and the RX buffer      */
+                                    /* overruns. The GETSTATS command returns them, so the TWI master      */
+                                    /* timings can be sized from real data. The counters are cleared on    */
+                                    /* every start, the timers are stopped before running the application. */
+                                    /* NOTE: This value can be set externally as a makefile option. It     */
+                                    /* takes 120 bytes of RAM plus code, TIMONEL_START may need lowering.  */
+
 // Led UI settings
 #ifndef LED_UI_PIN                  /* GPIO pin to monitor activity. If ENABLE_LED_UI is enabled, some     */
 #define LED_UI_PIN      PB1         /* bootloader commands could activate it at run time. Please check the */
@@ -135,15 +223,43 @@
 #define FL_INIT_2       1           /* Flag bit 2 (2)  : Two-step initialization STEP 2 */
 #define FL_DEL_FLASH    2           /* Flag bit 3 (4)  : Delete flash memory            */
 #define FL_EXIT_TML     3           /* Flag bit 4 (8)  : Exit Timonel & run application */
-#define FL_BIT_5        4           /* Flag bit 5 (16) : Not used */
-#define FL_BIT_6        5           /* Flag bit 6 (32) : Not used */
-#define FL_BIT_7        6           /* Flag bit 7 (64) : Not used */
-#define FL_BIT_8        7           /* Flag bit 8 (128): Not used */
+#define FL_GEN_CALL     4           /* Flag bit 5 (16) : General call command received  */
+#define FL_ERASE_PAGE   5           /* Flag bit 6 (32) : Erase a flash memory page      */
+#define FL_CALC_CRC     6           /* Flag bit 7 (64) : Calculate a flash memory CRC16 */
+#define FL_PKT_ERROR    7           /* Flag bit 8 (128): Data packet rejected, resync   */
 
 // Command reply length constants
-#define GETTMNLV_RPLYLN 12          /* GETTMNLV command reply length */
+#if PKT_RESYNC
+#define GETTMNLV_RPLYLN 16          /* GETTMNLV command reply length, with the page position */
+#else
+#define GETTMNLV_RPLYLN 14          /* GETTMNLV command reply length */
+#endif /* PKT_RESYNC */
 #define STPGADDR_RPLYLN 2           /* STPGADDR command reply length */
-#define WRITPAGE_RPLYLN 2           /* WRITPAGE command reply length */
+#define ERASEPAG_RPLYLN 2           /* ERASEPAG command reply length */
+#define GETCRC_CMDLN    5           /* GETCRC command length when setting the flash memory range */
+#define GETCRC_RPLYLN   3           /* GETCRC command reply length when returning the CRC16 */
+#define GETSTATS_CMDLN  2           /* GETSTATS command length: 1 cmd byte + 1 entry byte */
+#define GETSTATS_RPLYLN 8           /* GETSTATS command reply length: 1 ack + 2 count + 4 ticks + 1 clock */
+
+// Statistics timers: each event restarts its timer, an overflow means that it outlasted the 8-bit range
+#define STATS_CMD_START()   { TCNT0 = 0; TIFR = (1 << TOV0); }  /* Timer0: command handler start */
+#define STATS_CMD_OVF()     ((TIFR >> TOV0) & true)             /* Timer0: command handler overflow */
+#define STATS_SLOW_START()  { TCNT1 = 0; TIFR = (1 << TOV1); }  /* Timer1: flash memory operation start */
+#define STATS_SLOW_OVF()    ((TIFR >> TOV1) & true)             /* Timer1: flash memory operation overflow */
+
+// Data packet integrity check
+#if USE_CRC16
+#define PKT_CHECK_LEN   2           /* CRC16 (CCITT polynomial 0x1021, MSB first) */
+#define CRC16_INIT      0xFFFF      /* CRC16 initial value */
+#else
+#define PKT_CHECK_LEN   1           /* 8-bit sum (mod 256) */
+#endif /* USE_CRC16 */
+#define WRITPAGE_RPLYLN (1 + PKT_CHECK_LEN) /* WRITPAGE and WRITERLE commands reply length */
+#define CMD_MAX_LEN     (MST_PACKET_SIZE + 1 + PKT_CHECK_LEN) /* Longest command: WRITPAGE opcode + data + check */
+
+// WRITERLE data tokens: [0b0nnnnnnn + (n + 1) words] literal block, [0b1nnnnnnn + word] word repeated (n + 1) times
+#define RLE_RUN_FLAG    0x80        /* Token bit 8: the next word is repeated, otherwise n + 1 words follow */
+#define RLE_COUNT_MASK  0x7F        /* Token bits 1-7: word count - 1 */
 
 // Memory page definitions
 #define RESET_PAGE      0           /* Interrupt vector table address start location. */
@@ -160,6 +276,11 @@
 #define HFPLL_CLK_SRC   0x01        /* HF PLL (16 MHz) clock source low fuse value */
 #define RCOSC_CLK_SRC   0x02        /* RC oscillator (8 MHz) clock source low fuse value */
 #define LFUSE_PRESC_BIT 7           /* Prescaler bit position in low fuse (FUSE_CKDIV8) */
+#if ((LOW_FUSE & 0x0F) == HFPLL_CLK_SRC)
+#define STATS_CLK_MHZ   16          /* GETSTATS nominal CPU clock: HF PLL (16 MHz) */
+#else
+#define STATS_CLK_MHZ   8           /* GETSTATS nominal CPU clock: RC oscillator (8 MHz before OSC_FAST) */
+#endif /* LOW_FUSE CLOCK SOURCE */
 
 // Non-blocking delays
 #define SHORT_EXIT_DLY  0x0A        /* Long exit delay */
@@ -251,10 +372,26 @@
 #else
     #define EF_BIT_3    0
 #endif /* CHECK_PAGE_IX */
-#define EF_BIT_4    0       /* EF Bit 4 not used */
-#define EF_BIT_5    0       /* EF Bit 5 not used */
-#define EF_BIT_6    0       /* EF Bit 6 not used */
-#define EF_BIT_7    0       /* EF Bit 7 not used */
+#if (CMD_GENCALL == true)
+    #define EF_BIT_4    16
+#else
+    #define EF_BIT_4    0
+#endif /* CMD_GENCALL */
+#if (CMD_ERASEPAG == true)
+    #define EF_BIT_5    32
+#else
+    #define EF_BIT_5    0
+#endif /* CMD_ERASEPAG */
+#if (USE_CRC16 == true)
+    #define EF_BIT_6    64
+#else
+    #define EF_BIT_6    0
+#endif /* USE_CRC16 */
+#if (CMD_WRITERLE == true)
+    #define EF_BIT_7    128
+#else
+    #define EF_BIT_7    0
+#endif /* CMD_WRITERLE */
 
 #define TML_EXT_FEATURES (EF_BIT_7 + EF_BIT_6 + EF_BIT_5 + EF_BIT_4 + EF_BIT_3 + EF_BIT_2 + EF_BIT_1 + EF_BIT_0)
 
@@ -265,7 +402,11 @@
 // Driver buffer definitions
 // Allowed RX buffer sizes: 1, 2, 4, 8, 16, 32, 64, 128 or 256
 #ifndef TWI_RX_BUFFER_SIZE
+#if (MST_PACKET_SIZE > 32)
+#define TWI_RX_BUFFER_SIZE  128         /* Full-page WRITPAGE commands take 66 bytes */
+#else
 #define TWI_RX_BUFFER_SIZE  64
+#endif /* MST_PACKET_SIZE > 32 */
 #endif /* TWI_RX_BUFFER_SIZE */
 
 #define TWI_RX_BUFFER_MASK (TWI_RX_BUFFER_SIZE - 1)
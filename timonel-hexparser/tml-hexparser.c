@@ -20,11 +20,27 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#if defined(WIN)
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #define FILE_TYPE_INTEL_HEX 1
 #define FILE_TYPE_RAW 2
+#define OUTPUT_C_ARRAY 1      /* Output: C "payload[]" array definition to be included in the TWI master */
+#define OUTPUT_BINARY 2       /* Output: raw binary, padded with 0xFF up to a whole flash memory page */
+#define OUTPUT_IMAGE 3        /* Output: Timonel image, header + page map + non-blank pages */
 #define DEBUGLVL 1
 #define BYTESPERLINE 8
+#define PAGESIZE 64           /* ATtiny85 flash memory page size */
+#define RLE_MAX_PACKET 64     /* Biggest WRITERLE data packet (full-page Timonel configurations) */
+#define RLE_RUN_FLAG 0x80     /* WRITERLE token bit 8: the next word is repeated, otherwise n + 1 words follow */
+#define IMAGE_MAGIC "TMLI"    /* Timonel image header: magic characters */
+#define IMAGE_VERSION 1       /* Timonel image header: format version */
+#define IMAGE_HEADER_LEN 16   /* Timonel image header length */
+#define IMAGE_FL_SPARSE 0x01  /* Timonel image header flags: the blank (all 0xFF) pages aren't included */
+#define CRC16_INIT 0xFFFF     /* CRC16 (CCITT polynomial 0x1021) initial value, same as Timonel's GETCRC */
+#define CRC16_POLY 0x1021     /* CRC16 (CCITT) polynomial */
 
 #define TML_HEXPARSER_VERSION " Timonel Hex Parser version: 0.3"
 
@@ -36,7 +52,14 @@ static int parseRaw(char *hexfile, unsigned char *buffer, int *startAddr, int *e
 static int parseIntelHex(char *hexfile, unsigned char *buffer, int *startAddr, int *endAddr); /* taken from bootloadHID */
 static int parseUntilColon(FILE *fp); /* taken from bootloadHID */
 static int parseHex(FILE *fp, int numDigits); /* taken from bootloadHID */
+static int encodeRle(unsigned char *page, unsigned char *rle_data, int max_size);
+static void printRleStats(unsigned char *buffer, int endAddr);
+static void printCArray(unsigned char *buffer, int startAddr, int endAddr);
+static int writeBinary(unsigned char *buffer, int size);
+static int writeImage(unsigned char *buffer, int size, int skip_blank);
+static unsigned int updateCrc16(unsigned int crc, unsigned char data);
 static int use_ansi = 0;
+static int rle_stats = 0;
 
 // Main function
 int main(int argc, char *argv[]) {
@@ -46,11 +69,13 @@ int main(int argc, char *argv[]) {
   // Command argument parsing
   int run = 0;
   int file_type = FILE_TYPE_INTEL_HEX;
+  int output = OUTPUT_C_ARRAY;
+  int skip_blank = 0;
   int arg_pointer = 1;
   #if defined(WIN)
-    char* usage = "\n Timonel Intel Hex Parser\n ========================\n usage: tml-hexparser [--help] [--type intel-hex|raw] filename";
+    char* usage = "\n Timonel Intel Hex Parser\n ========================\n usage: tml-hexparser [--help] [--type intel-hex|raw] [--output c|bin|image] [--skip-blank] [--rle] filename";
   #else
-    char* usage = "\n Timonel Intel Hex Parser\n ========================\n usage: tml-hexparser [--help] [--type intel-hex|raw] filename [--no-ansi]\n";
+    char* usage = "\n Timonel Intel Hex Parser\n ========================\n usage: tml-hexparser [--help] [--type intel-hex|raw] [--output c|bin|image] [--skip-blank] [--rle] filename [--no-ansi]\n";
   #endif 
   #if defined(WIN)
     use_ansi = 0;
@@ -72,11 +97,31 @@ int main(int argc, char *argv[]) {
         printf("Unknown File Type specified with --type option");
         return EXIT_FAILURE;
       }
+    } else if (strcmp(argv[arg_pointer], "--output") == 0) {
+      arg_pointer += 1;
+      if ((arg_pointer < argc) && (strcmp(argv[arg_pointer], "c") == 0)) {
+        output = OUTPUT_C_ARRAY;
+      } else if ((arg_pointer < argc) && (strcmp(argv[arg_pointer], "bin") == 0)) {
+        output = OUTPUT_BINARY;
+      } else if ((arg_pointer < argc) && (strcmp(argv[arg_pointer], "image") == 0)) {
+        output = OUTPUT_IMAGE;
+      } else {
+        fprintf(stderr, "Unknown output format specified with --output option\n");
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[arg_pointer], "--skip-blank") == 0) {
+      skip_blank = 1;
     } else if (strcmp(argv[arg_pointer], "--help") == 0 || strcmp(argv[arg_pointer], "-h") == 0) {
       puts(usage);
       puts("");
       puts("  --type [intel-hex, raw]: Set file type to either Intel Hex or Raw");
       puts("                           bytes (Intel Hex is default)");
+      puts(" --output [c, bin, image]: Set the output to a C payload array (default),");
+      puts("                           a page-aligned raw binary or a Timonel image");
+      puts("                           (header, page map and pages) written to stdout");
+      puts("             --skip-blank: Leave the blank (all 0xFF) pages out of the image");
+      puts("                    --rle: Show how many bytes the WRITERLE command");
+      puts("                           saves when uploading this payload");
       #ifndef WIN
       puts("                --no-ansi: Don't use ANSI in terminal output");
       #endif
@@ -88,6 +133,8 @@ int main(int argc, char *argv[]) {
     } else if (strcmp(argv[arg_pointer], "--no-ansi") == 0) {
       use_ansi = 0;
       arg_pointer += 1;
+    } else if (strcmp(argv[arg_pointer], "--rle") == 0) {
+      rle_stats = 1;
     } else {
       file = argv[arg_pointer];
     }
@@ -124,6 +171,16 @@ int main(int argc, char *argv[]) {
 
   }
 
+  // Output: the binary formats sizes are rounded up to whole pages
+  if (output == OUTPUT_BINARY) {
+    return writeBinary(dataBuffer, endAddress);
+  } else if (output == OUTPUT_IMAGE) {
+    return writeImage(dataBuffer, endAddress, skip_blank);
+  }
+#if ( DEBUGLVL > 0 )
+  printCArray(dataBuffer, startAddress, endAddress);
+#endif
+
   printf("// Timonel Hex Parser done. Thank you!\n//\n");
 
   return EXIT_SUCCESS;
@@ -159,7 +216,7 @@ static int parseIntelHex(char *hexfile, unsigned char *buffer, int *startAddr, i
 
   input = strcmp(hexfile, "-") == 0 ? stdin : fopen(hexfile, "r");
   if (input == NULL) {
-    printf("//> Error opening %s: %s\n", hexfile, strerror(errno));
+    fprintf(stderr, "//> Error opening %s: %s\n", hexfile, strerror(errno));
     return 1;
   }
 
@@ -182,7 +239,7 @@ static int parseIntelHex(char *hexfile, unsigned char *buffer, int *startAddr, i
 
     sum += parseHex(input, 2);
     if ((sum & 0xff) != 0) {
-      printf("//> Warning: Checksum error between address 0x%x and 0x%x\n", base, address);
+      fprintf(stderr, "//> Warning: Checksum error between address 0x%x and 0x%x\n", base, address);
     }
 
     if(*startAddr > base) {
@@ -194,32 +251,6 @@ static int parseIntelHex(char *hexfile, unsigned char *buffer, int *startAddr, i
 
   }
   
-#if ( DEBUGLVL > 0 )
-  // GC: Printing addresses
-  printf("\n//\n");
-  printf("// Start Address: 0x%x \n", *startAddr);
-  printf("// End Address: 0x%x \n//\n", *endAddr);
-  // GC: Printing payload array definition ...
-  //printf("const byte payldType = 0;    /* Application Payload */\n\n");
-  //printf("const byte payload[%i] = {", *endAddr + 1);
-  printf("uint8_t payload[%i] = {", *endAddr + 1);  
-
-  
-  // GC: Printing loaded buffer ...
-  printf("\n    ");
-    int l = 0;
-	for(i = 0; i <= *endAddr; i++) {
-		printf("0x%02x", buffer[i]);
-		if (i <= (*endAddr) - 1) {
-			printf(", ");
-		}
-		if (l++ == BYTESPERLINE - 1) {
-			printf("\n    ");
-			l = 0;
-		}
-	}
-	printf("\n};\n\n//\n");  
-#endif
  
   fclose(input);
   return 0;
@@ -232,7 +263,7 @@ static int parseRaw(char *filename, unsigned char *data_buffer, int *start_addre
   input = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
 
   if (input == NULL) {
-    printf("//> Error reading %s: %s\n", filename, strerror(errno));
+    fprintf(stderr, "//> Error reading %s: %s\n", filename, strerror(errno));
     return 1;
   }
 
@@ -253,3 +284,160 @@ static int parseRaw(char *filename, unsigned char *data_buffer, int *start_addre
   fclose(input);
   return 0;
 }
+
+// Function encodeRle (same page encoding as the TWI master's Timonel::EncodeRle, returns 0 if it doesn't fit)
+static int encodeRle(unsigned char *page, unsigned char *rle_data, int max_size) {
+  int words = PAGESIZE / 2, size = 0, ix = 0, i;
+  while (ix < words) {
+    int run = 1;
+    while ((ix + run < words) && (page[(ix + run) * 2] == page[ix * 2]) && (page[(ix + run) * 2 + 1] == page[ix * 2 + 1])) {
+      run++;
+    }
+    if (run >= 2) {
+      if (size + 3 > max_size) {
+        return 0;
+      }
+      rle_data[size++] = RLE_RUN_FLAG | (run - 1);
+      rle_data[size++] = page[ix * 2];
+      rle_data[size++] = page[ix * 2 + 1];
+      ix += run;
+    } else {
+      int len = 1;
+      while ((ix + len < words) && !((ix + len + 1 < words) && (page[(ix + len) * 2] == page[(ix + len + 1) * 2]) && (page[(ix + len) * 2 + 1] == page[(ix + len + 1) * 2 + 1]))) {
+        len++;
+      }
+      if (size + 1 + len * 2 > max_size) {
+        return 0;
+      }
+      rle_data[size++] = len - 1;
+      for (i = 0; i < len * 2; i++) {
+        rle_data[size++] = page[ix * 2 + i];
+      }
+      ix += len;
+    }
+  }
+  return size;
+}
+
+// Function printRleStats (prints the payload data bytes sent with and without WRITERLE commands)
+static void printRleStats(unsigned char *buffer, int endAddr) {
+  unsigned char rle_data[RLE_MAX_PACKET];
+  int pages = (endAddr + PAGESIZE - 1) / PAGESIZE, rle_pages = 0, rle_bytes = 0, page;
+  for (page = 0; page < pages; page++) {
+    int size = encodeRle(&buffer[page * PAGESIZE], rle_data, RLE_MAX_PACKET);
+    if (size > 0) {
+      rle_pages++;
+      rle_bytes += size;
+    } else {
+      rle_bytes += PAGESIZE;
+    }
+  }
+  printf("// RLE: %d of %d pages encoded, %d data bytes instead of %d (%d%%)\n//\n", rle_pages, pages, rle_bytes, pages * PAGESIZE, (rle_bytes * 100) / (pages * PAGESIZE));
+}
+
+// Function printCArray (prints the payload as a C array definition to be included in the TWI master)
+static void printCArray(unsigned char *buffer, int startAddr, int endAddr) {
+  int i, l = 0;
+  // GC: Printing addresses
+  printf("\n//\n");
+  printf("// Start Address: 0x%x \n", startAddr);
+  printf("// End Address: 0x%x \n//\n", endAddr);
+  // GC: Printing payload array definition ...
+  printf("uint8_t payload[%i] = {", endAddr + 1);
+  // GC: Printing loaded buffer ...
+  printf("\n    ");
+  for (i = 0; i <= endAddr; i++) {
+    printf("0x%02x", buffer[i]);
+    if (i <= endAddr - 1) {
+      printf(", ");
+    }
+    if (l++ == BYTESPERLINE - 1) {
+      printf("\n    ");
+      l = 0;
+    }
+  }
+  printf("\n};\n\n//\n");
+  if (rle_stats) {
+    printRleStats(buffer, endAddr);
+  }
+}
+
+// Function writeBinary (writes the payload to stdout, padded with 0xFF up to a whole page)
+static int writeBinary(unsigned char *buffer, int size) {
+  int pages = (size + PAGESIZE - 1) / PAGESIZE;
+#if defined(WIN)
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  if (fwrite(buffer, 1, pages * PAGESIZE, stdout) != (size_t)(pages * PAGESIZE)) {
+    fprintf(stderr, "Error writing the binary output!\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+// Function writeImage (writes a Timonel image to stdout). All the multibyte values are little-endian.
+//   Header (16 bytes):
+//     0-3: "TMLI" | 4: format version | 5: flags (bit 1: blank pages skipped) | 6-7: page count
+//     8-9: payload size | 10-11: reset vector (payload bytes 0 and 1) | 12-13: payload CRC16
+//     14: page map length | 15: reserved (0)
+//   Page map: one bit per page (page 0 = bit 1 of the first byte), set when the page is in the image
+//   Pages: the pages included in the page map, SPM_PAGESIZE (64) bytes each, in ascending order
+static int writeImage(unsigned char *buffer, int size, int skip_blank) {
+  unsigned char header[IMAGE_HEADER_LEN] = {0};
+  unsigned char page_map[(65536 / PAGESIZE) / 8] = {0};
+  int pages = (size + PAGESIZE - 1) / PAGESIZE;
+  int map_length = (pages + 7) / 8;
+  unsigned int crc = CRC16_INIT;
+  int i, page;
+  for (i = 0; i < size; i++) {
+    crc = updateCrc16(crc, buffer[i]);
+  }
+  for (page = 0; page < pages; page++) {
+    int blank = 1;
+    for (i = 0; i < PAGESIZE; i++) {
+      if (buffer[page * PAGESIZE + i] != 0xFF) {
+        blank = 0;
+        break;
+      }
+    }
+    if (!(skip_blank && blank)) {
+      page_map[page / 8] |= (1 << (page % 8));
+    }
+  }
+  memcpy(header, IMAGE_MAGIC, 4);
+  header[4] = IMAGE_VERSION;
+  header[5] = (skip_blank ? IMAGE_FL_SPARSE : 0);
+  header[6] = pages & 0xFF;
+  header[7] = (pages >> 8) & 0xFF;
+  header[8] = size & 0xFF;
+  header[9] = (size >> 8) & 0xFF;
+  header[10] = buffer[0];
+  header[11] = buffer[1];
+  header[12] = crc & 0xFF;
+  header[13] = (crc >> 8) & 0xFF;
+  header[14] = map_length;
+#if defined(WIN)
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+  fwrite(header, 1, IMAGE_HEADER_LEN, stdout);
+  fwrite(page_map, 1, map_length, stdout);
+  for (page = 0; page < pages; page++) {
+    if ((page_map[page / 8] >> (page % 8)) & 1) {
+      if (fwrite(&buffer[page * PAGESIZE], 1, PAGESIZE, stdout) != PAGESIZE) {
+        fprintf(stderr, "Error writing the image output!\n");
+        return EXIT_FAILURE;
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+// Function updateCrc16 (CRC16 CCITT, MSB first, same as the TWI master's Timonel::UpdateCrc16)
+static unsigned int updateCrc16(unsigned int crc, unsigned char data) {
+  int i;
+  crc ^= ((unsigned int)data << 8);
+  for (i = 0; i < 8; i++) {
+    crc = ((crc & 0x8000) ? ((crc << 1) ^ CRC16_POLY) : (crc << 1)) & 0xFFFF;
+  }
+  return crc;
+}
@@ -0,0 +1,234 @@
+/*
+  main.cpp (timonel-twim-bench)
+  =============================
+  Timonel library benchmark program v1.4 "Beni"
+  ----------------------------------------------------------------------------
+  This program measures the throughput and latency of the Timonel bootloader
+  functions on all the devices found on the TWI bus, to compare bootloader
+  configurations and packet sizes and to catch performance regressions.
+  It uses a serial console configured at 115200 N 8 1 for its report.
+  ----------------------------------------------------------------------------
+  2019-11-04 Gustavo Casanova
+  ----------------------------------------------------------------------------
+*/
+
+/*
+ Working routine:
+ ----------------
+   1) Scans the TWI bus in search of all devices running Timonel (discovery).
+   2) On each device: deletes the application (erase), uploads the payload
+      (upload), reads it back (readback) and compares it (verify).
+   3) Repeats the routine BENCH_CYCLES times, printing one record per device
+      and cycle, then prints the per-phase latency percentiles.
+
+ Report format (one record per line, space-separated key=value fields):
+ ----------------------------------------------------------------------
+   BENCH_CONFIG  addr=11 version=1.4 features=0xFD ext_features=0x0F ...
+   BENCH_CYCLE   cycle=1 addr=11 discover_us=... upload_us=... upload_Bps=...
+   BENCH_SUMMARY addr=11 phase=upload count=10 p50_us=... p90_us=... ...
+   BENCH_DONE    cycles=10 devices=3 failed_cycles=0
+*/
+
+#include "NbMicro.h"
+#include "TimonelTwiM.h"
+
+#ifndef BENCH_PAYLOAD
+#define BENCH_PAYLOAD "payload.h"
+#endif /* BENCH_PAYLOAD */
+#include BENCH_PAYLOAD
+
+#define USE_SERIAL Serial
+#define SDA 0 /* I2C SDA pin */
+#define SCL 2 /* I2C SCL pin */
+#define SERIAL_SPEED 115200
+#define MAX_BENCH_DEVS 8    /* Max devices benchmarked at the same time */
+#ifndef BENCH_CYCLES
+#define BENCH_CYCLES 10     /* Discovery, erase, upload, readback and verify cycles */
+#endif /* BENCH_CYCLES */
+#ifndef BENCH_MAX_CLOCK
+#define BENCH_MAX_CLOCK 0   /* Max TWI clock negotiated with each device before the cycles (0 = default clock) */
+#endif /* BENCH_MAX_CLOCK */
+#define DLY_DISCOVERY 1000  /* Delay between discoveries while no devices are found (ms) */
+
+// Benchmark phases
+#define B_DISCOVER 0
+#define B_ERASE 1
+#define B_UPLOAD 2
+#define B_READ 3
+#define B_VERIFY 4
+#define B_PHASES 5
+
+// Prototypes
+void setup(void);
+void loop(void);
+byte RunCycle(const byte cycle);
+int FitPayload(Timonel *p_device);
+void PrintConfig(Timonel *p_device, const int bench_size);
+void PrintSummary(void);
+unsigned long Percentile(unsigned long samples[], const byte count, const byte percent);
+unsigned long BytesPerSecond(const int size, const unsigned long time_us);
+
+// Global Variables
+const char *phase_names[B_PHASES] = {"discover", "erase", "upload", "readback", "verify"};
+TimonelPool<MAX_BENCH_DEVS> tml_devices;
+byte bench_addr[MAX_BENCH_DEVS] = {0};                               /* Address of each benchmarked device */
+byte bench_count = 0;                                                /* Devices found on the first cycle */
+unsigned long samples[MAX_BENCH_DEVS][B_PHASES][BENCH_CYCLES] = {0}; /* Phase times of the successful cycles (us) */
+byte sample_count[MAX_BENCH_DEVS][B_PHASES] = {0};
+byte failed_cycles = 0;
+byte read_buffer[MCU_TOTAL_MEM];
+
+// Setup block
+void setup(void) {
+    USE_SERIAL.begin(SERIAL_SPEED);
+    Wire.begin(SDA, SCL);
+    delay(DLY_DISCOVERY);
+    USE_SERIAL.printf_P("\n\r# Timonel TWI Bootloader Benchmark (v1.4 twim-bench): payload=%s size=%d cycles=%d\n\r", BENCH_PAYLOAD, sizeof(payload), BENCH_CYCLES);
+    for (byte cycle = 1; cycle <= BENCH_CYCLES; cycle++) {
+        failed_cycles += (RunCycle(cycle) != OK);
+    }
+    PrintSummary();
+    USE_SERIAL.printf_P("BENCH_DONE cycles=%d devices=%d failed_cycles=%d\n\r", BENCH_CYCLES, bench_count, failed_cycles);
+    tml_devices.Clear();
+}
+
+// Main loop
+void loop(void) {
+    delay(DLY_DISCOVERY); /* The benchmark runs once, reset the board to repeat it */
+}
+
+// Function RunCycle (Discovers the devices and runs the erase, upload, readback and verify phases on each one)
+byte RunCycle(const byte cycle) {
+    TwiBus twi(SDA, SCL);
+    TwiBus::DeviceEntry dev_table[HIG_TWI_ADDR - LOW_TWI_ADDR + 1];
+    byte tml_count = 0;
+    unsigned long discover_us = 0;
+    while (tml_count == 0) {
+        unsigned long start_us = micros();
+        byte dev_count = twi.DiscoverDevices(dev_table, HIG_TWI_ADDR - LOW_TWI_ADDR + 1);
+        discover_us = (micros() - start_us);
+        tml_count = tml_devices.Load(dev_table, dev_count);
+        if (tml_count == 0) {
+            delay(DLY_DISCOVERY);
+        }
+    }
+    byte cycle_errors = OK;
+    if (bench_count == 0) {
+        bench_count = tml_count;
+    }
+    for (byte i = 0; i < tml_count; i++) {
+        Timonel *p_device = tml_devices[i];
+        // Devices are discovered in address order, a different device set breaks the comparison
+        if ((i >= bench_count) || ((bench_addr[i] != 0) && (bench_addr[i] != p_device->GetTwiAddress()))) {
+            USE_SERIAL.printf_P("# Device %02d wasn't found on the first cycle, skipping it\n\r", p_device->GetTwiAddress());
+            cycle_errors++;
+            continue;
+        }
+        if (bench_addr[i] == 0) {
+            bench_addr[i] = p_device->GetTwiAddress();
+#if (BENCH_MAX_CLOCK != 0)
+            p_device->NegotiateClock(BENCH_MAX_CLOCK);
+#endif /* BENCH_MAX_CLOCK */
+        }
+        const int bench_size = FitPayload(p_device);
+        if (cycle == 1) {
+            PrintConfig(p_device, bench_size);
+        }
+        unsigned long phase_us[B_PHASES] = {discover_us, 0, 0, 0, 0};
+        byte phase_errors[B_PHASES] = {OK, OK, OK, OK, OK};
+        p_device->ResetStats();
+        // Erase
+        unsigned long start_us = micros();
+        phase_errors[B_ERASE] = p_device->DeleteApplication();
+        phase_us[B_ERASE] = (micros() - start_us);
+        // Upload
+        if (phase_errors[B_ERASE] == OK) {
+            start_us = micros();
+            phase_errors[B_UPLOAD] = p_device->UploadApplication(payload, bench_size);
+            phase_us[B_UPLOAD] = (micros() - start_us);
+        }
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+        // Readback
+        if ((phase_errors[B_UPLOAD] == OK) && (phase_errors[B_ERASE] == OK)) {
+            start_us = micros();
+            phase_errors[B_READ] = p_device->ReadFlash(0, read_buffer, bench_size);
+            phase_us[B_READ] = (micros() - start_us);
+            // Verify
+            start_us = micros();
+            phase_errors[B_VERIFY] = p_device->VerifyApplication(payload, bench_size);
+            phase_us[B_VERIFY] = (micros() - start_us);
+        }
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+        byte errors = OK;
+        for (byte phase = 0; phase < B_PHASES; phase++) {
+            errors += phase_errors[phase];
+            if ((phase_errors[phase] == OK) && (phase_us[phase] != 0)) {
+                samples[i][phase][sample_count[i][phase]++] = phase_us[phase];
+            }
+        }
+        cycle_errors += errors;
+        NbMicro::Stats stats = p_device->GetStats();
+        USE_SERIAL.printf_P("BENCH_CYCLE cycle=%d addr=%d errors=%d discover_us=%lu erase_us=%lu upload_us=%lu upload_Bps=%lu readback_us=%lu readback_Bps=%lu verify_us=%lu",
+                            cycle, p_device->GetTwiAddress(), errors, phase_us[B_DISCOVER], phase_us[B_ERASE],
+                            phase_us[B_UPLOAD], BytesPerSecond(bench_size, phase_us[B_UPLOAD]),
+                            phase_us[B_READ], BytesPerSecond(bench_size, phase_us[B_READ]), phase_us[B_VERIFY]);
+        USE_SERIAL.printf_P(" erase_err=%d upload_err=%d readback_err=%d verify_err=%d transactions=%lu nacks=%lu busy_polls=%lu check_errors=%lu retries=%lu bus_us=%lu delay_us=%lu\n\r",
+                            phase_errors[B_ERASE], phase_errors[B_UPLOAD], phase_errors[B_READ], phase_errors[B_VERIFY],
+                            stats.transactions, stats.nacks, stats.busy_polls, stats.check_errors, stats.retries,
+                            stats.bus_time_us, stats.delay_time_us);
+    }
+    return cycle_errors;
+}
+
+// Function FitPayload (Returns the payload size, reduced by whole pages until it fits in the device application memory)
+int FitPayload(Timonel *p_device) {
+    int bench_size = sizeof(payload);
+    while ((bench_size > SPM_PAGESIZE) && (p_device->CheckUpload(bench_size) != OK)) {
+        bench_size = (((bench_size - 1) / SPM_PAGESIZE) * SPM_PAGESIZE);
+    }
+    return bench_size;
+}
+
+// Function PrintConfig (Prints a device bootloader configuration)
+void PrintConfig(Timonel *p_device, const int bench_size) {
+    Timonel::Status sts = p_device->GetStatus();
+    USE_SERIAL.printf_P("BENCH_CONFIG addr=%d version=%d.%d features=0x%02X ext_features=0x%02X bootloader_start=0x%04X mst_packet=%d slv_packet=%d windowed_ack=%d clock_stretch=%d clock_hz=%lu payload_size=%d\n\r",
+                        p_device->GetTwiAddress(), sts.version_major, sts.version_minor, sts.features_code, sts.ext_features_code,
+                        sts.bootloader_start, sts.mst_packet_size, sts.slv_packet_size, sts.windowed_ack, sts.clock_stretch,
+                        (unsigned long)p_device->GetBusClock(), bench_size);
+}
+
+// Function PrintSummary (Prints the phase latency percentiles of each device)
+void PrintSummary(void) {
+    for (byte i = 0; i < bench_count; i++) {
+        for (byte phase = 0; phase < B_PHASES; phase++) {
+            const byte count = sample_count[i][phase];
+            if (count == 0) {
+                continue;
+            }
+            USE_SERIAL.printf_P("BENCH_SUMMARY addr=%d phase=%s count=%d min_us=%lu p50_us=%lu p90_us=%lu p99_us=%lu max_us=%lu\n\r",
+                                bench_addr[i], phase_names[phase], count, Percentile(samples[i][phase], count, 0),
+                                Percentile(samples[i][phase], count, 50), Percentile(samples[i][phase], count, 90),
+                                Percentile(samples[i][phase], count, 99), Percentile(samples[i][phase], count, 100));
+        }
+    }
+}
+
+// Function Percentile (Returns a percentile of the samples with the nearest-rank method, sorting them)
+unsigned long Percentile(unsigned long samples[], const byte count, const byte percent) {
+    for (byte i = 1; i < count; i++) {
+        unsigned long sample = samples[i];
+        byte j = i;
+        for (; (j > 0) && (samples[j - 1] > sample); j--) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
+    }
+    byte rank = ((percent * count) + 99) / 100;
+    return samples[(rank > 0) ? (rank - 1) : 0];
+}
+
+// Function BytesPerSecond (Returns the throughput of a phase)
+unsigned long BytesPerSecond(const int size, const unsigned long time_us) {
+    return ((time_us == 0) ? 0 : (unsigned long)(((unsigned long long)size * 1000000ULL) / time_us));
+}
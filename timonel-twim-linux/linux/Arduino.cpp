@@ -0,0 +1,14 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Arduino.cpp (Arduino core subset)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#include "Arduino.h"
+
+HostSerial Serial;
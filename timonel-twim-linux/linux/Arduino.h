@@ -0,0 +1,83 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Arduino.h (Arduino core subset)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This header provides the few Arduino core
+ *  functions used by the NbMicro and TimonelTWIM
+ *  libraries, so they can be compiled for Linux
+ *  hosts (Raspberry Pi, BeagleBone, etc.).
+ */
+
+#ifndef _TML_LINUX_ARDUINO_H_
+#define _TML_LINUX_ARDUINO_H_
+
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <exception>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define PSTR(s) (s)
+#define F(s) (s)
+
+// Function micros (Microseconds since the first call)
+inline unsigned long micros(void) {
+    static struct timespec start_time = {0, 0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((start_time.tv_sec == 0) && (start_time.tv_nsec == 0)) {
+        start_time = now;
+    }
+    return (unsigned long)(((now.tv_sec - start_time.tv_sec) * 1000000L) + ((now.tv_nsec - start_time.tv_nsec) / 1000L));
+}
+
+// Function millis (Milliseconds since the first call)
+inline unsigned long millis(void) {
+    return (micros() / 1000UL);
+}
+
+// Function delayMicroseconds (Sleeps the calling thread)
+inline void delayMicroseconds(unsigned int us) {
+    struct timespec sleep_time = {(time_t)(us / 1000000U), (long)((us % 1000000U) * 1000L)};
+    nanosleep(&sleep_time, nullptr);
+}
+
+// Function delay (Sleeps the calling thread)
+inline void delay(unsigned long ms) {
+    struct timespec sleep_time = {(time_t)(ms / 1000UL), (long)((ms % 1000UL) * 1000000L)};
+    nanosleep(&sleep_time, nullptr);
+}
+
+// Function yield (Lets other threads run)
+inline void yield(void) {
+    sched_yield();
+}
+
+// Class HostSerial: console output for the libraries' debug messages (USE_SERIAL)
+class HostSerial {
+   public:
+    void begin(long) {
+    }
+    int printf_P(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        int length = vfprintf(stderr, format, args);
+        va_end(args);
+        return length;
+    }
+};
+
+extern HostSerial Serial;
+
+#endif /* _TML_LINUX_ARDUINO_H_ */
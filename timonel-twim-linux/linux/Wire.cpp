@@ -0,0 +1,212 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Wire.cpp (TwoWire over Linux i2c-dev)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#include "Wire.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+TwoWire Wire;
+
+// Class constructor (the adapter is opened by begin or by the first transaction)
+TwoWire::TwoWire(const char *device) : device_(device) {
+}
+
+// Class destructor
+TwoWire::~TwoWire() {
+    end();
+}
+
+/* _________________________
+  |                         | 
+  |          begin          |
+  |_________________________|
+*/
+// Open the i2c-dev adapter. The SDA and SCL pins are fixed by the adapter, so they are ignored.
+bool TwoWire::begin(int sda, int scl) {
+    (void)sda;
+    (void)scl;
+    return begin();
+}
+
+bool TwoWire::begin(void) {
+    if (fd_ < 0) {
+        fd_ = open(device_, O_RDWR);
+    }
+    return (fd_ >= 0);
+}
+
+/* _________________________
+  |                         | 
+  |           end           |
+  |_________________________|
+*/
+// Close the i2c-dev adapter
+void TwoWire::end(void) {
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+}
+
+/* _________________________
+  |                         | 
+  |        setClock         |
+  |_________________________|
+*/
+// The i2c-dev interface can't change the adapter clock: it's set by the kernel (e.g. the
+// device tree "clock-frequency" of the bus), so the negotiated clocks have no effect here.
+void TwoWire::setClock(uint32_t clock_hz) {
+    (void)clock_hz;
+}
+
+/* _________________________
+  |                         | 
+  |   setClockStretchLimit  |
+  |_________________________|
+*/
+// Clock stretching is handled by the adapter driver
+void TwoWire::setClockStretchLimit(uint32_t limit_us) {
+    (void)limit_us;
+}
+
+/* _________________________
+  |                         | 
+  |    beginTransmission    |
+  |_________________________|
+*/
+// Start preparing a write transaction to a slave address
+void TwoWire::beginTransmission(uint8_t address) {
+    address_ = address;
+    tx_length_ = 0;
+    tx_pending_ = false;
+}
+
+/* _________________________
+  |                         | 
+  |          write          |
+  |_________________________|
+*/
+// Add bytes to the write transaction being prepared, returns the bytes that fit in the buffer
+size_t TwoWire::write(uint8_t data) {
+    return write(&data, 1);
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t size) {
+    if (size > (BUFFER_LENGTH - tx_length_)) {
+        size = (BUFFER_LENGTH - tx_length_);
+    }
+    memcpy(&tx_buffer_[tx_length_], data, size);
+    tx_length_ += size;
+    return size;
+}
+
+/* _________________________________________________
+  |                                                 | 
+  | endTransmission                                 |
+  | - If no error                       -> return 0 |
+  | - If address not acknowledged       -> return 2 |
+  | - If other error                    -> return 4 |
+  |_________________________________________________|
+*/
+// Send the write transaction. Without a stop, it's sent along with the next requestFrom in a
+// single combined transaction (repeated start), then the errors are reported by requestFrom.
+uint8_t TwoWire::endTransmission(bool send_stop) {
+    if (!send_stop) {
+        tx_pending_ = true;
+        return 0;
+    }
+    return Transfer(false, 0);
+}
+
+/* _________________________
+  |                         | 
+  |       requestFrom       |
+  |_________________________|
+*/
+// Read bytes from a slave, returns the bytes read (0 if the transaction failed)
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t size, bool send_stop) {
+    (void)send_stop; /* The i2c-dev transactions always end with a stop */
+    if (tx_pending_ && (address != address_)) {
+        Transfer(false, 0);
+    }
+    address_ = address;
+    if (size > BUFFER_LENGTH) {
+        size = BUFFER_LENGTH;
+    }
+    rx_length_ = rx_ix_ = 0;
+    if (Transfer(true, size) == 0) {
+        rx_length_ = size;
+    }
+    return rx_length_;
+}
+
+/* _________________________
+  |                         | 
+  |     available / read    |
+  |_________________________|
+*/
+// Return the bytes of the last request not read yet
+int TwoWire::available(void) {
+    return (int)(rx_length_ - rx_ix_);
+}
+
+// Return the next byte of the last request (-1 if there are no more)
+int TwoWire::read(void) {
+    if (rx_ix_ >= rx_length_) {
+        return -1;
+    }
+    return rx_buffer_[rx_ix_++];
+}
+
+/* _________________________
+  |                         | 
+  |        GetDevice        |
+  |_________________________|
+*/
+// Return the i2c-dev adapter path of this bus
+const char *TwoWire::GetDevice(void) {
+    return device_;
+}
+
+// Function Transfer (Runs a write, a read, or a write followed by a read with a repeated start, in a single I2C_RDWR call)
+uint8_t TwoWire::Transfer(const bool with_read, const uint8_t read_size) {
+    struct i2c_msg msgs[2];
+    struct i2c_rdwr_ioctl_data transfer = {msgs, 0};
+    if (!begin()) {
+        tx_pending_ = false;
+        return 4;
+    }
+    if ((!with_read) || tx_pending_) {
+        msgs[transfer.nmsgs].addr = address_;
+        msgs[transfer.nmsgs].flags = 0;
+        msgs[transfer.nmsgs].len = tx_length_;
+        msgs[transfer.nmsgs].buf = tx_buffer_;
+        transfer.nmsgs++;
+    }
+    if (with_read) {
+        msgs[transfer.nmsgs].addr = address_;
+        msgs[transfer.nmsgs].flags = I2C_M_RD;
+        msgs[transfer.nmsgs].len = read_size;
+        msgs[transfer.nmsgs].buf = rx_buffer_;
+        transfer.nmsgs++;
+    }
+    tx_pending_ = false;
+    tx_length_ = 0;
+    if (ioctl(fd_, I2C_RDWR, &transfer) < 0) {
+        return (((errno == ENXIO) || (errno == EREMOTEIO)) ? 2 : 4); /* No acknowledge from the slave */
+    }
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Wire.h (TwoWire over Linux i2c-dev)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This TwoWire class implements the Arduino
+ *  Wire interface used by the TWI master
+ *  libraries on a Linux "/dev/i2c-N" adapter.
+ *  Each object is a separate I2C bus.
+ */
+
+#ifndef _TML_LINUX_WIRE_H_
+#define _TML_LINUX_WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_LENGTH 128          /* TX and RX buffer size (bytes) */
+#define WIRE_DEFAULT_DEV "/dev/i2c-1" /* I2C adapter used by the default "Wire" object */
+
+// Class TwoWire: Represents an I2C bus driven through a Linux i2c-dev adapter
+class TwoWire {
+   public:
+    TwoWire(const char *device = WIRE_DEFAULT_DEV);
+    ~TwoWire();
+    bool begin(void);
+    bool begin(int sda, int scl);
+    void end(void);
+    void setClock(uint32_t clock_hz);
+    void setClockStretchLimit(uint32_t limit_us);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t size);
+    uint8_t endTransmission(bool send_stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t size, bool send_stop = true);
+    int available(void);
+    int read(void);
+    const char *GetDevice(void);
+
+   private:
+    uint8_t Transfer(const bool with_read, const uint8_t read_size);
+    const char *device_ = WIRE_DEFAULT_DEV;
+    int fd_ = -1;                      /* i2c-dev file descriptor (-1 = closed) */
+    uint8_t address_ = 0;              /* Slave address of the transaction being prepared */
+    uint8_t tx_buffer_[BUFFER_LENGTH]; /* Bytes written by the current transaction */
+    size_t tx_length_ = 0;
+    bool tx_pending_ = false;          /* A write without stop that goes with the next read (repeated start) */
+    uint8_t rx_buffer_[BUFFER_LENGTH]; /* Bytes read by the last request */
+    size_t rx_length_ = 0;
+    size_t rx_ix_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif /* _TML_LINUX_WIRE_H_ */
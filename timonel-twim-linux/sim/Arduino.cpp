@@ -0,0 +1,26 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Arduino.cpp (Simulated Arduino core)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#include "Arduino.h"
+
+HostSerial Serial;
+
+static unsigned long long sim_clock_us = 0; /* Simulated time (us) */
+
+// Function SimClockGet (Returns the simulated time)
+unsigned long long SimClockGet(void) {
+    return sim_clock_us;
+}
+
+// Function SimClockAdvance (Moves the simulated time forward)
+void SimClockAdvance(const unsigned long long us) {
+    sim_clock_us += us;
+}
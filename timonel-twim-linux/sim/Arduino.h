@@ -0,0 +1,77 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Arduino.h (Simulated Arduino core)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This header provides the Arduino core
+ *  functions used by the TWI master libraries
+ *  on a simulated clock: delays don't sleep,
+ *  they advance the clock, so a simulation of
+ *  minutes of bus traffic runs in milliseconds.
+ */
+
+#ifndef _TML_SIM_ARDUINO_H_
+#define _TML_SIM_ARDUINO_H_
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <exception>
+
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define PSTR(s) (s)
+#define F(s) (s)
+
+// Simulated clock
+unsigned long long SimClockGet(void);
+void SimClockAdvance(const unsigned long long us);
+
+// Function micros (Simulated microseconds since the simulation start)
+inline unsigned long micros(void) {
+    return (unsigned long)SimClockGet();
+}
+
+// Function millis (Simulated milliseconds since the simulation start)
+inline unsigned long millis(void) {
+    return (unsigned long)(SimClockGet() / 1000ULL);
+}
+
+// Function delayMicroseconds (Advances the simulated clock)
+inline void delayMicroseconds(unsigned int us) {
+    SimClockAdvance(us);
+}
+
+// Function delay (Advances the simulated clock)
+inline void delay(unsigned long ms) {
+    SimClockAdvance(ms * 1000ULL);
+}
+
+// Function yield (Nothing else runs in the simulation)
+inline void yield(void) {
+}
+
+// Class HostSerial: console output for the libraries' debug messages (USE_SERIAL)
+class HostSerial {
+   public:
+    void begin(long) {
+    }
+    int printf_P(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        int length = vfprintf(stderr, format, args);
+        va_end(args);
+        return length;
+    }
+};
+
+extern HostSerial Serial;
+
+#endif /* _TML_SIM_ARDUINO_H_ */
@@ -0,0 +1,1324 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: TmlSim.cpp (Timonel bootloader model)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  The command replies and slow operations
+ *  follow "timonel.c" v1.4, the update stub
+ *  ones follow "tml-update-stub.c".
+ */
+
+#include "TmlSim.h"
+#include <string.h>
+#include "Arduino.h"
+
+// Bootloader flags (MemPack flags byte bits)
+#define FL_INIT_1 0     /* Two-step initialization STEP 1 */
+#define FL_INIT_2 1     /* Two-step initialization STEP 2 */
+#define FL_DEL_FLASH 2  /* Delete flash memory */
+#define FL_EXIT_TML 3   /* Exit Timonel & run application */
+#define FL_ERASE_PAGE 5 /* Erase a flash memory page */
+#define FL_CALC_CRC 6   /* Calculate a flash memory CRC16 */
+#define FL_PKT_ERROR 7  /* Data packet rejected, resync */
+
+// Update stub flags (tml-update-stub.h)
+#define FL_STUB_WRITE_PAGE 1  /* The staging page is complete, write it to flash memory */
+#define FL_STUB_CALC_CRC 2    /* Calculate the CRC16 of the staged image */
+#define FL_STUB_INSTALL 3     /* Check the staged image and copy it over the bootloader */
+#define FL_STUB_PKT_ERROR 4   /* A data packet was rejected, the page is discarded until the next STPGADDR */
+#define FL_STUB_STAGE_ERROR 5 /* A page outside the staging area, the install is rejected until a new image starts */
+
+// Reply lengths and packet flags
+#define GETTMNLV_RPLYLN 16
+#define STPGADDR_RPLYLN 2
+#define ERASEPAG_RPLYLN 2
+#define GETCRC_CMDLN 5
+#define GETCRC_RPLYLN 3
+#define GETSTATS_CMDLN 2
+#define GETSTATS_RPLYLN 8
+#define STUB_STPGADDR_CMDLN 4
+#define STUB_INSTTMNL_CMDLN 7
+#define STUB_INSTTMNL_RPLYLN 2
+#define INST_OK 0           /* INSTTMNL status: the image fits, its CRC16 is checked again before copying it */
+#define INST_ERR_RANGE 1    /* INSTTMNL status: the image doesn't fit in the staging area, or its destination overlaps it */
+#define INST_ERR_STAGE 2    /* INSTTMNL status: a page was sent outside the staging area */
+#define WND_ACK_FLAG 0x80   /* GETTMNLV packet size byte flag: windowed ack enabled */
+#define STR_WRITE_FLAG 0x80 /* GETTMNLV READFLSH size byte flag: clock stretching enabled */
+#define CRC16_INIT 0xFFFF
+#define RLE_RUN_FLAG 0x80   /* WRITERLE token bit 8: the next word is repeated, otherwise n + 1 words follow */
+#define RLE_COUNT_MASK 0x7F /* WRITERLE token bits 1-7: word count - 1 */
+#define RESET_PAGE 0
+#define RCOSC_CLK_SRC 0x02  /* RC oscillator (8 MHz) clock source low fuse value */
+#define HFPLL_CLK_SRC 0x01  /* HF PLL (16 MHz) clock source low fuse value */
+#define OSC_FAST 0x4C       /* OSCCAL offset for the RC oscillator */
+
+/////////////////////////////////////////////////////////////////////////////
+////////////                 TMLSIMDEVICE CLASS                  ////////////
+/////////////////////////////////////////////////////////////////////////////
+
+// Class constructor (a device with Timonel just flashed: the application memory erased)
+TmlSimDevice::TmlSimDevice(const Config &config) : config_(config) {
+    memset(flash_, 0xFF, sizeof(flash_));
+    memset(rx_buffer_, 0, sizeof(rx_buffer_));
+    memset(tx_buffer_, 0, sizeof(tx_buffer_));
+    memset(stats_count_, 0, sizeof(stats_count_));
+    memset(stats_ticks_, 0, sizeof(stats_ticks_));
+    rx_buffer_size_ = ((config_.mst_packet_size > 32) ? 128 : 64);
+    PowerOn();
+}
+
+/* _________________________
+  |                         |
+  |       CheckConfig       |
+  |_________________________|
+*/
+// Check the build options as "timonel.c" does at compile time, returns the error found or nullptr
+const char *TmlSimDevice::CheckConfig(const Config &config) {
+    if ((config.twi_address < 8) || (config.twi_address > 35)) {
+        return "TWI address out of range (8 to 35)";
+    }
+    if ((config.timonel_start % SIM_PAGE_SIZE != 0) || (config.timonel_start < (2 * SIM_PAGE_SIZE)) ||
+        (config.timonel_start >= SIM_FLASH_SIZE)) {
+        return "TIMONEL_START must be a page address inside the flash memory";
+    }
+    if (!(config.auto_page_addr) && !(config.cmd_setpgaddr)) {
+        return "CMD_SETPGADDR must be enabled when AUTO_PAGE_ADDR is disabled";
+    }
+    if ((config.mst_packet_size < 2) || (config.mst_packet_size > SIM_PAGE_SIZE) || (config.mst_packet_size & 1)) {
+        return "MST_PACKET_SIZE must be even, between 2 and a page size";
+    }
+    if (config.windowed_ack && (config.mst_packet_size == SIM_PAGE_SIZE)) {
+        return "WINDOWED_ACK makes no difference with full-page packets";
+    }
+    if (config.force_erase_pg && config.app_use_tpl_pg) {
+        return "FORCE_ERASE_PG can't be enabled along with APP_USE_TPL_PG";
+    }
+    if (config.fast_boot && !(config.timeout_exit)) {
+        return "FAST_BOOT needs TIMEOUT_EXIT enabled";
+    }
+    return nullptr;
+}
+
+/* _________________________
+  |                         |
+  |       AckAddress        |
+  |_________________________|
+*/
+// Address phase of a transaction: returns true when the device acknowledges it. As in the USI
+// driver, the command received is processed when the master addresses the device for reading.
+bool TmlSimDevice::AckAddress(const uint8_t address, const bool read) {
+    Update();
+    bool addressed = false;
+    if (firmware_ == SIM_BOOTLOADER) {
+        addressed = ((address == config_.twi_address) || ((address == 0) && (config_.cmd_gencall) && (!read)));
+    } else if (firmware_ == SIM_APPLICATION) {
+        addressed = ((config_.app_address != 0) && (address == config_.app_address));
+    } else if (firmware_ == SIM_UPDATE_STUB) {
+        addressed = (address == config_.stub_address);
+    }
+    if (!addressed) {
+        return false;
+    }
+    if (SimClockGet() < busy_until_us_) {
+        stats_.busy_nacks++;
+        return false;
+    }
+    reading_ = read;
+    general_call_ = (address == 0);
+    if (read) {
+        ProcessCommand();
+        tx_ix_ = 0;
+    } else if (firmware_ == SIM_APPLICATION) {
+        /* Application commands are block-API frames, one per write transaction (BURST_XMIT):
+           a new write drops the bytes of a command whose read never arrived */
+        rx_byte_count_ = 0;
+    }
+    return true;
+}
+
+// Function GetHoldTime (Time that the device holds SCL low when a transaction to an address starts)
+unsigned long long TmlSimDevice::GetHoldTime(const uint8_t address) {
+    Update();
+    if ((firmware_ == SIM_BOOTLOADER) && (address == config_.twi_address) &&
+        busy_stretching_ && (SimClockGet() < busy_until_us_)) {
+        return (busy_until_us_ - SimClockGet());
+    }
+    return 0;
+}
+
+// Function ReceiveByte (Data byte written by the master, returns false to NACK it when the RX buffer is full)
+bool TmlSimDevice::ReceiveByte(const uint8_t data) {
+    if (rx_byte_count_ >= ((firmware_ == SIM_UPDATE_STUB) ? SIM_STUB_RX_SIZE : rx_buffer_size_)) {
+        stats_.rx_overruns++;
+        if (firmware_ == SIM_BOOTLOADER) {
+            StatsAdd(STATS_RX_OVERRUN, 0, 1);
+        }
+        return false;
+    }
+    rx_buffer_[rx_byte_count_++] = data;
+    return true;
+}
+
+// Function SendByte (Data byte read by the master, the bus lines stay high when the reply is over)
+uint8_t TmlSimDevice::SendByte(void) {
+    if (tx_ix_ < tx_length_) {
+        return tx_buffer_[tx_ix_++];
+    }
+    tx_ix_ = (tx_length_ + 1);
+    return 0xFF;
+}
+
+/* _________________________
+  |                         |
+  |     EndTransaction      |
+  |_________________________|
+*/
+// Stop condition. The slow operations run after a reply read to the end: the master NACKs its last
+// byte. The general call commands and the windowed data packets are processed when they are received.
+void TmlSimDevice::EndTransaction(void) {
+    if (reading_) {
+        reading_ = false;
+        if ((tx_ix_ > 0) && (tx_ix_ <= tx_length_)) {
+            stats_.replies++;
+            if (firmware_ == SIM_UPDATE_STUB) {
+                RunStubOps();
+            } else if (firmware_ == SIM_APPLICATION) {
+                if (restart_pending_) {
+                    const bool boot_hold = hold_pending_;
+                    Restart(config_.reset_us);
+                    boot_hold_ = boot_hold;
+                }
+            } else {
+                RunSlowOps();
+            }
+        }
+        return;
+    }
+    if (firmware_ != SIM_BOOTLOADER) {
+        return;
+    }
+    if (general_call_) {
+        general_call_ = false;
+        if (rx_byte_count_ > 0) {
+            ProcessCommand();
+            tx_length_ = 0; /* Discard the reply, general call commands can't be read back */
+            RunSlowOps();
+        }
+    } else if ((config_.windowed_ack) && (rx_byte_count_ > 0) && (rx_buffer_[0] == WRITPGWN)) {
+        ProcessCommand();
+        tx_length_ = 0; /* Discard the reply, windowed packets aren't read back */
+    }
+}
+
+/* _________________________
+  |                         |
+  |         PowerOn         |
+  |_________________________|
+*/
+// Power-on reset: the reset vector jumps to the bootloader, or through the erased flash memory to it.
+// After a power loss while the update stub was installing a bootloader, it jumps to the stub. If it
+// points elsewhere, the bootloader was lost: the device is bricked. With FAST_BOOT, a loaded
+// application is run after the fast boot time unless the master initializes the bootloader.
+void TmlSimDevice::PowerOn(void) {
+    const uint16_t reset_vector = FlashWord(RESET_PAGE);
+    uint16_t boot_address = SIM_FLASH_SIZE;
+    if (reset_vector == 0xFFFF) {
+        boot_address = RESET_PAGE;
+        while ((boot_address < config_.timonel_start) && (FlashWord(boot_address) == 0xFFFF)) {
+            boot_address += 2; /* The erased words run up to the first programmed one, or the bootloader */
+        }
+    } else if ((reset_vector & 0xF000) == 0xC000) {
+        boot_address = JumpTarget(reset_vector, RESET_PAGE);
+    }
+    if (boot_address == config_.timonel_start) {
+        Restart(config_.reset_us);
+        fast_boot_ = (config_.fast_boot && (FlashWord(config_.timonel_start - 2) != 0xFFFF));
+    } else if ((config_.stub_address != 0) && (stub_reset_ != 0) && (boot_address == stub_reset_)) {
+        busy_until_us_ = (SimClockGet() + config_.reset_us);
+        flags_ = 0;
+        rx_byte_count_ = 0;
+        tx_length_ = 0;
+        reading_ = false;
+        memset(page_buffer_, 0xFF, sizeof(page_buffer_));
+        memset(page_filled_, 0, sizeof(page_filled_));
+        StartUpdateStub();
+    } else {
+        firmware_ = SIM_BRICKED;
+    }
+}
+
+// Function CutPowerInInstall (The next bootloader install by the update stub loses the power before the given
+// flash operation, a page erase or write: 1 = the first one, 0 = never. Then the device stays off until PowerOn)
+void TmlSimDevice::CutPowerInInstall(const uint16_t flash_op) {
+    install_cut_op_ = flash_op;
+}
+
+// Function GetFirmware (Firmware running: SIM_BOOTLOADER, SIM_APPLICATION, SIM_UPDATE_STUB, SIM_BRICKED or SIM_POWER_OFF)
+uint8_t TmlSimDevice::GetFirmware(void) {
+    Update();
+    return firmware_;
+}
+
+// Function GetFeatures (Features byte reported by GETTMNLV)
+uint8_t TmlSimDevice::GetFeatures(void) {
+    return ((config_.enable_led_ui << 0) | (config_.auto_page_addr << 1) | (config_.app_use_tpl_pg << 2) |
+            (config_.cmd_setpgaddr << 3) | (config_.two_step_init << 4) | (config_.use_wdt_reset << 5) |
+            (config_.timeout_exit << 6) | (config_.cmd_readflash << 7));
+}
+
+// Function GetExtFeatures (Extended features byte reported by GETTMNLV)
+uint8_t TmlSimDevice::GetExtFeatures(void) {
+    return ((config_.auto_clk_tweak << 0) | (config_.force_erase_pg << 1) | (config_.check_page_ix << 3) |
+            (config_.cmd_gencall << 4) | (config_.cmd_erasepag << 5) | (config_.use_crc16 << 6) |
+            (config_.cmd_writerle << 7));
+}
+
+// Function GetFlash (Flash memory contents)
+const uint8_t *TmlSimDevice::GetFlash(void) {
+    return flash_;
+}
+
+// Function GetConfig (Bootloader build options)
+const TmlSimDevice::Config &TmlSimDevice::GetConfig(void) {
+    return config_;
+}
+
+// Function GetStats (Device counters)
+TmlSimDevice::Stats TmlSimDevice::GetStats(void) {
+    return stats_;
+}
+
+// Function ResetStats
+void TmlSimDevice::ResetStats(void) {
+    stats_ = Stats();
+}
+
+// Function Update (Runs the events due at the current simulated time: the exit timeout)
+void TmlSimDevice::Update(void) {
+    const unsigned long long exit_timeout_us = ((fast_boot_ ? config_.fast_boot_ms : config_.exit_timeout_ms) * 1000ULL);
+    if ((firmware_ == SIM_BOOTLOADER) && (config_.timeout_exit) && (!IsInitialized()) && (!boot_hold_) &&
+        (SimClockGet() >= busy_until_us_) && (SimClockGet() >= (boot_time_us_ + exit_timeout_us))) {
+        RunApplication();
+    }
+    if (firmware_ == SIM_APPLICATION) {
+        ProcessBuffer();
+    }
+}
+
+// Function Restart (Starts the bootloader after a delay, its TWI address isn't acknowledged meanwhile)
+void TmlSimDevice::Restart(const unsigned long long delay_us) {
+    firmware_ = SIM_BOOTLOADER;
+    busy_until_us_ = (SimClockGet() + delay_us);
+    busy_stretching_ = false;
+    boot_time_us_ = busy_until_us_;
+    fast_boot_ = false;
+    boot_hold_ = false;
+    hold_pending_ = false;
+    page_addr_ = 0;
+    page_ix_ = 0;
+    flags_ = 0;
+    app_reset_lsb_ = 0;
+    app_reset_msb_ = 0;
+    crc_ = CRC16_INIT;
+    rx_byte_count_ = 0;
+    tx_length_ = 0;
+    tx_ix_ = 0;
+    reading_ = false;
+    general_call_ = false;
+    restart_pending_ = false;
+    memset(page_buffer_, 0xFF, sizeof(page_buffer_)); /* The start-up clears the temporary page buffer */
+    memset(page_filled_, 0, sizeof(page_filled_));
+    memset(stats_count_, 0, sizeof(stats_count_));
+    memset(stats_ticks_, 0, sizeof(stats_ticks_));
+    stats_.restarts++;
+}
+
+// Function RunApplication (Jumps to the trampoline, which runs through the erased flash memory to the bootloader when there is no application)
+void TmlSimDevice::RunApplication(void) {
+    stats_.app_runs++;
+    const uint16_t tpl_address = (config_.timonel_start - 2);
+    const uint16_t trampoline = FlashWord(tpl_address);
+    if (trampoline == 0xFFFF) {
+        Restart(0);
+    } else if ((trampoline & 0xF000) != 0xC000) {
+        firmware_ = SIM_BRICKED;
+    } else if (FlashWord(JumpTarget(trampoline, tpl_address)) == 0xFFFF) {
+        Restart(0);
+    } else {
+        firmware_ = SIM_APPLICATION;
+        flags_ = 0;
+        rx_byte_count_ = 0;
+        tx_length_ = 0;
+        buff_in_.clear();                       /* The application starts with empty buffers (TwisBufferReset) */
+        buff_out_.clear();
+        read_length_ = 0;
+        write_accepted_ = 0xFF;
+        if (config_.stub_address != 0) {
+            StartUpdateStub();
+        }
+    }
+}
+
+/*  ________________________
+   |                        |
+   | TWI command processing |
+   |________________________|
+*/
+void TmlSimDevice::ProcessCommand(void) {
+    uint8_t command_size = rx_byte_count_;
+    rx_byte_count_ = 0;
+    const uint8_t command_max_len = (config_.mst_packet_size + 1 + PacketCheckLength());
+    if ((firmware_ == SIM_BOOTLOADER) && (command_size > command_max_len)) {
+        command_size = command_max_len; /* Oversized commands are truncated and fail their checksums */
+    }
+    if ((firmware_ == SIM_BOOTLOADER) && (config_.windowed_ack) && (command_size == 0)) {
+        return; /* Nothing new to process, e.g. a windowed packet reply request */
+    }
+    tx_length_ = 0;
+    stats_.commands++;
+    if (firmware_ == SIM_UPDATE_STUB) {
+        Reply_UpdateStub(rx_buffer_, command_size);
+    } else if (firmware_ == SIM_APPLICATION) {
+        Reply_Application(rx_buffer_, command_size);
+    } else {
+        const uint8_t opcode = rx_buffer_[0];
+        if (ReceiveEvent(rx_buffer_, command_size)) {
+            StatsAdd((opcode & 0x0F), 0, STATS_CMD_PRESC); /* The command handlers take no simulated time */
+        }
+    }
+}
+
+/*  ________________________
+   |                        |
+   | TWI data receive event |
+   |________________________|
+*/
+bool TmlSimDevice::ReceiveEvent(uint8_t command[], uint8_t command_size) {
+    switch (command[0]) {
+        case GETTMNLV: {
+            Reply_GETTMNLV(command, command_size);
+            return true;
+        }
+        case EXITTMNL: {
+            Reply_EXITTMNL(command, command_size);
+            return true;
+        }
+        case DELFLASH: {
+            Reply_DELFLASH(command, command_size);
+            return true;
+        }
+        case STPGADDR: {
+            if (config_.cmd_setpgaddr || !(config_.auto_page_addr)) {
+                Reply_STPGADDR(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case WRITPAGE: {
+            Reply_WRITPAGE(command, command_size);
+            return true;
+        }
+        case WRITPGWN: {
+            if (config_.windowed_ack) {
+                Reply_WRITPAGE(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case WRITERLE: {
+            if (config_.cmd_writerle) {
+                Reply_WRITERLE(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case READFLSH: {
+            if (config_.cmd_readflash) {
+                Reply_READFLSH(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case ERASEPAG: {
+            if (config_.cmd_erasepag) {
+                Reply_ERASEPAG(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case GETCRC: {
+            if (config_.use_crc16) {
+                Reply_GETCRC(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case INITSOFT: {
+            if (config_.two_step_init) {
+                Reply_INITSOFT(command, command_size);
+                return true;
+            }
+            return false;
+        }
+        case GETSTATS: {
+            if (config_.cmd_getstats) {
+                Reply_GETSTATS(command, command_size);
+                return true;
+            }
+            return false;
+        }
+    }
+    return false; /* Unknown or disabled command */
+}
+
+/*  ________________________
+   |                        |
+   |    Slow operations     |
+   |________________________|
+*/
+// Run the slow operations of the bootloader main loop. Their time keeps the device busy: the TWI
+// address isn't acknowledged, or with STRETCH_ON_WRITE, the transactions are held while writing.
+void TmlSimDevice::RunSlowOps(void) {
+    if (!IsInitialized()) {
+        return;
+    }
+    // Exit the bootloader & run the application
+    if ((flags_ >> FL_EXIT_TML) & true) {
+        RunApplication();
+        return;
+    }
+    // Delete the application from memory, then restart
+    if ((flags_ >> FL_DEL_FLASH) & true) {
+        unsigned long long erase_us = 0;
+        uint16_t page_to_del = config_.timonel_start;
+        while (page_to_del != RESET_PAGE) {
+            page_to_del -= SIM_PAGE_SIZE;
+            PageErase(page_to_del);
+            erase_us += config_.page_erase_us;
+        }
+        Restart(erase_us + (config_.use_wdt_reset ? config_.reset_us : 0));
+        return;
+    }
+    unsigned long long busy_us = 0;
+    bool suspended = false; /* The TWI driver was suspended: the address is NACKed while busy */
+    // Erase a single flash memory page
+    if (config_.cmd_erasepag && ((flags_ >> FL_ERASE_PAGE) & true)) {
+        flags_ &= ~(1 << FL_ERASE_PAGE);
+        const uint16_t erase_limit = (config_.auto_page_addr ? (config_.timonel_start - SIM_PAGE_SIZE) : config_.timonel_start);
+        if (page_addr_ < erase_limit) { /* The trampoline page is handled by the bootloader */
+            PageErase(page_addr_);
+            busy_us += config_.page_erase_us;
+            suspended = true;
+        }
+    }
+    // Calculate the CRC16 of a flash memory range
+    if (config_.use_crc16 && ((flags_ >> FL_CALC_CRC) & true)) {
+        flags_ &= ~(1 << FL_CALC_CRC);
+        crc_ = CRC16_INIT;
+        for (uint16_t i = 0; i < crc_size_; i++) {
+            crc_ = CrcUpdate(crc_, flash_[(uint16_t)(crc_addr_ + i) & (SIM_FLASH_SIZE - 1)]);
+        }
+        busy_us += ((unsigned long long)crc_size_ * config_.crc_byte_us);
+        suspended = true;
+    }
+    // Write the received page to memory and prepare for a new one
+    const uint16_t write_limit = ((config_.app_use_tpl_pg || !(config_.auto_page_addr)) ? config_.timonel_start : (config_.timonel_start - SIM_PAGE_SIZE));
+    if ((page_ix_ == SIM_PAGE_SIZE) && (page_addr_ < write_limit)) {
+        suspended |= !(config_.stretch_on_write);
+        if (config_.force_erase_pg) {
+            PageErase(page_addr_);
+            busy_us += config_.page_erase_us;
+        }
+        PageWrite(page_addr_);
+        busy_us += config_.page_write_us;
+        if (config_.auto_page_addr) {
+            if (page_addr_ == RESET_PAGE) { /* Calculate and write trampoline */
+                const uint16_t tpl = Trampoline();
+                for (int i = 0; i < SIM_PAGE_SIZE - 2; i += 2) {
+                    PageFill((config_.timonel_start - SIM_PAGE_SIZE) + i, 0xFFFF);
+                }
+                PageFill((config_.timonel_start - 2), tpl);
+                if (config_.force_erase_pg || config_.cmd_erasepag) {
+                    PageErase(config_.timonel_start - SIM_PAGE_SIZE); /* Page 0 could be rewritten without deleting the app */
+                    busy_us += config_.page_erase_us;
+                }
+                PageWrite(config_.timonel_start - SIM_PAGE_SIZE);
+                busy_us += config_.page_write_us;
+            }
+            if (config_.app_use_tpl_pg && (page_addr_ == (config_.timonel_start - SIM_PAGE_SIZE))) {
+                // Read the trampoline page back to the page buffer and check that the application didn't overwrite the trampoline
+                for (uint8_t i = 0; i < SIM_PAGE_SIZE - 2; i += 2) {
+                    PageFill((config_.timonel_start - SIM_PAGE_SIZE) + i, FlashWord((config_.timonel_start - SIM_PAGE_SIZE) + i));
+                }
+                if (FlashWord(config_.timonel_start - 2) != Trampoline()) {
+                    flags_ |= (1 << FL_DEL_FLASH); /* If the application overwrites the trampoline bytes, delete it! */
+                }
+            }
+            page_addr_ += SIM_PAGE_SIZE;
+        }
+        page_ix_ = 0;
+    }
+    if (busy_us > 0) {
+        busy_until_us_ = (SimClockGet() + busy_us);
+        busy_stretching_ = !suspended;
+        if (suspended) {
+            rx_byte_count_ = 0; /* UsiTwiDriverInit flushes the TWI buffers */
+        }
+    }
+}
+
+// ******************
+// * GETTMNLV Reply *
+// ******************
+void TmlSimDevice::Reply_GETTMNLV(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    reply[0] = ACKTMNLV;
+    reply[1] = SIM_ID_CHAR;                                 /* "T" Signature */
+    reply[2] = SIM_VER_MJR;                                 /* Major version number */
+    reply[3] = SIM_VER_MNR;                                 /* Minor version number */
+    reply[4] = GetFeatures();                               /* Optional features */
+    reply[5] = GetExtFeatures();                            /* Extended optional features */
+    reply[6] = ((config_.timonel_start & 0xFF00) >> 8);     /* Bootloader start address MSB */
+    reply[7] = (config_.timonel_start & 0xFF);              /* Bootloader start address LSB */
+    reply[8] = flash_[config_.timonel_start - 1];           /* Trampoline second byte (MSB) */
+    reply[9] = flash_[config_.timonel_start - 2];           /* Trampoline first byte (LSB) */
+    reply[10] = config_.low_fuse;                           /* Low fuse setting */
+    reply[11] = (((config_.low_fuse & 0x0F) == RCOSC_CLK_SRC) ? (uint8_t)(config_.osccal + OSC_FAST) : config_.osccal);
+    reply[12] = (config_.mst_packet_size | (config_.windowed_ack ? WND_ACK_FLAG : 0));
+    reply[13] = (SIM_SLV_PACKET_SIZE | (config_.stretch_on_write ? STR_WRITE_FLAG : 0));
+    flags_ |= (1 << FL_INIT_1);                             /* First-step of single or two-step initialization */
+    if (config_.pkt_resync) {
+        reply[14] = (uint8_t)(page_addr_ / SIM_PAGE_SIZE); /* Page where the next data packet is written */
+        reply[15] = page_ix_;                               /* Data bytes already in the page buffer */
+        flags_ &= ~(1 << FL_PKT_ERROR);                     /* The master knows the page position, accept data packets again */
+        SendReply(GETTMNLV_RPLYLN);
+    } else {
+        SendReply(GETTMNLV_RPLYLN - 2);                     /* Without PKT_RESYNC, the page position isn't reported */
+    }
+}
+
+// ******************
+// * EXITTMNL Reply *
+// ******************
+void TmlSimDevice::Reply_EXITTMNL(uint8_t command[], uint8_t command_size) {
+    tx_buffer_[0] = ACKEXITT;
+    SendReply(1);
+    flags_ |= (1 << FL_EXIT_TML);
+}
+
+// ******************
+// * DELFLASH Reply *
+// ******************
+void TmlSimDevice::Reply_DELFLASH(uint8_t command[], uint8_t command_size) {
+    tx_buffer_[0] = ACKDELFL;
+    SendReply(1);
+    flags_ |= (1 << FL_DEL_FLASH);
+}
+
+// ******************
+// * STPGADDR Reply *
+// ******************
+void TmlSimDevice::Reply_STPGADDR(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    page_addr_ = ((command[1] << 8) + command[2]); /* Sets the flash memory page base address */
+    page_addr_ &= ~(SIM_PAGE_SIZE - 1);            /* Keep only pages' base addresses */
+    reply[0] = AKPGADDR;
+    reply[1] = (uint8_t)(command[1] + command[2]); /* Returns the sum of MSB and LSB of the page address */
+    SendReply(STPGADDR_RPLYLN);
+}
+
+// ******************
+// * WRITPAGE Reply *
+// ******************
+void TmlSimDevice::Reply_WRITPAGE(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    const uint8_t data_end = (command_size - PacketCheckLength()); /* Data bytes go from command[1] to command[data_end - 1] */
+    bool check_ok = false;
+    reply[0] = ACKWTPAG;
+    reply[1] = 0;
+    if (config_.use_crc16) {
+        uint16_t crc = CRC16_INIT;
+        for (uint8_t i = 1; i < data_end; i++) {
+            crc = CrcUpdate(crc, command[i]);
+        }
+        reply[1] = (uint8_t)(crc >> 8);
+        reply[2] = (uint8_t)(crc & 0xFF);
+        check_ok = ((reply[1] == command[data_end]) && (reply[2] == command[(uint8_t)(data_end + 1)]));
+    } else {
+        for (uint8_t i = 1; i < data_end; i++) {
+            reply[1] += (uint8_t)(command[i]);
+        }
+        check_ok = (reply[1] == command[data_end]);
+    }
+    if (config_.pkt_resync && ((flags_ >> FL_PKT_ERROR) & true)) {
+        check_ok = false; /* A previous packet was rejected, wait for the master to resync */
+    }
+    if ((!config_.pkt_resync) && config_.windowed_ack && ((flags_ >> FL_DEL_FLASH) & true)) {
+        check_ok = false; /* A previous windowed packet failed, report it in this reply */
+    }
+    if ((((uint8_t)(data_end - 1)) & 1) || ((config_.check_page_ix) && ((page_ix_ + (uint8_t)(data_end - 1)) > SIM_PAGE_SIZE))) {
+        flags_ |= (1 << FL_DEL_FLASH); /* Wrong packet sizes: safety payload deletion ... */
+        check_ok = false;
+    }
+    if (check_ok) {
+        uint8_t i = 1;
+        if ((page_addr_ + page_ix_) == RESET_PAGE) {
+            if (config_.auto_page_addr) {
+                app_reset_lsb_ = command[1];
+                app_reset_msb_ = command[2];
+            }
+            PageFill(RESET_PAGE, (0xC000 + ((config_.timonel_start / 2) - 1))); /* Reset vector pointing to this bootloader */
+            page_ix_ += 2;
+            i = 3;
+        }
+        for (; i < data_end; i += 2) {
+            PageFill((page_addr_ + page_ix_), ((command[(uint8_t)(i + 1)] << 8) | command[i]));
+            page_ix_ += 2;
+        }
+    } else {
+        stats_.rejected_packets++;
+        StatsAdd(STATS_PKT_ERROR, 0, 1);
+        if (config_.pkt_resync) {
+            flags_ |= (1 << FL_PKT_ERROR); /* Reject the data packets until the master reads the status */
+        } else {
+            flags_ |= (1 << FL_DEL_FLASH); /* Without PKT_RESYNC, a rejected packet requests the safety payload deletion */
+        }
+        reply[1] = 0;
+        reply[2] = 0;
+    }
+    SendReply(1 + PacketCheckLength());
+}
+
+// ******************
+// * WRITERLE Reply *
+// ******************
+// The packet check covers the encoded data as sent. The tokens are expanded into the page buffer like
+// the WRITPAGE data, a truncated block or data past the page end requests a safety payload deletion.
+void TmlSimDevice::Reply_WRITERLE(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    const uint8_t data_end = (command_size - PacketCheckLength()); /* Encoded data goes from command[1] to command[data_end - 1] */
+    bool check_ok = false;
+    bool data_ok = true;
+    reply[0] = ACKWTRLE;
+    reply[1] = 0;
+    if (config_.use_crc16) {
+        uint16_t crc = CRC16_INIT;
+        for (uint8_t i = 1; i < data_end; i++) {
+            crc = CrcUpdate(crc, command[i]);
+        }
+        reply[1] = (uint8_t)(crc >> 8);
+        reply[2] = (uint8_t)(crc & 0xFF);
+        check_ok = ((reply[1] == command[data_end]) && (reply[2] == command[(uint8_t)(data_end + 1)]));
+    } else {
+        for (uint8_t i = 1; i < data_end; i++) {
+            reply[1] += (uint8_t)(command[i]);
+        }
+        check_ok = (reply[1] == command[data_end]);
+    }
+    if (config_.pkt_resync && ((flags_ >> FL_PKT_ERROR) & true)) {
+        check_ok = false; /* A previous packet was rejected, wait for the master to resync */
+    }
+    uint8_t i = 1;
+    while ((i < data_end) && data_ok && check_ok) {
+        const uint8_t token = command[i++];
+        const bool run = ((token & RLE_RUN_FLAG) == RLE_RUN_FLAG);
+        uint8_t word_count = ((token & RLE_COUNT_MASK) + 1);
+        const uint16_t block_end = (i + (run ? 2 : (word_count << 1)));
+        if (block_end > data_end) {
+            data_ok = false; /* Truncated block */
+            break;
+        }
+        while (word_count--) {
+            if (page_ix_ >= SIM_PAGE_SIZE) {
+                data_ok = false; /* The expanded data doesn't fit in the page */
+                break;
+            }
+            uint16_t page_word = ((command[(uint8_t)(i + 1)] << 8) | command[i]);
+            if ((page_addr_ + page_ix_) == RESET_PAGE) {
+                if (config_.auto_page_addr) {
+                    app_reset_lsb_ = command[i];
+                    app_reset_msb_ = command[(uint8_t)(i + 1)];
+                }
+                page_word = (0xC000 + ((config_.timonel_start / 2) - 1)); /* Reset vector pointing to this bootloader */
+            }
+            PageFill((page_addr_ + page_ix_), page_word);
+            page_ix_ += 2;
+            if (!run) {
+                i += 2;
+            }
+        }
+        i = (uint8_t)block_end;
+    }
+    if (!data_ok) {
+        flags_ |= (1 << FL_DEL_FLASH); /* Wrong encoded data, partially expanded: safety payload deletion ... */
+    }
+    if (check_ok && data_ok) {
+        stats_.rle_packets++;
+    } else {
+        stats_.rejected_packets++;
+        StatsAdd(STATS_PKT_ERROR, 0, 1);
+        if (config_.pkt_resync) {
+            flags_ |= (1 << FL_PKT_ERROR); /* Reject the data packets until the master reads the status */
+        } else {
+            flags_ |= (1 << FL_DEL_FLASH); /* Without PKT_RESYNC, a rejected packet requests the safety payload deletion */
+        }
+        reply[1] = 0;
+        reply[2] = 0;
+    }
+    SendReply(1 + PacketCheckLength());
+}
+
+// ******************
+// * READFLSH Reply *
+// ******************
+void TmlSimDevice::Reply_READFLSH(uint8_t command[], uint8_t command_size) {
+    if (command[3] > SIM_SLV_PACKET_SIZE) {
+        command[3] = SIM_SLV_PACKET_SIZE; /* The reply has to fit in the TX buffer */
+    }
+    const uint8_t reply_len = (command[3] + 1 + PacketCheckLength());
+    uint8_t *reply = tx_buffer_;
+    uint16_t crc = CrcUpdate(CrcUpdate(CRC16_INIT, command[1]), command[2]); /* Address MSB and LSB first */
+    uint8_t sum = (uint8_t)(command[1] + command[2]);
+    const uint16_t mem_position = ((command[1] << 8) + command[2]);
+    reply[0] = ACKRDFSH;
+    for (uint8_t i = 1; i < command[3] + 1; i++) {
+        reply[i] = flash_[(uint16_t)(mem_position + i - 1) & (SIM_FLASH_SIZE - 1)];
+        crc = CrcUpdate(crc, reply[i]);
+        sum += reply[i];
+    }
+    if (config_.use_crc16) {
+        reply[reply_len - 2] = (uint8_t)(crc >> 8);
+        reply[reply_len - 1] = (uint8_t)(crc & 0xFF);
+    } else {
+        reply[reply_len - 1] = sum;
+    }
+    SendReply(reply_len);
+}
+
+// ******************
+// * ERASEPAG Reply *
+// ******************
+void TmlSimDevice::Reply_ERASEPAG(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    page_addr_ = ((command[1] << 8) + command[2]); /* Sets the flash memory page base address */
+    page_addr_ &= ~(SIM_PAGE_SIZE - 1);            /* Keep only pages' base addresses */
+    page_ix_ = 0;                                  /* Next data packets are written to this page */
+    flags_ |= (1 << FL_ERASE_PAGE);                /* Erase the page after the reply (slow op) */
+    reply[0] = ACKERPAG;
+    reply[1] = (uint8_t)(command[1] + command[2]);
+    SendReply(ERASEPAG_RPLYLN);
+}
+
+// ******************
+// *  GETCRC Reply  *
+// ******************
+void TmlSimDevice::Reply_GETCRC(uint8_t command[], uint8_t command_size) {
+    tx_buffer_[0] = ACKGTCRC;
+    if (command_size == GETCRC_CMDLN) {
+        crc_addr_ = ((command[1] << 8) + command[2]);
+        crc_size_ = ((command[3] << 8) + command[4]);
+        flags_ |= (1 << FL_CALC_CRC);
+        tx_buffer_[1] = (uint8_t)(command[1] + command[2] + command[3] + command[4]); /* Operands checksum */
+        SendReply(2);
+    } else {
+        tx_buffer_[1] = (uint8_t)(crc_ >> 8);
+        tx_buffer_[2] = (uint8_t)(crc_ & 0xFF);
+        SendReply(GETCRC_RPLYLN);
+    }
+}
+
+// ******************
+// * INITSOFT Reply *
+// ******************
+void TmlSimDevice::Reply_INITSOFT(uint8_t command[], uint8_t command_size) {
+    flags_ |= (1 << FL_INIT_2); /* Two-step init step 1: receive INITSOFT command */
+    tx_buffer_[0] = ACKINITS;
+    SendReply(1);
+}
+
+// ******************
+// * GETSTATS Reply *
+// ******************
+void TmlSimDevice::Reply_GETSTATS(uint8_t command[], uint8_t command_size) {
+    uint8_t *reply = tx_buffer_;
+    const uint8_t entry = (command[1] & ~STATS_CLEAR_FLAG);
+    reply[0] = ACKGTSTS;
+    if ((command_size != GETSTATS_CMDLN) || (entry >= STATS_ENTRIES)) {
+        SendReply(1); /* Unknown entry: the short reply tells the master */
+        return;
+    }
+    reply[1] = (uint8_t)(stats_count_[entry] >> 8);
+    reply[2] = (uint8_t)(stats_count_[entry] & 0xFF);
+    reply[3] = (uint8_t)(stats_ticks_[entry] >> 24);
+    reply[4] = (uint8_t)(stats_ticks_[entry] >> 16);
+    reply[5] = (uint8_t)(stats_ticks_[entry] >> 8);
+    reply[6] = (uint8_t)(stats_ticks_[entry] & 0xFF);
+    reply[7] = (((config_.low_fuse & 0x0F) == HFPLL_CLK_SRC) ? 16 : 8); /* Nominal clock (STATS_CLK_MHZ) */
+    if (command[1] & STATS_CLEAR_FLAG) {
+        stats_count_[entry] = 0;
+        stats_ticks_[entry] = 0;
+    }
+    SendReply(GETSTATS_RPLYLN);
+}
+
+// Application replies: RESETMCU and BOOTTMNL restart the bootloader, READBUFF and WRITBUFF stream data when
+// the application has a buffer, the other commands are unknown
+void TmlSimDevice::Reply_Application(uint8_t command[], uint8_t command_size) {
+    if ((config_.app_buffer_size != 0) && (command_size > 0) && ((command[0] == READBUFF) || (command[0] == WRITBUFF))) {
+        const uint8_t reply_size = Reply_Buffer(command, command_size);
+        if (reply_size != 0) {
+            SendReply(reply_size);
+            return;
+        }
+        tx_buffer_[0] = UNKNOWNC;
+    } else if ((command_size > 0) && (command[0] == RESETMCU)) {
+        tx_buffer_[0] = ACKRESET;
+        restart_pending_ = true;
+    } else if ((command_size > 0) && (command[0] == BOOTTMNL)) {
+        tx_buffer_[0] = ACKBOOTT;
+        restart_pending_ = true;
+        hold_pending_ = config_.reboot_hold; /* The application leaves the marker, the bootloader checks it if built with REBOOT_HOLD */
+    } else {
+        tx_buffer_[0] = UNKNOWNC;
+    }
+    SendReply(1);
+}
+
+// Function Reply_Buffer (READBUFF and WRITBUFF, as TwisBufferCommand does: returns the reply length, or 0 when the
+// command is too short. A frame with the same sequence number as the previous one is answered with the same reply,
+// a frame failing its checksum gets a reply the master rejects or BUFF_CHECK_ERR, without changing the last one)
+uint8_t TmlSimDevice::Reply_Buffer(uint8_t command[], uint8_t command_size) {
+    if (command_size < 4) {
+        return 0;
+    }
+    uint8_t count = (command[2] & 0x7F);
+    if (command[0] == READBUFF) {
+        if ((uint8_t)(command[1] + command[2]) != command[3]) {
+            tx_buffer_[0] = ACKRDBUF;
+            tx_buffer_[1] = command[1];
+            tx_buffer_[2] = 0;
+            tx_buffer_[3] = ~command[1];
+            return 4;
+        }
+        if ((command[2] & 0x80) || (read_length_ == 0) || (read_frame_[1] != command[1])) {
+            // New frame: the processed data goes out (p_buffer_source)
+            if (count > SIM_BUFF_FRAME) {
+                count = SIM_BUFF_FRAME;
+            }
+            if (count > buff_out_.size()) {
+                count = buff_out_.size();
+            }
+            read_frame_[0] = ACKRDBUF;
+            read_frame_[1] = command[1];
+            read_frame_[2] = count;
+            uint8_t sum = command[1] + count;
+            for (uint8_t i = 0; i < count; i++) {
+                read_frame_[i + 3] = buff_out_.front();
+                buff_out_.pop_front();
+                sum += read_frame_[i + 3];
+            }
+            read_frame_[count + 3] = sum;
+            read_length_ = (count + 4);
+        } else {
+            stats_.buffer_repeats++;
+        }
+        memcpy(tx_buffer_, read_frame_, read_length_);
+        return read_length_;
+    }
+    if ((command[2] & 0x80) || (write_accepted_ == 0xFF) || (write_seq_ != command[1])) {
+        // New frame: its data goes in the application buffer as far as it fits (p_buffer_sink)
+        uint8_t sum = command[1] + count;
+        if ((count <= SIM_BUFF_FRAME) && (command_size >= (count + 4))) {
+            for (uint8_t i = 0; i < count; i++) {
+                sum += command[i + 3];
+            }
+            sum -= command[count + 3];
+        } else {
+            sum = 1; /* Wrong frame size */
+        }
+        if (sum != 0) {
+            tx_buffer_[0] = ACKWTBUF;
+            tx_buffer_[1] = command[1];
+            tx_buffer_[2] = 0xFF;
+            tx_buffer_[3] = command[1] + 0xFF;
+            return 4;
+        } else {
+            write_seq_ = command[1];
+            write_accepted_ = 0;
+            if (buff_in_.empty()) {
+                buff_time_us_ = SimClockGet();
+            }
+            while ((write_accepted_ < count) && (buff_in_.size() < config_.app_buffer_size)) {
+                buff_in_.push_back(command[3 + write_accepted_++]);
+            }
+            stats_.buffer_full += (write_accepted_ < count);
+        }
+    } else {
+        stats_.buffer_repeats++;
+    }
+    tx_buffer_[0] = ACKWTBUF;
+    tx_buffer_[1] = command[1];
+    tx_buffer_[2] = write_accepted_;
+    tx_buffer_[3] = command[1] + write_accepted_;
+    return 4;
+}
+
+// Function ProcessBuffer (The application processes the bytes written to its buffer, one every app_byte_us)
+void TmlSimDevice::ProcessBuffer(void) {
+    while ((!buff_in_.empty()) && (SimClockGet() >= (buff_time_us_ + config_.app_byte_us))) {
+        buff_time_us_ += config_.app_byte_us;
+        buff_out_.push_back(buff_in_.front());
+        buff_in_.pop_front();
+    }
+}
+
+/*  ________________________
+   |                        |
+   |      Update stub       |
+   |________________________|
+*/
+// Function StartUpdateStub (The application is the update stub: its staging area goes from the second page after
+// its code up to Timonel's trampoline page. When Timonel starts it, the trampoline jumps to its __init and the last
+// byte written below the trampoline page stands for __data_load_end. When it starts from the reset vector after a
+// power loss while installing, the staging area end is read from the page after its code, where it was saved)
+void TmlSimDevice::StartUpdateStub(void) {
+    firmware_ = SIM_UPDATE_STUB;
+    const bool installing = ((stub_reset_ != 0) && (FlashWord(RESET_PAGE) == StubResetVector()));
+    if (!installing) {
+        const uint16_t tpl_address = (config_.timonel_start - 2);
+        stub_reset_ = JumpTarget(FlashWord(tpl_address), tpl_address);
+        stub_end_ = (config_.timonel_start - SIM_PAGE_SIZE);
+        while ((stub_end_ > RESET_PAGE) && (flash_[stub_end_ - 1] == 0xFF)) {
+            stub_end_--;
+        }
+    }
+    bounds_page_ = ((stub_end_ + (SIM_PAGE_SIZE - 1)) & ~(SIM_PAGE_SIZE - 1));
+    stage_start_ = (bounds_page_ + SIM_PAGE_SIZE);
+    const uint16_t stage_end = (installing ? FlashWord(bounds_page_) : (JumpTarget(FlashWord(RESET_PAGE), RESET_PAGE) - SIM_PAGE_SIZE));
+    stage_size_ = (((stage_end > stage_start_) && (stage_end <= SIM_FLASH_SIZE)) ? (stage_end - stage_start_) : 0);
+    stub_page_offset_ = 0;
+    stub_page_ix_ = 0;
+    stub_flags_ = 0;
+    crc_ = CRC16_INIT;
+    crc_size_ = 0;
+}
+
+// Function Reply_UpdateStub (Update stub TWI data receive event)
+void TmlSimDevice::Reply_UpdateStub(uint8_t command[], uint8_t command_size) {
+    switch (command[0]) {
+        case STPGADDR: {
+            stub_page_offset_ = (((command[1] << 8) + command[2]) & ~(SIM_PAGE_SIZE - 1));
+            stub_page_ix_ = 0;
+            stub_flags_ &= ~(1 << FL_STUB_PKT_ERROR);
+            if (stub_page_offset_ == 0) {
+                stub_flags_ &= ~(1 << FL_STUB_STAGE_ERROR); /* A new image starts */
+            }
+            if ((command_size != STUB_STPGADDR_CMDLN) || (stub_page_offset_ >= stage_size_)) {
+                stub_flags_ |= (1 << FL_STUB_STAGE_ERROR);
+            }
+            tx_buffer_[0] = AKPGADDR;
+            tx_buffer_[1] = (uint8_t)(command[1] + command[2]);
+            SendReply(STPGADDR_RPLYLN);
+            break;
+        }
+        case WRITPAGE: {
+            // 8-bit sum (even command length) or CRC16 (odd command length), as the bootloader being replaced
+            const bool use_crc = (command_size & 1);
+            const uint8_t check_len = (use_crc ? 2 : 1);
+            uint8_t data_end = 1;
+            if (command_size >= (check_len + 3)) {
+                data_end = (command_size - check_len);
+            }
+            uint16_t check = (use_crc ? CRC16_INIT : 0);
+            for (uint8_t i = 1; i < data_end; i++) {
+                check = (use_crc ? CrcUpdate(check, command[i]) : (uint8_t)(check + command[i]));
+            }
+            const uint16_t received = (use_crc ? ((command[data_end] << 8) | command[data_end + 1]) : command[data_end]);
+            if ((data_end == 1) || (check != received) ||
+                ((stub_page_ix_ + (data_end - 1)) > SIM_PAGE_SIZE) || ((stub_flags_ >> FL_STUB_PKT_ERROR) & true)) {
+                stub_flags_ |= (1 << FL_STUB_PKT_ERROR);
+                stats_.rejected_packets++;
+                check = 0;
+            } else {
+                for (uint8_t i = 1; i < data_end; i++) {
+                    stub_page_data_[stub_page_ix_++] = command[i];
+                }
+                if (stub_page_ix_ == SIM_PAGE_SIZE) {
+                    stub_flags_ |= (1 << FL_STUB_WRITE_PAGE);
+                }
+            }
+            tx_buffer_[0] = ACKWTPAG;
+            if (use_crc) {
+                tx_buffer_[1] = (uint8_t)(check >> 8);
+            }
+            tx_buffer_[check_len] = (uint8_t)(check & 0xFF);
+            SendReply(1 + check_len);
+            break;
+        }
+        case GETCRC: {
+            tx_buffer_[0] = ACKGTCRC;
+            if (command_size == GETCRC_CMDLN) {
+                crc_size_ = ((command[3] << 8) + command[4]); /* The offset is always 0: the image start */
+                stub_flags_ |= (1 << FL_STUB_CALC_CRC);
+                tx_buffer_[1] = (uint8_t)(command[1] + command[2] + command[3] + command[4]);
+                SendReply(2);
+            } else {
+                tx_buffer_[1] = (uint8_t)(crc_ >> 8);
+                tx_buffer_[2] = (uint8_t)(crc_ & 0xFF);
+                SendReply(GETCRC_RPLYLN);
+            }
+            break;
+        }
+        case INSTTMNL: {
+            uint8_t status = INST_OK;
+            install_start_ = ((command[1] << 8) + command[2]);
+            install_size_ = ((command[3] << 8) + command[4]);
+            install_crc_ = ((command[5] << 8) + command[6]);
+            if ((command_size != STUB_INSTTMNL_CMDLN) || (install_size_ == 0) || (install_size_ > stage_size_) ||
+                (install_start_ & (SIM_PAGE_SIZE - 1)) || (install_start_ < (stage_start_ + stage_size_)) ||
+                (((uint32_t)install_start_ + install_size_) > SIM_FLASH_SIZE)) {
+                status = INST_ERR_RANGE;
+            } else if ((stub_flags_ >> FL_STUB_STAGE_ERROR) & true) {
+                status = INST_ERR_STAGE;
+            } else {
+                stub_flags_ |= (1 << FL_STUB_INSTALL);
+            }
+            tx_buffer_[0] = ACKINSTT;
+            tx_buffer_[1] = status;
+            SendReply(STUB_INSTTMNL_RPLYLN);
+            break;
+        }
+        default: {
+            tx_buffer_[0] = UNKNOWNC;
+            SendReply(1);
+            break;
+        }
+    }
+}
+
+// Function RunStubOps (Update stub main loop: the slow operations after a reply, the address is NACKed meanwhile)
+void TmlSimDevice::RunStubOps(void) {
+    unsigned long long busy_us = 0;
+    if ((stub_flags_ >> FL_STUB_WRITE_PAGE) & true) {
+        stub_flags_ &= ~(1 << FL_STUB_WRITE_PAGE);
+        busy_us += WriteStagePage();
+    }
+    if ((stub_flags_ >> FL_STUB_CALC_CRC) & true) {
+        stub_flags_ &= ~(1 << FL_STUB_CALC_CRC);
+        crc_ = StageCrc(crc_size_);
+        busy_us += ((unsigned long long)crc_size_ * config_.crc_byte_us);
+    }
+    if ((stub_flags_ >> FL_STUB_INSTALL) & true) {
+        stub_flags_ &= ~(1 << FL_STUB_INSTALL);
+        busy_us += ((unsigned long long)install_size_ * config_.crc_byte_us);
+        if (StageCrc(install_size_) == install_crc_) {
+            InstallBootloader(busy_us); /* The device restarts into the new bootloader */
+            return;
+        }
+        stub_flags_ |= (1 << FL_STUB_STAGE_ERROR);
+    }
+    if (busy_us > 0) {
+        busy_until_us_ = (SimClockGet() + busy_us);
+    }
+}
+
+// Function WriteStagePage (Writes the complete staging page to flash memory, returns the time taken)
+unsigned long long TmlSimDevice::WriteStagePage(void) {
+    if (stub_page_offset_ >= stage_size_) {
+        stub_flags_ |= (1 << FL_STUB_STAGE_ERROR); /* The page would go beyond the staging area */
+    }
+    if ((stub_flags_ >> FL_STUB_STAGE_ERROR) & true) {
+        return 0; /* The page is outside the staging area */
+    }
+    const uint16_t page_addr = (stage_start_ + stub_page_offset_);
+    PageErase(page_addr);
+    for (uint8_t i = 0; i < SIM_PAGE_SIZE; i += 2) {
+        PageFill((page_addr + i), ((stub_page_data_[i + 1] << 8) | stub_page_data_[i]));
+    }
+    PageWrite(page_addr);
+    stub_page_offset_ += SIM_PAGE_SIZE; /* Consecutive pages don't need STPGADDR */
+    stub_page_ix_ = 0;
+    return (config_.page_erase_us + config_.page_write_us);
+}
+
+// Function StageCrc (CRC16 of the staged image first bytes, as Timonel's GETCRC)
+uint16_t TmlSimDevice::StageCrc(const uint16_t size) {
+    uint16_t stage_crc = CRC16_INIT;
+    for (uint16_t i = 0; (i < size) && (i < stage_size_); i++) {
+        stage_crc = CrcUpdate(stage_crc, flash_[stage_start_ + i]);
+    }
+    return stage_crc;
+}
+
+// Function InstallBootloader (Copies the staged image over the bootloader as the stub does, then the watchdog
+// restarts the device from its reset vector. The new bootloader is modeled with the same build options as the
+// replaced one, at the start address installed. With a power cut set, the device is left off after it)
+void TmlSimDevice::InstallBootloader(const unsigned long long busy_us) {
+    unsigned long long install_us = busy_us;
+    cut_ops_ = install_cut_op_;
+    install_cut_op_ = 0;
+    FlashPage(bounds_page_, bounds_page_, (stage_start_ + stage_size_));
+    FlashPage(RESET_PAGE, RESET_PAGE, StubResetVector());
+    for (uint16_t offset = 0; offset < install_size_; offset += SIM_PAGE_SIZE) {
+        FlashPage((install_start_ + offset), (stage_start_ + offset), 0);
+    }
+    PageErase(install_start_ - SIM_PAGE_SIZE);
+    PageErase(RESET_PAGE);
+    for (uint8_t i = 0; i < SIM_PAGE_SIZE; i += 2) {
+        PageFill((RESET_PAGE + i), (0xC000 + (((install_start_ - i) / 2) - 1))); /* Every vector jumps to the new bootloader start */
+    }
+    PageWrite(RESET_PAGE);
+    cut_ops_ = 0;
+    if (power_cut_) {
+        power_cut_ = false;
+        firmware_ = SIM_POWER_OFF;
+        return;
+    }
+    const unsigned long long copied_pages = (((install_size_ + (SIM_PAGE_SIZE - 1)) / SIM_PAGE_SIZE) + 2); /* The image, the staging bounds and the reset page */
+    install_us += ((copied_pages * (config_.page_erase_us + config_.page_write_us)) + (2 * config_.page_erase_us) + config_.page_write_us);
+    const uint16_t reset_vector = FlashWord(RESET_PAGE);
+    if (((reset_vector & 0xF000) == 0xC000) && (JumpTarget(reset_vector, RESET_PAGE) == install_start_)) {
+        config_.timonel_start = install_start_;
+        Restart(install_us + config_.reset_us);
+    } else {
+        firmware_ = SIM_BRICKED;
+    }
+}
+
+// Function FlashPage (Erases a page and writes another one's contents to it. If first_word isn't 0, it replaces the first word)
+void TmlSimDevice::FlashPage(const uint16_t page_addr, const uint16_t src_addr, const uint16_t first_word) {
+    uint16_t words[SIM_PAGE_SIZE / 2];
+    for (uint8_t i = 0; i < (SIM_PAGE_SIZE / 2); i++) {
+        words[i] = FlashWord(src_addr + (i << 1));
+    }
+    if (first_word != 0) {
+        words[0] = first_word;
+    }
+    PageErase(page_addr);
+    for (uint8_t i = 0; i < (SIM_PAGE_SIZE / 2); i++) {
+        PageFill((page_addr + (i << 1)), words[i]);
+    }
+    PageWrite(page_addr);
+}
+
+// Function StubResetVector (Reset vector jumping to the stub: rjmp __init)
+uint16_t TmlSimDevice::StubResetVector(void) {
+    return (0xC000 + (((stub_reset_ / 2) - 1) & 0x0FFF));
+}
+
+// Function SendReply (Sets the reply length, the replies are written from tx_buffer_[0] on)
+void TmlSimDevice::SendReply(const uint8_t reply_size) {
+    tx_length_ = reply_size;
+}
+
+/*  ________________________
+   |                        |
+   |   SPM flash functions  |
+   |________________________|
+*/
+// Function PageFill (Writes a word to the temporary page buffer: a word written twice is corrupted)
+void TmlSimDevice::PageFill(const uint16_t address, const uint16_t data) {
+    const uint8_t word_ix = ((address & (SIM_PAGE_SIZE - 1)) >> 1);
+    if (page_filled_[word_ix]) {
+        stats_.page_rewrites++;
+        page_buffer_[word_ix] &= data;
+    } else {
+        page_buffer_[word_ix] = data;
+        page_filled_[word_ix] = true;
+    }
+}
+
+// Function PageWrite (Writes the temporary page buffer to a page: the flash bits can only go from 1 to 0)
+void TmlSimDevice::PageWrite(const uint16_t address) {
+    if (PowerCut()) {
+        return;
+    }
+    const uint16_t page = ((address & (SIM_FLASH_SIZE - 1)) & ~(SIM_PAGE_SIZE - 1));
+    if (page >= config_.timonel_start) {
+        stats_.boot_writes++;
+    }
+    for (uint8_t i = 0; i < (SIM_PAGE_SIZE / 2); i++) {
+        flash_[page + (i * 2)] &= (uint8_t)(page_buffer_[i] & 0xFF);
+        flash_[page + (i * 2) + 1] &= (uint8_t)(page_buffer_[i] >> 8);
+        page_buffer_[i] = 0xFFFF; /* The page buffer is cleared after writing */
+        page_filled_[i] = false;
+    }
+    stats_.page_writes++;
+    StatsAdd(STATS_PAGE_WRITE, config_.page_write_us, STATS_SLOW_PRESC);
+}
+
+// Function StatsAdd (Counts a GETSTATS event, its time in 8-bit timer ticks at the nominal clock. As in
+// Timonel, the events that outlast the timer range are saturated and flag the entry)
+void TmlSimDevice::StatsAdd(const uint8_t entry, const uint32_t time_us, const uint32_t prescaler) {
+    const uint32_t clock_mhz = (((config_.low_fuse & 0x0F) == HFPLL_CLK_SRC) ? 16 : 8);
+    uint32_t ticks = ((time_us * clock_mhz) / prescaler);
+    if (ticks > 0xFF) {
+        ticks = 0xFF;
+        stats_ticks_[entry] |= STATS_SAT_TICKS;
+    }
+    stats_count_[entry]++;
+    stats_ticks_[entry] += ticks;
+}
+
+// Function PageErase (Erases a page)
+void TmlSimDevice::PageErase(const uint16_t address) {
+    if (PowerCut()) {
+        return;
+    }
+    const uint16_t page = ((address & (SIM_FLASH_SIZE - 1)) & ~(SIM_PAGE_SIZE - 1));
+    if (page >= config_.timonel_start) {
+        stats_.boot_writes++;
+    }
+    memset(&flash_[page], 0xFF, SIM_PAGE_SIZE);
+    stats_.page_erases++;
+    StatsAdd(STATS_PAGE_ERASE, config_.page_erase_us, STATS_SLOW_PRESC);
+}
+
+// Function PowerCut (Counts a flash operation for the power cut test, returns true when the power is off)
+bool TmlSimDevice::PowerCut(void) {
+    if ((cut_ops_ > 0) && (--cut_ops_ == 0)) {
+        power_cut_ = true;
+    }
+    return power_cut_;
+}
+
+// Function FlashWord (Reads a flash memory word, little-endian)
+uint16_t TmlSimDevice::FlashWord(const uint16_t address) {
+    return (flash_[address & (SIM_FLASH_SIZE - 1)] | (flash_[(address + 1) & (SIM_FLASH_SIZE - 1)] << 8));
+}
+
+// Function Trampoline (Jump from the trampoline to the application start, calculated from its reset vector)
+uint16_t TmlSimDevice::Trampoline(void) {
+    return (((~((config_.timonel_start >> 1) - ((((app_reset_msb_ << 8) | app_reset_lsb_) + 1) & 0x0FFF)) + 1) & 0x0FFF) | 0xC000);
+}
+
+// Function PacketCheckLength (Data packet check length: CRC16 or 8-bit sum)
+uint8_t TmlSimDevice::PacketCheckLength(void) {
+    return (config_.use_crc16 ? 2 : 1);
+}
+
+// Function IsInitialized (Single or two-step initialization completed)
+bool TmlSimDevice::IsInitialized(void) {
+    if (config_.two_step_init) {
+        return (((flags_ >> FL_INIT_1) & true) && ((flags_ >> FL_INIT_2) & true));
+    }
+    return ((flags_ >> FL_INIT_1) & true);
+}
+
+// Function CrcUpdate (CRC16 CCITT polynomial 0x1021, as avr-libc _crc_xmodem_update)
+uint16_t TmlSimDevice::CrcUpdate(uint16_t crc, const uint8_t data) {
+    crc ^= ((uint16_t)data << 8);
+    for (uint8_t i = 0; i < 8; i++) {
+        crc = ((crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1));
+    }
+    return crc;
+}
+
+// Function JumpTarget (Byte address reached by an "rjmp" instruction, the 8 KB address space wraps around)
+uint16_t TmlSimDevice::JumpTarget(const uint16_t instruction, const uint16_t address) {
+    return ((((address >> 1) + 1 + (instruction & 0x0FFF)) & 0x0FFF) << 1);
+}
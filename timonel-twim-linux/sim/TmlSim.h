@@ -0,0 +1,222 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: TmlSim.h (Timonel bootloader model)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This class models a Tiny85 running Timonel
+ *  v1.4 on a simulated TWI bus: the bootloader
+ *  command replies, the slow operations run
+ *  after each reply and the SPM page buffer,
+ *  on a simulated 8 KB flash memory. It's used
+ *  to test the TWI master libraries on a PC.
+ *  It also models the update stub application
+ *  (apps/tml-update-stub), which replaces the
+ *  bootloader over TWI, and an application that
+ *  streams data with READBUFF and WRITBUFF
+ *  (nb-libs/twis nb-twis-buffer).
+ */
+
+#ifndef _TML_SIM_H_
+#define _TML_SIM_H_
+
+#include <stdint.h>
+#include <deque>
+#include "../../nb-libs/cmd/nb-twi-cmd.h"
+
+#define SIM_FLASH_SIZE 8192         /* ATtiny85 flash memory size */
+#define SIM_PAGE_SIZE 64            /* ATtiny85 flash memory page size (SPM_PAGESIZE) */
+#define SIM_SLV_PACKET_SIZE 32      /* READFLSH data packet size (SLV_PACKET_SIZE) */
+#define SIM_TX_BUFFER_SIZE 64       /* TWI TX buffer size */
+#define SIM_VER_MJR 1               /* Timonel version modeled */
+#define SIM_VER_MNR 4
+#define SIM_ID_CHAR 84              /* "T" Signature */
+#define SIM_STUB_RX_SIZE 64         /* Update stub TWI RX buffer size (nb-usitwisl TWI_RX_BUFFER_SIZE) */
+#define SIM_BUFF_FRAME 24           /* READBUFF and WRITBUFF max data bytes per frame (TWIS_BUFF_FRAME) */
+
+// Class TmlSimDevice: Simulated Tiny85 running the Timonel bootloader
+class TmlSimDevice {
+   public:
+    // Bootloader build options, as set in "tml-config.mak", plus the device timing
+    typedef struct sim_config_ {
+        uint8_t twi_address = 11;               /* TIMONEL_TWI_ADDR */
+        uint16_t timonel_start = 0x1B00;        /* TIMONEL_START */
+        bool enable_led_ui = false;
+        bool auto_page_addr = true;
+        bool app_use_tpl_pg = false;
+        bool cmd_setpgaddr = false;
+        bool two_step_init = false;
+        bool use_wdt_reset = true;
+        bool timeout_exit = false;
+        bool cmd_readflash = false;
+        bool auto_clk_tweak = false;
+        bool force_erase_pg = false;
+        bool check_page_ix = false;
+        bool cmd_gencall = false;
+        bool cmd_erasepag = false;
+        bool use_crc16 = false;
+        bool windowed_ack = false;
+        bool stretch_on_write = false;
+        bool fast_boot = false;
+        bool reboot_hold = true;                /* REBOOT_HOLD: BOOTTMNL holds the bootloader after the reboot */
+        bool cmd_getstats = false;              /* CMD_GETSTATS: GETSTATS returns the statistics counters */
+        bool cmd_writerle = false;              /* CMD_WRITERLE: WRITERLE expands run-length encoded pages */
+        bool pkt_resync = false;                /* PKT_RESYNC: rejected packets can be resent from the reported page position */
+        uint8_t mst_packet_size = 32;           /* MST_PACKET_SIZE */
+        uint8_t low_fuse = 0x62;                /* LOW_FUSE, reported by GETTMNLV */
+        uint8_t osccal = 0xA6;                  /* OSCCAL value reported by GETTMNLV */
+        uint8_t app_address = 0;                /* TWI address of the application (0 = it doesn't use the bus) */
+        uint8_t stub_address = 0;               /* TWI address of the update stub: the application runs as it (0 = a regular application) */
+        uint16_t app_buffer_size = 0;           /* Application data buffer for READBUFF and WRITBUFF (0 = the application doesn't use them) */
+        uint32_t app_byte_us = 2000;            /* Time the application takes to process each byte written to its buffer */
+        uint32_t max_clock_hz = 400000;         /* Fastest TWI clock the USI driver keeps up with */
+        uint32_t page_write_us = 4500;          /* SPM page write time */
+        uint32_t page_erase_us = 4500;          /* SPM page erase time */
+        uint32_t crc_byte_us = 8;               /* GETCRC time per flash byte */
+        uint32_t reset_us = 16000;              /* Restart time: watchdog timeout and start-up (USE_WDT_RESET) */
+        uint32_t exit_timeout_ms = 1600;        /* Time to exit to the application when not initialized (TIMEOUT_EXIT) */
+        uint32_t fast_boot_ms = 32;             /* Exit timeout after a power-on with an application loaded (FAST_BOOT) */
+    } Config;
+    // Device counters
+    typedef struct sim_stats_ {
+        unsigned long commands = 0;             /* Commands processed */
+        unsigned long replies = 0;              /* Replies read to the end (slow operations enabled) */
+        unsigned long page_writes = 0;          /* SPM page writes */
+        unsigned long page_erases = 0;          /* SPM page erases */
+        unsigned long restarts = 0;             /* Bootloader restarts */
+        unsigned long app_runs = 0;             /* Exits to the application */
+        unsigned long busy_nacks = 0;           /* Addresses not acknowledged while busy */
+        unsigned long rx_overruns = 0;          /* Bytes dropped with the RX buffer full */
+        unsigned long rejected_packets = 0;     /* Data packets rejected (check or size errors) */
+        unsigned long rle_packets = 0;          /* WRITERLE packets expanded in the page buffer */
+        unsigned long page_rewrites = 0;        /* Page buffer words filled twice (corrupted) */
+        unsigned long boot_writes = 0;          /* Writes or erases attempted on the bootloader memory */
+        unsigned long buffer_full = 0;          /* WRITBUFF frames not fully accepted with the application buffer full */
+        unsigned long buffer_repeats = 0;       /* READBUFF and WRITBUFF frames repeated by the master, answered with the last reply */
+    } Stats;
+    // Firmware running
+    enum { SIM_BOOTLOADER, SIM_APPLICATION, SIM_UPDATE_STUB, SIM_BRICKED, SIM_POWER_OFF };
+    TmlSimDevice(const Config &config);
+    static const char *CheckConfig(const Config &config);
+    // Bus side (called by TwoWire)
+    bool AckAddress(const uint8_t address, const bool read);
+    unsigned long long GetHoldTime(const uint8_t address);
+    bool ReceiveByte(const uint8_t data);
+    uint8_t SendByte(void);
+    void EndTransaction(void);
+    // Test side
+    void PowerOn(void);
+    void CutPowerInInstall(const uint16_t flash_op);
+    uint8_t GetFirmware(void);
+    uint8_t GetFeatures(void);
+    uint8_t GetExtFeatures(void);
+    const uint8_t *GetFlash(void);
+    const Config &GetConfig(void);
+    Stats GetStats(void);
+    void ResetStats(void);
+
+   private:
+    void Update(void);
+    void Restart(const unsigned long long delay_us);
+    void RunApplication(void);
+    void ProcessCommand(void);
+    bool ReceiveEvent(uint8_t command[], uint8_t command_size);
+    void RunSlowOps(void);
+    void Reply_GETTMNLV(uint8_t command[], uint8_t command_size);
+    void Reply_EXITTMNL(uint8_t command[], uint8_t command_size);
+    void Reply_DELFLASH(uint8_t command[], uint8_t command_size);
+    void Reply_STPGADDR(uint8_t command[], uint8_t command_size);
+    void Reply_WRITPAGE(uint8_t command[], uint8_t command_size);
+    void Reply_WRITERLE(uint8_t command[], uint8_t command_size);
+    void Reply_READFLSH(uint8_t command[], uint8_t command_size);
+    void Reply_ERASEPAG(uint8_t command[], uint8_t command_size);
+    void Reply_GETCRC(uint8_t command[], uint8_t command_size);
+    void Reply_INITSOFT(uint8_t command[], uint8_t command_size);
+    void Reply_GETSTATS(uint8_t command[], uint8_t command_size);
+    void Reply_Application(uint8_t command[], uint8_t command_size);
+    uint8_t Reply_Buffer(uint8_t command[], uint8_t command_size);
+    void ProcessBuffer(void);
+    void StartUpdateStub(void);
+    void Reply_UpdateStub(uint8_t command[], uint8_t command_size);
+    void RunStubOps(void);
+    unsigned long long WriteStagePage(void);
+    uint16_t StageCrc(const uint16_t size);
+    void InstallBootloader(const unsigned long long busy_us);
+    void FlashPage(const uint16_t page_addr, const uint16_t src_addr, const uint16_t first_word);
+    uint16_t StubResetVector(void);
+    uint16_t FlashWord(const uint16_t address);
+    void SendReply(const uint8_t reply_size);
+    void PageFill(const uint16_t address, const uint16_t data);
+    void PageWrite(const uint16_t address);
+    void PageErase(const uint16_t address);
+    bool PowerCut(void);
+    uint16_t Trampoline(void);
+    uint8_t PacketCheckLength(void);
+    void StatsAdd(const uint8_t entry, const uint32_t time_us, const uint32_t prescaler);
+    bool IsInitialized(void);
+    static uint16_t CrcUpdate(uint16_t crc, const uint8_t data);
+    static uint16_t JumpTarget(const uint16_t instruction, const uint16_t address);
+    Config config_;
+    Stats stats_;
+    uint8_t firmware_ = SIM_BOOTLOADER;
+    uint8_t flash_[SIM_FLASH_SIZE];             /* Flash memory */
+    uint16_t page_buffer_[SIM_PAGE_SIZE / 2];   /* SPM temporary page buffer */
+    bool page_filled_[SIM_PAGE_SIZE / 2];       /* Page buffer words written since the last page write */
+    unsigned long long busy_until_us_ = 0;      /* The device doesn't acknowledge its addresses until then */
+    bool busy_stretching_ = false;              /* While busy, a transaction start is held instead of not acknowledged */
+    unsigned long long boot_time_us_ = 0;       /* Bootloader start time, for the exit timeout */
+    bool fast_boot_ = false;                    /* Started from a power-on with an application loaded (FAST_BOOT) */
+    bool boot_hold_ = false;                    /* Started from a BOOTTMNL reboot: no exit timeout (REBOOT_HOLD) */
+    bool hold_pending_ = false;                 /* The application replied BOOTTMNL, the reboot handshake marker is set */
+    // Bootloader state (MemPack and USI TWI driver globals)
+    uint16_t page_addr_ = 0;
+    uint8_t page_ix_ = 0;
+    uint8_t flags_ = 0;
+    uint8_t app_reset_lsb_ = 0;
+    uint8_t app_reset_msb_ = 0;
+    uint16_t crc_addr_ = 0;
+    uint16_t crc_size_ = 0;
+    uint16_t crc_ = 0xFFFF;
+    uint16_t stats_count_[STATS_ENTRIES];       /* GETSTATS counters, cleared on every start (CMD_GETSTATS) */
+    uint32_t stats_ticks_[STATS_ENTRIES];
+    uint8_t rx_buffer_[256];                    /* Indexed by a byte, the commands too short for their type read stale data */
+    uint8_t rx_buffer_size_ = 64;               /* TWI_RX_BUFFER_SIZE */
+    uint8_t rx_byte_count_ = 0;
+    uint8_t tx_buffer_[SIM_TX_BUFFER_SIZE];
+    uint8_t tx_length_ = 0;
+    uint8_t tx_ix_ = 0;
+    bool reading_ = false;                      /* The current transaction is a read */
+    bool general_call_ = false;                 /* The current transaction was sent to the general call address */
+    bool reply_complete_ = false;               /* The master read the whole reply (it NACKs its last byte) */
+    bool restart_pending_ = false;              /* The application resets after its reply is read (RESETMCU) */
+    // Update stub state (tml-update-stub.c globals)
+    uint8_t stub_page_data_[SIM_PAGE_SIZE];     /* Staging page contents */
+    uint16_t stub_page_offset_ = 0;             /* Staging page offset from the image start */
+    uint8_t stub_page_ix_ = 0;                  /* Staging page bytes received */
+    uint16_t stub_reset_ = 0;                   /* Stub __init (link-time constant, kept across restarts) */
+    uint16_t stub_end_ = 0;                     /* Stub __data_load_end (link-time constant, kept across restarts) */
+    uint16_t bounds_page_ = 0;                  /* First page after the stub: the staging area end, saved while installing */
+    uint16_t stage_start_ = 0;                  /* Staging area: the page after bounds_page_ */
+    uint16_t stage_size_ = 0;                   /* Staging area: up to the trampoline page below Timonel */
+    uint8_t stub_flags_ = 0;
+    uint16_t install_start_ = 0;                /* INSTTMNL: new bootloader start address */
+    uint16_t install_size_ = 0;                 /* INSTTMNL: new bootloader size */
+    uint16_t install_crc_ = 0;                  /* INSTTMNL: expected CRC16 */
+    // Buffer streaming application state (nb-twis-buffer.c globals, plus the application data)
+    std::deque<uint8_t> buff_in_;               /* Bytes written by the master, waiting to be processed */
+    std::deque<uint8_t> buff_out_;              /* Bytes processed, returned to the master by READBUFF */
+    unsigned long long buff_time_us_ = 0;       /* Processing time of the first byte waiting */
+    uint8_t read_frame_[SIM_BUFF_FRAME + 4];    /* Last READBUFF reply, resent when the master repeats it */
+    uint8_t read_length_ = 0;                   /* Last READBUFF reply length (0 = none) */
+    uint8_t write_seq_ = 0;                     /* Last WRITBUFF frame sequence number */
+    uint8_t write_accepted_ = 0xFF;             /* Last WRITBUFF frame accepted bytes (0xFF = none) */
+    // Power cut test
+    uint16_t install_cut_op_ = 0;               /* The next install loses the power before this flash operation (1 = the first one, 0 = never) */
+    uint16_t cut_ops_ = 0;                      /* Flash operations left until the power cut */
+    bool power_cut_ = false;                    /* The power was lost: the flash operations are no longer done */
+};
+
+#endif /* _TML_SIM_H_ */
@@ -0,0 +1,286 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Wire.cpp (TwoWire over a simulated bus)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#include "Wire.h"
+#include "Arduino.h"
+#include "TmlSim.h"
+
+TwoWire Wire;
+
+// Class constructor
+TwoWire::TwoWire(void) {
+}
+
+/* _________________________
+  |                         |
+  |          begin          |
+  |_________________________|
+*/
+// Start the bus at the default clock, the SDA and SCL pins are ignored
+bool TwoWire::begin(int sda, int scl) {
+    (void)sda;
+    (void)scl;
+    return begin();
+}
+
+bool TwoWire::begin(void) {
+    clock_hz_ = SIM_CLK_DEFAULT;
+    return true;
+}
+
+// Function end (Nothing to release)
+void TwoWire::end(void) {
+}
+
+// Function setClock (Bus clock: it sets the transactions time, the devices don't acknowledge clocks faster than their maximum)
+void TwoWire::setClock(uint32_t clock_hz) {
+    if (clock_hz > 0) {
+        clock_hz_ = clock_hz;
+    }
+}
+
+// Function setClockStretchLimit (Longest clock stretching accepted, the ESP8266 core sets it)
+void TwoWire::setClockStretchLimit(uint32_t limit_us) {
+    stretch_limit_us_ = limit_us;
+}
+
+/* _________________________
+  |                         |
+  |    beginTransmission    |
+  |_________________________|
+*/
+// Start preparing a write transaction
+void TwoWire::beginTransmission(uint8_t address) {
+    address_ = address;
+    tx_length_ = 0;
+}
+
+// Function write (Append a byte to the write transaction being prepared)
+size_t TwoWire::write(uint8_t data) {
+    if (tx_length_ >= BUFFER_LENGTH) {
+        return 0;
+    }
+    tx_buffer_[tx_length_++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t size) {
+    size_t written = 0;
+    while ((written < size) && (write(data[written]) == 1)) {
+        written++;
+    }
+    return written;
+}
+
+/* _________________________
+  |                         |
+  |     endTransmission     |
+  |_________________________|
+*/
+// Send the write transaction: 0 = OK, 2 = address NACK, 3 = data NACK, 4 = clock stretching timeout.
+// The transaction ends for the devices either with a stop or with the repeated start of the next one.
+uint8_t TwoWire::endTransmission(bool send_stop) {
+    (void)send_stop;
+    stats_.transactions++;
+    unsigned long long hold_us = 0;
+    for (TmlSimDevice *p_device : devices_) {
+        unsigned long long device_hold_us = p_device->GetHoldTime(address_);
+        hold_us = ((device_hold_us > hold_us) ? device_hold_us : hold_us);
+    }
+    if (hold_us > stretch_limit_us_) {
+        SimClockAdvance(stretch_limit_us_);
+        stats_.stretch_us += stretch_limit_us_;
+        return 4;
+    }
+    SimClockAdvance(hold_us);
+    stats_.stretch_us += hold_us;
+    std::vector<TmlSimDevice *> receivers;
+    if (address_ == SIM_GEN_CALL_ADDR) {
+        receivers = AddressAllDevices();
+    } else {
+        TmlSimDevice *p_device = AddressDevice(address_, false);
+        if (p_device != nullptr) {
+            receivers.push_back(p_device);
+        }
+    }
+    if (receivers.empty()) {
+        BusTime(0);
+        stats_.address_nacks++;
+        return 2;
+    }
+    uint8_t result = 0;
+    size_t sent = 0;
+    for (; sent < tx_length_; sent++) {
+        const uint8_t data = InjectError(tx_buffer_[sent]);
+        bool acknowledged = false;
+        for (TmlSimDevice *p_receiver : receivers) {
+            acknowledged |= p_receiver->ReceiveByte(data);
+        }
+        if (!acknowledged) {
+            stats_.data_nacks++;
+            result = 3;
+            sent++;
+            break;
+        }
+    }
+    BusTime(sent);
+    stats_.bytes_written += sent;
+    for (TmlSimDevice *p_receiver : receivers) {
+        p_receiver->EndTransaction();
+    }
+    return result;
+}
+
+/* _________________________
+  |                         |
+  |       requestFrom       |
+  |_________________________|
+*/
+// Read transaction, returns the bytes read (0 = address NACK). As with a real bus, the bytes requested
+// after the device reply is over are read as 0xFF, and the master NACKs the last byte requested.
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t size, bool send_stop) {
+    (void)send_stop;
+    stats_.transactions++;
+    rx_length_ = 0;
+    rx_ix_ = 0;
+    if (size > BUFFER_LENGTH) {
+        size = BUFFER_LENGTH;
+    }
+    unsigned long long hold_us = 0;
+    for (TmlSimDevice *p_device : devices_) {
+        unsigned long long device_hold_us = p_device->GetHoldTime(address);
+        hold_us = ((device_hold_us > hold_us) ? device_hold_us : hold_us);
+    }
+    if (hold_us > stretch_limit_us_) {
+        SimClockAdvance(stretch_limit_us_);
+        stats_.stretch_us += stretch_limit_us_;
+        return 0;
+    }
+    SimClockAdvance(hold_us);
+    stats_.stretch_us += hold_us;
+    TmlSimDevice *p_device = AddressDevice(address, true);
+    if (p_device == nullptr) {
+        BusTime(0);
+        stats_.address_nacks++;
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        rx_buffer_[i] = InjectError(p_device->SendByte());
+    }
+    BusTime(size);
+    p_device->EndTransaction();
+    stats_.bytes_read += size;
+    rx_length_ = size;
+    return size;
+}
+
+// Function available (Bytes left to read from the last request)
+int TwoWire::available(void) {
+    return (int)(rx_length_ - rx_ix_);
+}
+
+// Function read (Next byte of the last request, -1 if there are no more)
+int TwoWire::read(void) {
+    if (rx_ix_ >= rx_length_) {
+        return -1;
+    }
+    return rx_buffer_[rx_ix_++];
+}
+
+/* _________________________
+  |                         |
+  |       Simulation        |
+  |_________________________|
+*/
+// Function AttachDevice (Connect a simulated device to the bus)
+void TwoWire::AttachDevice(TmlSimDevice *p_device) {
+    devices_.push_back(p_device);
+}
+
+// Function DetachDevices (Disconnect all the devices)
+void TwoWire::DetachDevices(void) {
+    devices_.clear();
+}
+
+// Function SetFaults (Random address NACKs and data bit errors, from a repeatable PRNG seed)
+void TwoWire::SetFaults(const double address_nack_rate, const double byte_error_rate, const uint32_t seed) {
+    address_nack_rate_ = address_nack_rate;
+    byte_error_rate_ = byte_error_rate;
+    random_state_ = ((seed == 0) ? 1 : seed);
+}
+
+// Function GetClock (Current bus clock)
+uint32_t TwoWire::GetClock(void) {
+    return clock_hz_;
+}
+
+// Function GetStats (Bus counters)
+TwoWire::BusStats TwoWire::GetStats(void) {
+    return stats_;
+}
+
+// Function ResetStats
+void TwoWire::ResetStats(void) {
+    stats_ = BusStats();
+}
+
+// Function AddressDevice (Returns the device that acknowledges an address, nullptr if none does)
+TmlSimDevice *TwoWire::AddressDevice(const uint8_t address, const bool read) {
+    if ((address_nack_rate_ > 0) && (Random() < address_nack_rate_)) {
+        stats_.injected_nacks++;
+        return nullptr;
+    }
+    for (TmlSimDevice *p_device : devices_) {
+        if ((p_device->GetConfig().max_clock_hz >= clock_hz_) && p_device->AckAddress(address, read)) {
+            return p_device;
+        }
+    }
+    return nullptr;
+}
+
+// Function AddressAllDevices (Returns the devices that acknowledge the general call address)
+std::vector<TmlSimDevice *> TwoWire::AddressAllDevices(void) {
+    std::vector<TmlSimDevice *> receivers;
+    if ((address_nack_rate_ > 0) && (Random() < address_nack_rate_)) {
+        stats_.injected_nacks++;
+        return receivers;
+    }
+    for (TmlSimDevice *p_device : devices_) {
+        if ((p_device->GetConfig().max_clock_hz >= clock_hz_) && p_device->AckAddress(SIM_GEN_CALL_ADDR, false)) {
+            receivers.push_back(p_device);
+        }
+    }
+    return receivers;
+}
+
+// Function BusTime (Advances the clock by a transaction time: start, address, data bytes with their ack bits and stop)
+void TwoWire::BusTime(const size_t bytes) {
+    const unsigned long long bus_time_us = ((((bytes + 1) * 9ULL) + 2ULL) * 1000000ULL) / clock_hz_;
+    SimClockAdvance(bus_time_us);
+    stats_.bus_time_us += bus_time_us;
+}
+
+// Function InjectError (Flips a random bit of a data byte at the byte error rate)
+uint8_t TwoWire::InjectError(const uint8_t data) {
+    if ((byte_error_rate_ > 0) && (Random() < byte_error_rate_)) {
+        stats_.injected_errors++;
+        return (data ^ (1 << (uint8_t)(Random() * 8)));
+    }
+    return data;
+}
+
+// Function Random (Uniform value from 0 to 1, xorshift32)
+double TwoWire::Random(void) {
+    random_state_ ^= (random_state_ << 13);
+    random_state_ ^= (random_state_ >> 17);
+    random_state_ ^= (random_state_ << 5);
+    return (random_state_ / 4294967296.0);
+}
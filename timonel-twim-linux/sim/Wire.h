@@ -0,0 +1,91 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: Wire.h (TwoWire over a simulated bus)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This TwoWire class implements the Arduino
+ *  Wire interface on a simulated TWI bus with
+ *  TmlSimDevice slaves attached. Each bus byte
+ *  advances the simulated clock by its time at
+ *  the bus clock, and address NACKs and data
+ *  bit errors can be injected at random.
+ */
+
+#ifndef _TML_SIM_WIRE_H_
+#define _TML_SIM_WIRE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define BUFFER_LENGTH 128          /* TX and RX buffer size (bytes) */
+#define SIM_CLK_DEFAULT 100000     /* Bus clock set by begin (Hz) */
+#define SIM_STRETCH_LIMIT 1000000  /* Clock stretching accepted by default (us), as the Linux i2c-dev adapter timeout */
+#define SIM_GEN_CALL_ADDR 0        /* General call address, received by all the devices */
+
+class TmlSimDevice;
+
+// Class TwoWire: Represents a simulated TWI bus
+class TwoWire {
+   public:
+    // Bus counters
+    typedef struct bus_stats_ {
+        unsigned long transactions = 0;     /* Transactions started (write and read) */
+        unsigned long address_nacks = 0;    /* Transactions not acknowledged by any device */
+        unsigned long data_nacks = 0;       /* Written bytes not acknowledged */
+        unsigned long bytes_written = 0;    /* Data bytes sent by the master */
+        unsigned long bytes_read = 0;       /* Data bytes received by the master */
+        unsigned long injected_nacks = 0;   /* Address NACKs injected */
+        unsigned long injected_errors = 0;  /* Data bytes with an injected bit error */
+        unsigned long long bus_time_us = 0; /* Time the bus was in use */
+        unsigned long long stretch_us = 0;  /* Time the bus was held by the devices (clock stretching) */
+    } BusStats;
+    TwoWire(void);
+    bool begin(void);
+    bool begin(int sda, int scl);
+    void end(void);
+    void setClock(uint32_t clock_hz);
+    void setClockStretchLimit(uint32_t limit_us);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t size);
+    uint8_t endTransmission(bool send_stop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t size, bool send_stop = true);
+    int available(void);
+    int read(void);
+    // Simulation
+    void AttachDevice(TmlSimDevice *p_device);
+    void DetachDevices(void);
+    void SetFaults(const double address_nack_rate, const double byte_error_rate, const uint32_t seed);
+    uint32_t GetClock(void);
+    BusStats GetStats(void);
+    void ResetStats(void);
+
+   private:
+    TmlSimDevice *AddressDevice(const uint8_t address, const bool read);
+    std::vector<TmlSimDevice *> AddressAllDevices(void);
+    void BusTime(const size_t bytes);
+    uint8_t InjectError(const uint8_t data);
+    double Random(void);
+    std::vector<TmlSimDevice *> devices_;
+    uint32_t clock_hz_ = SIM_CLK_DEFAULT;
+    uint32_t stretch_limit_us_ = SIM_STRETCH_LIMIT;
+    double address_nack_rate_ = 0;      /* Probability of each address not being acknowledged (0 to 1) */
+    double byte_error_rate_ = 0;        /* Probability of each data byte getting a bit flipped (0 to 1) */
+    uint32_t random_state_ = 1;         /* Fault injection PRNG state (xorshift32) */
+    BusStats stats_;
+    uint8_t address_ = 0;              /* Slave address of the transaction being prepared */
+    uint8_t tx_buffer_[BUFFER_LENGTH]; /* Bytes written by the current transaction */
+    size_t tx_length_ = 0;
+    uint8_t rx_buffer_[BUFFER_LENGTH]; /* Bytes read by the last request */
+    size_t rx_length_ = 0;
+    size_t rx_ix_ = 0;
+};
+
+extern TwoWire Wire;
+
+#endif /* _TML_SIM_WIRE_H_ */
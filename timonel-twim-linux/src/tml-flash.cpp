@@ -0,0 +1,227 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: tml-flash.cpp (Batch flasher)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This command-line program uploads an
+ *  application to several Timonel devices from
+ *  a Linux host. The devices on each I2C bus
+ *  are flashed together by a bus thread, and
+ *  all the buses are flashed at the same time.
+ */
+
+#include <NbMicro.h>
+#include <TimonelTwiM.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tml-image.h"
+
+#define I2C_DEV_PREFIX "/dev/i2c-"   /* Linux i2c-dev adapter path prefix */
+#define DLY_RUN_APP 10               /* Delay before running the applications (ms) */
+
+// Devices on the same I2C bus, flashed by the same thread
+typedef struct bus_job_ {
+    int bus_number = 0;
+    std::string device;
+    TwoWire *p_wire = nullptr;
+    TwiBus *p_bus = nullptr;
+    std::vector<byte> addresses;
+    std::vector<Timonel *> devices;
+    std::vector<byte> errors; /* Errors of each device (0 = flashed OK) */
+    std::vector<bool> current; /* The device was already running the image, it wasn't flashed */
+} BusJob;
+
+// Prototypes
+void ShowUsage(const char *program);
+bool ParseTarget(const char *target, std::vector<BusJob> &jobs);
+void FlashBus(BusJob *p_job, std::vector<byte> *p_image, const bool run_app, const bool force);
+
+// Main function
+int main(int argc, char *argv[]) {
+    bool run_app = true;
+    bool force = false;
+    int arg_ix = 1;
+    for (; (arg_ix < argc) && (argv[arg_ix][0] == '-'); arg_ix++) {
+        if (strcmp(argv[arg_ix], "-n") == 0) {
+            run_app = false;
+        } else if (strcmp(argv[arg_ix], "-f") == 0) {
+            force = true;
+        } else {
+            ShowUsage(argv[0]);
+            return 1;
+        }
+    }
+    if ((argc - arg_ix) < 2) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    std::vector<byte> image;
+    if (!LoadImage(argv[arg_ix], image)) {
+        fprintf(stderr, "Error: unable to load the application image \"%s\"\n", argv[arg_ix]);
+        return 1;
+    }
+    printf("Application image \"%s\": %u bytes\n", argv[arg_ix], (unsigned int)image.size());
+    std::vector<BusJob> jobs;
+    for (arg_ix++; arg_ix < argc; arg_ix++) {
+        if (!ParseTarget(argv[arg_ix], jobs)) {
+            fprintf(stderr, "Error: wrong target \"%s\" (expected <bus>:<addr>[,<addr>...], addresses %d to %d)\n", argv[arg_ix], LOW_TML_ADDR, HIG_TML_ADDR);
+            return 1;
+        }
+    }
+    if (jobs.size() > MAX_TWI_BUSES) {
+        fprintf(stderr, "Error: more than %d I2C buses\n", MAX_TWI_BUSES);
+        return 1;
+    }
+    // The bus and device objects are created before starting the threads, so the
+    // libraries' shared bus table is only modified by the main thread
+    for (BusJob &job : jobs) {
+        job.p_wire = new TwoWire(job.device.c_str());
+        if (!job.p_wire->begin()) {
+            fprintf(stderr, "Error: unable to open %s\n", job.device.c_str());
+            return 1;
+        }
+        job.p_bus = new TwiBus(*job.p_wire);
+        for (byte twi_address : job.addresses) {
+            job.devices.push_back(new Timonel(*job.p_wire, twi_address));
+        }
+    }
+    std::vector<std::thread> threads;
+    for (BusJob &job : jobs) {
+        threads.push_back(std::thread(FlashBus, &job, &image, run_app, force));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    // Results
+    int failed_devices = 0;
+    for (BusJob &job : jobs) {
+        for (size_t i = 0; i < job.devices.size(); i++) {
+            printf("%s device %02d: %s", job.device.c_str(), job.addresses[i], ((job.errors[i] == OK) ? (job.current[i] ? "CURRENT" : "OK") : "FAILED"));
+            if (job.errors[i] != OK) {
+                printf(" (%d errors)", job.errors[i]);
+                failed_devices++;
+            }
+            NbMicro::Stats stats = job.devices[i]->GetStats();
+            printf(", upload %lu ms, %lu retries\n", stats.phase_time_us[PH_UPLOAD] / 1000UL, stats.retries);
+            delete job.devices[i];
+        }
+        delete job.p_bus;
+        delete job.p_wire;
+    }
+    return ((failed_devices == 0) ? 0 : 1);
+}
+
+/* _________________________
+  |                         | 
+  |        FlashBus         |
+  |_________________________|
+*/
+// Flash all the devices on a bus: delete their applications, upload the image interleaving the
+// devices' pages with TwiBus::UploadAll and run the applications. It runs in its own thread.
+// Unless forced, the devices already running the image are only started again (Timonel::NeedsUpdate
+// finds them only when the bootloader has USE_CRC16, otherwise they are flashed).
+void FlashBus(BusJob *p_job, std::vector<byte> *p_image, const bool run_app, const bool force) {
+    const size_t device_count = p_job->devices.size();
+    std::vector<Timonel *> ready_devices;
+    std::vector<size_t> ready_ix;
+    p_job->errors.assign(device_count, OK);
+    p_job->current.assign(device_count, false);
+    for (size_t i = 0; i < device_count; i++) {
+        Timonel *p_device = p_job->devices[i];
+        if (p_device->GetStatus().signature != T_SIGNATURE) {
+            printf("%s device %02d: Timonel not found\n", p_job->device.c_str(), p_job->addresses[i]);
+            p_job->errors[i] = ERR_NOT_READY;
+            continue;
+        }
+        if ((!force) && (!p_device->NeedsUpdate(p_image->data(), (int)p_image->size()))) {
+            p_job->current[i] = true;
+            if (run_app) {
+                p_device->RunApplication();
+            }
+            continue;
+        }
+        byte errors = p_device->DeleteApplication();
+        if (errors != OK) {
+            printf("%s device %02d: error deleting the application\n", p_job->device.c_str(), p_job->addresses[i]);
+            p_job->errors[i] = errors;
+            continue;
+        }
+        ready_devices.push_back(p_device);
+        ready_ix.push_back(i);
+    }
+    if (ready_devices.empty()) {
+        return;
+    }
+    printf("%s: uploading to %u devices ...\n", p_job->device.c_str(), (unsigned int)ready_devices.size());
+    std::vector<byte> upload_errors(ready_devices.size(), OK);
+    p_job->p_bus->UploadAll(ready_devices.data(), (byte)ready_devices.size(), p_image->data(), (int)p_image->size(), upload_errors.data());
+    for (size_t i = 0; i < ready_devices.size(); i++) {
+        p_job->errors[ready_ix[i]] = upload_errors[i];
+        if ((upload_errors[i] == OK) && run_app) {
+            delay(DLY_RUN_APP);
+            ready_devices[i]->RunApplication();
+        }
+    }
+}
+
+/* _________________________
+  |                         | 
+  |       ParseTarget       |
+  |_________________________|
+*/
+// Add the devices of a "<bus>:<addr>[,<addr>...]" argument to the bus jobs, e.g. "1:11,12" for
+// devices 11 and 12 on /dev/i2c-1. The same bus can be given in several arguments.
+bool ParseTarget(const char *target, std::vector<BusJob> &jobs) {
+    char *p_end = nullptr;
+    long bus_number = strtol(target, &p_end, 10);
+    if ((p_end == target) || (*p_end != ':') || (bus_number < 0)) {
+        return false;
+    }
+    BusJob *p_job = nullptr;
+    for (BusJob &job : jobs) {
+        if (job.bus_number == bus_number) {
+            p_job = &job;
+        }
+    }
+    if (p_job == nullptr) {
+        jobs.push_back(BusJob());
+        p_job = &jobs.back();
+        p_job->bus_number = (int)bus_number;
+        p_job->device = I2C_DEV_PREFIX + std::to_string(bus_number);
+    }
+    do {
+        const char *p_addr = p_end + 1;
+        long twi_address = strtol(p_addr, &p_end, 0);
+        if ((p_end == p_addr) || ((*p_end != ',') && (*p_end != '\0')) ||
+            (twi_address < LOW_TML_ADDR) || (twi_address > HIG_TML_ADDR)) {
+            return false;
+        }
+        for (byte known_address : p_job->addresses) {
+            if (known_address == twi_address) {
+                return false;
+            }
+        }
+        p_job->addresses.push_back((byte)twi_address);
+    } while (*p_end == ',');
+    return true;
+}
+
+/* _________________________
+  |                         | 
+  |        ShowUsage        |
+  |_________________________|
+*/
+// Show the command-line arguments
+void ShowUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [-n] [-f] <image.hex|image.bin> <bus>:<addr>[,<addr>...] ...\n", program);
+    fprintf(stderr, "  -n  Don't run the applications after flashing them\n");
+    fprintf(stderr, "  -f  Flash the devices already running the image too (without it, they're skipped,\n"
+                    "      only found on bootloaders built with USE_CRC16)\n");
+    fprintf(stderr, "  E.g. \"%s app.hex 1:11,12 3:11\" flashes devices 11 and 12 on %s1 and device 11 on %s3\n", program, I2C_DEV_PREFIX, I2C_DEV_PREFIX);
+}
@@ -0,0 +1,153 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: tml-image.cpp (Application images)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ */
+
+#include "tml-image.h"
+#include <TimonelTwiM.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+
+/* _________________________
+  |                         | 
+  |        LoadImage        |
+  |_________________________|
+*/
+// Load an application image: Intel HEX when the file name ends in ".hex", otherwise a Timonel image
+// when the file starts with its magic characters (tml-hexparser --output image), or raw binary
+bool LoadImage(const char *path, std::vector<byte> &image) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool loaded = false;
+    size_t path_length = strlen(path);
+    if ((path_length > 4) && (strcasecmp(&path[path_length - 4], ".hex") == 0)) {
+        loaded = LoadHexImage(file, image);
+    } else {
+        std::vector<byte> file_data;
+        byte data[SPM_PAGESIZE];
+        size_t data_size = 0;
+        while ((data_size = fread(data, 1, sizeof(data), file)) > 0) {
+            file_data.insert(file_data.end(), data, data + data_size);
+        }
+        loaded = (ferror(file) == 0);
+        if (loaded && (file_data.size() >= IMAGE_HEADER_LEN) && (memcmp(&file_data[0], IMAGE_MAGIC, 4) == 0)) {
+            loaded = LoadTmlImage(file_data, image);
+        } else {
+            image.swap(file_data);
+        }
+    }
+    fclose(file);
+    return (loaded && (!image.empty()) && (image.size() <= MAX_IMAGE_SIZE));
+}
+
+// Function LoadTmlImage (Expands a Timonel image, the pages left out of its page map are filled with 0xFF).
+// The image is rejected when its header, page map or length don't match, or when the payload CRC16 fails.
+bool LoadTmlImage(const std::vector<byte> &file_data, std::vector<byte> &image) {
+    if ((file_data.size() < IMAGE_HEADER_LEN) || (file_data[4] != IMAGE_VERSION)) {
+        return false;
+    }
+    const size_t pages = file_data[6] | (file_data[7] << 8);
+    const size_t payload_size = file_data[8] | (file_data[9] << 8);
+    const word payload_crc = file_data[12] | (file_data[13] << 8);
+    const size_t map_length = file_data[14];
+    if ((payload_size == 0) || (payload_size > MAX_IMAGE_SIZE) || (pages != ((payload_size + SPM_PAGESIZE - 1) / SPM_PAGESIZE)) ||
+        (map_length != ((pages + 7) / 8)) || (file_data.size() < (IMAGE_HEADER_LEN + map_length))) {
+        return false;
+    }
+    const byte *p_map = &file_data[IMAGE_HEADER_LEN];
+    size_t data_offset = IMAGE_HEADER_LEN + map_length;
+    image.assign(pages * SPM_PAGESIZE, 0xFF);
+    for (size_t page = 0; page < pages; page++) {
+        if ((p_map[page / 8] >> (page % 8)) & 1) {
+            if ((data_offset + SPM_PAGESIZE) > file_data.size()) {
+                return false; /* Truncated image */
+            }
+            memcpy(&image[page * SPM_PAGESIZE], &file_data[data_offset], SPM_PAGESIZE);
+            data_offset += SPM_PAGESIZE;
+        }
+    }
+    if (data_offset != file_data.size()) {
+        return false; /* Trailing data */
+    }
+    image.resize(payload_size);
+    word crc = CRC16_INIT;
+    for (byte data : image) {
+        crc ^= (data << 8);
+        for (byte bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ CRC16_POLY) : (crc << 1);
+        }
+    }
+    return (crc == payload_crc);
+}
+
+// Function LoadHexImage (Parses Intel HEX data records, the gaps between them are filled with 0xFF)
+bool LoadHexImage(FILE *file, std::vector<byte> &image) {
+    char line[600];
+    unsigned long base_address = 0;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char *p_line = line;
+        while (isspace((unsigned char)*p_line)) {
+            p_line++;
+        }
+        if (*p_line == '\0') {
+            continue;
+        }
+        if (*p_line++ != ':') {
+            return false;
+        }
+        byte record[256 + 5];
+        size_t record_size = 0;
+        while (isxdigit((unsigned char)p_line[0]) && isxdigit((unsigned char)p_line[1]) && (record_size < sizeof(record))) {
+            char hex_byte[3] = {p_line[0], p_line[1], '\0'};
+            record[record_size++] = (byte)strtoul(hex_byte, nullptr, 16);
+            p_line += 2;
+        }
+        if ((record_size < 5) || (record_size != (size_t)(record[0] + 5))) {
+            return false;
+        }
+        byte sum = 0;
+        for (size_t i = 0; i < record_size; i++) {
+            sum += record[i];
+        }
+        if (sum != 0) {
+            return false; /* Checksum error */
+        }
+        const unsigned long address = base_address + ((record[1] << 8) | record[2]);
+        switch (record[3]) {
+            case 0x00: { /* Data */
+                if ((address + record[0]) > MAX_IMAGE_SIZE) {
+                    return false;
+                }
+                if (image.size() < (address + record[0])) {
+                    image.resize(address + record[0], 0xFF);
+                }
+                memcpy(&image[address], &record[4], record[0]);
+                break;
+            }
+            case 0x01: { /* End of file */
+                return true;
+            }
+            case 0x02: { /* Extended segment address */
+                base_address = ((record[4] << 8) | record[5]) << 4;
+                break;
+            }
+            case 0x04: { /* Extended linear address */
+                base_address = (unsigned long)((record[4] << 8) | record[5]) << 16;
+                break;
+            }
+            default: { /* Start addresses aren't used */
+                break;
+            }
+        }
+    }
+    return true;
+}
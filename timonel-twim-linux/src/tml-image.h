@@ -0,0 +1,31 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: tml-image.h (Application images)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  Application image loader shared by the
+ *  command-line programs: Intel HEX, Timonel
+ *  image or raw binary files.
+ */
+
+#ifndef _TML_IMAGE_H_
+#define _TML_IMAGE_H_
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <vector>
+
+#define MAX_IMAGE_SIZE 8192 /* Biggest application image accepted (ATtiny85 flash size) */
+#define IMAGE_MAGIC "TMLI"  /* Timonel image header: magic characters (see tml-hexparser writeImage) */
+#define IMAGE_VERSION 1     /* Timonel image header: format version */
+#define IMAGE_HEADER_LEN 16 /* Timonel image header length */
+
+bool LoadImage(const char *path, std::vector<byte> &image);
+bool LoadHexImage(FILE *file, std::vector<byte> &image);
+bool LoadTmlImage(const std::vector<byte> &file_data, std::vector<byte> &image);
+
+#endif /* _TML_IMAGE_H_ */
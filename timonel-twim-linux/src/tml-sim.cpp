@@ -0,0 +1,679 @@
+/*
+ *  Timonel TWI Master for Linux
+ *  Author: Gustavo Casanova
+ *  ...........................................
+ *  File: tml-sim.cpp (Protocol simulator)
+ *  ...........................................
+ *  Version: 1.0 / 2019-11-04
+ *  gustavo.casanova@nicebots.com
+ *  ...........................................
+ *  This command-line program runs the NbMicro
+ *  and TimonelTWIM libraries against simulated
+ *  Timonel devices on a simulated bus, with
+ *  random bus faults if requested. Each cycle
+ *  deletes, uploads, verifies and runs the
+ *  application, then the devices' flash memory
+ *  is checked independently of the libraries.
+ *  With "-U", each cycle replaces the devices'
+ *  bootloader through the update stub instead.
+ *  With "-S", the applications stream a data
+ *  block with READBUFF and WRITBUFF.
+ */
+
+#include <NbMicro.h>
+#include <TimonelTwiM.h>
+#include <TmlSim.h>
+#include <Wire.h>
+#include <time.h>
+#include <vector>
+
+#include "tml-image.h"
+
+#define SIM_FIRST_ADDR 11 /* TWI address of the first simulated device, the next ones follow */
+#define DLY_POWER_ON 100  /* Delay after power-on, longer than the bootloaders start (ms) */
+#define DLY_RUN_APP 10    /* Delay before running the applications (ms) */
+#define SIM_STUB_ADDR 36  /* TWI address of the update stub (TWI_ADDR in apps/tml-update-stub/Makefile) */
+#define SIM_APP_BUFFER 64 /* Application data buffer with "-S" (TWI_RX_BUFFER_SIZE in nb-usitwisl) */
+#define MAX_STREAM_POLLS 5 /* ReadBuffer calls without data before the stream test gives up */
+#define DLY_STREAM_POLL 5 /* Delay between ReadBuffer calls without data (ms) */
+
+// Bootloader option names accepted by "-f", they set or clear a TmlSimDevice::Config flag
+typedef struct sim_option_ {
+    const char *name;
+    bool TmlSimDevice::Config::*p_flag;
+    bool value;
+} SimOption;
+
+const SimOption sim_options[] = {
+    {"ledui", &TmlSimDevice::Config::enable_led_ui, true},
+    {"noautopage", &TmlSimDevice::Config::auto_page_addr, false},
+    {"tplpage", &TmlSimDevice::Config::app_use_tpl_pg, true},
+    {"setpgaddr", &TmlSimDevice::Config::cmd_setpgaddr, true},
+    {"twostep", &TmlSimDevice::Config::two_step_init, true},
+    {"nowdt", &TmlSimDevice::Config::use_wdt_reset, false},
+    {"timeout", &TmlSimDevice::Config::timeout_exit, true},
+    {"readflash", &TmlSimDevice::Config::cmd_readflash, true},
+    {"clktweak", &TmlSimDevice::Config::auto_clk_tweak, true},
+    {"forceerase", &TmlSimDevice::Config::force_erase_pg, true},
+    {"checkpageix", &TmlSimDevice::Config::check_page_ix, true},
+    {"gencall", &TmlSimDevice::Config::cmd_gencall, true},
+    {"erasepag", &TmlSimDevice::Config::cmd_erasepag, true},
+    {"crc16", &TmlSimDevice::Config::use_crc16, true},
+    {"windowed", &TmlSimDevice::Config::windowed_ack, true},
+    {"stretch", &TmlSimDevice::Config::stretch_on_write, true},
+    {"fastboot", &TmlSimDevice::Config::fast_boot, true},
+    {"noboothold", &TmlSimDevice::Config::reboot_hold, false},
+    {"getstats", &TmlSimDevice::Config::cmd_getstats, true},
+    {"writerle", &TmlSimDevice::Config::cmd_writerle, true},
+    {"pktresync", &TmlSimDevice::Config::pkt_resync, true},
+};
+
+// Simulation settings
+typedef struct sim_setup_ {
+    TmlSimDevice::Config config;
+    int device_count = 1;
+    int cycles = 1;
+    uint32_t max_clock = 0;        /* Clock negotiated with each device (0 = default clock) */
+    double address_nack_rate = 0;
+    double byte_error_rate = 0;
+    uint32_t seed = 1;
+    bool upload_all = false;       /* Upload with TwiBus::UploadAll instead of one device at a time */
+    bool reboot_apps = false;      /* From the second cycle on, reboot the applications into Timonel instead of a power-on */
+    bool skip_current = false;     /* Don't flash the devices already running the image, as found by Timonel::NeedsUpdate */
+    const char *inventory_path = nullptr; /* Warm start the bus discovery from this inventory file */
+    const char *bootloader_path = nullptr; /* Replace the bootloader with this image, the application image is the update stub */
+    uint16_t power_cut_op = 0;     /* Cut the power before this flash operation of each bootloader install (0 = never) */
+    word stream_bytes = 0;         /* Bytes streamed to and from each application after running it (0 = none) */
+    const char *image_path = nullptr;
+} SimSetup;
+
+// Class InventoryFile: TwiBus inventory kept in a file of the host, it survives between runs
+class InventoryFile : public InventoryStore {
+   public:
+    explicit InventoryFile(const char *path) : path_(path) {}
+    int Load(byte data[], const int size) {
+        FILE *p_file = fopen(path_, "rb");
+        if (p_file == nullptr) {
+            return 0;
+        }
+        const int read_size = (int)fread(data, 1, size, p_file);
+        fclose(p_file);
+        return read_size;
+    }
+    bool Save(const byte data[], const int size) {
+        FILE *p_file = fopen(path_, "wb");
+        if (p_file == nullptr) {
+            return false;
+        }
+        const bool saved = ((int)fwrite(data, 1, size, p_file) == size);
+        return ((fclose(p_file) == 0) && saved);
+    }
+
+   private:
+    const char *path_;
+};
+
+// Prototypes
+void ShowUsage(const char *program);
+bool ParseArguments(int argc, char *argv[], SimSetup &setup);
+bool ParseFeatures(char *features, TmlSimDevice::Config &config);
+byte RunCycle(const int cycle, SimSetup &setup, std::vector<TmlSimDevice *> &devices, std::vector<byte> &image);
+byte RunUpdate(const int cycle, SimSetup &setup, std::vector<TmlSimDevice *> &devices, std::vector<byte> &stub, std::vector<byte> &bootloader, const word bootloader_start);
+const char *CheckDevice(TmlSimDevice *p_device, std::vector<byte> &image);
+const char *CheckBootloader(TmlSimDevice *p_device, std::vector<byte> &bootloader, const word bootloader_start);
+byte PrintDeviceStats(const int cycle, Timonel *p_timonel, const byte twi_address);
+byte StreamBuffer(const int cycle, SimSetup &setup, TmlSimDevice *p_device);
+unsigned long long WallClockUs(void);
+
+// Main function
+int main(int argc, char *argv[]) {
+    SimSetup setup;
+    if (!ParseArguments(argc, argv, setup)) {
+        ShowUsage(argv[0]);
+        return 1;
+    }
+    const char *config_error = TmlSimDevice::CheckConfig(setup.config);
+    if (config_error != nullptr) {
+        fprintf(stderr, "Error: wrong bootloader options, %s\n", config_error);
+        return 1;
+    }
+    std::vector<byte> image;
+    if (!LoadImage(setup.image_path, image)) {
+        fprintf(stderr, "Error: unable to load the application image \"%s\"\n", setup.image_path);
+        return 1;
+    }
+    // The bootloader image loads at its flash memory address, the first page written is its start
+    std::vector<byte> bootloader;
+    word bootloader_start = 0;
+    if (setup.bootloader_path != nullptr) {
+        if (!LoadImage(setup.bootloader_path, bootloader)) {
+            fprintf(stderr, "Error: unable to load the bootloader image \"%s\"\n", setup.bootloader_path);
+            return 1;
+        }
+        while ((bootloader_start < bootloader.size()) && (bootloader[bootloader_start] == 0xFF)) {
+            bootloader_start++;
+        }
+        bootloader_start &= ~(SPM_PAGESIZE - 1);
+        if (bootloader_start == 0) {
+            fprintf(stderr, "Error: the bootloader image \"%s\" has to be an Intel HEX file at the bootloader address\n", setup.bootloader_path);
+            return 1;
+        }
+        bootloader.erase(bootloader.begin(), bootloader.begin() + bootloader_start);
+    }
+    std::vector<TmlSimDevice *> devices;
+    for (int i = 0; i < setup.device_count; i++) {
+        TmlSimDevice::Config config = setup.config;
+        config.twi_address = (SIM_FIRST_ADDR + i);
+        config.app_address = ((setup.reboot_apps || (setup.stream_bytes != 0)) ? (config.twi_address + APP_ADDR_OFFSET) : 0);
+        config.app_buffer_size = ((setup.stream_bytes != 0) ? SIM_APP_BUFFER : 0);
+        config.stub_address = ((setup.bootloader_path != nullptr) ? SIM_STUB_ADDR : 0);
+        devices.push_back(new TmlSimDevice(config));
+        Wire.AttachDevice(devices.back());
+    }
+    Wire.SetFaults(setup.address_nack_rate, setup.byte_error_rate, setup.seed);
+    printf("SIM_CONFIG image=%s size=%u devices=%d start=0x%04X features=0x%02X ext_features=0x%02X mst_packet=%d windowed_ack=%d clock_stretch=%d max_clock=%lu nack_rate=%g error_rate=%g seed=%lu\n",
+           setup.image_path, (unsigned int)image.size(), setup.device_count, setup.config.timonel_start,
+           devices[0]->GetFeatures(), devices[0]->GetExtFeatures(), setup.config.mst_packet_size,
+           setup.config.windowed_ack, setup.config.stretch_on_write, (unsigned long)setup.max_clock,
+           setup.address_nack_rate, setup.byte_error_rate, (unsigned long)setup.seed);
+    const unsigned long long wall_start_us = WallClockUs();
+    int failed_cycles = 0;
+    for (int cycle = 1; cycle <= setup.cycles; cycle++) {
+        if (setup.bootloader_path != nullptr) {
+            failed_cycles += (RunUpdate(cycle, setup, devices, image, bootloader, bootloader_start) != OK);
+        } else {
+            failed_cycles += (RunCycle(cycle, setup, devices, image) != OK);
+        }
+    }
+    printf("SIM_DONE cycles=%d failed_cycles=%d sim_ms=%llu wall_ms=%llu\n", setup.cycles, failed_cycles,
+           SimClockGet() / 1000ULL, (WallClockUs() - wall_start_us) / 1000ULL);
+    Wire.DetachDevices();
+    for (TmlSimDevice *p_device : devices) {
+        delete p_device;
+    }
+    return ((failed_cycles == 0) ? 0 : 1);
+}
+
+/* _________________________
+  |                         |
+  |        RunCycle         |
+  |_________________________|
+*/
+// Discover the devices, then delete, upload, verify and run the application on each one, as a TWI
+// master program would. Afterward, check the devices' memory and print a report line per device.
+// With "-u", the applications left running by the previous cycle are rebooted into Timonel over TWI.
+// With "-k", the devices already running the image are only started again. With "-i", the discovery
+// checks the devices saved in an inventory file instead of scanning the whole bus. With "-S", a data
+// block is streamed to and from each application that was started.
+byte RunCycle(const int cycle, SimSetup &setup, std::vector<TmlSimDevice *> &devices, std::vector<byte> &image) {
+    byte failed_devices = 0;
+    const bool reboot_apps = (setup.reboot_apps && (cycle > 1));
+    std::vector<byte> errors(devices.size(), OK);
+    for (TmlSimDevice *p_device : devices) {
+        if (!reboot_apps) {
+            p_device->PowerOn(); /* The previous cycle left the applications running */
+        }
+        p_device->ResetStats();
+    }
+    Wire.ResetStats();
+    const unsigned long long cycle_start_us = SimClockGet();
+    if (reboot_apps) {
+        for (size_t i = 0; i < devices.size(); i++) {
+            Timonel timonel(Wire, devices[i]->GetConfig().twi_address);
+            errors[i] += timonel.EnterBootloader(devices[i]->GetConfig().app_address);
+        }
+    }
+    TwiBus *p_bus = new TwiBus(Wire);
+    TwiBus::DeviceEntry dev_table[HIG_TWI_ADDR - LOW_TWI_ADDR + 1];
+    delay(DLY_POWER_ON); /* Let the bootloaders start */
+    InventoryFile inventory(setup.inventory_path);
+    byte dev_count = ((setup.inventory_path != nullptr) ? p_bus->DiscoverDevices(dev_table, HIG_TWI_ADDR - LOW_TWI_ADDR + 1, inventory)
+                                                        : p_bus->DiscoverDevices(dev_table, HIG_TWI_ADDR - LOW_TWI_ADDR + 1));
+    const unsigned long discovery_transactions = Wire.GetStats().transactions;
+    byte tml_count = 0;
+    for (byte i = 0; i < dev_count; i++) {
+        tml_count += (dev_table[i].firmware == FW_TIMONEL);
+    }
+    std::vector<Timonel *> timonels;
+    for (TmlSimDevice *p_device : devices) {
+        timonels.push_back(new Timonel(Wire, p_device->GetConfig().twi_address));
+    }
+    std::vector<bool> current(timonels.size(), false);
+    std::vector<Timonel *> pending;
+    std::vector<size_t> pending_ix;
+    for (size_t i = 0; i < timonels.size(); i++) {
+        if (setup.max_clock != 0) {
+            timonels[i]->NegotiateClock(setup.max_clock);
+        }
+        if (setup.skip_current && (!timonels[i]->NeedsUpdate(image.data(), (int)image.size()))) {
+            current[i] = true;
+            continue;
+        }
+        errors[i] += timonels[i]->DeleteApplication();
+        pending.push_back(timonels[i]);
+        pending_ix.push_back(i);
+    }
+    if ((setup.inventory_path != nullptr) && (setup.max_clock != 0)) {
+        p_bus->SaveInventory(dev_table, dev_count, inventory); /* The next warm start probes at the negotiated clocks */
+    }
+    if (setup.upload_all) {
+        std::vector<byte> upload_errors(pending.size(), OK);
+        if (!pending.empty()) {
+            p_bus->UploadAll(pending.data(), (byte)pending.size(), image.data(), (int)image.size(), upload_errors.data());
+        }
+        for (size_t i = 0; i < pending.size(); i++) {
+            errors[pending_ix[i]] += upload_errors[i];
+        }
+    } else {
+        for (size_t i = 0; i < pending.size(); i++) {
+            byte upload_errors = pending[i]->UploadApplication(image.data(), (int)image.size());
+            if ((upload_errors != OK) && devices[pending_ix[i]]->GetConfig().pkt_resync) {
+                // Uploads that Timonel can resume (PKT_RESYNC and AUTO_PAGE_ADDR) aren't deleted after an error
+                const byte resume_errors = pending[i]->ResumeApplication(image.data(), (int)image.size());
+                upload_errors = ((resume_errors == ERR_NOT_SUPP) ? upload_errors : resume_errors);
+            }
+            errors[pending_ix[i]] += upload_errors;
+        }
+    }
+    for (size_t i = 0; i < timonels.size(); i++) {
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+        if (devices[i]->GetConfig().cmd_readflash && (!current[i])) {
+            errors[i] += timonels[i]->VerifyApplication(image.data(), (int)image.size());
+        }
+#endif /* FEATURES_CODE >> F_CMD_READFLASH */
+        if (devices[i]->GetConfig().cmd_getstats) {
+            errors[i] += PrintDeviceStats(cycle, timonels[i], devices[i]->GetConfig().twi_address);
+        }
+        delay(DLY_RUN_APP);
+        errors[i] += timonels[i]->RunApplication();
+    }
+    delay(DLY_RUN_APP);
+    if (setup.stream_bytes != 0) {
+        for (size_t i = 0; i < devices.size(); i++) {
+            if (errors[i] == OK) {
+                errors[i] += StreamBuffer(cycle, setup, devices[i]);
+            }
+        }
+    }
+    const unsigned long long cycle_us = (SimClockGet() - cycle_start_us);
+    TwoWire::BusStats bus_stats = Wire.GetStats();
+    for (size_t i = 0; i < timonels.size(); i++) {
+        const char *check = CheckDevice(devices[i], image);
+        const bool passed = ((errors[i] == OK) && (check == nullptr));
+        failed_devices += !passed;
+        NbMicro::Stats stats = timonels[i]->GetStats();
+        TmlSimDevice::Stats sim_stats = devices[i]->GetStats();
+        printf("SIM_CYCLE cycle=%d addr=%d result=%s errors=%d check=%s found=%d erase_us=%lu upload_us=%lu verify_us=%lu transactions=%lu nacks=%lu busy_polls=%lu check_errors=%lu retries=%lu delay_us=%lu",
+               cycle, devices[i]->GetConfig().twi_address, (passed ? "OK" : "FAIL"), errors[i], ((check == nullptr) ? "OK" : check),
+               tml_count, stats.phase_time_us[PH_ERASE], stats.phase_time_us[PH_UPLOAD], stats.phase_time_us[PH_VERIFY],
+               stats.transactions, stats.nacks, stats.busy_polls, stats.check_errors, stats.retries, stats.delay_time_us);
+        printf(" commands=%lu page_writes=%lu page_erases=%lu restarts=%lu busy_nacks=%lu rx_overruns=%lu rejected_packets=%lu rle_packets=%lu page_rewrites=%lu boot_writes=%lu current=%d\n",
+               sim_stats.commands, sim_stats.page_writes, sim_stats.page_erases, sim_stats.restarts, sim_stats.busy_nacks,
+               sim_stats.rx_overruns, sim_stats.rejected_packets, sim_stats.rle_packets, sim_stats.page_rewrites, sim_stats.boot_writes, (int)current[i]);
+        delete timonels[i];
+    }
+    printf("SIM_BUS cycle=%d sim_us=%llu clock_hz=%lu discovery_transactions=%lu transactions=%lu address_nacks=%lu data_nacks=%lu bytes_written=%lu bytes_read=%lu bus_us=%llu stretch_us=%llu injected_nacks=%lu injected_errors=%lu\n",
+           cycle, cycle_us, (unsigned long)Wire.GetClock(), discovery_transactions, bus_stats.transactions, bus_stats.address_nacks, bus_stats.data_nacks,
+           bus_stats.bytes_written, bus_stats.bytes_read, bus_stats.bus_time_us, bus_stats.stretch_us,
+           bus_stats.injected_nacks, bus_stats.injected_errors);
+    delete p_bus;
+    return failed_devices;
+}
+
+/* _________________________
+  |                         |
+  |        RunUpdate        |
+  |_________________________|
+*/
+// Replace the bootloader of each device with Timonel::UpdateBootloader, one at a time as they share the
+// update stub TWI address. Afterward, check the new bootloader in the devices' memory and its status, as
+// read by the library when it initializes the new bootloader, and print a report line per device. With "-P",
+// the power is cut in the middle of each install: after powering the device on again, the update is resumed
+// through the stub or, when the cut came before the stub took the reset vector, run again from Timonel.
+byte RunUpdate(const int cycle, SimSetup &setup, std::vector<TmlSimDevice *> &devices, std::vector<byte> &stub, std::vector<byte> &bootloader, const word bootloader_start) {
+    byte failed_devices = 0;
+    for (TmlSimDevice *p_device : devices) {
+        p_device->PowerOn();
+        p_device->ResetStats();
+    }
+    Wire.ResetStats();
+    delay(DLY_POWER_ON); /* Let the bootloaders start */
+    for (TmlSimDevice *p_device : devices) {
+        const unsigned long long update_start_us = SimClockGet();
+        Timonel *p_timonel = new Timonel(Wire, p_device->GetConfig().twi_address);
+        p_device->CutPowerInInstall(setup.power_cut_op);
+        byte errors = p_timonel->UpdateBootloader(stub.data(), (int)stub.size(), SIM_STUB_ADDR,
+                                                  bootloader.data(), (int)bootloader.size(), bootloader_start);
+        const char *recovery = "none";
+        if (p_device->GetFirmware() == TmlSimDevice::SIM_POWER_OFF) {
+            p_device->PowerOn();
+            delay(DLY_POWER_ON);
+            if (p_device->GetFirmware() == TmlSimDevice::SIM_UPDATE_STUB) {
+                recovery = "stub";
+                errors = p_timonel->ResumeBootloaderUpdate(SIM_STUB_ADDR, bootloader.data(), (int)bootloader.size(), bootloader_start);
+            } else if (p_device->GetFirmware() == TmlSimDevice::SIM_BOOTLOADER) {
+                recovery = "bootloader";
+                delete p_timonel; /* The new object initializes the restarted bootloader */
+                p_timonel = new Timonel(Wire, p_device->GetConfig().twi_address);
+                errors = p_timonel->UpdateBootloader(stub.data(), (int)stub.size(), SIM_STUB_ADDR,
+                                                     bootloader.data(), (int)bootloader.size(), bootloader_start);
+            } else {
+                recovery = "bricked";
+            }
+        }
+        const char *check = CheckBootloader(p_device, bootloader, bootloader_start);
+        if ((check == nullptr) && (p_timonel->GetStatus().bootloader_start != bootloader_start)) {
+            check = "status";
+        }
+        const bool passed = ((errors == OK) && (check == nullptr));
+        failed_devices += !passed;
+        NbMicro::Stats stats = p_timonel->GetStats();
+        delete p_timonel;
+        TmlSimDevice::Stats sim_stats = p_device->GetStats();
+        printf("SIM_UPDATE cycle=%d addr=%d result=%s errors=%d check=%s start=0x%04X size=%u update_us=%llu transactions=%lu nacks=%lu busy_polls=%lu check_errors=%lu retries=%lu",
+               cycle, p_device->GetConfig().twi_address, (passed ? "OK" : "FAIL"), errors, ((check == nullptr) ? "OK" : check),
+               bootloader_start, (unsigned int)bootloader.size(), (SimClockGet() - update_start_us), stats.transactions,
+               stats.nacks, stats.busy_polls, stats.check_errors, stats.retries);
+        printf(" commands=%lu page_writes=%lu page_erases=%lu restarts=%lu busy_nacks=%lu rejected_packets=%lu boot_writes=%lu",
+               sim_stats.commands, sim_stats.page_writes, sim_stats.page_erases, sim_stats.restarts, sim_stats.busy_nacks,
+               sim_stats.rejected_packets, sim_stats.boot_writes);
+        if (setup.power_cut_op != 0) {
+            printf(" power_cut=%u recovery=%s", setup.power_cut_op, recovery);
+        }
+        printf("\n");
+    }
+    return failed_devices;
+}
+
+/* _________________________
+  |                         |
+  |    PrintDeviceStats     |
+  |_________________________|
+*/
+// Read the GETSTATS counters of a device built with CMD_GETSTATS before it runs the application,
+// they cover the upload since the last bootloader start (the application deletion restarts it)
+byte PrintDeviceStats(const int cycle, Timonel *p_timonel, const byte twi_address) {
+    Timonel::DeviceStats writes, erases, rejected, overruns, command;
+    byte twi_errors = p_timonel->GetDeviceStats(STATS_PAGE_WRITE, &writes);
+    twi_errors += p_timonel->GetDeviceStats(STATS_PAGE_ERASE, &erases);
+    twi_errors += p_timonel->GetDeviceStats(STATS_PKT_ERROR, &rejected);
+    twi_errors += p_timonel->GetDeviceStats(STATS_RX_OVERRUN, &overruns);
+    unsigned long commands = 0;
+    byte saturated = (writes.saturated + erases.saturated); /* Timed entries with events outlasting the timer range */
+    for (byte entry = 0; entry < STATS_PAGE_WRITE; entry++) {
+        twi_errors += p_timonel->GetDeviceStats(entry, &command);
+        commands += command.count;
+        saturated += command.saturated;
+    }
+    printf("SIM_STATS cycle=%d addr=%d errors=%d commands=%lu page_writes=%u write_us=%lu page_erases=%u erase_us=%lu rejected_packets=%u rx_overruns=%u saturated=%d\n",
+           cycle, twi_address, twi_errors, commands, writes.count, (unsigned long)writes.time_us, erases.count,
+           (unsigned long)erases.time_us, rejected.count, overruns.count, saturated);
+    return twi_errors;
+}
+
+/* _________________________
+  |                         |
+  |      StreamBuffer       |
+  |_________________________|
+*/
+// Write a data block to an application with NbMicro::WriteBuffer and read it back with ReadBuffer. The
+// application takes app_byte_us to process each byte, so its buffer fills up while it's written and the
+// library has to wait for room. Prints a report line, returns 0 when the data read matches the written one.
+byte StreamBuffer(const int cycle, SimSetup &setup, TmlSimDevice *p_device) {
+    const byte app_address = p_device->GetConfig().app_address;
+    std::vector<byte> data(setup.stream_bytes), echo(setup.stream_bytes, 0);
+    for (word i = 0; i < setup.stream_bytes; i++) {
+        data[i] = (byte)((i * 7) + cycle + app_address);
+    }
+    NbMicro *p_micro = new NbMicro(Wire, app_address);
+    const unsigned long long stream_start_us = SimClockGet();
+    const byte write_errors = p_micro->WriteBuffer(data.data(), setup.stream_bytes);
+    byte read_errors = OK;
+    word echoed = 0;
+    for (byte polls = 0; (read_errors == OK) && (echoed < setup.stream_bytes) && (polls < MAX_STREAM_POLLS);) {
+        word bytes_read = 0;
+        read_errors = p_micro->ReadBuffer(&echo[echoed], (setup.stream_bytes - echoed), &bytes_read);
+        echoed += bytes_read;
+        if (bytes_read == 0) {
+            polls++;
+            delay(DLY_STREAM_POLL); /* The application is still processing the data written */
+        } else {
+            polls = 0;
+        }
+    }
+    const bool passed = ((write_errors == OK) && (read_errors == OK) && (echo == data));
+    NbMicro::Stats stats = p_micro->GetStats();
+    delete p_micro;
+    TmlSimDevice::Stats sim_stats = p_device->GetStats();
+    printf("SIM_STREAM cycle=%d addr=%d result=%s write_errors=%d read_errors=%d bytes=%u echoed=%u stream_us=%llu transactions=%lu check_errors=%lu retries=%lu buffer_full=%lu buffer_repeats=%lu\n",
+           cycle, app_address, (passed ? "OK" : "FAIL"), write_errors, read_errors, setup.stream_bytes, echoed,
+           (SimClockGet() - stream_start_us), stats.transactions, stats.check_errors, stats.retries,
+           sim_stats.buffer_full, sim_stats.buffer_repeats);
+    return (passed ? OK : 1);
+}
+
+/* _________________________
+  |                         |
+  |       CheckDevice       |
+  |_________________________|
+*/
+// Check the application written to a simulated device, returns the first problem found or nullptr:
+// the application is running, its code is in memory, and the reset vector and trampoline are right
+const char *CheckDevice(TmlSimDevice *p_device, std::vector<byte> &image) {
+    const byte *flash = p_device->GetFlash();
+    const word timonel_start = p_device->GetConfig().timonel_start;
+    if (p_device->GetFirmware() != TmlSimDevice::SIM_APPLICATION) {
+        return "not_running";
+    }
+    for (size_t i = 2; i < image.size(); i++) {
+        if (flash[i] != image[i]) {
+            return "flash";
+        }
+    }
+    const word reset_vector = (flash[0] | (flash[1] << 8));
+    if (reset_vector != (0xC000 + ((timonel_start / 2) - 1))) {
+        return "reset_vector";
+    }
+    const word app_reset = (image[0] | (image[1] << 8));
+    const word trampoline = (flash[timonel_start - 2] | (flash[timonel_start - 1] << 8));
+    if (((app_reset & 0xF000) == 0xC000) &&
+        ((((app_reset + 1) & 0x0FFF)) != (((timonel_start / 2) + (trampoline & 0x0FFF)) & 0x0FFF))) {
+        return "trampoline";
+    }
+    return nullptr;
+}
+
+// Function CheckBootloader (Check the bootloader installed by the update stub, returns the first problem found or nullptr:
+// the new bootloader is running from its start address, every vector jumps to it and there is no application left)
+const char *CheckBootloader(TmlSimDevice *p_device, std::vector<byte> &bootloader, const word bootloader_start) {
+    const byte *flash = p_device->GetFlash();
+    if (p_device->GetFirmware() != TmlSimDevice::SIM_BOOTLOADER) {
+        return "not_running";
+    }
+    if (p_device->GetConfig().timonel_start != bootloader_start) {
+        return "start";
+    }
+    for (size_t i = 0; i < bootloader.size(); i++) {
+        if (flash[bootloader_start + i] != bootloader[i]) {
+            return "flash";
+        }
+    }
+    for (word i = 0; i < SPM_PAGESIZE; i += 2) {
+        if ((flash[i] | (flash[i + 1] << 8)) != (0xC000 + (((bootloader_start - i) / 2) - 1))) {
+            return "reset_vector";
+        }
+    }
+    for (word i = (bootloader_start - SPM_PAGESIZE); i < bootloader_start; i++) {
+        if (flash[i] != 0xFF) {
+            return "trampoline";
+        }
+    }
+    return nullptr;
+}
+
+/* _________________________
+  |                         |
+  |     ParseArguments      |
+  |_________________________|
+*/
+// Read the command-line options, returns false when they are wrong
+bool ParseArguments(int argc, char *argv[], SimSetup &setup) {
+    int arg_ix = 1;
+    for (; (arg_ix < argc) && (argv[arg_ix][0] == '-'); arg_ix++) {
+        const char option = argv[arg_ix][1];
+        if ((argv[arg_ix][2] != '\0') || (option == '\0')) {
+            return false;
+        }
+        if (option == 'b') {
+            setup.upload_all = true;
+            continue;
+        }
+        if (option == 'u') {
+            setup.reboot_apps = true;
+            continue;
+        }
+        if (option == 'k') {
+            setup.skip_current = true;
+            continue;
+        }
+        if (option == 'i') {
+            if (++arg_ix >= argc) {
+                return false;
+            }
+            setup.inventory_path = argv[arg_ix];
+            continue;
+        }
+        if (option == 'U') {
+            if (++arg_ix >= argc) {
+                return false;
+            }
+            setup.bootloader_path = argv[arg_ix];
+            continue;
+        }
+        if (++arg_ix >= argc) {
+            return false;
+        }
+        char *value = argv[arg_ix];
+        char *p_end = nullptr;
+        switch (option) {
+            case 'd': {
+                setup.device_count = (int)strtol(value, &p_end, 10);
+                if ((setup.device_count < 1) || (setup.device_count > (HIG_TML_ADDR - SIM_FIRST_ADDR + 1))) {
+                    return false;
+                }
+                break;
+            }
+            case 's': {
+                setup.config.timonel_start = (uint16_t)strtoul(value, &p_end, 16);
+                break;
+            }
+            case 'p': {
+                setup.config.mst_packet_size = (uint8_t)strtoul(value, &p_end, 10);
+                break;
+            }
+            case 'f': {
+                if (!ParseFeatures(value, setup.config)) {
+                    return false;
+                }
+                p_end = value + strlen(value);
+                break;
+            }
+            case 'c': {
+                setup.max_clock = (uint32_t)strtoul(value, &p_end, 10);
+                break;
+            }
+            case 'a': {
+                setup.address_nack_rate = strtod(value, &p_end);
+                break;
+            }
+            case 'e': {
+                setup.byte_error_rate = strtod(value, &p_end);
+                break;
+            }
+            case 'r': {
+                setup.seed = (uint32_t)strtoul(value, &p_end, 10);
+                break;
+            }
+            case 'P': {
+                setup.power_cut_op = (uint16_t)strtoul(value, &p_end, 10);
+                break;
+            }
+            case 'S': {
+                setup.stream_bytes = (word)strtoul(value, &p_end, 10);
+                break;
+            }
+            case 'n': {
+                setup.cycles = (int)strtol(value, &p_end, 10);
+                if (setup.cycles < 1) {
+                    return false;
+                }
+                break;
+            }
+            default: {
+                return false;
+            }
+        }
+        if ((p_end == value) || (*p_end != '\0')) {
+            return false;
+        }
+    }
+    if ((argc - arg_ix) != 1) {
+        return false;
+    }
+    setup.image_path = argv[arg_ix];
+    return true;
+}
+
+// Function ParseFeatures (Apply a comma-separated list of bootloader option names)
+bool ParseFeatures(char *features, TmlSimDevice::Config &config) {
+    for (char *name = strtok(features, ","); name != nullptr; name = strtok(nullptr, ",")) {
+        bool known = false;
+        for (const SimOption &sim_option : sim_options) {
+            if (strcmp(name, sim_option.name) == 0) {
+                config.*(sim_option.p_flag) = sim_option.value;
+                known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function WallClockUs (Real time, to show how long the simulation took)
+unsigned long long WallClockUs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((unsigned long long)now.tv_sec * 1000000ULL) + (now.tv_nsec / 1000ULL);
+}
+
+/* _________________________
+  |                         |
+  |        ShowUsage        |
+  |_________________________|
+*/
+// Show the command-line arguments
+void ShowUsage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <image.hex|image.bin>\n", program);
+    fprintf(stderr, "  -d <count>     Simulated devices, with TWI addresses from %d on (default: 1)\n", SIM_FIRST_ADDR);
+    fprintf(stderr, "  -s <hex>       Bootloader start address, TIMONEL_START (default: 1B00)\n");
+    fprintf(stderr, "  -p <bytes>     Biggest WRITPAGE data packet, MST_PACKET_SIZE (default: 32)\n");
+    fprintf(stderr, "  -f <options>   Bootloader options, comma-separated:");
+    for (const SimOption &sim_option : sim_options) {
+        fprintf(stderr, " %s", sim_option.name);
+    }
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  -c <hz>        Negotiate a TWI clock up to this value with each device\n");
+    fprintf(stderr, "  -a <rate>      Address NACK injection rate, 0 to 1 (default: 0)\n");
+    fprintf(stderr, "  -e <rate>      Data byte bit error injection rate, 0 to 1 (default: 0)\n");
+    fprintf(stderr, "  -r <seed>      Fault injection random seed (default: 1)\n");
+    fprintf(stderr, "  -n <cycles>    Delete, upload, verify and run cycles (default: 1)\n");
+    fprintf(stderr, "  -b             Upload to all the devices at once with TwiBus::UploadAll\n");
+    fprintf(stderr, "  -u             Reboot the applications into Timonel with BOOTTMNL instead of a power-on (apps at TWI address + %d)\n", APP_ADDR_OFFSET);
+    fprintf(stderr, "  -k             Skip the devices already running the image (Timonel::NeedsUpdate, it needs the crc16 option)\n");
+    fprintf(stderr, "  -i <file>      Warm start the bus discovery from this inventory file, it's saved again on changes\n");
+    fprintf(stderr, "  -U <file.hex>  Replace the bootloader with this image through the update stub, the application image is the stub (TWI address %d)\n", SIM_STUB_ADDR);
+    fprintf(stderr, "  -P <op>        With -U, cut the power before this flash page erase or write of each install (1 = the first one), then resume the update\n");
+    fprintf(stderr, "  -S <bytes>     Stream this many bytes to each application and back with WRITBUFF and READBUFF after running it (apps at TWI address + %d)\n", APP_ADDR_OFFSET);
+}
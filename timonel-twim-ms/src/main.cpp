@@ -17,7 +17,7 @@
    1) Scans the TWI bus in search of all devices running Timonel.
    2) Creates an array of Timonel objects, one per device.
    3) Deletes existing firmware of each device.
-   4) Uploads "avr-blink-twis.hex" application payload to each device.
+   4) Uploads "avr-blink-twis.hex" application payload to all devices at once.
    5) Launches application on each device, let it run 10 seconds.
    6) Sends reset command to the application: led blinking should stop on all devices.
    7) Repeats the routine 3 times.
@@ -25,6 +25,7 @@
 
 //#include <Arduino.h>
 //#include <Memory>
+#include <LittleFS.h>
 #include "NbMicro.h"
 #include "TimonelTwiM.h"
 #include "payload.h"
@@ -35,12 +36,36 @@
 #define MAX_TWI_DEVS 28
 #define LOOP_COUNT 3
 #define T_SIGNATURE 84
+#define INVENTORY_FILE "/inventory.bin" /* Devices found by the last bus scan, checked on warm starts */
+
+// Class InventoryFile: TwiBus inventory kept in the ESP8266 flash filesystem
+class InventoryFile : public InventoryStore {
+   public:
+    int Load(byte data[], const int size) {
+        File file = LittleFS.open(INVENTORY_FILE, "r");
+        if (!file) {
+            return 0;
+        }
+        const int read_size = file.read(data, size);
+        file.close();
+        return read_size;
+    }
+    bool Save(const byte data[], const int size) {
+        File file = LittleFS.open(INVENTORY_FILE, "w");
+        if (!file) {
+            return false;
+        }
+        const bool saved = (file.write(data, size) == (size_t)size);
+        file.close();
+        return saved;
+    }
+};
 
 // Prototypes
 void setup(void);
 void loop(void);
 bool CheckApplUpdate(void);
-void PrintStatus(Timonel timonel);
+void PrintStatus(Timonel &timonel);
 void ThreeStarDelay(void);
 void ShowHeader(void);
 void ShowMenu(void);
@@ -53,12 +78,16 @@ byte block_rx_size = 0;
 bool app_mode = false;
 byte timonels = 0;
 byte applications = 0;
+TimonelPool<MAX_TWI_DEVS> tml_devices; /* Reused on every pass, the heap isn't fragmented by device objects */
+InventoryFile inventory;
 
 // Setup block
 void setup() {
     // Initialize the serial port for debugging
     USE_SERIAL.begin(9600);
     Wire.begin(SDA, SCL);
+    // Without a filesystem the inventory can't be loaded and every pass scans the whole bus
+    LittleFS.begin();
     ClrScr();
     PrintLogo();
     ShowHeader();
@@ -69,80 +98,80 @@ void setup() {
         // The bus device scanning it has to be made as fast as possible since each
         // discovered Timonel has to be initialized before launching the user apps
         TwiBus twi(SDA, SCL);
-        TwiBus::DeviceInfo dev_info_arr[HIG_TWI_ADDR - LOW_TWI_ADDR + 1];
+        TwiBus::DeviceEntry dev_table[HIG_TWI_ADDR - LOW_TWI_ADDR + 1];
         // Scanning the TWI bus in search of devices ...
         byte tml_count = 0;
+        byte dev_count = 0;
         USE_SERIAL.printf_P("\n\r");
         while (tml_count == 0) {
             USE_SERIAL.printf_P("\r\x1b[5mScanning TWI bus ...\x1b[0m");
-            twi.ScanBus(dev_info_arr, HIG_TWI_ADDR - LOW_TWI_ADDR + 1, LOW_TWI_ADDR);
-            byte arr_size = (sizeof(dev_info_arr) / sizeof(dev_info_arr[0]));
-            for (byte i = 0; i < arr_size; i++) {
-                if (dev_info_arr[i].firmware == "Timonel") {
+            dev_count = twi.DiscoverDevices(dev_table, HIG_TWI_ADDR - LOW_TWI_ADDR + 1, inventory);
+            for (byte i = 0; i < dev_count; i++) {
+                if (dev_table[i].firmware == FW_TIMONEL) {
                     tml_count++;
                 }
             }
             if (tml_count > 0) {
                 USE_SERIAL.printf_P("\rTimonel devices found: %d\n\r", tml_count);
+            } else {
+                delay(1000);
             }
-            delay(1000);
         }
-        Timonel *tml_pool[tml_count];
-        // Create and initialize bootloader objects found
-        for (byte i = 0; i <= (tml_count); i++) {
-            if (dev_info_arr[i].firmware == "Timonel") {
-                tml_pool[i] = new Timonel(dev_info_arr[i].addr);
-                USE_SERIAL.printf_P("\n\rGetting status of Timonel device %d\n\r", dev_info_arr[i].addr);
-                Timonel::Status sts = tml_pool[i]->GetStatus();
-                if ((sts.features_code >> F_USE_WDT_RESET) & true) {
-                    USE_SERIAL.printf_P("\n\r ***************************************************************************************\n\r");
-                    USE_SERIAL.printf_P(" * WARNING! The Timonel bootloader with TWI address %02d has the \"TIMEOUT_EXIT\" feature. *\n\r", dev_info_arr[i].addr);
-                    USE_SERIAL.printf_P(" * enabled. This TWI master firmware can't control it properly! Please recompile it    *\n\r");
-                    USE_SERIAL.printf_P(" * using a configuration with that option disabled (e.g. \"tml-t85-small\").             *\n\r");
-                    USE_SERIAL.printf_P(" ***************************************************************************************\n\r");
-                }
+        // Create the bootloader objects found, they reuse the status read by the bus discovery
+        tml_count = tml_devices.Load(dev_table, dev_count);
+        Timonel **tml_pool = tml_devices.GetDevices();
+        for (byte i = 0; i < tml_count; i++) {
+            USE_SERIAL.printf_P("\n\rGetting status of Timonel device %d\n\r", tml_pool[i]->GetTwiAddress());
+            Timonel::Status sts = tml_pool[i]->GetStatus();
+            if ((sts.features_code >> F_USE_WDT_RESET) & true) {
+                USE_SERIAL.printf_P("\n\r ***************************************************************************************\n\r");
+                USE_SERIAL.printf_P(" * WARNING! The Timonel bootloader with TWI address %02d has the \"TIMEOUT_EXIT\" feature. *\n\r", tml_pool[i]->GetTwiAddress());
+                USE_SERIAL.printf_P(" * enabled. This TWI master firmware can't control it properly! Please recompile it    *\n\r");
+                USE_SERIAL.printf_P(" * using a configuration with that option disabled (e.g. \"tml-t85-small\").             *\n\r");
+                USE_SERIAL.printf_P(" ***************************************************************************************\n\r");
             }
         }
         USE_SERIAL.printf_P("\n\r");
         ThreeStarDelay();
         USE_SERIAL.printf_P("\n\n\r");
         // Delete user applications from devices
-        for (byte i = 0; i <= (tml_count); i++) {
-            if (dev_info_arr[i].firmware == "Timonel") {
-                delay(10);
-                USE_SERIAL.printf_P("Deleting application on device %d ", dev_info_arr[i].addr);
-                byte errors = tml_pool[i]->DeleteApplication();
-                if (errors == 0) {
-                    USE_SERIAL.printf_P("OK!\n\r");
-                } else {
-                    USE_SERIAL.printf_P("Error!\n\r", errors);
-                }
-                delay(1000);
-                USE_SERIAL.printf_P("\n\rGetting status of device %d\n\r", dev_info_arr[i].addr);
-                tml_pool[i]->GetStatus();
-                PrintStatus(*tml_pool[i]);
+        for (byte i = 0; i < tml_count; i++) {
+            delay(10);
+            USE_SERIAL.printf_P("Deleting application on device %d ", tml_pool[i]->GetTwiAddress());
+            byte errors = tml_pool[i]->DeleteApplication();
+            if (errors == 0) {
+                USE_SERIAL.printf_P("OK!\n\r");
+            } else {
+                USE_SERIAL.printf_P("Error!\n\r", errors);
             }
+            delay(1000);
+            USE_SERIAL.printf_P("\n\rGetting status of device %d\n\r", tml_pool[i]->GetTwiAddress());
+            PrintStatus(*tml_pool[i]);
         }
         ThreeStarDelay();
         USE_SERIAL.printf_P("\n\r");
-        // Upload user applications to devices and run them
-        for (byte i = 0; i <= (tml_count); i++) {
-            if (dev_info_arr[i].firmware == "Timonel") {
-                USE_SERIAL.printf_P("\n\rUploading application to device %d, \x1b[5mPLEASE WAIT\x1b[0m ...", dev_info_arr[i].addr);
-                byte errors = tml_pool[i]->UploadApplication(payload, sizeof(payload));
-                if (errors == 0) {
-                    USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b successful!      \n\r");
-                } else {
-                    USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b error!           \n\r", errors);
-                }
-                delay(10);
-                USE_SERIAL.printf_P("\n\rGetting status of device %d\n\r", dev_info_arr[i].addr);
-                PrintStatus(*tml_pool[i]);
-                delay(10);
-                USE_SERIAL.printf_P("Running application on device %d\n\r", dev_info_arr[i].addr);
-                tml_pool[i]->RunApplication();
-                delay(1500);
+        // Upload user applications to all devices at once (broadcast, then verify each device)
+        USE_SERIAL.printf_P("\n\rUploading application to %d devices, \x1b[5mPLEASE WAIT\x1b[0m ...", tml_count);
+        byte upload_errors[MAX_TWI_DEVS];
+        byte failed_count = twi.BroadcastAll(tml_pool, tml_count, payload, sizeof(payload), upload_errors);
+        if (failed_count == 0) {
+            USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b successful!      \n\r");
+        } else {
+            USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b %d failed!         \n\r", failed_count);
+        }
+        // Run the user applications
+        for (byte i = 0; i < tml_count; i++) {
+            if (upload_errors[i] != 0) {
+                USE_SERIAL.printf_P("\n\rUpload to device %d failed (%d errors), skipping it\n\r", tml_pool[i]->GetTwiAddress(), upload_errors[i]);
+                continue;
             }
+            delay(10);
+            USE_SERIAL.printf_P("\n\rGetting status of device %d\n\r", tml_pool[i]->GetTwiAddress());
+            PrintStatus(*tml_pool[i]);
+            delay(10);
+            USE_SERIAL.printf_P("Running application on device %d\n\r", tml_pool[i]->GetTwiAddress());
+            tml_pool[i]->RunApplication();
+            delay(1500);
         }
         // Reset applications and prepare for another cycle, then clean objects
         if (loop < LOOP_COUNT - 1) {
@@ -161,23 +190,33 @@ void setup() {
             USE_SERIAL.printf_P("\b\b* ");
             USE_SERIAL.printf_P("\n\n\r");
             // Resetting devices
-            // NOTE: All devices share the same application, since the application TWI address is
-            // set at compile time, this is shared across all devices when the app is running.
-            // Once discovered, the app TWI address is used to send the reset command to all devices.
-            byte app_addr = twi.ScanBus();
-            NbMicro *micro = new NbMicro;
-            micro->SetTwiAddress(app_addr); /* NOTE: All devices share the same TWI application address (44) */
-            USE_SERIAL.printf_P("Resetting devices running application at address %d\n\r", micro->GetTwiAddress());
-            micro->TwiCmdXmit(RESETMCU, ACKRESET);
-            delay(1000);
-            delete micro;
+            // NOTE: Applications built with TWI_ADDR_FROM_BOOT answer at their bootloader address
+            // + APP_ADDR_OFFSET, as handed over by Timonel, so each device is rebooted on its own.
+            byte failed_reboots = 0;
+            for (byte i = 0; i < tml_count; i++) {
+                const byte dev_app_addr = (tml_pool[i]->GetTwiAddress() + APP_ADDR_OFFSET);
+                USE_SERIAL.printf_P("Rebooting device %d running application at address %d into Timonel\n\r", tml_pool[i]->GetTwiAddress(), dev_app_addr);
+                if (tml_pool[i]->EnterBootloader(dev_app_addr) != OK) {
+                    failed_reboots++;
+                }
+            }
+            // Otherwise, since the application TWI address is set at compile time, it's shared across
+            // all devices when the app is running. Once discovered, it's used to reset all devices.
+            if (failed_reboots != 0) {
+                byte app_addr = twi.ScanBus();
+                NbMicro micro;
+                micro.SetTwiAddress(app_addr); /* NOTE: All devices share the same TWI application address (44) */
+                USE_SERIAL.printf_P("Rebooting devices running application at address %d into Timonel\n\r", micro.GetTwiAddress());
+                if (micro.TwiCmdXmit(BOOTTMNL, ACKBOOTT) != OK) {
+                    micro.TwiCmdXmit(RESETMCU, ACKRESET); /* Applications without BOOTTMNL are just reset */
+                }
+                delay(1000);
+            }
             Wire.begin(SDA, SCL);
         } else {
             USE_SERIAL.printf_P("\n\rCycle completed %d of %d passes! Letting application run ...\n\n\r", LOOP_COUNT, LOOP_COUNT);
         }
-        for (byte i = 0; i < tml_count; i++) {
-            delete tml_pool[i];
-        }
+        tml_devices.Clear();
     }
 }
 
@@ -210,7 +249,7 @@ void PrintLogo(void) {
 }
 
 // Function print Timonel instance status
-void PrintStatus(Timonel timonel) {
+void PrintStatus(Timonel &timonel) {
     Timonel::Status tml_status = timonel.GetStatus(); /* Get the instance id parameters received from the ATTiny85 */
     byte twi_address = timonel.GetTwiAddress();
     byte version_major = tml_status.version_major;
@@ -249,7 +288,8 @@ void PrintStatus(Timonel timonel) {
         }
         USE_SERIAL.printf_P("\n\r");
         USE_SERIAL.printf_P("           Low fuse: 0x%02X\n\r", tml_status.low_fuse_setting);
-        USE_SERIAL.printf_P("             RC osc: 0x%02X\n\n\r", tml_status.oscillator_cal);
+        USE_SERIAL.printf_P("             RC osc: 0x%02X\n\r", tml_status.oscillator_cal);
+        USE_SERIAL.printf_P("       Packet sizes: %d (write), %d (read)\n\n\r", tml_status.mst_packet_size, tml_status.slv_packet_size);
     } else {
         USE_SERIAL.printf_P("\n\r *******************************************************************\n\r");
         USE_SERIAL.printf_P(" * Unknown bootloader, application or device at TWI address %02d ... *\n\r", twi_address);
@@ -26,7 +26,7 @@ void setup(void);
 void loop(void);
 bool CheckApplUpdate(void);
 void ListTwiDevices(byte sda = 0, byte scl = 0);
-void PrintStatus(Timonel tml);
+void PrintStatus(Timonel &tml);
 void ThreeStarDelay(void);
 void ReadChar(void);
 word ReadWord(void);
@@ -60,7 +60,6 @@ void setup() {
     byte slave_address = i2c.ScanBus(p_app_mode);
     tml.SetTwiAddress(slave_address);
     ShowHeader();
-    tml.GetStatus();
     PrintStatus(tml);
     ShowMenu();
 }
@@ -122,7 +121,7 @@ void loop() {
             case 'v':
             case 'V': {
                 USE_SERIAL.printf_P("\nBootloader Cmd >>> Get bootloader version ...\r\n");
-                tml.GetStatus();
+                tml.RefreshStatus();
                 PrintStatus(tml);
                 break;
             }
@@ -209,6 +208,25 @@ void loop() {
                 USE_SERIAL.printf_P("\n\n\r");
                 break;
             }
+#if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))
+            // ***************************************
+            // * Timonel ::: Delta upload (READFLSH) *
+            // ***************************************
+            case 'd':
+            case 'D': {
+                USE_SERIAL.printf_P("\n\rBootloader Cmd >>> Update app firmware (changed pages only), \x1b[5mPLEASE WAIT\x1b[0m ...");
+                byte cmd_errors = tml.UploadDelta(payload, sizeof(payload));
+                USE_SERIAL.printf_P("\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b\b");
+                if (cmd_errors == 0) {
+                    USE_SERIAL.printf_P(" successful        ");
+                }
+                else {
+                    USE_SERIAL.printf_P(" [ command error! %d ]", cmd_errors);
+                }
+                USE_SERIAL.printf_P("\n\n\r");
+                break;
+            }
+#endif /* CMD_READFLASH */
 #if ((defined FEATURES_CODE) && ((FEATURES_CODE >> F_CMD_READFLASH) & true))                
             // ********************************
             // * Timonel ::: READFLSH command *
@@ -311,7 +329,7 @@ void PrintLogo(void) {
 }
 
 // Function print Timonel instance status
-void PrintStatus(Timonel timonel) {
+void PrintStatus(Timonel &timonel) {
     Timonel::Status tml_status = timonel.GetStatus(); /* Get the instance id parameters received from the ATTiny85 */
     byte twi_address = timonel.GetTwiAddress();
     byte version_major = tml_status.version_major;
@@ -350,7 +368,8 @@ void PrintStatus(Timonel timonel) {
         }
         USE_SERIAL.printf_P("\n\r");
         USE_SERIAL.printf_P("           Low fuse: 0x%02X\n\r", tml_status.low_fuse_setting);
-        USE_SERIAL.printf_P("             RC osc: 0x%02X\n\n\r", tml_status.oscillator_cal);
+        USE_SERIAL.printf_P("             RC osc: 0x%02X\n\r", tml_status.oscillator_cal);
+        USE_SERIAL.printf_P("       Packet sizes: %d (write), %d (read)\n\n\r", tml_status.mst_packet_size, tml_status.slv_packet_size);
     } else {
         USE_SERIAL.printf_P("\n\r *******************************************************************\n\r");
         USE_SERIAL.printf_P(" * Unknown bootloader, application or device at TWI address %02d ... *\n\r", twi_address);
@@ -387,6 +406,9 @@ void ShowMenu(void) {
         if ((sts.features_code & 0x80) == 0x80) {
             USE_SERIAL.printf_P(", 'm' mem dump");
         }
+        if (((sts.features_code & 0x82) == 0x82) && ((((sts.features_code & 0x08) == 0x08) && ((sts.ext_features_code & 0x02) == 0x02)) || ((sts.ext_features_code & 0x20) == 0x20))) {
+            USE_SERIAL.printf_P(", 'd' delta upload");
+        }
         USE_SERIAL.printf_P("): ");
     }
 }
@@ -399,9 +421,9 @@ void ListTwiDevices(byte sda, byte scl) {
     for (byte i = 0; i < (((HIG_TWI_ADDR + 1) - LOW_TWI_ADDR) / 2); i++) {
         USE_SERIAL.printf_P("...........................................................\n\r");
         USE_SERIAL.printf_P("Pos: %02d | ", i + 1);
-        if (dev_info_arr[i].firmware != "") {
+        if (dev_info_arr[i].firmware[0] != '\0') {
             USE_SERIAL.printf_P("TWI Addr: %02d | ", dev_info_arr[i].addr);
-            USE_SERIAL.printf_P("Firmware: %s | ", dev_info_arr[i].firmware.c_str());
+            USE_SERIAL.printf_P("Firmware: %s | ", dev_info_arr[i].firmware);
             USE_SERIAL.printf_P("Version %d.%d\n\r", dev_info_arr[i].version_major, dev_info_arr[i].version_minor);
         } else {
             USE_SERIAL.printf_P("No device found\n\r");